@@ -4,6 +4,7 @@
 #include "../xvalue.h"
 #include "../xutils.h"
 #include "../xtypeid.h"
+#include "../xfrozen.h"
 #include "xbuiltin_common.h"
 
 #include <ctype.h>
@@ -23,7 +24,18 @@ static xen_value xen_builtin_typeid(i32 argc, array(xen_value) argv) {
     xen_value val = argv[0];
     i32 typeid    = xen_typeid_get(val);
 
-    return NUMBER_VAL(typeid);
+    return INT_VAL(typeid);
+}
+
+static xen_value xen_builtin_freeze(i32 argc, array(xen_value) argv) {
+    REQUIRE_ARG("value", 0, TYPEID_UNDEFINED);
+    xen_value frozen;
+    const char* failed = NULL;
+    if (!xen_freeze(argv[0], &frozen, &failed)) {
+        xen_runtime_error("cannot freeze values of type %s", failed);
+        return NULL_VAL;
+    }
+    return frozen;
 }
 
 void xen_builtins_register() {
@@ -36,22 +48,29 @@ void xen_builtins_register() {
     xen_vm_register_namespace("os", OBJ_VAL(xen_builtin_os()));
     xen_vm_register_namespace("dictionary", OBJ_VAL(xen_builtin_dict()));
     xen_vm_register_namespace("net", OBJ_VAL(xen_builtin_net()));
+    xen_vm_register_namespace("fiber", OBJ_VAL(xen_builtin_fiber()));
+    xen_vm_register_namespace("aio", OBJ_VAL(xen_builtin_aio()));
+    xen_vm_register_namespace("http", OBJ_VAL(xen_builtin_http()));
+    xen_vm_register_namespace("thread", OBJ_VAL(xen_builtin_thread()));
 
     // register globals
     define_native_fn("typeof", xen_builtin_typeof);
     define_native_fn("typeid", xen_builtin_typeid);
+    define_native_fn("freeze", xen_builtin_freeze);
 
     // type constructors (uses capitalization to distinguish from namespaces)
     define_native_fn("Number", xen_builtin_number_ctor);
+    define_native_fn("Int", xen_builtin_int_ctor);
     define_native_fn("String", xen_builtin_string_ctor);
     define_native_fn("Bool", xen_builtin_bool_ctor);
     define_native_fn("Array", xen_builtin_array_ctor);
     define_native_fn("Dictionary", xen_builtin_dict_ctor);
     define_native_fn("UInt8Array", xen_builtin_u8array_ctor);
     define_native_fn("Error", xen_builtin_error_ctor);
+    define_native_fn("Fiber", xen_builtin_fiber_ctor);
 }
 
 void xen_vm_register_namespace(const char* name, xen_value ns) {
     xen_obj_str* name_str = xen_obj_str_copy(name, (i32)strlen(name));
-    xen_table_set(&g_vm.namespace_registry, name_str, ns);
+    xen_table_set(&g_vm->namespace_registry, name_str, ns);
 }
@@ -14,6 +14,10 @@
 #include "xbuiltin_os.h"
 #include "xbuiltin_string.h"
 #include "xbuiltin_net.h"
+#include "xbuiltin_fiber.h"
+#include "xbuiltin_aio.h"
+#include "xbuiltin_http.h"
+#include "xbuiltin_thread.h"
 
 void xen_builtins_register();
 void xen_vm_register_namespace(const char* name, xen_value ns);
@@ -27,6 +31,10 @@ static const char* xen_builtin_namespaces[] = {
   "dictionary",
   "os",
   "net",
+  "fiber",
+  "aio",
+  "http",
+  "thread",
   NULL,  // sentinel
 };
 
@@ -0,0 +1,728 @@
+#include "xbuiltin_aio.h"
+#include "xbuiltin_common.h"
+#include "xbuiltin_net.h"
+#include "../xutils.h"
+
+#include "../object/xobj_string.h"
+#include "../object/xobj_namespace.h"
+#include "../object/xobj_native_function.h"
+#include "../object/xobj_instance.h"
+#include "../object/xobj_fiber.h"
+#include "../xvm.h"
+
+#ifndef PLATFORM_WINDOWS
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <stdlib.h>
+    #include <sys/stat.h>
+#endif
+#ifdef PLATFORM_LINUX
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+#endif
+
+#ifndef PLATFORM_WINDOWS
+
+//==============================================================//
+//                       Operations                             //
+//==============================================================//
+
+typedef enum {
+    AIO_ACCEPT,
+    AIO_RECV,
+    AIO_SEND,
+    AIO_OPEN,  // first half of readfile(), becomes AIO_READ once the file is open
+    AIO_READ,
+} xen_aio_kind;
+
+typedef struct xen_aio_op {
+    xen_aio_kind kind;
+    int fd;
+    xen_value callback;     // NULL_VAL when a fiber awaits the result
+    xen_obj_fiber* waiter;  // suspended fiber to resume with the result
+    char* path;             // AIO_OPEN
+    char* buffer;           // recv/read destination or send source
+    size_t length;          // bytes read so far (AIO_READ) or to send (AIO_SEND)
+    size_t capacity;
+    bool sized;  // AIO_READ: capacity is the exact file size, so no final zero-length read is needed
+    struct sockaddr_in addr;
+    socklen_t addr_len;
+    i32 result;  // sync backend: the syscall's return value, or -errno
+    struct xen_aio_op* next;
+} xen_aio_op;
+
+typedef struct {
+    xen_aio_op* head;
+    xen_aio_op* tail;
+} xen_aio_list;
+
+#ifdef PLATFORM_LINUX
+typedef struct {
+    int fd;
+    u32 entries;
+    u32* sq_head;
+    u32* sq_tail;
+    u32* sq_mask;
+    u32* sq_array;
+    struct io_uring_sqe* sqes;
+    u32* cq_head;
+    u32* cq_tail;
+    u32* cq_mask;
+    struct io_uring_cqe* cqes;
+    void* ring_ptr;
+    size_t ring_size;
+    size_t sqes_size;
+    u32 unsubmitted;  // SQEs published to the ring but not yet handed to io_uring_enter()
+} xen_uring;
+#endif
+
+static XEN_THREAD_LOCAL struct {
+    bool initialized;
+    bool uring;
+#ifdef PLATFORM_LINUX
+    xen_uring ring;
+#endif
+    i32 in_flight;           // operations whose completion hasn't been delivered yet
+    i32 delivered;           // completions handed to scripts so far
+    xen_aio_list queued;     // sync backend: waiting for the next submit
+    xen_aio_list blocked;    // hit EAGAIN on a non-blocking socket, retried once it becomes ready
+    xen_aio_list completed;  // sync backend: done, waiting to be delivered
+    xen_aio_op* free_ops;
+} g_aio;
+
+static void aio_list_push(xen_aio_list* list, xen_aio_op* op) {
+    op->next = NULL;
+    if (list->tail != NULL)
+        list->tail->next = op;
+    else
+        list->head = op;
+    list->tail = op;
+}
+
+static xen_aio_op* aio_list_take(xen_aio_list* list) {
+    xen_aio_op* head = list->head;
+    list->head       = NULL;
+    list->tail       = NULL;
+    return head;
+}
+
+static xen_aio_op* aio_op_new(xen_aio_kind kind, int fd) {
+    xen_aio_op* op = g_aio.free_ops;
+    if (op != NULL)
+        g_aio.free_ops = op->next;
+    else
+        op = (xen_aio_op*)malloc(sizeof(xen_aio_op));
+
+    memset(op, 0, sizeof(xen_aio_op));
+    op->kind     = kind;
+    op->fd       = fd;
+    op->callback = NULL_VAL;
+    return op;
+}
+
+static void aio_op_release(xen_aio_op* op) {
+    free(op->path);
+    if (op->kind == AIO_RECV)
+        xen_buffer_release(&g_vm->buffers, op->buffer, op->capacity);
+    else
+        free(op->buffer);
+    op->next       = g_aio.free_ops;
+    g_aio.free_ops = op;
+}
+
+//==============================================================//
+//                     io_uring Backend                         //
+//==============================================================//
+
+#ifdef PLATFORM_LINUX
+
+static int uring_setup(u32 entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, u32 to_submit, u32 min_complete, u32 flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, u32 opcode, void* arg, u32 nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// Every opcode the namespace submits has to be supported, otherwise the sync backend is used for everything
+static bool uring_supports_ops(int fd) {
+    static const u8 required[] = {
+      IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE};
+
+    const size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = (struct io_uring_probe*)calloc(1, probe_size);
+    bool supported               = uring_register(fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; supported && i < sizeof(required); i++) {
+        supported = required[i] <= probe->last_op && (probe->ops[required[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return supported;
+}
+
+static bool uring_init(xen_uring* ring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = uring_setup(XEN_AIO_RING_ENTRIES, &params);
+    if (ring->fd < 0)
+        return XEN_FALSE;
+    // kernels older than 5.4 map the two rings separately; not worth supporting next to the sync fallback
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !uring_supports_ops(ring->fd)) {
+        close(ring->fd);
+        return XEN_FALSE;
+    }
+
+    const size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+    const size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size      = sq_size > cq_size ? sq_size : cq_size;
+    ring->sqes_size      = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->ring_ptr =
+      mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->ring_ptr == MAP_FAILED) {
+        close(ring->fd);
+        return XEN_FALSE;
+    }
+    ring->sqes = (struct io_uring_sqe*)mmap(
+      NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        munmap(ring->ring_ptr, ring->ring_size);
+        close(ring->fd);
+        return XEN_FALSE;
+    }
+
+    u8* ptr           = (u8*)ring->ring_ptr;
+    ring->entries     = params.sq_entries;
+    ring->sq_head     = (u32*)(ptr + params.sq_off.head);
+    ring->sq_tail     = (u32*)(ptr + params.sq_off.tail);
+    ring->sq_mask     = (u32*)(ptr + params.sq_off.ring_mask);
+    ring->sq_array    = (u32*)(ptr + params.sq_off.array);
+    ring->cq_head     = (u32*)(ptr + params.cq_off.head);
+    ring->cq_tail     = (u32*)(ptr + params.cq_off.tail);
+    ring->cq_mask     = (u32*)(ptr + params.cq_off.ring_mask);
+    ring->cqes        = (struct io_uring_cqe*)(ptr + params.cq_off.cqes);
+    ring->unsubmitted = 0;
+    return XEN_TRUE;
+}
+
+// Hands every published SQE to the kernel, optionally waiting for at least `min_complete` completions
+static bool uring_flush(xen_uring* ring, u32 min_complete) {
+    const u32 flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    if (ring->unsubmitted == 0 && min_complete == 0)
+        return XEN_TRUE;
+
+    const int submitted = uring_enter(ring->fd, ring->unsubmitted, min_complete, flags);
+    if (submitted < 0) {
+        if (errno == EINTR)
+            return XEN_TRUE;
+        xen_runtime_error("[aio] io_uring_enter() failed: %s", strerror(errno));
+        return XEN_FALSE;
+    }
+    ring->unsubmitted -= (u32)submitted;
+    return XEN_TRUE;
+}
+
+static struct io_uring_sqe* uring_get_sqe(xen_uring* ring) {
+    u32 tail = *ring->sq_tail;
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == ring->entries) {
+        // ring full: submit what's there to make room
+        uring_flush(ring, 0);
+        if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == ring->entries)
+            return NULL;
+    }
+
+    const u32 index                = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe       = &ring->sqes[index];
+    ring->sq_array[index]          = index;
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    return sqe;
+}
+
+static void uring_publish(xen_uring* ring) {
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+    ring->unsubmitted++;
+}
+
+static bool uring_queue(xen_uring* ring, xen_aio_op* op) {
+    struct io_uring_sqe* sqe = uring_get_sqe(ring);
+    if (sqe == NULL)
+        return XEN_FALSE;
+
+    sqe->fd        = op->fd;
+    sqe->user_data = (u64)(uintptr_t)op;
+    switch (op->kind) {
+        case AIO_ACCEPT:
+            sqe->opcode       = IORING_OP_ACCEPT;
+            sqe->addr         = (u64)(uintptr_t)&op->addr;
+            sqe->addr2        = (u64)(uintptr_t)&op->addr_len;
+            sqe->accept_flags = SOCK_CLOEXEC;
+            break;
+        case AIO_RECV:
+            sqe->opcode = IORING_OP_RECV;
+            sqe->addr   = (u64)(uintptr_t)op->buffer;
+            sqe->len    = (u32)op->capacity;
+            break;
+        case AIO_SEND:
+            sqe->opcode    = IORING_OP_SEND;
+            sqe->addr      = (u64)(uintptr_t)op->buffer;
+            sqe->len       = (u32)op->length;
+            sqe->msg_flags = MSG_NOSIGNAL;
+            break;
+        case AIO_OPEN:
+            sqe->opcode     = IORING_OP_OPENAT;
+            sqe->fd         = AT_FDCWD;
+            sqe->addr       = (u64)(uintptr_t)op->path;
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            break;
+        case AIO_READ:
+            sqe->opcode = IORING_OP_READ;
+            sqe->addr   = (u64)(uintptr_t)(op->buffer + op->length);
+            sqe->len    = (u32)(op->capacity - op->length);
+            sqe->off    = op->length;
+            break;
+    }
+    uring_publish(ring);
+    return XEN_TRUE;
+}
+
+// Fire-and-forget close; user_data 0 tells the reaper there's nothing to deliver
+static void uring_queue_close(xen_uring* ring, int fd) {
+    struct io_uring_sqe* sqe = uring_get_sqe(ring);
+    if (sqe == NULL) {
+        close(fd);
+        return;
+    }
+    sqe->opcode    = IORING_OP_CLOSE;
+    sqe->fd        = fd;
+    sqe->user_data = 0;
+    uring_publish(ring);
+}
+
+#endif
+
+//==============================================================//
+//                      Sync Backend                            //
+//==============================================================//
+
+static i32 sync_execute(xen_aio_op* op) {
+    ssize_t result = -1;
+    switch (op->kind) {
+        case AIO_ACCEPT:
+            result = accept(op->fd, (struct sockaddr*)&op->addr, &op->addr_len);
+            break;
+        case AIO_RECV:
+            result = recv(op->fd, op->buffer, op->capacity, 0);
+            break;
+        case AIO_SEND:
+#ifdef PLATFORM_LINUX
+            result = send(op->fd, op->buffer, op->length, MSG_NOSIGNAL);
+#else
+            result = send(op->fd, op->buffer, op->length, 0);
+#endif
+            break;
+        case AIO_OPEN:
+            result = open(op->path, O_RDONLY | O_CLOEXEC);
+            break;
+        case AIO_READ:
+            result = pread(op->fd, op->buffer + op->length, op->capacity - op->length, (off_t)op->length);
+            break;
+    }
+    return result < 0 ? -errno : (i32)result;
+}
+
+// Performs every queued operation. Returns how many were attempted.
+static i32 sync_submit() {
+    i32 count = 0;
+    for (xen_aio_op* op = aio_list_take(&g_aio.queued); op != NULL;) {
+        xen_aio_op* next = op->next;
+        op->result       = sync_execute(op);
+        aio_list_push(op->result == -EAGAIN || op->result == -EWOULDBLOCK ? &g_aio.blocked : &g_aio.completed, op);
+        op = next;
+        count++;
+    }
+    return count;
+}
+
+// Waits (up to timeout_ms) for any blocked operation's socket to become ready, then retries them all
+static void sync_retry_blocked(i32 timeout_ms) {
+    struct pollfd fds[XEN_AIO_RING_ENTRIES];
+    nfds_t count = 0;
+    for (xen_aio_op* op = g_aio.blocked.head; op != NULL && count < XEN_AIO_RING_ENTRIES; op = op->next) {
+        fds[count].fd      = op->fd;
+        fds[count].events  = op->kind == AIO_SEND ? POLLOUT : POLLIN;
+        fds[count].revents = 0;
+        count++;
+    }
+    if (count == 0 || poll(fds, count, timeout_ms) <= 0)
+        return;
+
+    for (xen_aio_op* op = aio_list_take(&g_aio.blocked); op != NULL;) {
+        xen_aio_op* next = op->next;
+        aio_list_push(&g_aio.queued, op);
+        op = next;
+    }
+    sync_submit();
+}
+
+//==============================================================//
+//                       Completions                            //
+//==============================================================//
+
+static void aio_queue(xen_aio_op* op) {
+#ifdef PLATFORM_LINUX
+    if (g_aio.uring && uring_queue(&g_aio.ring, op))
+        return;
+    if (g_aio.uring) {
+        // the kernel isn't draining the ring; perform this one synchronously rather than lose it
+        op->result = sync_execute(op);
+        aio_list_push(&g_aio.completed, op);
+        return;
+    }
+#endif
+    aio_list_push(&g_aio.queued, op);
+}
+
+static void aio_close_file(int fd) {
+#ifdef PLATFORM_LINUX
+    if (g_aio.uring) {
+        uring_queue_close(&g_aio.ring, fd);
+        return;
+    }
+#endif
+    close(fd);
+}
+
+static bool aio_deliver(xen_aio_op* op, xen_value value) {
+    const xen_value callback = op->callback;
+    xen_obj_fiber* waiter    = op->waiter;
+    aio_op_release(op);
+    g_aio.in_flight--;
+    g_aio.delivered++;
+
+    xen_value result;
+    if (waiter != NULL)
+        return waiter->state != FIBER_SUSPENDED || xen_vm_resume(waiter, value, &result);
+    return xen_vm_call(callback, 1, &value, &result);
+}
+
+// Turns a raw completion into the script-visible result, or queues the next step of a chained operation. Returns
+// false if the callback or fiber it was delivered to raised a runtime error.
+static bool aio_complete(xen_aio_op* op, i32 res) {
+    // io_uring normally waits for readiness itself, anything that still would block is retried through poll()
+    if ((res == -EAGAIN || res == -EWOULDBLOCK) && op->kind != AIO_OPEN && op->kind != AIO_READ) {
+        aio_list_push(&g_aio.blocked, op);
+        return XEN_TRUE;
+    }
+
+    switch (op->kind) {
+        case AIO_ACCEPT:
+            if (res < 0) {
+                xen_runtime_error("[aio] accept() failed: %s", strerror(-res));
+                return aio_deliver(op, NULL_VAL);
+            }
+            return aio_deliver(op, xen_net_stream_new(res, &op->addr));
+
+        case AIO_RECV:
+            if (res < 0) {
+                xen_runtime_error("[aio] recv() failed: %s", strerror(-res));
+                return aio_deliver(op, NULL_VAL);
+            }
+            // zero bytes is an orderly shutdown by the peer
+            return aio_deliver(op, res == 0 ? NULL_VAL : OBJ_VAL(xen_obj_str_copy(op->buffer, res)));
+
+        case AIO_SEND:
+            if (res < 0) {
+                xen_runtime_error("[aio] send() failed: %s", strerror(-res));
+                return aio_deliver(op, INT_VAL(-1));
+            }
+            return aio_deliver(op, INT_VAL(res));
+
+        case AIO_OPEN: {
+            struct stat st;
+            if (res < 0) {
+                xen_runtime_error("[aio] failed to open file: %s (%s)", op->path, strerror(-res));
+                return aio_deliver(op, NULL_VAL);
+            }
+            op->fd = res;
+            // a size of 0 is also what procfs and friends report, those are read until EOF
+            op->sized    = fstat(op->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0;
+            op->capacity = op->sized ? (size_t)st.st_size : 4096;
+            op->buffer   = (char*)malloc(op->capacity + 1);
+            op->kind     = AIO_READ;
+            aio_queue(op);
+            return XEN_TRUE;
+        }
+
+        case AIO_READ:
+            if (res < 0) {
+                xen_runtime_error("[aio] failed to read file: %s (%s)", op->path, strerror(-res));
+                aio_close_file(op->fd);
+                return aio_deliver(op, NULL_VAL);
+            }
+            op->length += (size_t)res;
+            if (res > 0 && !(op->sized && op->length == op->capacity)) {
+                if (op->length == op->capacity) {
+                    op->capacity *= 2;
+                    op->buffer = (char*)realloc(op->buffer, op->capacity + 1);
+                }
+                aio_queue(op);
+                return XEN_TRUE;
+            }
+            aio_close_file(op->fd);
+
+            // the string takes over the buffer
+            op->buffer[op->length] = '\0';
+            xen_obj_str* contents  = xen_obj_str_take(op->buffer, (i32)op->length);
+            op->buffer             = NULL;
+            return aio_deliver(op, OBJ_VAL(contents));
+    }
+    return XEN_TRUE;
+}
+
+// Submits everything queued and delivers whatever has completed. With `wait`, blocks until at least one operation
+// completes (unless nothing is in flight).
+static bool aio_poll(bool wait) {
+#ifdef PLATFORM_LINUX
+    if (g_aio.uring) {
+        xen_uring* ring = &g_aio.ring;
+        const bool idle = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) == *ring->cq_head;
+        const bool block =
+          wait && idle && g_aio.in_flight > 0 && g_aio.completed.head == NULL && g_aio.blocked.head == NULL;
+        if (!uring_flush(ring, block ? 1 : 0))
+            return XEN_FALSE;
+
+        // completions are copied out first, callbacks may queue (and flush) new operations
+        for (;;) {
+            struct io_uring_cqe batch[XEN_AIO_RING_ENTRIES];
+            u32 count  = 0;
+            u32 head   = *ring->cq_head;
+            u32 tail   = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+            while (head != tail && count < XEN_AIO_RING_ENTRIES) {
+                batch[count++] = ring->cqes[head & *ring->cq_mask];
+                head++;
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+            if (count == 0)
+                break;
+
+            for (u32 i = 0; i < count; i++) {
+                if (batch[i].user_data == 0)
+                    continue;
+                if (!aio_complete((xen_aio_op*)(uintptr_t)batch[i].user_data, batch[i].res))
+                    return XEN_FALSE;
+            }
+        }
+    }
+#endif
+
+    sync_submit();
+    if (wait && g_aio.completed.head == NULL && g_aio.blocked.head != NULL)
+        sync_retry_blocked(-1);
+    else if (g_aio.blocked.head != NULL)
+        sync_retry_blocked(0);
+
+    for (xen_aio_op* op = aio_list_take(&g_aio.completed); op != NULL;) {
+        xen_aio_op* next = op->next;
+        if (!aio_complete(op, op->result))
+            return XEN_FALSE;
+        op = next;
+    }
+    return XEN_TRUE;
+}
+
+static void aio_init() {
+    if (g_aio.initialized)
+        return;
+    g_aio.initialized = XEN_TRUE;
+
+#ifdef PLATFORM_LINUX
+    const char* mode = getenv("XEN_AIO");
+    if (mode == NULL || strcmp(mode, "sync") != 0)
+        g_aio.uring = uring_init(&g_aio.ring);
+#endif
+}
+
+//==============================================================//
+//                       Namespace                              //
+//==============================================================//
+
+// The trailing callback is optional inside a fiber: without one the fiber is suspended until the operation
+// completes and the result becomes the return value of the call.
+static bool aio_bind_completion(xen_aio_op* op, i32 argc, array(xen_value) argv, i32 slot) {
+    if (argc > slot && xen_typeid_get(argv[slot]) == TYPEID_FUNC) {
+        op->callback = argv[slot];
+        return XEN_TRUE;
+    }
+    if (argc > slot && !VAL_IS_NULL(argv[slot])) {
+        xen_runtime_error("[aio] callback must be a function (got '%s')", xen_value_type_to_str(argv[slot]));
+        return XEN_FALSE;
+    }
+    if (g_vm->fiber == NULL) {
+        xen_runtime_error("[aio] a callback is required outside a fiber");
+        return XEN_FALSE;
+    }
+
+    xen_obj_fiber* fiber = g_vm->fiber;
+    if (!xen_vm_yield(NULL_VAL))
+        return XEN_FALSE;
+    op->waiter = fiber;
+    return XEN_TRUE;
+}
+
+static xen_value aio_start(xen_aio_op* op, i32 argc, array(xen_value) argv, i32 slot) {
+    if (!aio_bind_completion(op, argc, argv, slot)) {
+        aio_op_release(op);
+        return NULL_VAL;
+    }
+    g_aio.in_flight++;
+    aio_queue(op);
+    return NULL_VAL;  // replaced by the result when a fiber awaits it
+}
+
+static socket_t aio_socket_arg(i32 argc, array(xen_value) argv, const char* fn) {
+    const socket_t fd = argc > 0 ? xen_net_socket_fd(argv[0]) : INVALID_SOCKET_FD;
+    if (fd == INVALID_SOCKET_FD)
+        xen_runtime_error("[aio] %s() expects an open TcpStream or TcpListener", fn);
+    return fd;
+}
+
+// aio.accept(listener, callback?) -> TcpStream or null
+static xen_value aio_accept(i32 argc, array(xen_value) argv) {
+    const socket_t fd = aio_socket_arg(argc, argv, "accept");
+    if (fd == INVALID_SOCKET_FD)
+        return NULL_VAL;
+
+    aio_init();
+    xen_aio_op* op = aio_op_new(AIO_ACCEPT, fd);
+    op->addr_len   = sizeof(op->addr);
+    return aio_start(op, argc, argv, 1);
+}
+
+// aio.recv(stream, max_bytes = 4096, callback?) -> string, or null once the peer has closed the connection
+static xen_value aio_recv(i32 argc, array(xen_value) argv) {
+    const socket_t fd = aio_socket_arg(argc, argv, "recv");
+    if (fd == INVALID_SOCKET_FD)
+        return NULL_VAL;
+
+    i32 max_bytes = 4096;
+    if (argc > 1 && VAL_IS_NUMBER(argv[1])) {
+        max_bytes = (i32)VAL_AS_INTEGER(argv[1]);
+        if (max_bytes < 1)
+            max_bytes = 1;
+        if (max_bytes > (i32)XEN_BUFFER_MAX)
+            max_bytes = (i32)XEN_BUFFER_MAX;
+    }
+
+    aio_init();
+    xen_aio_op* op = aio_op_new(AIO_RECV, fd);
+    op->capacity   = (size_t)max_bytes;
+    op->buffer     = (char*)xen_buffer_acquire(&g_vm->buffers, op->capacity);
+    return aio_start(op, argc, argv, 2);
+}
+
+// aio.send(stream, data, callback?) -> number of bytes sent, -1 on error
+static xen_value aio_send(i32 argc, array(xen_value) argv) {
+    const socket_t fd = aio_socket_arg(argc, argv, "send");
+    if (fd == INVALID_SOCKET_FD)
+        return NULL_VAL;
+    if (argc < 2 || !OBJ_IS_STRING(argv[1])) {
+        xen_runtime_error("[aio] send() requires a string argument");
+        return NULL_VAL;
+    }
+
+    aio_init();
+    xen_obj_str* data = OBJ_AS_STRING(argv[1]);
+    i32 decoded_size;
+    xen_aio_op* op = aio_op_new(AIO_SEND, fd);
+    op->buffer     = (char*)xen_decode_string_literal(data->str, data->length, &decoded_size);
+    op->length     = (size_t)decoded_size;
+    return aio_start(op, argc, argv, 2);
+}
+
+// aio.readfile(path, callback?) -> file contents as a string, or null if it can't be opened
+static xen_value aio_readfile(i32 argc, array(xen_value) argv) {
+    REQUIRE_ARG("path", 0, TYPEID_STRING);
+
+    aio_init();
+    xen_obj_str* path = OBJ_AS_STRING(argv[0]);
+    xen_aio_op* op    = aio_op_new(AIO_OPEN, -1);
+    op->path          = strndup(path->str, path->length);
+    return aio_start(op, argc, argv, 1);
+}
+
+// aio.submit() -> number of operations handed to the kernel
+static xen_value aio_submit(i32 argc, array(xen_value) argv) {
+    aio_init();
+#ifdef PLATFORM_LINUX
+    if (g_aio.uring) {
+        const u32 before = g_aio.ring.unsubmitted;
+        uring_flush(&g_aio.ring, 0);
+        return INT_VAL(before - g_aio.ring.unsubmitted);
+    }
+#endif
+    return INT_VAL(sync_submit());
+}
+
+// aio.poll(wait = false) -> number of completions delivered
+static xen_value aio_poll_fn(i32 argc, array(xen_value) argv) {
+    aio_init();
+    const i32 delivered = g_aio.delivered;
+    aio_poll(argc > 0 && VAL_IS_BOOL(argv[0]) && VAL_AS_BOOL(argv[0]));
+    return INT_VAL(g_aio.delivered - delivered);
+}
+
+// aio.run() -> delivers completions until nothing is in flight, returns how many were delivered
+static xen_value aio_run(i32 argc, array(xen_value) argv) {
+    aio_init();
+    const i32 delivered = g_aio.delivered;
+    while (g_aio.in_flight > 0) {
+        if (!aio_poll(XEN_TRUE))
+            break;
+    }
+    return INT_VAL(g_aio.delivered - delivered);
+}
+
+// aio.pending() -> operations that haven't completed yet
+static xen_value aio_pending(i32 argc, array(xen_value) argv) {
+    return INT_VAL(g_aio.in_flight);
+}
+
+// aio.backend() -> "io_uring" or "sync"
+static xen_value aio_backend(i32 argc, array(xen_value) argv) {
+    aio_init();
+    const char* name = g_aio.uring ? "io_uring" : "sync";
+    return OBJ_VAL(xen_obj_str_copy(name, (i32)strlen(name)));
+}
+
+xen_obj_namespace* xen_builtin_aio() {
+    xen_obj_namespace* aio = xen_obj_namespace_new("aio");
+    xen_obj_namespace_set(aio, "accept", OBJ_VAL(xen_obj_native_func_new(aio_accept, "accept")));
+    xen_obj_namespace_set(aio, "recv", OBJ_VAL(xen_obj_native_func_new(aio_recv, "recv")));
+    xen_obj_namespace_set(aio, "send", OBJ_VAL(xen_obj_native_func_new(aio_send, "send")));
+    xen_obj_namespace_set(aio, "readfile", OBJ_VAL(xen_obj_native_func_new(aio_readfile, "readfile")));
+    xen_obj_namespace_set(aio, "submit", OBJ_VAL(xen_obj_native_func_new(aio_submit, "submit")));
+    xen_obj_namespace_set(aio, "poll", OBJ_VAL(xen_obj_native_func_new(aio_poll_fn, "poll")));
+    xen_obj_namespace_set(aio, "run", OBJ_VAL(xen_obj_native_func_new(aio_run, "run")));
+    xen_obj_namespace_set(aio, "pending", OBJ_VAL(xen_obj_native_func_new(aio_pending, "pending")));
+    xen_obj_namespace_set(aio, "backend", OBJ_VAL(xen_obj_native_func_new(aio_backend, "backend")));
+    return aio;
+}
+
+#else
+
+static xen_value aio_backend(i32 argc, array(xen_value) argv) {
+    return OBJ_VAL(xen_obj_str_copy("none", 4));
+}
+
+xen_obj_namespace* xen_builtin_aio() {
+    xen_obj_namespace* aio = xen_obj_namespace_new("aio");
+    xen_obj_namespace_set(aio, "backend", OBJ_VAL(xen_obj_native_func_new(aio_backend, "backend")));
+    return aio;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef X_BUILTIN_AIO_H
+#define X_BUILTIN_AIO_H
+
+#include "../xcommon.h"
+#include "../xvalue.h"
+
+/*
+ * Completion-based async I/O (aio namespace)
+ *
+ * Operations are queued rather than performed: accept, recv, send and readfile return immediately and their result is
+ * handed to a callback, or to the calling fiber if no callback is given, once the operation completes. On Linux the
+ * queue is an io_uring submission ring, so a whole batch of operations costs a single io_uring_enter() when the script
+ * polls. Kernels without io_uring (or with it disabled, or XEN_AIO=sync in the environment) fall back to performing
+ * the same operations with plain syscalls at submit time, delivering completions through the same interface. The
+ * fallback only overlaps waiting on non-blocking sockets (through poll()); on blocking ones each operation runs to
+ * completion in turn.
+ */
+
+// Submission ring size, also the most completions reaped per io_uring_enter()
+#define XEN_AIO_RING_ENTRIES 256
+
+xen_obj_namespace* xen_builtin_aio();
+
+#endif
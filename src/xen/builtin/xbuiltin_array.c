@@ -1,30 +1,41 @@
 #include "xbuiltin_array.h"
 #include "xbuiltin_common.h"
+#include "xbuiltin_thread.h"
 
 #include "../object/xobj_string.h"
 #include "../object/xobj_array.h"
 #include "../object/xobj_namespace.h"
 #include "../object/xobj_native_function.h"
+#include "../object/xobj_function.h"
+#include "../object/xobj_closure.h"
+#include "../xvm.h"
+
+#ifndef _WIN32
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
 
 xen_value xen_arr_len(i32 argc, array(xen_value) argv) {
     if (argc < 1 || !OBJ_IS_ARRAY(argv[0]))
-        return NUMBER_VAL(-1);
-    return NUMBER_VAL(OBJ_AS_ARRAY(argv[0])->array.count);
+        return INT_VAL(-1);
+    return INT_VAL(OBJ_AS_ARRAY(argv[0])->array.count);
 }
 
 xen_value xen_arr_push(i32 argc, array(xen_value) argv) {
     if (argc < 2 || !OBJ_IS_ARRAY(argv[0]))
         return NULL_VAL;
+    REQUIRE_MUTABLE(0);
     xen_obj_array* arr = OBJ_AS_ARRAY(argv[0]);
     for (i32 i = 1; i < argc; i++) {
         xen_obj_array_push(arr, argv[i]);
     }
-    return NUMBER_VAL(arr->array.count);
+    return INT_VAL(arr->array.count);
 }
 
 xen_value xen_arr_pop(i32 argc, array(xen_value) argv) {
     if (argc < 1 || !OBJ_IS_ARRAY(argv[0]))
         return NULL_VAL;
+    REQUIRE_MUTABLE(0);
     return xen_obj_array_pop(OBJ_AS_ARRAY(argv[0]));
 }
 
@@ -49,6 +60,7 @@ xen_value xen_arr_last(i32 argc, array(xen_value) argv) {
 xen_value xen_arr_clear(i32 argc, array(xen_value) argv) {
     if (argc < 1 || !OBJ_IS_ARRAY(argv[0]))
         return NULL_VAL;
+    REQUIRE_MUTABLE(0);
     OBJ_AS_ARRAY(argv[0])->array.count = 0;
     return NULL_VAL;
 }
@@ -68,20 +80,21 @@ xen_value xen_arr_contains(i32 argc, array(xen_value) argv) {
 
 xen_value xen_arr_index_of(i32 argc, array(xen_value) argv) {
     if (argc < 2 || !OBJ_IS_ARRAY(argv[0]))
-        return NUMBER_VAL(-1);
+        return INT_VAL(-1);
     xen_obj_array* arr = OBJ_AS_ARRAY(argv[0]);
     xen_value needle   = argv[1];
     for (i32 i = 0; i < arr->array.count; i++) {
         if (xen_value_equal(arr->array.values[i], needle)) {
-            return NUMBER_VAL(i);
+            return INT_VAL(i);
         }
     }
-    return NUMBER_VAL(-1);
+    return INT_VAL(-1);
 }
 
 xen_value xen_arr_reverse(i32 argc, array(xen_value) argv) {
     if (argc < 1 || !OBJ_IS_ARRAY(argv[0]))
         return NULL_VAL;
+    REQUIRE_MUTABLE(0);
     xen_obj_array* arr = OBJ_AS_ARRAY(argv[0]);
     for (i32 i = 0; i < arr->array.count / 2; i++) {
         i32 j                = arr->array.count - 1 - i;
@@ -135,6 +148,228 @@ xen_value xen_arr_join(i32 argc, array(xen_value) argv) {
     return OBJ_VAL(xen_obj_str_copy(strbuf, strbuf_size_needed));
 }
 
+static bool is_callable(xen_value value) {
+    return OBJ_IS_FUNCTION(value) || OBJ_IS_CLOSURE(value) || OBJ_IS_NATIVE_FUNC(value);
+}
+
+xen_value xen_arr_map(i32 argc, array(xen_value) argv) {
+    if (argc < 2 || !OBJ_IS_ARRAY(argv[0]) || !is_callable(argv[1])) {
+        xen_runtime_error("map expects a function argument");
+        return NULL_VAL;
+    }
+
+    // argv points into the VM stack, which the callback may grow (and move) when running inside a fiber
+    xen_obj_array* arr    = OBJ_AS_ARRAY(argv[0]);
+    const xen_value fn    = argv[1];
+    const i32 count       = arr->array.count;
+    xen_obj_array* mapped = xen_obj_array_new_with_capacity(count);
+    for (i32 i = 0; i < count && i < arr->array.count; i++) {
+        xen_value result;
+        if (!xen_vm_call(fn, 1, &arr->array.values[i], &result))
+            return NULL_VAL;
+        xen_obj_array_push(mapped, result);
+    }
+    return OBJ_VAL(mapped);
+}
+
+xen_value xen_arr_filter(i32 argc, array(xen_value) argv) {
+    if (argc < 2 || !OBJ_IS_ARRAY(argv[0]) || !is_callable(argv[1])) {
+        xen_runtime_error("filter expects a function argument");
+        return NULL_VAL;
+    }
+
+    xen_obj_array* arr      = OBJ_AS_ARRAY(argv[0]);
+    const xen_value fn      = argv[1];
+    const i32 count         = arr->array.count;
+    xen_obj_array* filtered = xen_obj_array_new();
+    for (i32 i = 0; i < count && i < arr->array.count; i++) {
+        xen_value element = arr->array.values[i];
+        xen_value keep;
+        if (!xen_vm_call(fn, 1, &element, &keep))
+            return NULL_VAL;
+        if (!VAL_IS_NULL(keep) && !(VAL_IS_BOOL(keep) && !VAL_AS_BOOL(keep)))
+            xen_obj_array_push(filtered, element);
+    }
+    return OBJ_VAL(filtered);
+}
+
+// Optional trailing worker count of the par_* methods, 0 (one per CPU) when absent
+static i32 par_workers(i32 argc, array(xen_value) argv, i32 index) {
+    return argc > index && VAL_IS_NUMBER(argv[index]) ? (i32)VAL_AS_INTEGER(argv[index]) : 0;
+}
+
+xen_value xen_arr_par_map(i32 argc, array(xen_value) argv) {
+    if (argc < 2 || !OBJ_IS_ARRAY(argv[0]) || !is_callable(argv[1])) {
+        xen_runtime_error("par_map expects a function argument");
+        return NULL_VAL;
+    }
+    return xen_thread_par_map(OBJ_AS_ARRAY(argv[0]), argv[1], par_workers(argc, argv, 2));
+}
+
+xen_value xen_arr_par_reduce(i32 argc, array(xen_value) argv) {
+    if (argc < 3 || !OBJ_IS_ARRAY(argv[0]) || !is_callable(argv[1])) {
+        xen_runtime_error("par_reduce expects a function and an initial value");
+        return NULL_VAL;
+    }
+    return xen_thread_par_reduce(OBJ_AS_ARRAY(argv[0]), argv[1], argv[2], par_workers(argc, argv, 3));
+}
+
+// Shortest run par_sort() hands to a thread of its own, smaller arrays use fewer threads
+#define PAR_SORT_MIN_RUN 4096
+
+typedef int (*sort_compare_fn)(const void*, const void*);
+
+static int sort_compare_numbers(const void* a, const void* b) {
+    const xen_value x = *(const xen_value*)a;
+    const xen_value y = *(const xen_value*)b;
+    if (VAL_IS_INT(x) && VAL_IS_INT(y))
+        return (x.as.integer > y.as.integer) - (x.as.integer < y.as.integer);
+    const f64 fx = VAL_AS_NUMBER(x);
+    const f64 fy = VAL_AS_NUMBER(y);
+    return (fx > fy) - (fx < fy);
+}
+
+static int sort_compare_strings(const void* a, const void* b) {
+    const xen_obj_str* x = OBJ_AS_STRING(*(const xen_value*)a);
+    const xen_obj_str* y = OBJ_AS_STRING(*(const xen_value*)b);
+    const int result     = memcmp(x->str, y->str, (size_t)XEN_MIN(x->length, y->length));
+    return result != 0 ? result : (x->length > y->length) - (x->length < y->length);
+}
+
+// par_sort() sorts one run of the array per worker, then merges neighbouring runs pairwise, round by round. The steps
+// of a round are independent of each other, so each gets a thread.
+typedef struct {
+    xen_value* src;
+    xen_value* dst;
+    i32 begin;
+    i32 middle;  // end of the left run when merging
+    i32 end;
+    sort_compare_fn compare;
+} sort_task;
+
+static void* sort_run(void* arg) {
+    sort_task* task = arg;
+    qsort(task->src + task->begin, (size_t)(task->end - task->begin), sizeof(xen_value), task->compare);
+    return NULL;
+}
+
+static void* sort_merge(void* arg) {
+    sort_task* task = arg;
+    i32 left        = task->begin;
+    i32 right       = task->middle;
+    i32 out         = task->begin;
+    while (left < task->middle && right < task->end) {
+        if (task->compare(&task->src[right], &task->src[left]) < 0)
+            task->dst[out++] = task->src[right++];
+        else
+            task->dst[out++] = task->src[left++];
+    }
+    memcpy(task->dst + out, task->src + left, sizeof(xen_value) * (size_t)(task->middle - left));
+    out += task->middle - left;
+    memcpy(task->dst + out, task->src + right, sizeof(xen_value) * (size_t)(task->end - right));
+    return NULL;
+}
+
+#ifndef _WIN32
+// Runs tasks[1..] on threads of their own and tasks[0] on the caller. A task whose thread can't be created runs on
+// the caller as well.
+static void sort_parallel(sort_task* tasks, i32 count, void* (*step)(void*)) {
+    pthread_t* threads = malloc(sizeof(pthread_t) * (size_t)count);
+    bool* started      = calloc((size_t)count, sizeof(bool));
+    for (i32 i = 1; i < count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, step, &tasks[i]) == 0;
+    }
+    step(&tasks[0]);
+    for (i32 i = 1; i < count; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            step(&tasks[i]);
+    }
+    free(threads);
+    free(started);
+}
+
+static i32 sort_cpu_count() {
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (i32)count : 1;
+}
+#else
+static void sort_parallel(sort_task* tasks, i32 count, void* (*step)(void*)) {
+    for (i32 i = 0; i < count; i++) {
+        step(&tasks[i]);
+    }
+}
+
+static i32 sort_cpu_count() {
+    return 1;
+}
+#endif
+
+// Method: par_sort(workers = one per CPU) -> the array, sorted in place. Items must all be numbers or all strings.
+xen_value xen_arr_par_sort(i32 argc, array(xen_value) argv) {
+    if (argc < 1 || !OBJ_IS_ARRAY(argv[0]))
+        return NULL_VAL;
+    REQUIRE_MUTABLE(0);
+    xen_obj_array* arr = OBJ_AS_ARRAY(argv[0]);
+    const i32 count    = arr->array.count;
+    xen_value* values  = arr->array.values;
+    if (count < 2)
+        return argv[0];
+
+    const bool numbers = VAL_IS_NUMBER(values[0]);
+    for (i32 i = 0; i < count; i++) {
+        if (numbers ? !VAL_IS_NUMBER(values[i]) : !OBJ_IS_STRING(values[i])) {
+            xen_runtime_error("par_sort expects an array of numbers or an array of strings");
+            return NULL_VAL;
+        }
+    }
+    const sort_compare_fn compare = numbers ? sort_compare_numbers : sort_compare_strings;
+
+    i32 runs = par_workers(argc, argv, 1);
+    if (runs <= 0)
+        runs = sort_cpu_count();
+    runs = XEN_MAX(1, XEN_MIN(runs, count / PAR_SORT_MIN_RUN));
+    if (runs == 1) {
+        qsort(values, (size_t)count, sizeof(xen_value), compare);
+        return argv[0];
+    }
+
+    sort_task* tasks   = malloc(sizeof(sort_task) * (size_t)runs);
+    i32* bounds        = malloc(sizeof(i32) * (size_t)(runs + 1));
+    xen_value* scratch = malloc(sizeof(xen_value) * (size_t)count);
+    for (i32 i = 0; i <= runs; i++) {
+        bounds[i] = (i32)((i64)count * i / runs);
+    }
+    for (i32 i = 0; i < runs; i++) {
+        tasks[i] = (sort_task) {values, NULL, bounds[i], 0, bounds[i + 1], compare};
+    }
+    sort_parallel(tasks, runs, sort_run);
+
+    // each round merges runs `width` apart, ping-ponging between the array and the scratch buffer
+    xen_value* src = values;
+    xen_value* dst = scratch;
+    for (i32 width = 1; width < runs; width *= 2) {
+        i32 merges = 0;
+        for (i32 i = 0; i < runs; i += 2 * width) {
+            const i32 middle = XEN_MIN(i + width, runs);
+            const i32 end    = XEN_MIN(i + 2 * width, runs);
+            tasks[merges++]  = (sort_task) {src, dst, bounds[i], bounds[middle], bounds[end], compare};
+        }
+        sort_parallel(tasks, merges, sort_merge);
+        xen_value* swap = src;
+        src             = dst;
+        dst             = swap;
+    }
+    if (src != values)
+        memcpy(values, src, sizeof(xen_value) * (size_t)count);
+
+    free(tasks);
+    free(bounds);
+    free(scratch);
+    return argv[0];
+}
+
 xen_obj_namespace* xen_builtin_array() {
     xen_obj_namespace* arr = xen_obj_namespace_new("array");
     xen_obj_namespace_set(arr, "len", OBJ_VAL(xen_obj_native_func_new(xen_arr_len, "len")));
@@ -147,5 +382,10 @@ xen_obj_namespace* xen_builtin_array() {
     xen_obj_namespace_set(arr, "index_of", OBJ_VAL(xen_obj_native_func_new(xen_arr_index_of, "index_of")));
     xen_obj_namespace_set(arr, "reverse", OBJ_VAL(xen_obj_native_func_new(xen_arr_reverse, "reverse")));
     xen_obj_namespace_set(arr, "join", OBJ_VAL(xen_obj_native_func_new(xen_arr_join, "join")));
+    xen_obj_namespace_set(arr, "map", OBJ_VAL(xen_obj_native_func_new(xen_arr_map, "map")));
+    xen_obj_namespace_set(arr, "filter", OBJ_VAL(xen_obj_native_func_new(xen_arr_filter, "filter")));
+    xen_obj_namespace_set(arr, "par_map", OBJ_VAL(xen_obj_native_func_new(xen_arr_par_map, "par_map")));
+    xen_obj_namespace_set(arr, "par_reduce", OBJ_VAL(xen_obj_native_func_new(xen_arr_par_reduce, "par_reduce")));
+    xen_obj_namespace_set(arr, "par_sort", OBJ_VAL(xen_obj_native_func_new(xen_arr_par_sort, "par_sort")));
     return arr;
 }
\ No newline at end of file
@@ -16,5 +16,10 @@ xen_value xen_arr_contains(i32 argc, array(xen_value) argv);
 xen_value xen_arr_index_of(i32 argc, array(xen_value) argv);
 xen_value xen_arr_reverse(i32 argc, array(xen_value) argv);
 xen_value xen_arr_join(i32 argc, array(xen_value) argv);
+xen_value xen_arr_map(i32 argc, array(xen_value) argv);
+xen_value xen_arr_filter(i32 argc, array(xen_value) argv);
+xen_value xen_arr_par_map(i32 argc, array(xen_value) argv);
+xen_value xen_arr_par_reduce(i32 argc, array(xen_value) argv);
+xen_value xen_arr_par_sort(i32 argc, array(xen_value) argv);
 
 #endif
\ No newline at end of file
@@ -19,16 +19,25 @@
             xen_runtime_error("argument '%s' (position %d) required for %s", name, slot, __func__);                    \
             return NULL_VAL;                                                                                           \
         }                                                                                                              \
-        if (typeid != xen_typeid_get(argv[slot]) && typeid != TYPEID_UNDEFINED) {                                      \
+        if (!xen_typeid_accepts(typeid, argv[slot])) {                                                                 \
             xen_runtime_error("expected typeid %d for argment '%s' (got %d"), typeid, name,                            \
               xen_typeid_get(argv[slot]);                                                                              \
             return NULL_VAL;                                                                                           \
         }                                                                                                              \
     } while (XEN_FALSE)
 
+// Natives that modify a value (their receiver or a buffer argument) refuse frozen ones
+#define REQUIRE_MUTABLE(slot)                                                                                          \
+    do {                                                                                                               \
+        if (OBJ_IS_FROZEN(argv[slot])) {                                                                               \
+            xen_runtime_error("cannot modify a frozen %s", xen_typeid_str(xen_typeid_get(argv[slot])));                \
+            return NULL_VAL;                                                                                           \
+        }                                                                                                              \
+    } while (XEN_FALSE)
+
 inline static void define_native_fn(const char* name, xen_native_fn fn) {
     xen_obj_str* key = xen_obj_str_copy(name, strlen(name));
-    xen_table_set(&g_vm.globals, key, OBJ_VAL(xen_obj_native_func_new(fn, name)));
+    xen_table_set(&g_vm->globals, key, OBJ_VAL(xen_obj_native_func_new(fn, name)));
 }
 
 // type constructors
@@ -42,6 +51,8 @@ inline static xen_value xen_builtin_number_ctor(i32 argc, array(xen_value) argv)
             return NUMBER_VAL(0);
         case VAL_NUMBER:
             return val;
+        case VAL_INT:
+            return NUMBER_VAL((f64)VAL_AS_INT(val));
         case VAL_OBJECT: {
             if (OBJ_IS_STRING(val)) {
                 const char* str = OBJ_AS_CSTRING(val);
@@ -58,6 +69,33 @@ inline static xen_value xen_builtin_number_ctor(i32 argc, array(xen_value) argv)
     return NULL_VAL;
 }
 
+inline static xen_value xen_builtin_int_ctor(i32 argc, array(xen_value) argv) {
+    REQUIRE_ARG("construct_from", 0, TYPEID_UNDEFINED);
+    xen_value val = argv[0];
+    switch (val.type) {
+        case VAL_BOOL:
+            return INT_VAL(VAL_AS_BOOL(val));
+        case VAL_NULL:
+            return INT_VAL(0);
+        case VAL_NUMBER:
+            return INT_VAL((i64)VAL_AS_NUMBER(val));
+        case VAL_INT:
+            return val;
+        case VAL_OBJECT: {
+            if (OBJ_IS_STRING(val)) {
+                const char* str = OBJ_AS_CSTRING(val);
+                return INT_VAL((i64)strtoll(str, NULL, 0));
+            } else {
+                const char* type_str = xen_value_type_to_str(val);
+                xen_runtime_error("cannot construct int from %s", type_str);
+                return NULL_VAL;
+            }
+        }
+    }
+
+    return NULL_VAL;
+}
+
 inline static xen_value xen_builtin_string_ctor(i32 argc, array(xen_value) argv) {
     REQUIRE_ARG("construct_from", 0, TYPEID_UNDEFINED);
     xen_value val = argv[0];
@@ -73,6 +111,11 @@ inline static xen_value xen_builtin_string_ctor(i32 argc, array(xen_value) argv)
             snprintf(buffer, sizeof(buffer), "%f", VAL_AS_NUMBER(val));
             return OBJ_VAL(xen_obj_str_copy(buffer, strlen(buffer)));
         }
+        case VAL_INT: {
+            char buffer[32] = {'\0'};
+            snprintf(buffer, sizeof(buffer), "%lld", (long long)VAL_AS_INT(val));
+            return OBJ_VAL(xen_obj_str_copy(buffer, strlen(buffer)));
+        }
         case VAL_OBJECT: {
             if (OBJ_IS_STRING(val)) {
                 return val;
@@ -94,7 +137,8 @@ inline static xen_value xen_builtin_bool_ctor(i32 argc, array(xen_value) argv) {
         }
         case VAL_NULL:
             return BOOL_VAL(XEN_FALSE);
-        case VAL_NUMBER: {
+        case VAL_NUMBER:
+        case VAL_INT: {
             if (VAL_AS_NUMBER(val) != 0) {
                 return BOOL_VAL(XEN_TRUE);
             } else {
@@ -115,7 +159,7 @@ inline static xen_value xen_builtin_array_ctor(i32 argc, array(xen_value) argv)
         return NULL_VAL;
     }
 
-    if (argc > 0 && argv[0].type != VAL_NUMBER) {
+    if (argc > 0 && !VAL_IS_NUMBER(argv[0])) {
         xen_runtime_error("element count must be a number");
         return NULL_VAL;
     }
@@ -140,14 +184,14 @@ inline static xen_value xen_builtin_u8array_ctor(i32 argc, array(xen_value) argv
         return NULL_VAL;
     }
 
-    if (argc > 0 && argv[0].type != VAL_NUMBER) {
+    if (argc > 0 && !VAL_IS_NUMBER(argv[0])) {
         xen_runtime_error("element count must be a number");
         return NULL_VAL;
     }
 
     i32 element_count = (argc > 0 && VAL_IS_NUMBER(argv[0])) ? VAL_AS_NUMBER(argv[0]) : 0;
     bool has_default  = (argc == 2) ? XEN_TRUE : XEN_FALSE;
-    u8 default_value  = (has_default) ? (u8)VAL_AS_NUMBER(argv[1]) : 0;
+    u8 default_value  = (has_default) ? (u8)VAL_AS_INTEGER(argv[1]) : 0;
 
     // create the array
     xen_obj_u8array* arr = xen_obj_u8array_new_with_capacity(element_count);
@@ -8,9 +8,9 @@
 
 xen_value xen_dict_len(i32 argc, array(xen_value) argv) {
     if (argc < 1 || !OBJ_IS_DICT(argv[0]))
-        return NUMBER_VAL(0);
+        return INT_VAL(0);
     xen_obj_dict* dict = OBJ_AS_DICT(argv[0]);
-    return NUMBER_VAL(dict->table.count);
+    return INT_VAL(dict->table.count);
 }
 
 xen_value xen_dict_keys(i32 argc, array(xen_value) argv) {
@@ -59,6 +59,7 @@ xen_value xen_dict_has(i32 argc, array(xen_value) argv) {
 xen_value xen_dict_remove(i32 argc, array(xen_value) argv) {
     if (argc < 2 || !OBJ_IS_DICT(argv[0]))
         return BOOL_VAL(XEN_FALSE);
+    REQUIRE_MUTABLE(0);
 
     xen_obj_dict* dict = OBJ_AS_DICT(argv[0]);
     return BOOL_VAL(xen_obj_dict_delete(dict, argv[1]));
@@ -67,6 +68,7 @@ xen_value xen_dict_remove(i32 argc, array(xen_value) argv) {
 xen_value xen_dict_clear(i32 argc, array(xen_value) argv) {
     if (argc < 1 || !OBJ_IS_DICT(argv[0]))
         return NULL_VAL;
+    REQUIRE_MUTABLE(0);
 
     xen_obj_dict* dict = OBJ_AS_DICT(argv[0]);
     xen_table_free(&dict->table);
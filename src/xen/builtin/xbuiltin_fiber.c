@@ -0,0 +1,36 @@
+#include "xbuiltin_fiber.h"
+#include "xbuiltin_common.h"
+
+#include "../object/xobj_closure.h"
+#include "../object/xobj_fiber.h"
+#include "../object/xobj_function.h"
+#include "../object/xobj_namespace.h"
+#include "../object/xobj_native_function.h"
+#include "../xvm.h"
+
+xen_value xen_builtin_fiber_ctor(i32 argc, array(xen_value) argv) {
+    REQUIRE_ARG("fn", 0, TYPEID_FUNC);
+    xen_value fn    = argv[0];
+    const i32 arity = OBJ_IS_CLOSURE(fn) ? OBJ_AS_CLOSURE(fn)->fn->arity : OBJ_AS_FUNCTION(fn)->arity;
+    if (arity > 1) {
+        xen_runtime_error("fiber function must take at most one argument (got %d)", arity);
+        return NULL_VAL;
+    }
+    return OBJ_VAL(xen_obj_fiber_new(fn));
+}
+
+static xen_value fiber_yield(i32 argc, array(xen_value) argv) {
+    xen_vm_yield(argc > 0 ? argv[0] : NULL_VAL);
+    return NULL_VAL;  // replaced by the value passed to the next resume()
+}
+
+static xen_value fiber_current(i32 argc, array(xen_value) argv) {
+    return g_vm->fiber != NULL ? OBJ_VAL(g_vm->fiber) : NULL_VAL;
+}
+
+xen_obj_namespace* xen_builtin_fiber() {
+    xen_obj_namespace* fiber = xen_obj_namespace_new("fiber");
+    xen_obj_namespace_set(fiber, "yield", OBJ_VAL(xen_obj_native_func_new(fiber_yield, "yield")));
+    xen_obj_namespace_set(fiber, "current", OBJ_VAL(xen_obj_native_func_new(fiber_current, "current")));
+    return fiber;
+}
@@ -0,0 +1,10 @@
+#ifndef X_BUILTIN_FIBER_H
+#define X_BUILTIN_FIBER_H
+
+#include "../xcommon.h"
+#include "../xvalue.h"
+
+xen_obj_namespace* xen_builtin_fiber();
+xen_value xen_builtin_fiber_ctor(i32 argc, array(xen_value) argv);
+
+#endif
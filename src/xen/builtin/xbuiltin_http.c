@@ -0,0 +1,746 @@
+#include "xbuiltin_http.h"
+#include "xbuiltin_common.h"
+#include "xbuiltin_net.h"
+#include "../xutils.h"
+
+#include "../object/xobj_string.h"
+#include "../object/xobj_dict.h"
+#include "../object/xobj_namespace.h"
+#include "../object/xobj_native_function.h"
+#include "../object/xobj_class.h"
+#include "../object/xobj_instance.h"
+#include "../object/xobj_u8array.h"
+#include "../xvm.h"
+
+#include <ctype.h>
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
+
+//==============================================================//
+//                          Globals                             //
+//==============================================================//
+
+static XEN_THREAD_LOCAL xen_obj_class* g_http_request_class = NULL;
+
+// Field indices of http.Request, in the order they are added in create_request_class()
+enum {
+    REQUEST_METHOD,
+    REQUEST_PATH,
+    REQUEST_VERSION,
+    REQUEST_HEADERS,
+    REQUEST_BODY,
+    REQUEST_KEEP_ALIVE,
+};
+
+//==============================================================//
+//                          Parser                              //
+//==============================================================//
+
+typedef enum {
+    HTTP_HEAD,
+    HTTP_BODY,
+    HTTP_CHUNK_SIZE,
+    HTTP_CHUNK_DATA,
+    HTTP_CHUNK_DATA_END,
+    HTTP_TRAILERS,
+    HTTP_FAILED,
+} xen_http_state;
+
+typedef enum {
+    HTTP_INCOMPLETE,
+    HTTP_COMPLETE,
+    HTTP_ERROR,
+} xen_http_result;
+
+// A piece of the request head, relative to the start of the request so compacting the buffer doesn't move it
+typedef struct {
+    u32 offset;
+    u32 length;
+} xen_http_span;
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+
+    // absolute positions in data
+    size_t start;       // first byte of the request being parsed
+    size_t scan;        // head: where the search for the blank line resumes
+    size_t pos;         // body: next unparsed byte
+    size_t body_start;  // first byte after the head
+
+    xen_http_state state;
+    xen_http_span method;
+    xen_http_span path;
+    xen_http_span version;
+    xen_http_span names[XEN_HTTP_MAX_HEADERS];
+    xen_http_span values[XEN_HTTP_MAX_HEADERS];
+    i32 header_count;
+    bool keep_alive;
+    bool chunked;
+    size_t content_length;
+
+    // chunked bodies are decoded into their own buffer
+    char* body;
+    size_t body_length;
+    size_t body_capacity;
+    size_t chunk_remaining;
+
+    const char* error;
+} xen_http_parser;
+
+// Returns the next '\n' in [p, end), or NULL. Head lines are short but there are many of them, so 16 bytes are
+// compared at a time where SSE2 is available.
+static const char* http_find_newline(const char* p, const char* end) {
+#ifdef __SSE2__
+    const __m128i lf = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), lf));
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    return (const char*)memchr(p, '\n', (size_t)(end - p));
+}
+
+static bool http_span_equals(const xen_http_parser* parser, xen_http_span span, const char* text) {
+    const size_t length = strlen(text);
+    return span.length == length && strncasecmp(parser->data + parser->start + span.offset, text, length) == 0;
+}
+
+static bool http_span_contains(const xen_http_parser* parser, xen_http_span span, const char* token) {
+    const size_t length = strlen(token);
+    const char* value   = parser->data + parser->start + span.offset;
+    for (size_t i = 0; i + length <= span.length; i++) {
+        if (strncasecmp(value + i, token, length) == 0)
+            return XEN_TRUE;
+    }
+    return XEN_FALSE;
+}
+
+static xen_http_span http_span(const xen_http_parser* parser, const char* from, const char* to) {
+    xen_http_span span = {(u32)(from - (parser->data + parser->start)), (u32)(to - from)};
+    return span;
+}
+
+static xen_http_result http_fail(xen_http_parser* parser, const char* error) {
+    parser->state = HTTP_FAILED;
+    parser->error = error;
+    return HTTP_ERROR;
+}
+
+static void http_reset_request(xen_http_parser* parser) {
+    parser->state           = HTTP_HEAD;
+    parser->scan            = parser->start;
+    parser->header_count    = 0;
+    parser->chunked         = XEN_FALSE;
+    parser->content_length  = 0;
+    parser->body_length     = 0;
+    parser->chunk_remaining = 0;
+}
+
+static void http_append(xen_http_parser* parser, const char* bytes, size_t count) {
+    // drop consumed requests before growing, positions are shifted with them
+    if (parser->start > 0 && parser->length + count > parser->capacity) {
+        const size_t shift = parser->start;
+        memmove(parser->data, parser->data + shift, parser->length - shift);
+        parser->length -= shift;
+        parser->start = 0;
+        parser->scan -= shift;
+        parser->pos -= parser->pos >= shift ? shift : parser->pos;
+        parser->body_start -= parser->body_start >= shift ? shift : parser->body_start;
+    }
+    if (parser->length + count > parser->capacity) {
+        size_t capacity = parser->capacity < 4096 ? 4096 : parser->capacity;
+        while (capacity < parser->length + count)
+            capacity *= 2;
+        parser->data     = (char*)realloc(parser->data, capacity);
+        parser->capacity = capacity;
+    }
+    memcpy(parser->data + parser->length, bytes, count);
+    parser->length += count;
+}
+
+static void http_body_append(xen_http_parser* parser, const char* bytes, size_t count) {
+    if (parser->body_length + count > parser->body_capacity) {
+        size_t capacity = parser->body_capacity < 1024 ? 1024 : parser->body_capacity;
+        while (capacity < parser->body_length + count)
+            capacity *= 2;
+        parser->body          = (char*)realloc(parser->body, capacity + 1);
+        parser->body_capacity = capacity;
+    }
+    memcpy(parser->body + parser->body_length, bytes, count);
+    parser->body_length += count;
+}
+
+// Parses the request line and headers in [start, head_end), which ends with the blank line
+static xen_http_result http_parse_head(xen_http_parser* parser, size_t head_end) {
+    const char* line = parser->data + parser->start;
+    const char* end  = parser->data + head_end;
+
+    // request line: METHOD SP target SP HTTP/1.x
+    const char* eol      = http_find_newline(line, end);
+    const char* line_end = eol > line && eol[-1] == '\r' ? eol - 1 : eol;
+    const char* sp1      = memchr(line, ' ', (size_t)(line_end - line));
+    const char* sp2      = sp1 != NULL ? memchr(sp1 + 1, ' ', (size_t)(line_end - sp1 - 1)) : NULL;
+    if (sp1 == NULL || sp2 == NULL || sp1 == line || sp2 == sp1 + 1)
+        return http_fail(parser, "malformed request line");
+    if (line_end - sp2 - 1 != 8 || strncmp(sp2 + 1, "HTTP/1.", 7) != 0 || !isdigit((u8)sp2[8]))
+        return http_fail(parser, "unsupported HTTP version");
+
+    parser->method     = http_span(parser, line, sp1);
+    parser->path       = http_span(parser, sp1 + 1, sp2);
+    parser->version    = http_span(parser, sp2 + 1, line_end);
+    parser->keep_alive = sp2[8] != '0';  // HTTP/1.1 defaults to keep-alive, 1.0 doesn't
+
+    bool has_length = XEN_FALSE;
+    for (line = eol + 1; line < end; line = eol + 1) {
+        eol      = http_find_newline(line, end);
+        line_end = eol > line && eol[-1] == '\r' ? eol - 1 : eol;
+        if (line_end == line)
+            break;  // the blank line
+
+        const char* colon = memchr(line, ':', (size_t)(line_end - line));
+        if (colon == NULL || colon == line || line[0] == ' ' || line[0] == '\t' || colon[-1] == ' ')
+            return http_fail(parser, "malformed header line");
+        if (parser->header_count == XEN_HTTP_MAX_HEADERS)
+            return http_fail(parser, "too many headers");
+
+        const char* value     = colon + 1;
+        const char* value_end = line_end;
+        while (value < value_end && (*value == ' ' || *value == '\t'))
+            value++;
+        while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+            value_end--;
+
+        const i32 index             = parser->header_count++;
+        parser->names[index]        = http_span(parser, line, colon);
+        parser->values[index]       = http_span(parser, value, value_end);
+        const xen_http_span name    = parser->names[index];
+        const xen_http_span content = parser->values[index];
+
+        if (http_span_equals(parser, name, "content-length")) {
+            size_t length = 0;
+            if (value == value_end)
+                return http_fail(parser, "invalid Content-Length");
+            for (const char* c = value; c < value_end; c++) {
+                if (!isdigit((u8)*c) || length > XEN_HTTP_MAX_BODY)
+                    return http_fail(parser, "invalid Content-Length");
+                length = length * 10 + (size_t)(*c - '0');
+            }
+            if (has_length && length != parser->content_length)
+                return http_fail(parser, "conflicting Content-Length headers");
+            parser->content_length = length;
+            has_length             = XEN_TRUE;
+        } else if (http_span_equals(parser, name, "transfer-encoding")) {
+            parser->chunked = http_span_contains(parser, content, "chunked");
+        } else if (http_span_equals(parser, name, "connection")) {
+            if (http_span_contains(parser, content, "close"))
+                parser->keep_alive = XEN_FALSE;
+            else if (http_span_contains(parser, content, "keep-alive"))
+                parser->keep_alive = XEN_TRUE;
+        }
+    }
+
+    if (parser->content_length > XEN_HTTP_MAX_BODY)
+        return http_fail(parser, "request body too large");
+
+    parser->body_start = head_end;
+    parser->pos        = head_end;
+    if (parser->chunked)
+        parser->state = HTTP_CHUNK_SIZE;  // Transfer-Encoding wins over Content-Length
+    else
+        parser->state = HTTP_BODY;
+    return HTTP_COMPLETE;
+}
+
+// Finds the blank line ending the head, resuming where the previous call stopped
+static xen_http_result http_scan_head(xen_http_parser* parser) {
+    // empty lines before the request line are ignored (RFC 9112 2.2)
+    if (parser->scan == parser->start) {
+        while (parser->start < parser->length &&
+               (parser->data[parser->start] == '\r' || parser->data[parser->start] == '\n'))
+            parser->start++;
+        parser->scan = parser->start;
+    }
+
+    const char* end = parser->data + parser->length;
+    const char* p   = parser->data + parser->scan;
+    for (;;) {
+        const char* lf = http_find_newline(p, end);
+        if (lf == NULL) {
+            parser->scan = parser->length;
+            break;
+        }
+        // a line feed followed by LF or CRLF closes the head; without enough lookahead retry from this LF
+        if (lf + 1 >= end || (lf[1] == '\r' && lf + 2 >= end)) {
+            parser->scan = (size_t)(lf - parser->data);
+            break;
+        }
+        if (lf[1] == '\n')
+            return http_parse_head(parser, (size_t)(lf + 2 - parser->data));
+        if (lf[1] == '\r' && lf[2] == '\n')
+            return http_parse_head(parser, (size_t)(lf + 3 - parser->data));
+        p = lf + 1;
+    }
+
+    if (parser->length - parser->start > XEN_HTTP_MAX_HEAD)
+        return http_fail(parser, "request head too large");
+    return HTTP_INCOMPLETE;
+}
+
+static xen_http_result http_parse_chunked(xen_http_parser* parser) {
+    const char* end = parser->data + parser->length;
+    for (;;) {
+        const char* p = parser->data + parser->pos;
+        switch (parser->state) {
+            case HTTP_CHUNK_SIZE: {
+                const char* lf = http_find_newline(p, end);
+                if (lf == NULL)
+                    return end - p > 1024 ? http_fail(parser, "malformed chunk size") : HTTP_INCOMPLETE;
+
+                size_t size  = 0;
+                const char* c = p;
+                for (; c < lf && isxdigit((u8)*c); c++) {
+                    size = size * 16 + (size_t)(isdigit((u8)*c) ? *c - '0' : (tolower((u8)*c) - 'a' + 10));
+                    if (size > XEN_HTTP_MAX_BODY)
+                        return http_fail(parser, "request body too large");
+                }
+                // anything after the digits is a chunk extension (";name=value"), which is ignored
+                if (c == p || (c < lf && *c != ';' && *c != ' ' && *c != '\t' && *c != '\r'))
+                    return http_fail(parser, "malformed chunk size");
+                if (parser->body_length + size > XEN_HTTP_MAX_BODY)
+                    return http_fail(parser, "request body too large");
+
+                parser->pos             = (size_t)(lf + 1 - parser->data);
+                parser->chunk_remaining = size;
+                parser->state           = size == 0 ? HTTP_TRAILERS : HTTP_CHUNK_DATA;
+                break;
+            }
+            case HTTP_CHUNK_DATA: {
+                const size_t available = (size_t)(end - p);
+                const size_t count     = available < parser->chunk_remaining ? available : parser->chunk_remaining;
+                http_body_append(parser, p, count);
+                parser->pos += count;
+                parser->chunk_remaining -= count;
+                if (parser->chunk_remaining > 0)
+                    return HTTP_INCOMPLETE;
+                parser->state = HTTP_CHUNK_DATA_END;
+                break;
+            }
+            case HTTP_CHUNK_DATA_END:
+                if (p >= end || (p[0] == '\r' && p + 1 >= end))
+                    return HTTP_INCOMPLETE;
+                if (p[0] == '\n')
+                    parser->pos += 1;
+                else if (p[0] == '\r' && p[1] == '\n')
+                    parser->pos += 2;
+                else
+                    return http_fail(parser, "missing line break after chunk");
+                parser->state = HTTP_CHUNK_SIZE;
+                break;
+            case HTTP_TRAILERS: {
+                // trailer fields are skipped up to the final blank line
+                const char* lf = http_find_newline(p, end);
+                if (lf == NULL)
+                    return end - p > XEN_HTTP_MAX_HEAD ? http_fail(parser, "trailers too large") : HTTP_INCOMPLETE;
+                const bool blank = lf == p || (lf == p + 1 && p[0] == '\r');
+                parser->pos      = (size_t)(lf + 1 - parser->data);
+                if (blank)
+                    return HTTP_COMPLETE;
+                break;
+            }
+            default:
+                return HTTP_ERROR;
+        }
+    }
+}
+
+static xen_value http_string(const xen_http_parser* parser, xen_http_span span) {
+    return OBJ_VAL(xen_obj_str_copy(parser->data + parser->start + span.offset, (i32)span.length));
+}
+
+// Materializes the finished request; header names are lowercased so lookups don't depend on the client's casing
+static xen_value http_build_request(xen_http_parser* parser) {
+    xen_obj_instance* request = xen_obj_instance_new(g_http_request_class);
+
+    request->fields[REQUEST_METHOD]     = http_string(parser, parser->method);
+    request->fields[REQUEST_PATH]       = http_string(parser, parser->path);
+    request->fields[REQUEST_VERSION]    = http_string(parser, parser->version);
+    request->fields[REQUEST_KEEP_ALIVE] = BOOL_VAL(parser->keep_alive);
+
+    xen_obj_dict* headers = xen_obj_dict_new();
+    request->fields[REQUEST_HEADERS] = OBJ_VAL(headers);
+    for (i32 i = 0; i < parser->header_count; i++) {
+        char name[256];
+        const xen_http_span span = parser->names[i];
+        const u32 length         = span.length < sizeof(name) ? span.length : sizeof(name) - 1;
+        for (u32 c = 0; c < length; c++)
+            name[c] = (char)tolower((u8)parser->data[parser->start + span.offset + c]);
+        xen_obj_dict_set(headers, OBJ_VAL(xen_obj_str_copy(name, (i32)length)), http_string(parser, parser->values[i]));
+    }
+
+    if (parser->chunked) {
+        const char* body              = parser->body != NULL ? parser->body : "";
+        request->fields[REQUEST_BODY] = OBJ_VAL(xen_obj_str_copy(body, (i32)parser->body_length));
+    } else {
+        request->fields[REQUEST_BODY] =
+          OBJ_VAL(xen_obj_str_copy(parser->data + parser->body_start, (i32)parser->content_length));
+    }
+    return OBJ_VAL(request);
+}
+
+// Parses the next buffered request. Returns the Request, or null if it isn't complete yet or the input is malformed.
+static xen_value http_next(xen_http_parser* parser) {
+    if (parser->state == HTTP_HEAD) {
+        const xen_http_result result = http_scan_head(parser);
+        if (result != HTTP_COMPLETE)
+            return NULL_VAL;
+    }
+
+    if (parser->state == HTTP_BODY) {
+        if (parser->length - parser->body_start < parser->content_length)
+            return NULL_VAL;
+        parser->pos = parser->body_start + parser->content_length;
+    } else if (parser->state == HTTP_FAILED || http_parse_chunked(parser) != HTTP_COMPLETE) {
+        return NULL_VAL;
+    }
+
+    const xen_value request = http_build_request(parser);
+    parser->start           = parser->pos;
+    http_reset_request(parser);
+    return request;
+}
+
+//==============================================================//
+//                       Parser Class                           //
+//==============================================================//
+
+static xen_http_parser* parser_get(xen_value self) {
+    return (xen_http_parser*)(intptr_t)VAL_AS_INTEGER(OBJ_AS_INSTANCE(self)->fields[0]);
+}
+
+// Like parser_get(), but raises a runtime error (and returns NULL) once the parser has been closed
+static xen_http_parser* parser_get_open(xen_value self, const char* method) {
+    xen_http_parser* parser = parser_get(self);
+    if (parser == NULL)
+        xen_runtime_error("[http.Parser] %s() called on a closed parser", method);
+    return parser;
+}
+
+// Reports a parse failure through the parser's `error` field
+static xen_value parser_result(xen_value self, xen_value request) {
+    const xen_http_parser* parser = parser_get(self);
+    if (parser->state == HTTP_FAILED && VAL_IS_NULL(OBJ_AS_INSTANCE(self)->fields[1])) {
+        OBJ_AS_INSTANCE(self)->fields[1] = OBJ_VAL(xen_obj_str_copy(parser->error, (i32)strlen(parser->error)));
+    }
+    return request;
+}
+
+static xen_value http_parser_init(i32 argc, array(xen_value) argv) {
+    xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
+
+    xen_http_parser* parser = XEN_ALLOCATE(xen_http_parser, 1);
+    memset(parser, 0, sizeof(xen_http_parser));
+    http_reset_request(parser);
+
+    self->fields[0] = INT_VAL((i64)(intptr_t)parser);
+    return OBJ_VAL(self);
+}
+
+// Method: feed(data, length = all) -> buffers a string, or the first `length` bytes of a UInt8Array, and returns the
+// next complete Request (null if more input is needed or the request is malformed, see `error`)
+static xen_value http_parser_feed(i32 argc, array(xen_value) argv) {
+    if (argc < 2 || !OBJ_IS_INSTANCE(argv[0])) {
+        xen_runtime_error("[http.Parser] feed() expects a string or UInt8Array");
+        return NULL_VAL;
+    }
+
+    xen_http_parser* parser = parser_get_open(argv[0], "feed");
+    if (parser == NULL || parser->state == HTTP_FAILED)
+        return NULL_VAL;
+
+    if (OBJ_IS_STRING(argv[1])) {
+        xen_obj_str* data = OBJ_AS_STRING(argv[1]);
+        http_append(parser, data->str, (size_t)data->length);
+    } else if (OBJ_IS_U8ARRAY(argv[1])) {
+        xen_obj_u8array* data = OBJ_AS_U8ARRAY(argv[1]);
+        i64 length            = argc > 2 && VAL_IS_NUMBER(argv[2]) ? VAL_AS_INTEGER(argv[2]) : data->count;
+        if (length < 0 || length > data->count)
+            length = data->count;
+        http_append(parser, (const char*)data->values, (size_t)length);
+    } else if (!VAL_IS_NULL(argv[1])) {
+        xen_runtime_error("[http.Parser] feed() expects a string or UInt8Array (got '%s')",
+          xen_value_type_to_str(argv[1]));
+        return NULL_VAL;
+    }
+
+    return parser_result(argv[0], http_next(parser));
+}
+
+// Method: next() -> the next pipelined Request already buffered, or null
+static xen_value http_parser_next(i32 argc, array(xen_value) argv) {
+    if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
+        return NULL_VAL;
+    }
+    xen_http_parser* parser = parser_get_open(argv[0], "next");
+    if (parser == NULL)
+        return NULL_VAL;
+    return parser_result(argv[0], http_next(parser));
+}
+
+// Method: reset() -> drops buffered input and any parse error
+static xen_value http_parser_reset(i32 argc, array(xen_value) argv) {
+    if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
+        return NULL_VAL;
+    }
+    xen_http_parser* parser = parser_get_open(argv[0], "reset");
+    if (parser == NULL)
+        return NULL_VAL;
+    parser->length     = 0;
+    parser->start      = 0;
+    parser->pos        = 0;
+    parser->body_start = 0;
+    parser->error      = NULL;
+    http_reset_request(parser);
+    OBJ_AS_INSTANCE(argv[0])->fields[1] = NULL_VAL;
+    return NULL_VAL;
+}
+
+// Method: buffered() -> bytes received but not yet returned as part of a request
+static xen_value http_parser_buffered(i32 argc, array(xen_value) argv) {
+    if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
+        return INT_VAL(0);
+    }
+    const xen_http_parser* parser = parser_get(argv[0]);
+    if (parser == NULL)
+        return INT_VAL(0);
+    return INT_VAL((i64)(parser->length - parser->start));
+}
+
+// Method: close() -> frees the parser's buffers. Call it when the connection it reads from is closed; the parser
+// can't be used afterwards, and closing it again does nothing.
+static xen_value http_parser_close(i32 argc, array(xen_value) argv) {
+    if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
+        return NULL_VAL;
+    }
+    xen_http_parser* parser = parser_get(argv[0]);
+    if (parser != NULL) {
+        free(parser->data);
+        free(parser->body);
+        XEN_FREE(xen_http_parser, parser);
+        OBJ_AS_INSTANCE(argv[0])->fields[0] = INT_VAL(0);
+    }
+    return NULL_VAL;
+}
+
+static xen_obj_class* create_parser_class() {
+    xen_obj_str* name    = xen_obj_str_copy("Parser", 6);
+    xen_obj_class* class = xen_obj_class_new(name);
+
+    xen_obj_class_add_property(class, xen_obj_str_copy("_parser", 7), INT_VAL(0), XEN_TRUE);
+    xen_obj_class_add_property(class, xen_obj_str_copy("error", 5), NULL_VAL, XEN_FALSE);
+
+    xen_obj_class_set_native_init(class, http_parser_init);
+
+    xen_obj_class_add_native_method(class, "feed", http_parser_feed, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "next", http_parser_next, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "reset", http_parser_reset, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "buffered", http_parser_buffered, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "close", http_parser_close, XEN_FALSE);
+
+    return class;
+}
+
+static xen_obj_class* create_request_class() {
+    static const char* fields[] = {"method", "path", "version", "headers", "body", "keep_alive"};
+
+    xen_obj_str* name    = xen_obj_str_copy("Request", 7);
+    xen_obj_class* class = xen_obj_class_new(name);
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        xen_obj_class_add_property(class, xen_obj_str_copy(fields[i], (i32)strlen(fields[i])), NULL_VAL, XEN_FALSE);
+    }
+    return class;
+}
+
+//==============================================================//
+//                         Responses                            //
+//==============================================================//
+
+static const struct {
+    i64 status;
+    const char* reason;
+} k_http_reasons[] = {
+  {100, "Continue"},
+  {101, "Switching Protocols"},
+  {200, "OK"},
+  {201, "Created"},
+  {202, "Accepted"},
+  {204, "No Content"},
+  {206, "Partial Content"},
+  {301, "Moved Permanently"},
+  {302, "Found"},
+  {303, "See Other"},
+  {304, "Not Modified"},
+  {307, "Temporary Redirect"},
+  {308, "Permanent Redirect"},
+  {400, "Bad Request"},
+  {401, "Unauthorized"},
+  {403, "Forbidden"},
+  {404, "Not Found"},
+  {405, "Method Not Allowed"},
+  {408, "Request Timeout"},
+  {409, "Conflict"},
+  {411, "Length Required"},
+  {413, "Content Too Large"},
+  {414, "URI Too Long"},
+  {415, "Unsupported Media Type"},
+  {429, "Too Many Requests"},
+  {431, "Request Header Fields Too Large"},
+  {500, "Internal Server Error"},
+  {501, "Not Implemented"},
+  {502, "Bad Gateway"},
+  {503, "Service Unavailable"},
+  {504, "Gateway Timeout"},
+  {505, "HTTP Version Not Supported"},
+};
+
+static const char* http_reason(i64 status) {
+    for (size_t i = 0; i < sizeof(k_http_reasons) / sizeof(k_http_reasons[0]); i++) {
+        if (k_http_reasons[i].status == status)
+            return k_http_reasons[i].reason;
+    }
+    return "Unknown";
+}
+
+// A CR or LF in a header name or value would end the header early and let the rest pass as headers (or a body) of
+// its own, and NUL bytes are cut short by many clients
+static bool is_header_safe(const xen_obj_str* str) {
+    for (i32 i = 0; i < str->length; i++) {
+        if (str->str[i] == '\r' || str->str[i] == '\n' || str->str[i] == '\0')
+            return XEN_FALSE;
+    }
+    return XEN_TRUE;
+}
+
+// http.respond(conn, status, body = "", headers = null, keep_alive = true) -> bytes sent, -1 on error. The head is
+// assembled in one buffer (Content-Length and Connection are added) and goes out with the body in one writev().
+static xen_value http_respond(i32 argc, array(xen_value) argv) {
+    const socket_t fd = argc > 0 ? xen_net_socket_fd(argv[0]) : INVALID_SOCKET_FD;
+    if (fd == INVALID_SOCKET_FD) {
+        xen_runtime_error("[http] respond() expects an open TcpStream");
+        return INT_VAL(-1);
+    }
+    if (argc < 2 || !VAL_IS_NUMBER(argv[1])) {
+        xen_runtime_error("[http] respond() expects a status code");
+        return INT_VAL(-1);
+    }
+    if (argc > 2 && !VAL_IS_NULL(argv[2]) && !OBJ_IS_STRING(argv[2])) {
+        xen_runtime_error("[http] respond() body must be a string");
+        return INT_VAL(-1);
+    }
+    if (argc > 3 && !VAL_IS_NULL(argv[3]) && !OBJ_IS_DICT(argv[3])) {
+        xen_runtime_error("[http] respond() headers must be a dictionary");
+        return INT_VAL(-1);
+    }
+
+    const i64 status      = VAL_AS_INTEGER(argv[1]);
+    const bool keep_alive = argc > 4 && VAL_IS_BOOL(argv[4]) ? VAL_AS_BOOL(argv[4]) : XEN_TRUE;
+    xen_table* headers    = argc > 3 && OBJ_IS_DICT(argv[3]) ? &OBJ_AS_DICT(argv[3])->table : NULL;
+
+    i32 body_size    = 0;
+    char* body       = NULL;
+    xen_obj_str* src = argc > 2 && OBJ_IS_STRING(argv[2]) ? OBJ_AS_STRING(argv[2]) : NULL;
+    if (src != NULL)
+        body = xen_decode_string_literal(src->str, src->length, &body_size);
+
+    // status line, Content-Length and Connection fit in 128 bytes
+    size_t head_capacity = 128;
+    if (headers != NULL) {
+        for (u64 i = 0; i < headers->capacity; i++) {
+            const xen_table_entry* entry = &headers->entries[i];
+            if (entry->key == NULL)
+                continue;
+            if (!OBJ_IS_STRING(entry->value)) {
+                xen_runtime_error("[http] respond() header '%s' must be a string", entry->key->str);
+                XEN_FREE_ARRAY(char, body, src != NULL ? src->length + 1 : 0);
+                return INT_VAL(-1);
+            }
+            if (!is_header_safe(entry->key) || !is_header_safe(OBJ_AS_STRING(entry->value))) {
+                xen_runtime_error("[http] respond() header '%s' contains CR, LF or NUL", entry->key->str);
+                XEN_FREE_ARRAY(char, body, src != NULL ? src->length + 1 : 0);
+                return INT_VAL(-1);
+            }
+            head_capacity += (size_t)entry->key->length + (size_t)OBJ_AS_STRING(entry->value)->length + 4;
+        }
+    }
+    if (head_capacity > XEN_BUFFER_MAX) {
+        xen_runtime_error("[http] respond() headers too large");
+        XEN_FREE_ARRAY(char, body, src != NULL ? src->length + 1 : 0);
+        return INT_VAL(-1);
+    }
+
+    char* head  = (char*)xen_buffer_acquire(&g_vm->buffers, head_capacity);
+    size_t size = (size_t)snprintf(head, head_capacity, "HTTP/1.1 %lld %s\r\n", (long long)status, http_reason(status));
+    if (headers != NULL) {
+        for (u64 i = 0; i < headers->capacity; i++) {
+            const xen_table_entry* entry = &headers->entries[i];
+            if (entry->key == NULL)
+                continue;
+            // copied as they are: decoding escapes would let "\r\n" in a value start a header of its own
+            const xen_obj_str* value = OBJ_AS_STRING(entry->value);
+            memcpy(head + size, entry->key->str, (size_t)entry->key->length);
+            size += (size_t)entry->key->length;
+            head[size++] = ':';
+            head[size++] = ' ';
+            memcpy(head + size, value->str, (size_t)value->length);
+            size += (size_t)value->length;
+            head[size++] = '\r';
+            head[size++] = '\n';
+        }
+    }
+    size += (size_t)snprintf(head + size, head_capacity - size, "Content-Length: %d\r\nConnection: %s\r\n\r\n",
+      body_size, keep_alive ? "keep-alive" : "close");
+
+    const char* parts[2] = {head, body};
+    const i32 sizes[2]   = {(i32)size, body_size};
+    const ssize_t sent   = xen_net_writev(fd, parts, sizes, body_size > 0 ? 2 : 1);
+
+    xen_buffer_release(&g_vm->buffers, head, head_capacity);
+    if (body != NULL)
+        XEN_FREE_ARRAY(char, body, src->length + 1);
+
+    if (sent < 0) {
+        if (SOCKET_WOULD_BLOCK)
+            return INT_VAL(0);
+        xen_runtime_error("[http] respond() failed: %s", strerror(SOCKET_ERROR_CODE));
+        return INT_VAL(-1);
+    }
+    return INT_VAL(sent);
+}
+
+// http.reason(status) -> standard reason phrase for a status code
+static xen_value http_reason_fn(i32 argc, array(xen_value) argv) {
+    REQUIRE_ARG("status", 0, TYPEID_NUMBER);
+    const char* reason = http_reason(VAL_AS_INTEGER(argv[0]));
+    return OBJ_VAL(xen_obj_str_copy(reason, (i32)strlen(reason)));
+}
+
+//==============================================================//
+//                    Register Namespace                        //
+//==============================================================//
+
+xen_obj_namespace* xen_builtin_http() {
+    xen_obj_namespace* http = xen_obj_namespace_new("http");
+
+    g_http_request_class = create_request_class();
+
+    xen_obj_namespace_set(http, "Parser", OBJ_VAL(create_parser_class()));
+    xen_obj_namespace_set(http, "Request", OBJ_VAL(g_http_request_class));
+    xen_obj_namespace_set(http, "respond", OBJ_VAL(xen_obj_native_func_new(http_respond, "respond")));
+    xen_obj_namespace_set(http, "reason", OBJ_VAL(xen_obj_native_func_new(http_reason_fn, "reason")));
+
+    return http;
+}
@@ -0,0 +1,25 @@
+#ifndef X_BUILTIN_HTTP_H
+#define X_BUILTIN_HTTP_H
+
+#include "../xcommon.h"
+#include "../xvalue.h"
+
+/*
+ * HTTP/1.1 (http namespace)
+ *
+ * http.Parser is an incremental request parser: bytes are fed in as they arrive and a complete Request comes out
+ * once the head and body are in, however the input was split across reads. Everything stays in the parser's own
+ * buffer as offsets while a request is incomplete; strings are only created for the finished request. Pipelined
+ * requests stay buffered and are returned by next(). Bodies are either Content-Length delimited or chunked.
+ *
+ * http.respond() builds the status line and headers into one buffer and sends them together with the body in a single
+ * gathered write.
+ */
+
+#define XEN_HTTP_MAX_HEADERS 64
+#define XEN_HTTP_MAX_HEAD (64 * 1024)          // request line plus headers
+#define XEN_HTTP_MAX_BODY (64 * 1024 * 1024)  // Content-Length or total chunked size
+
+xen_obj_namespace* xen_builtin_http();
+
+#endif
@@ -53,7 +53,7 @@ static xen_value io_pause(i32 argc, array(xen_value) argv) {
     int c;
     while ((c = getchar()) != '\n' && c != EOF)
         ;
-    return NUMBER_VAL(c);
+    return INT_VAL(c);
 }
 
 xen_obj_namespace* xen_builtin_io() {
@@ -80,6 +80,10 @@ static xen_value math_random(i32 argc, array(xen_value) argv) {
 
 static xen_value xen_num_abs(i32 argc, array(xen_value) argv) {
     REQUIRE_ARG("value", 0, TYPEID_NUMBER);
+    if (VAL_IS_INT(argv[0]) && VAL_AS_INT(argv[0]) != INT64_MIN) {
+        const i64 value = VAL_AS_INT(argv[0]);
+        return INT_VAL(value < 0 ? -value : value);
+    }
     return NUMBER_VAL(fabs(VAL_AS_NUMBER(argv[0])));
 }
 
@@ -1,19 +1,35 @@
 #include "xbuiltin_net.h"
 #include "xbuiltin_common.h"
+#include "xbuiltin_fiber.h"
 #include "../xutils.h"
 
 #include "../object/xobj_string.h"
 #include "../object/xobj_array.h"
+#include "../object/xobj_u8array.h"
 #include "../object/xobj_namespace.h"
 #include "../object/xobj_native_function.h"
 #include "../object/xobj_class.h"
 #include "../object/xobj_instance.h"
+#include "../object/xobj_fiber.h"
+#include "../xvm.h"
+
+#ifndef PLATFORM_WINDOWS
+    #include <fcntl.h>
+    #include <sys/uio.h>
+#endif
+#ifdef PLATFORM_LINUX
+    #include <sys/epoll.h>
+    #include <sys/sendfile.h>
+#endif
 
 //==============================================================//
 //                          Globals                             //
 //==============================================================//
 
-static xen_obj_class* g_tcp_stream_class = NULL;
+static XEN_THREAD_LOCAL xen_obj_class* g_tcp_stream_class   = NULL;
+static XEN_THREAD_LOCAL xen_obj_class* g_tcp_listener_class = NULL;
+
+static void event_loops_forget(socket_t fd);
 
 //==============================================================//
 //                  Platform Initialization                     //
@@ -89,6 +105,103 @@ static ssize_t socket_write(socket_t fd, const void* buffer, size_t size) {
 #endif
 }
 
+ssize_t xen_net_writev(socket_t fd, const char** parts, const i32* sizes, i32 count) {
+#ifdef PLATFORM_WINDOWS
+    WSABUF buffers[XEN_NET_WRITEV_MAX];
+    for (i32 i = 0; i < count; i++) {
+        buffers[i].buf = (char*)parts[i];
+        buffers[i].len = (ULONG)sizes[i];
+    }
+    DWORD sent = 0;
+    return WSASend(fd, buffers, count, &sent, 0, NULL, NULL) == 0 ? (ssize_t)sent : -1;
+#else
+    struct iovec iov[XEN_NET_WRITEV_MAX];
+    for (i32 i = 0; i < count; i++) {
+        iov[i].iov_base = (void*)parts[i];
+        iov[i].iov_len  = (size_t)sizes[i];
+    }
+    return writev(fd, iov, count);
+#endif
+}
+
+// Sends `count` bytes of `file` starting at `offset` (the file position is left alone). Stops early when a
+// non-blocking socket's buffer fills up; returns the bytes sent, or -1 with the error in errno if nothing was sent.
+static i64 socket_send_file(socket_t fd, FILE* file, i64 offset, i64 count) {
+    i64 sent = 0;
+#ifdef PLATFORM_LINUX
+    // straight from the page cache to the socket
+    off_t position = (off_t)offset;
+    while (sent < count) {
+        const ssize_t n = sendfile(fd, fileno(file), &position, (size_t)(count - sent));
+        if (n <= 0) {
+            if (n < 0 && sent == 0 && !SOCKET_WOULD_BLOCK)
+                return -1;
+            break;
+        }
+        sent += n;
+    }
+#else
+    const size_t chunk = 64 * 1024;
+    char* buffer       = (char*)xen_buffer_acquire(&g_vm->buffers, chunk);
+    fseek(file, (long)offset, SEEK_SET);
+    while (sent < count) {
+        const size_t want = (size_t)(count - sent) < chunk ? (size_t)(count - sent) : chunk;
+        const size_t got  = fread(buffer, 1, want, file);
+        if (got == 0)
+            break;
+        const ssize_t n = socket_write(fd, buffer, got);
+        if (n <= 0) {
+            if (n < 0 && sent == 0 && !SOCKET_WOULD_BLOCK) {
+                xen_buffer_release(&g_vm->buffers, buffer, chunk);
+                return -1;
+            }
+            break;
+        }
+        sent += n;
+        if ((size_t)n < got)
+            break;
+    }
+    xen_buffer_release(&g_vm->buffers, buffer, chunk);
+#endif
+    return sent;
+}
+
+static bool set_socket_nonblocking(socket_t fd, bool enabled) {
+#ifdef PLATFORM_WINDOWS
+    u_long mode = enabled ? 1 : 0;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0)
+        return XEN_FALSE;
+    flags = enabled ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(fd, F_SETFL, flags) == 0;
+#endif
+}
+
+// Method: set_nonblocking(enabled = true). Shared by TcpStream and TcpListener, `fd_field` is the socket's field index.
+static xen_value socket_set_nonblocking(i32 argc, array(xen_value) argv, i32 fd_field) {
+    if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
+        return BOOL_VAL(XEN_FALSE);
+    }
+
+    xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
+    socket_t fd            = (socket_t)VAL_AS_INTEGER(self->fields[fd_field]);
+    bool enabled           = argc < 2 || !VAL_IS_BOOL(argv[1]) || VAL_AS_BOOL(argv[1]);
+
+    if (fd == INVALID_SOCKET_FD) {
+        xen_runtime_error("[Net] Socket is closed");
+        return BOOL_VAL(XEN_FALSE);
+    }
+
+    if (!set_socket_nonblocking(fd, enabled)) {
+        xen_runtime_error("[Net] set_nonblocking() failed: %s", get_socket_error());
+        return BOOL_VAL(XEN_FALSE);
+    }
+
+    return BOOL_VAL(XEN_TRUE);
+}
+
 //==============================================================//
 //                      TcpStream Class                         //
 //==============================================================//
@@ -102,12 +215,12 @@ static xen_value tcp_stream_init(i32 argc, array(xen_value) argv) {
         return NULL_VAL;
     }
 
-    socket_t fd = (socket_t)VAL_AS_NUMBER(argv[1]);
+    socket_t fd = (socket_t)VAL_AS_INTEGER(argv[1]);
 
     // Set properties (fd=0, remote_addr=1, remote_port=2)
-    self->fields[0] = NUMBER_VAL((double)fd);
+    self->fields[0] = INT_VAL(fd);
     self->fields[1] = argc > 2 ? argv[2] : NULL_VAL;       // remote_addr
-    self->fields[2] = argc > 3 ? argv[3] : NUMBER_VAL(0);  // remote_port
+    self->fields[2] = argc > 3 ? argv[3] : INT_VAL(0);  // remote_port
 
     return OBJ_VAL(self);
 }
@@ -119,7 +232,7 @@ static xen_value tcp_stream_read(i32 argc, array(xen_value) argv) {
     }
 
     xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
-    socket_t fd            = (socket_t)VAL_AS_NUMBER(self->fields[0]);
+    socket_t fd            = (socket_t)VAL_AS_INTEGER(self->fields[0]);
 
     if (fd == INVALID_SOCKET_FD) {
         xen_runtime_error("[TcpStream] Socket is closed");
@@ -128,88 +241,151 @@ static xen_value tcp_stream_read(i32 argc, array(xen_value) argv) {
 
     i32 max_bytes = 4096;
     if (argc > 1 && VAL_IS_NUMBER(argv[1])) {
-        max_bytes = (i32)VAL_AS_NUMBER(argv[1]);
+        max_bytes = (i32)VAL_AS_INTEGER(argv[1]);
         if (max_bytes < 1)
             max_bytes = 1;
-        if (max_bytes > 65536)
-            max_bytes = 65536;  // Cap at 64KB
-    }
-
-    char* buffer = (char*)malloc(max_bytes);
-    if (!buffer) {
-        xen_runtime_error("[TcpStream] Failed to allocate buffer");
-        return NULL_VAL;
+        if (max_bytes > (i32)XEN_BUFFER_MAX)
+            max_bytes = (i32)XEN_BUFFER_MAX;
     }
 
+    char* buffer       = (char*)xen_buffer_acquire(&g_vm->buffers, max_bytes);
     ssize_t bytes_read = socket_read(fd, buffer, max_bytes);
 
     if (bytes_read < 0) {
-        free(buffer);
+        xen_buffer_release(&g_vm->buffers, buffer, max_bytes);
+        // non-blocking socket without data: empty string, as opposed to null for EOF
+        if (SOCKET_WOULD_BLOCK)
+            return EMPTY_STRING_VAL;
+        // a peer that reset the connection is gone just like one that closed it
+        if (SOCKET_CONNECTION_LOST)
+            return NULL_VAL;
         xen_runtime_error("[TcpStream] read() failed: %s", get_socket_error());
         return NULL_VAL;
     }
 
     if (bytes_read == 0) {
         // EOF - connection closed by peer
-        free(buffer);
+        xen_buffer_release(&g_vm->buffers, buffer, max_bytes);
         return NULL_VAL;
     }
 
     xen_obj_str* result = xen_obj_str_copy(buffer, (i32)bytes_read);
-    free(buffer);
+    xen_buffer_release(&g_vm->buffers, buffer, max_bytes);
 
     return OBJ_VAL(result);
 }
 
+// Method: read_into(buffer, offset = 0, max_bytes = rest of buffer) -> bytes read into the UInt8Array, 0 if a
+// non-blocking socket has no data, null on EOF or error
+static xen_value tcp_stream_read_into(i32 argc, array(xen_value) argv) {
+    if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
+        return NULL_VAL;
+    }
+
+    xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
+    socket_t fd            = (socket_t)VAL_AS_INTEGER(self->fields[0]);
+
+    if (fd == INVALID_SOCKET_FD) {
+        xen_runtime_error("[TcpStream] Socket is closed");
+        return NULL_VAL;
+    }
+
+    if (argc < 2 || !OBJ_IS_U8ARRAY(argv[1])) {
+        xen_runtime_error("[TcpStream] read_into() requires a UInt8Array argument");
+        return NULL_VAL;
+    }
+    REQUIRE_MUTABLE(1);
+
+    xen_obj_u8array* target = OBJ_AS_U8ARRAY(argv[1]);
+    i64 offset              = argc > 2 && VAL_IS_NUMBER(argv[2]) ? VAL_AS_INTEGER(argv[2]) : 0;
+    if (offset < 0 || offset > target->count) {
+        xen_runtime_error("[TcpStream] read_into() offset %lld is outside the buffer (length %d)", (long long)offset,
+          target->count);
+        return NULL_VAL;
+    }
+
+    i64 max_bytes = target->count - offset;
+    if (argc > 3 && VAL_IS_NUMBER(argv[3]) && VAL_AS_INTEGER(argv[3]) < max_bytes) {
+        max_bytes = VAL_AS_INTEGER(argv[3]);
+    }
+    if (max_bytes <= 0) {
+        // returning 0 would read as "no data yet" and keep a retry loop spinning on a range that can never fill
+        xen_runtime_error("[TcpStream] read_into() has no room to read into (offset %lld, max_bytes %lld, length %d)",
+          (long long)offset, (long long)max_bytes, target->count);
+        return NULL_VAL;
+    }
+
+    ssize_t bytes_read = socket_read(fd, target->values + offset, (size_t)max_bytes);
+
+    if (bytes_read < 0) {
+        if (SOCKET_WOULD_BLOCK)
+            return INT_VAL(0);
+        if (SOCKET_CONNECTION_LOST)
+            return NULL_VAL;
+        xen_runtime_error("[TcpStream] read_into() failed: %s", get_socket_error());
+        return NULL_VAL;
+    }
+
+    if (bytes_read == 0) {
+        return NULL_VAL;
+    }
+
+    return INT_VAL(bytes_read);
+}
+
 // Method: write(data) -> returns number of bytes written or -1 on error
 static xen_value tcp_stream_write(i32 argc, array(xen_value) argv) {
     if (argc < 2 || !OBJ_IS_INSTANCE(argv[0])) {
-        return NUMBER_VAL(-1);
+        return INT_VAL(-1);
     }
 
     xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
-    socket_t fd            = (socket_t)VAL_AS_NUMBER(self->fields[0]);
+    socket_t fd            = (socket_t)VAL_AS_INTEGER(self->fields[0]);
 
     if (fd == INVALID_SOCKET_FD) {
         xen_runtime_error("[TcpStream] Socket is closed");
-        return NUMBER_VAL(-1);
+        return INT_VAL(-1);
     }
 
     if (!OBJ_IS_STRING(argv[1])) {
         xen_runtime_error("[TcpStream] write() requires a string argument");
-        return NUMBER_VAL(-1);
+        return INT_VAL(-1);
     }
 
     xen_obj_str* data = OBJ_AS_STRING(argv[1]);
     i32 decoded_size;
     const char* data_decoded = xen_decode_string_literal(data->str, data->length, &decoded_size);
     ssize_t bytes_written    = socket_write(fd, data_decoded, decoded_size);
+    XEN_FREE_ARRAY(char, (char*)data_decoded, data->length + 1);
 
     if (bytes_written < 0) {
+        // non-blocking socket with a full send buffer
+        if (SOCKET_WOULD_BLOCK)
+            return INT_VAL(0);
         xen_runtime_error("[TcpStream] write() failed: %s", get_socket_error());
-        return NUMBER_VAL(-1);
+        return INT_VAL(-1);
     }
 
-    return NUMBER_VAL((double)bytes_written);
+    return INT_VAL(bytes_written);
 }
 
 // Method: send(data) -> alias for write(), returns number of bytes sent
 static xen_value tcp_stream_send(i32 argc, array(xen_value) argv) {
     if (argc < 2 || !OBJ_IS_INSTANCE(argv[0])) {
-        return NUMBER_VAL(-1);
+        return INT_VAL(-1);
     }
 
     xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
-    socket_t fd            = (socket_t)VAL_AS_NUMBER(self->fields[0]);
+    socket_t fd            = (socket_t)VAL_AS_INTEGER(self->fields[0]);
 
     if (fd == INVALID_SOCKET_FD) {
         xen_runtime_error("[TcpStream] Socket is closed");
-        return NUMBER_VAL(-1);
+        return INT_VAL(-1);
     }
 
     if (!OBJ_IS_STRING(argv[1])) {
         xen_runtime_error("[TcpStream] send() requires a string argument");
-        return NUMBER_VAL(-1);
+        return INT_VAL(-1);
     }
 
     xen_obj_str* data = OBJ_AS_STRING(argv[1]);
@@ -220,13 +396,143 @@ static xen_value tcp_stream_send(i32 argc, array(xen_value) argv) {
 #else
     ssize_t bytes_sent = send(fd, data_decoded, decoded_size, 0);
 #endif
+    XEN_FREE_ARRAY(char, (char*)data_decoded, data->length + 1);
 
     if (bytes_sent < 0) {
+        if (SOCKET_WOULD_BLOCK)
+            return INT_VAL(0);
         xen_runtime_error("[TcpStream] send() failed: %s", get_socket_error());
-        return NUMBER_VAL(-1);
+        return INT_VAL(-1);
+    }
+
+    return INT_VAL(bytes_sent);
+}
+
+// Method: writev(parts) -> sends an array of strings (or the strings passed as arguments) with a single gathered
+// write, returns number of bytes written or -1 on error
+static xen_value tcp_stream_writev(i32 argc, array(xen_value) argv) {
+    if (argc < 2 || !OBJ_IS_INSTANCE(argv[0])) {
+        return INT_VAL(-1);
+    }
+
+    xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
+    socket_t fd            = (socket_t)VAL_AS_INTEGER(self->fields[0]);
+
+    if (fd == INVALID_SOCKET_FD) {
+        xen_runtime_error("[TcpStream] Socket is closed");
+        return INT_VAL(-1);
+    }
+
+    xen_value* parts = argv + 1;
+    i32 part_count   = argc - 1;
+    if (OBJ_IS_ARRAY(argv[1])) {
+        parts      = OBJ_AS_ARRAY(argv[1])->array.values;
+        part_count = (i32)OBJ_AS_ARRAY(argv[1])->array.count;
+    }
+    if (part_count > XEN_NET_WRITEV_MAX) {
+        xen_runtime_error("[TcpStream] writev() takes at most %d parts (got %d)", XEN_NET_WRITEV_MAX, part_count);
+        return INT_VAL(-1);
+    }
+    for (i32 i = 0; i < part_count; i++) {
+        if (!OBJ_IS_STRING(parts[i])) {
+            xen_runtime_error("[TcpStream] writev() parts must be strings (got '%s')", xen_value_type_to_str(parts[i]));
+            return INT_VAL(-1);
+        }
     }
 
-    return NUMBER_VAL((double)bytes_sent);
+    char* decoded[XEN_NET_WRITEV_MAX];
+    i32 decoded_sizes[XEN_NET_WRITEV_MAX];
+    for (i32 i = 0; i < part_count; i++) {
+        xen_obj_str* part = OBJ_AS_STRING(parts[i]);
+        decoded[i]        = xen_decode_string_literal(part->str, part->length, &decoded_sizes[i]);
+    }
+
+    ssize_t bytes_sent = xen_net_writev(fd, (const char**)decoded, decoded_sizes, part_count);
+    for (i32 i = 0; i < part_count; i++) {
+        XEN_FREE_ARRAY(char, decoded[i], OBJ_AS_STRING(parts[i])->length + 1);
+    }
+
+    if (bytes_sent < 0) {
+        if (SOCKET_WOULD_BLOCK)
+            return INT_VAL(0);
+        xen_runtime_error("[TcpStream] writev() failed: %s", get_socket_error());
+        return INT_VAL(-1);
+    }
+
+    return INT_VAL(bytes_sent);
+}
+
+// Method: send_file(path, offset = 0, length = rest of file, header = null) -> sends the header followed by part of a
+// file without copying the file through the VM, returns number of bytes sent (header included) or -1 on error
+static xen_value tcp_stream_send_file(i32 argc, array(xen_value) argv) {
+    if (argc < 2 || !OBJ_IS_INSTANCE(argv[0])) {
+        return INT_VAL(-1);
+    }
+
+    xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
+    socket_t fd            = (socket_t)VAL_AS_INTEGER(self->fields[0]);
+
+    if (fd == INVALID_SOCKET_FD) {
+        xen_runtime_error("[TcpStream] Socket is closed");
+        return INT_VAL(-1);
+    }
+
+    if (!OBJ_IS_STRING(argv[1])) {
+        xen_runtime_error("[TcpStream] send_file() requires a path");
+        return INT_VAL(-1);
+    }
+    if (argc > 4 && !VAL_IS_NULL(argv[4]) && !OBJ_IS_STRING(argv[4])) {
+        xen_runtime_error("[TcpStream] send_file() header must be a string");
+        return INT_VAL(-1);
+    }
+
+    FILE* file = fopen(OBJ_AS_CSTRING(argv[1]), "rb");
+    if (!file) {
+        xen_runtime_error("[TcpStream] send_file() failed to open file: %s", OBJ_AS_CSTRING(argv[1]));
+        return INT_VAL(-1);
+    }
+    fseek(file, 0, SEEK_END);
+    const i64 file_size = (i64)ftell(file);
+
+    i64 offset = argc > 2 && VAL_IS_NUMBER(argv[2]) ? VAL_AS_INTEGER(argv[2]) : 0;
+    if (offset < 0 || offset > file_size)
+        offset = file_size;
+    i64 length = argc > 3 && VAL_IS_NUMBER(argv[3]) ? VAL_AS_INTEGER(argv[3]) : -1;
+    if (length < 0 || length > file_size - offset)
+        length = file_size - offset;
+
+    i64 header_sent = 0;
+    if (argc > 4 && OBJ_IS_STRING(argv[4])) {
+        xen_obj_str* header = OBJ_AS_STRING(argv[4]);
+        i32 decoded_size;
+        char* decoded = xen_decode_string_literal(header->str, header->length, &decoded_size);
+#ifdef PLATFORM_LINUX
+        // held back until the file data follows, so small responses still leave in one segment
+        header_sent = send(fd, decoded, decoded_size, length > 0 ? MSG_MORE : 0);
+#else
+        header_sent = socket_write(fd, decoded, decoded_size);
+#endif
+        XEN_FREE_ARRAY(char, decoded, header->length + 1);
+
+        if (header_sent < 0 || header_sent < decoded_size) {
+            fclose(file);
+            if (header_sent < 0 && !SOCKET_WOULD_BLOCK) {
+                xen_runtime_error("[TcpStream] send_file() failed: %s", get_socket_error());
+                return INT_VAL(-1);
+            }
+            return INT_VAL(header_sent < 0 ? 0 : header_sent);
+        }
+    }
+
+    const i64 body_sent = socket_send_file(fd, file, offset, length);
+    fclose(file);
+
+    if (body_sent < 0) {
+        xen_runtime_error("[TcpStream] send_file() failed: %s", get_socket_error());
+        return INT_VAL(header_sent > 0 ? header_sent : -1);
+    }
+
+    return INT_VAL(header_sent + body_sent);
 }
 
 // Method: recv(max_bytes = 4096) -> alias for read()
@@ -236,7 +542,7 @@ static xen_value tcp_stream_recv(i32 argc, array(xen_value) argv) {
     }
 
     xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
-    socket_t fd            = (socket_t)VAL_AS_NUMBER(self->fields[0]);
+    socket_t fd            = (socket_t)VAL_AS_INTEGER(self->fields[0]);
 
     if (fd == INVALID_SOCKET_FD) {
         xen_runtime_error("[TcpStream] Socket is closed");
@@ -245,18 +551,14 @@ static xen_value tcp_stream_recv(i32 argc, array(xen_value) argv) {
 
     i32 max_bytes = 4096;
     if (argc > 1 && VAL_IS_NUMBER(argv[1])) {
-        max_bytes = (i32)VAL_AS_NUMBER(argv[1]);
+        max_bytes = (i32)VAL_AS_INTEGER(argv[1]);
         if (max_bytes < 1)
             max_bytes = 1;
-        if (max_bytes > 65536)
-            max_bytes = 65536;
+        if (max_bytes > (i32)XEN_BUFFER_MAX)
+            max_bytes = (i32)XEN_BUFFER_MAX;
     }
 
-    char* buffer = (char*)malloc(max_bytes);
-    if (!buffer) {
-        xen_runtime_error("[TcpStream] Failed to allocate buffer");
-        return NULL_VAL;
-    }
+    char* buffer = (char*)xen_buffer_acquire(&g_vm->buffers, max_bytes);
 
 #ifdef PLATFORM_WINDOWS
     ssize_t bytes_recv = recv(fd, buffer, max_bytes, 0);
@@ -265,18 +567,22 @@ static xen_value tcp_stream_recv(i32 argc, array(xen_value) argv) {
 #endif
 
     if (bytes_recv < 0) {
-        free(buffer);
+        xen_buffer_release(&g_vm->buffers, buffer, max_bytes);
+        if (SOCKET_WOULD_BLOCK)
+            return EMPTY_STRING_VAL;
+        if (SOCKET_CONNECTION_LOST)
+            return NULL_VAL;
         xen_runtime_error("[TcpStream] recv() failed: %s", get_socket_error());
         return NULL_VAL;
     }
 
     if (bytes_recv == 0) {
-        free(buffer);
+        xen_buffer_release(&g_vm->buffers, buffer, max_bytes);
         return NULL_VAL;
     }
 
     xen_obj_str* result = xen_obj_str_copy(buffer, (i32)bytes_recv);
-    free(buffer);
+    xen_buffer_release(&g_vm->buffers, buffer, max_bytes);
 
     return OBJ_VAL(result);
 }
@@ -288,13 +594,14 @@ static xen_value tcp_stream_close(i32 argc, array(xen_value) argv) {
     }
 
     xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
-    socket_t fd            = (socket_t)VAL_AS_NUMBER(self->fields[0]);
+    socket_t fd            = (socket_t)VAL_AS_INTEGER(self->fields[0]);
 
     if (fd != INVALID_SOCKET_FD) {
         if (CLOSE_SOCKET(fd) < 0) {
             xen_runtime_error("[TcpStream] close() failed: %s", get_socket_error());
         }
-        self->fields[0] = NUMBER_VAL((double)INVALID_SOCKET_FD);
+        event_loops_forget(fd);
+        self->fields[0] = INT_VAL(INVALID_SOCKET_FD);
     }
 
     return NULL_VAL;
@@ -307,7 +614,7 @@ static xen_value tcp_stream_shutdown(i32 argc, array(xen_value) argv) {
     }
 
     xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
-    socket_t fd            = (socket_t)VAL_AS_NUMBER(self->fields[0]);
+    socket_t fd            = (socket_t)VAL_AS_INTEGER(self->fields[0]);
 
     if (fd == INVALID_SOCKET_FD) {
         xen_runtime_error("[TcpStream] Socket is closed");
@@ -316,7 +623,7 @@ static xen_value tcp_stream_shutdown(i32 argc, array(xen_value) argv) {
 
     int how = SHUTDOWN_BOTH;  // Default: shutdown both read and write
     if (argc > 1 && VAL_IS_NUMBER(argv[1])) {
-        i32 how_arg = (i32)VAL_AS_NUMBER(argv[1]);
+        i32 how_arg = (i32)VAL_AS_INTEGER(argv[1]);
         if (how_arg == 0)
             how = SHUTDOWN_READ;
         else if (how_arg == 1)
@@ -333,28 +640,37 @@ static xen_value tcp_stream_shutdown(i32 argc, array(xen_value) argv) {
     return BOOL_VAL(XEN_TRUE);
 }
 
+// Method: set_nonblocking(enabled = true). read()/recv() then return "" and write()/send() 0 instead of blocking.
+static xen_value tcp_stream_set_nonblocking(i32 argc, array(xen_value) argv) {
+    return socket_set_nonblocking(argc, argv, 0);
+}
+
 static xen_obj_class* create_tcp_stream_class() {
     xen_obj_str* name    = xen_obj_str_copy("TcpStream", 9);
     xen_obj_class* class = xen_obj_class_new(name);
 
     // Properties: _fd, remote_addr, remote_port
     xen_obj_str* fd_name = xen_obj_str_copy("_fd", 3);
-    xen_obj_class_add_property(class, fd_name, NUMBER_VAL((double)INVALID_SOCKET_FD), XEN_TRUE);
+    xen_obj_class_add_property(class, fd_name, INT_VAL(INVALID_SOCKET_FD), XEN_TRUE);
 
     xen_obj_str* addr_name = xen_obj_str_copy("remote_addr", 11);
     xen_obj_class_add_property(class, addr_name, NULL_VAL, XEN_FALSE);
 
     xen_obj_str* port_name = xen_obj_str_copy("remote_port", 11);
-    xen_obj_class_add_property(class, port_name, NUMBER_VAL(0), XEN_FALSE);
+    xen_obj_class_add_property(class, port_name, INT_VAL(0), XEN_FALSE);
 
     xen_obj_class_set_native_init(class, tcp_stream_init);
 
     xen_obj_class_add_native_method(class, "read", tcp_stream_read, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "read_into", tcp_stream_read_into, XEN_FALSE);
     xen_obj_class_add_native_method(class, "write", tcp_stream_write, XEN_FALSE);
     xen_obj_class_add_native_method(class, "send", tcp_stream_send, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "writev", tcp_stream_writev, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "send_file", tcp_stream_send_file, XEN_FALSE);
     xen_obj_class_add_native_method(class, "recv", tcp_stream_recv, XEN_FALSE);
     xen_obj_class_add_native_method(class, "close", tcp_stream_close, XEN_FALSE);
     xen_obj_class_add_native_method(class, "shutdown", tcp_stream_shutdown, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "set_nonblocking", tcp_stream_set_nonblocking, XEN_FALSE);
 
     return class;
 }
@@ -383,34 +699,32 @@ static xen_value tcp_listener_init(i32 argc, array(xen_value) argv) {
         return NULL_VAL;
     }
 
-    i32 port = (i32)VAL_AS_NUMBER(argv[1]);
+    i32 port = (i32)VAL_AS_INTEGER(argv[1]);
 
-    // Set properties (port is index 0, _socket is index 1)
-    self->fields[0] = NUMBER_VAL(port);
-    self->fields[1] = NUMBER_VAL((double)INVALID_SOCKET_FD);
+    // Set properties (port is index 0, _socket is index 1, _nonblocking is index 2)
+    self->fields[0] = INT_VAL(port);
+    self->fields[1] = INT_VAL(INVALID_SOCKET_FD);
+    self->fields[2] = BOOL_VAL(XEN_FALSE);
 
     return OBJ_VAL(self);
 }
 
-// Method: bind()
-static xen_value tcp_listener_bind(i32 argc, array(xen_value) argv) {
-    if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
-        return BOOL_VAL(XEN_FALSE);
-    }
-
-    xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
-    i32 port               = (i32)VAL_AS_NUMBER(self->fields[0]);
-    socket_t socket_fd     = (socket_t)VAL_AS_NUMBER(self->fields[1]);
+// Creates and binds the listener's socket. With `reuse_port` several sockets (usually one per worker process) can
+// bind the same port and the kernel spreads incoming connections across them. Prefork workers (xen --workers N) get
+// it by default so unmodified scripts shard their listeners.
+static bool tcp_listener_open(xen_obj_instance* self, bool reuse_port) {
+    i32 port           = (i32)VAL_AS_INTEGER(self->fields[0]);
+    socket_t socket_fd = (socket_t)VAL_AS_INTEGER(self->fields[1]);
 
     if (socket_fd != INVALID_SOCKET_FD) {
         xen_runtime_error("[TcpListener] Socket is already bound");
-        return BOOL_VAL(XEN_FALSE);
+        return XEN_FALSE;
     }
 
     socket_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (socket_fd == INVALID_SOCKET_FD) {
         xen_runtime_error("[TcpListener] Failed to create socket: %s", get_socket_error());
-        return BOOL_VAL(XEN_FALSE);
+        return XEN_FALSE;
     }
 
     // Set SO_REUSEADDR to allow quick rebinding
@@ -422,7 +736,23 @@ static xen_value tcp_listener_bind(i32 argc, array(xen_value) argv) {
 #endif
         CLOSE_SOCKET(socket_fd);
         xen_runtime_error("[TcpListener] setsockopt() failed: %s", get_socket_error());
-        return BOOL_VAL(XEN_FALSE);
+        return XEN_FALSE;
+    }
+
+    if (reuse_port || getenv(XEN_WORKER_ID_ENV) != NULL) {
+#ifdef SO_REUSEPORT
+        if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+            CLOSE_SOCKET(socket_fd);
+            xen_runtime_error("[TcpListener] setsockopt(SO_REUSEPORT) failed: %s", get_socket_error());
+            return XEN_FALSE;
+        }
+#else
+        if (reuse_port) {
+            CLOSE_SOCKET(socket_fd);
+            xen_runtime_error("[TcpListener] reuse_port is not supported on this platform");
+            return XEN_FALSE;
+        }
+#endif
     }
 
     struct sockaddr_in address;
@@ -434,13 +764,23 @@ static xen_value tcp_listener_bind(i32 argc, array(xen_value) argv) {
     if (bind(socket_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
         CLOSE_SOCKET(socket_fd);
         xen_runtime_error("[TcpListener] bind() failed on port %d: %s", port, get_socket_error());
-        return BOOL_VAL(XEN_FALSE);
+        return XEN_FALSE;
     }
 
     printf("[TcpListener] Binding to port %d\n", port);
-    self->fields[1] = NUMBER_VAL((double)socket_fd);
+    self->fields[1] = INT_VAL(socket_fd);
 
-    return BOOL_VAL(XEN_TRUE);
+    return XEN_TRUE;
+}
+
+// Method: bind(reuse_port = false)
+static xen_value tcp_listener_bind(i32 argc, array(xen_value) argv) {
+    if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
+        return BOOL_VAL(XEN_FALSE);
+    }
+
+    const bool reuse_port = argc > 1 && VAL_IS_BOOL(argv[1]) && VAL_AS_BOOL(argv[1]);
+    return BOOL_VAL(tcp_listener_open(OBJ_AS_INSTANCE(argv[0]), reuse_port));
 }
 
 // Method: listen(backlog = 5)
@@ -450,7 +790,7 @@ static xen_value tcp_listener_listen(i32 argc, array(xen_value) argv) {
     }
 
     xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
-    socket_t socket_fd     = (socket_t)VAL_AS_NUMBER(self->fields[1]);
+    socket_t socket_fd     = (socket_t)VAL_AS_INTEGER(self->fields[1]);
 
     if (socket_fd == INVALID_SOCKET_FD) {
         xen_runtime_error("[TcpListener] Socket not bound - call bind() first");
@@ -459,7 +799,7 @@ static xen_value tcp_listener_listen(i32 argc, array(xen_value) argv) {
 
     i32 backlog = 5;
     if (argc > 1 && VAL_IS_NUMBER(argv[1])) {
-        backlog = (i32)VAL_AS_NUMBER(argv[1]);
+        backlog = (i32)VAL_AS_INTEGER(argv[1]);
         if (backlog < 1)
             backlog = 1;
     }
@@ -473,61 +813,22 @@ static xen_value tcp_listener_listen(i32 argc, array(xen_value) argv) {
     return BOOL_VAL(XEN_TRUE);
 }
 
+// Method: bind_and_listen(backlog = 5, reuse_port = false)
 static xen_value tcp_listener_bind_and_listen(i32 argc, array(xen_value) argv) {
     if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
         return NULL_VAL;
     }
 
     xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
-    i32 port               = (i32)VAL_AS_NUMBER(self->fields[0]);
-    socket_t socket_fd     = (socket_t)VAL_AS_NUMBER(self->fields[1]);
-
-    if (socket_fd != INVALID_SOCKET_FD) {
-        xen_runtime_error("[TcpListener] Socket is already bound");
-        return BOOL_VAL(XEN_FALSE);
-    }
-
-    socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_fd == INVALID_SOCKET_FD) {
-        xen_runtime_error("[TcpListener] Failed to create socket: %s", get_socket_error());
-        return BOOL_VAL(XEN_FALSE);
-    }
-
-    // Set SO_REUSEADDR to allow quick rebinding
-    int opt = 1;
-#ifdef PLATFORM_WINDOWS
-    if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, (const char*)&opt, sizeof(opt)) < 0) {
-#else
-    if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-#endif
-        CLOSE_SOCKET(socket_fd);
-        xen_runtime_error("[TcpListener] setsockopt() failed: %s", get_socket_error());
-        return BOOL_VAL(XEN_FALSE);
-    }
-
-    struct sockaddr_in address;
-    memset(&address, 0, sizeof(address));
-    address.sin_family      = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port        = htons((u16)port);
-
-    if (bind(socket_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
-        CLOSE_SOCKET(socket_fd);
-        xen_runtime_error("[TcpListener] bind() failed on port %d: %s", port, get_socket_error());
-        return BOOL_VAL(XEN_FALSE);
-    }
-
-    printf("[TcpListener] Binding to port %d\n", port);
-    self->fields[1] = NUMBER_VAL((double)socket_fd);
-
-    if (socket_fd == INVALID_SOCKET_FD) {
-        xen_runtime_error("[TcpListener] Socket not bound - call bind() first");
+    const bool reuse_port  = argc > 2 && VAL_IS_BOOL(argv[2]) && VAL_AS_BOOL(argv[2]);
+    if (!tcp_listener_open(self, reuse_port)) {
         return BOOL_VAL(XEN_FALSE);
     }
+    socket_t socket_fd = (socket_t)VAL_AS_INTEGER(self->fields[1]);
 
     i32 backlog = 5;
     if (argc > 1 && VAL_IS_NUMBER(argv[1])) {
-        backlog = (i32)VAL_AS_NUMBER(argv[1]);
+        backlog = (i32)VAL_AS_INTEGER(argv[1]);
         if (backlog < 1)
             backlog = 1;
     }
@@ -541,6 +842,29 @@ static xen_value tcp_listener_bind_and_listen(i32 argc, array(xen_value) argv) {
     return BOOL_VAL(XEN_TRUE);
 }
 
+xen_value xen_net_stream_new(socket_t fd, const struct sockaddr_in* remote) {
+    char addr_str[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &remote->sin_addr, addr_str, INET_ADDRSTRLEN);
+
+    // Initialize the stream with fd, remote_addr, remote_port
+    xen_obj_instance* stream = xen_obj_instance_new(g_tcp_stream_class);
+    stream->fields[0]        = INT_VAL(fd);
+    stream->fields[1]        = OBJ_VAL(xen_obj_str_copy(addr_str, strlen(addr_str)));
+    stream->fields[2]        = INT_VAL(ntohs(remote->sin_port));
+    return OBJ_VAL(stream);
+}
+
+socket_t xen_net_socket_fd(xen_value socket) {
+    if (!OBJ_IS_INSTANCE(socket))
+        return INVALID_SOCKET_FD;
+    xen_obj_instance* instance = OBJ_AS_INSTANCE(socket);
+    if (instance->class == g_tcp_stream_class)
+        return (socket_t)VAL_AS_INTEGER(instance->fields[0]);
+    if (instance->class == g_tcp_listener_class)
+        return (socket_t)VAL_AS_INTEGER(instance->fields[1]);
+    return INVALID_SOCKET_FD;
+}
+
 // Method: accept() -> returns TcpStream instance
 static xen_value tcp_listener_accept(i32 argc, array(xen_value) argv) {
     if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
@@ -548,7 +872,7 @@ static xen_value tcp_listener_accept(i32 argc, array(xen_value) argv) {
     }
 
     xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
-    socket_t socket_fd     = (socket_t)VAL_AS_NUMBER(self->fields[1]);
+    socket_t socket_fd     = (socket_t)VAL_AS_INTEGER(self->fields[1]);
 
     if (socket_fd == INVALID_SOCKET_FD) {
         xen_runtime_error("[TcpListener] Socket not bound - call bind() and listen() first");
@@ -565,30 +889,21 @@ static xen_value tcp_listener_accept(i32 argc, array(xen_value) argv) {
     socket_t client_fd = accept(socket_fd, (struct sockaddr*)&client_addr, &addr_len);
 
     if (client_fd == INVALID_SOCKET_FD) {
+        // non-blocking listener with no pending connection
+        if (SOCKET_WOULD_BLOCK)
+            return NULL_VAL;
         xen_runtime_error("[TcpListener] accept() failed: %s", get_socket_error());
         return NULL_VAL;
     }
 
-    // Get client address as string
-    char addr_str[INET_ADDRSTRLEN];
-#ifdef PLATFORM_WINDOWS
-    inet_ntop(AF_INET, &client_addr.sin_addr, addr_str, INET_ADDRSTRLEN);
-#else
-    inet_ntop(AF_INET, &client_addr.sin_addr, addr_str, INET_ADDRSTRLEN);
-#endif
-    xen_obj_str* remote_addr = xen_obj_str_copy(addr_str, strlen(addr_str));
-    u16 remote_port          = ntohs(client_addr.sin_port);
-
-    // Create TcpStream instance
-    xen_obj_class* tcp_stream_class = g_tcp_stream_class;
-    xen_obj_instance* stream        = xen_obj_instance_new(tcp_stream_class);
-
-    // Initialize the stream with fd, remote_addr, remote_port
-    stream->fields[0] = NUMBER_VAL((double)client_fd);
-    stream->fields[1] = OBJ_VAL(remote_addr);
-    stream->fields[2] = NUMBER_VAL(remote_port);
+    // streams accepted by a non-blocking listener are non-blocking too, so they can be handed to an EventLoop
+    if (VAL_AS_BOOL(self->fields[2]) && !set_socket_nonblocking(client_fd, XEN_TRUE)) {
+        CLOSE_SOCKET(client_fd);
+        xen_runtime_error("[TcpListener] Failed to make accepted socket non-blocking: %s", get_socket_error());
+        return NULL_VAL;
+    }
 
-    return OBJ_VAL(stream);
+    return xen_net_stream_new(client_fd, &client_addr);
 }
 
 // Method: close()
@@ -598,27 +913,40 @@ static xen_value tcp_listener_close(i32 argc, array(xen_value) argv) {
     }
 
     xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
-    socket_t fd            = (socket_t)VAL_AS_NUMBER(self->fields[1]);
+    socket_t fd            = (socket_t)VAL_AS_INTEGER(self->fields[1]);
 
     if (fd != INVALID_SOCKET_FD) {
         if (CLOSE_SOCKET(fd) < 0) {
             xen_runtime_error("[TcpListener] close() failed: %s", get_socket_error());
         }
-        self->fields[1] = NUMBER_VAL((double)INVALID_SOCKET_FD);
+        event_loops_forget(fd);
+        self->fields[1] = INT_VAL(INVALID_SOCKET_FD);
     }
 
     return NULL_VAL;
 }
 
+// Method: set_nonblocking(enabled = true). accept() then returns null when no connection is pending and hands out
+// non-blocking streams.
+static xen_value tcp_listener_set_nonblocking(i32 argc, array(xen_value) argv) {
+    xen_value result = socket_set_nonblocking(argc, argv, 1);
+    if (VAL_AS_BOOL(result))
+        OBJ_AS_INSTANCE(argv[0])->fields[2] = BOOL_VAL(argc < 2 || !VAL_IS_BOOL(argv[1]) || VAL_AS_BOOL(argv[1]));
+    return result;
+}
+
 static xen_obj_class* create_tcp_listener_class() {
     xen_obj_str* name    = xen_obj_str_copy("TcpListener", 11);
     xen_obj_class* class = xen_obj_class_new(name);
 
     xen_obj_str* port_name = xen_obj_str_copy("port", 4);
-    xen_obj_class_add_property(class, port_name, NUMBER_VAL(0), XEN_FALSE);
+    xen_obj_class_add_property(class, port_name, INT_VAL(0), XEN_FALSE);
 
     xen_obj_str* socket_name = xen_obj_str_copy("_socket", 7);
-    xen_obj_class_add_property(class, socket_name, NUMBER_VAL((double)INVALID_SOCKET_FD), XEN_TRUE);
+    xen_obj_class_add_property(class, socket_name, INT_VAL(INVALID_SOCKET_FD), XEN_TRUE);
+
+    xen_obj_str* nonblocking_name = xen_obj_str_copy("_nonblocking", 12);
+    xen_obj_class_add_property(class, nonblocking_name, BOOL_VAL(XEN_FALSE), XEN_TRUE);
 
     xen_obj_class_set_native_init(class, tcp_listener_init);
 
@@ -627,10 +955,442 @@ static xen_obj_class* create_tcp_listener_class() {
     xen_obj_class_add_native_method(class, "bind_and_listen", tcp_listener_bind_and_listen, XEN_FALSE);
     xen_obj_class_add_native_method(class, "accept", tcp_listener_accept, XEN_FALSE);
     xen_obj_class_add_native_method(class, "close", tcp_listener_close, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "set_nonblocking", tcp_listener_set_nonblocking, XEN_FALSE);
 
     return class;
 }
 
+//==============================================================//
+//                      EventLoop Class                         //
+//==============================================================//
+
+/*
+ * Readiness-based event loop (epoll, Linux only). Sockets are either watched with a callback that runs every time
+ * they become ready, or awaited from inside a fiber: wait() suspends the fiber and the loop resumes it once the socket
+ * is ready, so connection handlers can be written as plain sequential code.
+ */
+
+#ifdef PLATFORM_LINUX
+
+    #define XEN_LOOP_MAX_EVENTS 256
+
+typedef struct {
+    xen_value socket;       // TcpListener or TcpStream instance
+    xen_value callback;     // NULL_VAL unless watched
+    xen_obj_fiber* waiter;  // fiber suspended in wait(), NULL if none
+    bool registered;        // fd is in the epoll set (possibly disarmed after a one-shot wait)
+} xen_loop_watch;
+
+typedef struct {
+    xen_obj_fiber* fiber;
+    xen_value value;  // passed to resume()
+} xen_loop_task;
+
+typedef struct xen_event_loop {
+    int epoll_fd;
+    xen_loop_watch* watches;  // indexed by fd
+    i32 watch_capacity;
+    i32 active;  // watches with a callback or a waiting fiber
+    xen_loop_task* ready;
+    i32 ready_count;
+    i32 ready_capacity;
+    bool stopped;
+    struct xen_event_loop* next;
+} xen_event_loop;
+
+static XEN_THREAD_LOCAL xen_event_loop* g_event_loops = NULL;
+
+// See xen_net_set_loop_hook
+typedef struct {
+    int fd;
+    bool (*on_ready)(void* data);
+    void* data;
+} xen_loop_hook;
+
+static XEN_THREAD_LOCAL xen_loop_hook g_loop_hook = {-1, NULL, NULL};
+
+static xen_event_loop* event_loop_get(xen_value self) {
+    return (xen_event_loop*)(intptr_t)VAL_AS_INTEGER(OBJ_AS_INSTANCE(self)->fields[0]);
+}
+
+// Sockets handed to the loop are switched to non-blocking mode
+static bool socket_make_nonblocking(xen_value socket, socket_t fd) {
+    if (!set_socket_nonblocking(fd, XEN_TRUE)) {
+        xen_runtime_error("[EventLoop] Failed to make socket non-blocking: %s", get_socket_error());
+        return XEN_FALSE;
+    }
+    xen_obj_instance* instance = OBJ_AS_INSTANCE(socket);
+    if (instance->class == g_tcp_listener_class)
+        instance->fields[2] = BOOL_VAL(XEN_TRUE);
+    return XEN_TRUE;
+}
+
+static void watch_reset(xen_loop_watch* watch) {
+    watch->socket     = NULL_VAL;
+    watch->callback   = NULL_VAL;
+    watch->waiter     = NULL;
+    watch->registered = XEN_FALSE;
+}
+
+static xen_loop_watch* event_loop_watch_for(xen_event_loop* loop, socket_t fd) {
+    if (fd >= loop->watch_capacity) {
+        i32 capacity = loop->watch_capacity;
+        while (capacity <= fd)
+            capacity = XEN_GROW_CAPACITY(capacity);
+        loop->watches = XEN_GROW_ARRAY(xen_loop_watch, loop->watches, loop->watch_capacity, capacity);
+        for (i32 i = loop->watch_capacity; i < capacity; i++)
+            watch_reset(&loop->watches[i]);
+        loop->watch_capacity = capacity;
+    }
+    return &loop->watches[fd];
+}
+
+static u32 to_epoll_events(i64 flags) {
+    u32 events = 0;
+    if (flags & XEN_NET_READABLE)
+        events |= EPOLLIN | EPOLLRDHUP;
+    if (flags & XEN_NET_WRITABLE)
+        events |= EPOLLOUT;
+    return events;
+}
+
+static i64 from_epoll_events(u32 events) {
+    i64 flags = 0;
+    // errors and hang-ups are reported as readable, the following read() returns null
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        flags |= XEN_NET_READABLE;
+    if (events & EPOLLOUT)
+        flags |= XEN_NET_WRITABLE;
+    return flags;
+}
+
+static bool event_loop_arm(xen_event_loop* loop, xen_loop_watch* watch, socket_t fd, u32 events) {
+    struct epoll_event ev;
+    ev.events  = events;
+    ev.data.fd = fd;
+
+    // the fd may have been closed and reused behind our back, so fall back between ADD and MOD
+    int op = watch->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(loop->epoll_fd, op, fd, &ev) < 0) {
+        op = (errno == ENOENT) ? EPOLL_CTL_ADD : (errno == EEXIST ? EPOLL_CTL_MOD : -1);
+        if (op < 0 || epoll_ctl(loop->epoll_fd, op, fd, &ev) < 0) {
+            xen_runtime_error("[EventLoop] epoll_ctl() failed: %s", get_socket_error());
+            return XEN_FALSE;
+        }
+    }
+    watch->registered = XEN_TRUE;
+    return XEN_TRUE;
+}
+
+static void event_loop_schedule(xen_event_loop* loop, xen_obj_fiber* fiber, xen_value value) {
+    if (loop->ready_count == loop->ready_capacity) {
+        const i32 capacity   = XEN_GROW_CAPACITY(loop->ready_capacity);
+        loop->ready          = XEN_GROW_ARRAY(xen_loop_task, loop->ready, loop->ready_capacity, capacity);
+        loop->ready_capacity = capacity;
+    }
+    loop->ready[loop->ready_count++] = (xen_loop_task) {fiber, value};
+}
+
+// Called when a socket is closed: epoll drops the fd by itself, the loops forget it before the number is reused.
+// A fiber still waiting on it is resumed with no readiness flags.
+static void event_loops_forget(socket_t fd) {
+    for (xen_event_loop* loop = g_event_loops; loop != NULL; loop = loop->next) {
+        if (fd >= loop->watch_capacity)
+            continue;
+        xen_loop_watch* watch = &loop->watches[fd];
+        if (watch->waiter != NULL) {
+            event_loop_schedule(loop, watch->waiter, INT_VAL(0));
+        }
+        if (watch->waiter != NULL || !VAL_IS_NULL(watch->callback)) {
+            loop->active--;
+        }
+        watch_reset(watch);
+    }
+}
+
+static void loop_hook_add(xen_event_loop* loop, int fd) {
+    struct epoll_event ev;
+    ev.events  = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+void xen_net_set_loop_hook(int fd, bool (*on_ready)(void* data), void* data) {
+    for (xen_event_loop* loop = g_event_loops; loop != NULL; loop = loop->next) {
+        if (g_loop_hook.fd >= 0)
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, g_loop_hook.fd, NULL);
+        if (fd >= 0)
+            loop_hook_add(loop, fd);
+    }
+    g_loop_hook = (xen_loop_hook) {fd, on_ready, data};
+}
+
+// Native initializer: init()
+static xen_value event_loop_init(i32 argc, array(xen_value) argv) {
+    xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        xen_runtime_error("[EventLoop] epoll_create1() failed: %s", get_socket_error());
+        return NULL_VAL;
+    }
+
+    xen_event_loop* loop = XEN_ALLOCATE(xen_event_loop, 1);
+    memset(loop, 0, sizeof(xen_event_loop));
+    loop->epoll_fd = epoll_fd;
+    loop->next     = g_event_loops;
+    g_event_loops  = loop;
+    if (g_loop_hook.fd >= 0)
+        loop_hook_add(loop, g_loop_hook.fd);
+
+    self->fields[0] = INT_VAL((i64)(intptr_t)loop);
+    return OBJ_VAL(self);
+}
+
+// Method: watch(socket, events, callback) -> callback(socket, events) runs whenever the socket is ready
+static xen_value event_loop_watch(i32 argc, array(xen_value) argv) {
+    if (argc < 4 || !OBJ_IS_INSTANCE(argv[0]) || !VAL_IS_INT(argv[2])) {
+        xen_runtime_error("[EventLoop] watch() expects a socket, readiness flags and a callback");
+        return BOOL_VAL(XEN_FALSE);
+    }
+
+    xen_event_loop* loop = event_loop_get(argv[0]);
+    socket_t fd          = xen_net_socket_fd(argv[1]);
+    if (fd == INVALID_SOCKET_FD) {
+        xen_runtime_error("[EventLoop] watch() requires an open TcpListener or TcpStream");
+        return BOOL_VAL(XEN_FALSE);
+    }
+
+    xen_loop_watch* watch = event_loop_watch_for(loop, fd);
+    if (watch->waiter != NULL) {
+        xen_runtime_error("[EventLoop] a fiber is already waiting on this socket");
+        return BOOL_VAL(XEN_FALSE);
+    }
+    if (!socket_make_nonblocking(argv[1], fd) ||
+        !event_loop_arm(loop, watch, fd, to_epoll_events(VAL_AS_INT(argv[2])))) {
+        return BOOL_VAL(XEN_FALSE);
+    }
+
+    if (VAL_IS_NULL(watch->callback))
+        loop->active++;
+    watch->socket   = argv[1];
+    watch->callback = argv[3];
+    return BOOL_VAL(XEN_TRUE);
+}
+
+// Method: unwatch(socket)
+static xen_value event_loop_unwatch(i32 argc, array(xen_value) argv) {
+    if (argc < 2 || !OBJ_IS_INSTANCE(argv[0])) {
+        return BOOL_VAL(XEN_FALSE);
+    }
+
+    xen_event_loop* loop = event_loop_get(argv[0]);
+    socket_t fd          = xen_net_socket_fd(argv[1]);
+    if (fd == INVALID_SOCKET_FD || fd >= loop->watch_capacity || VAL_IS_NULL(loop->watches[fd].callback)) {
+        return BOOL_VAL(XEN_FALSE);
+    }
+
+    xen_loop_watch* watch = &loop->watches[fd];
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    watch_reset(watch);
+    loop->active--;
+    return BOOL_VAL(XEN_TRUE);
+}
+
+// Method: wait(socket, events) -> suspends the running fiber until the socket is ready, returns the ready flags
+static xen_value event_loop_wait(i32 argc, array(xen_value) argv) {
+    if (argc < 3 || !OBJ_IS_INSTANCE(argv[0]) || !VAL_IS_INT(argv[2])) {
+        xen_runtime_error("[EventLoop] wait() expects a socket and readiness flags");
+        return NULL_VAL;
+    }
+
+    xen_event_loop* loop = event_loop_get(argv[0]);
+    socket_t fd          = xen_net_socket_fd(argv[1]);
+    if (fd == INVALID_SOCKET_FD) {
+        xen_runtime_error("[EventLoop] wait() requires an open TcpListener or TcpStream");
+        return NULL_VAL;
+    }
+
+    xen_loop_watch* watch = event_loop_watch_for(loop, fd);
+    if (watch->waiter != NULL || !VAL_IS_NULL(watch->callback)) {
+        xen_runtime_error("[EventLoop] socket is already watched or waited on");
+        return NULL_VAL;
+    }
+
+    xen_obj_fiber* fiber = g_vm->fiber;
+    if (!xen_vm_yield(NULL_VAL)) {
+        return NULL_VAL;
+    }
+
+    // one-shot: the fd is disarmed once it fires and re-armed by the next wait()
+    if (!socket_make_nonblocking(argv[1], fd) ||
+        !event_loop_arm(loop, watch, fd, to_epoll_events(VAL_AS_INT(argv[2])) | EPOLLONESHOT)) {
+        g_vm->switch_pending = XEN_FALSE;
+        fiber->state         = FIBER_RUNNING;
+        return NULL_VAL;
+    }
+
+    watch->socket = argv[1];
+    watch->waiter = fiber;
+    loop->active++;
+    return NULL_VAL;  // replaced by the ready flags when the loop resumes the fiber
+}
+
+// Method: spawn(fn, arg = null) -> runs fn(arg) in a new fiber on the next loop iteration, returns the fiber
+static xen_value event_loop_spawn(i32 argc, array(xen_value) argv) {
+    if (argc < 2 || !OBJ_IS_INSTANCE(argv[0])) {
+        xen_runtime_error("[EventLoop] spawn() expects a function");
+        return NULL_VAL;
+    }
+
+    xen_value fiber = xen_builtin_fiber_ctor(1, &argv[1]);
+    if (VAL_IS_NULL(fiber)) {
+        return NULL_VAL;
+    }
+
+    event_loop_schedule(event_loop_get(argv[0]), OBJ_AS_FIBER(fiber), argc > 2 ? argv[2] : NULL_VAL);
+    return fiber;
+}
+
+// Resumes spawned fibers and dispatches one batch of readiness events. Returns false if a callback or fiber raised a
+// runtime error, in which case the script is already being aborted.
+static bool event_loop_poll(xen_event_loop* loop, i32 timeout_ms, i32* dispatched) {
+    // fibers scheduled while these run wait for the next iteration
+    const i32 ready_count = loop->ready_count;
+    for (i32 i = 0; i < ready_count; i++) {
+        xen_loop_task task = loop->ready[i];
+        xen_value result;
+        if (task.fiber->state != FIBER_NEW && task.fiber->state != FIBER_SUSPENDED)
+            continue;
+        if (!xen_vm_resume(task.fiber, task.value, &result))
+            return XEN_FALSE;
+        (*dispatched)++;
+    }
+    if (loop->ready_count > ready_count)
+        memmove(loop->ready, loop->ready + ready_count, sizeof(xen_loop_task) * (loop->ready_count - ready_count));
+    loop->ready_count -= ready_count;
+
+    if (loop->ready_count > 0 || loop->stopped)
+        timeout_ms = 0;
+    if (loop->active == 0 && loop->ready_count == 0)
+        return XEN_TRUE;
+
+    struct epoll_event events[XEN_LOOP_MAX_EVENTS];
+    const int count = epoll_wait(loop->epoll_fd, events, XEN_LOOP_MAX_EVENTS, timeout_ms);
+    if (count < 0 && errno != EINTR) {
+        xen_runtime_error("[EventLoop] epoll_wait() failed: %s", get_socket_error());
+        return XEN_TRUE;
+    }
+
+    for (i32 i = 0; i < count; i++) {
+        const socket_t fd     = events[i].data.fd;
+        const xen_value flags = INT_VAL(from_epoll_events(events[i].events));
+        if (fd == g_loop_hook.fd) {
+            if (!g_loop_hook.on_ready(g_loop_hook.data))
+                return XEN_FALSE;
+            continue;
+        }
+        if (fd >= loop->watch_capacity)
+            continue;
+
+        // watches may move while scripts run, so nothing is kept across the calls below
+        xen_loop_watch* watch = &loop->watches[fd];
+        if (watch->waiter != NULL) {
+            xen_obj_fiber* waiter = watch->waiter;
+            watch->waiter         = NULL;
+            loop->active--;
+            xen_value result;
+            if (waiter->state == FIBER_SUSPENDED && !xen_vm_resume(waiter, flags, &result))
+                return XEN_FALSE;
+        } else if (!VAL_IS_NULL(watch->callback)) {
+            xen_value args[2] = {watch->socket, flags};
+            xen_value result;
+            if (!xen_vm_call(watch->callback, 2, args, &result))
+                return XEN_FALSE;
+        }
+        (*dispatched)++;
+    }
+    return XEN_TRUE;
+}
+
+// Method: run_once(timeout_ms = -1) -> number of callbacks and fibers run
+static xen_value event_loop_run_once(i32 argc, array(xen_value) argv) {
+    if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
+        return INT_VAL(0);
+    }
+
+    i32 timeout_ms = -1;
+    if (argc > 1 && VAL_IS_NUMBER(argv[1]))
+        timeout_ms = (i32)VAL_AS_INTEGER(argv[1]);
+
+    i32 dispatched = 0;
+    event_loop_poll(event_loop_get(argv[0]), timeout_ms, &dispatched);
+    return INT_VAL(dispatched);
+}
+
+// Method: run() -> runs until stop() is called or nothing is watched, waiting or scheduled anymore
+static xen_value event_loop_run(i32 argc, array(xen_value) argv) {
+    if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
+        return NULL_VAL;
+    }
+
+    xen_event_loop* loop = event_loop_get(argv[0]);
+    loop->stopped        = XEN_FALSE;
+    while (!loop->stopped && (loop->active > 0 || loop->ready_count > 0)) {
+        i32 dispatched = 0;
+        if (!event_loop_poll(loop, -1, &dispatched))
+            break;
+    }
+    return NULL_VAL;
+}
+
+// Method: stop() -> makes run() return after the current batch
+static xen_value event_loop_stop(i32 argc, array(xen_value) argv) {
+    if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
+        return NULL_VAL;
+    }
+    event_loop_get(argv[0])->stopped = XEN_TRUE;
+    return NULL_VAL;
+}
+
+// Method: pending() -> sockets watched or waited on plus fibers scheduled to run
+static xen_value event_loop_pending(i32 argc, array(xen_value) argv) {
+    if (argc < 1 || !OBJ_IS_INSTANCE(argv[0])) {
+        return INT_VAL(0);
+    }
+    xen_event_loop* loop = event_loop_get(argv[0]);
+    return INT_VAL(loop->active + loop->ready_count);
+}
+
+static xen_obj_class* create_event_loop_class() {
+    xen_obj_str* name    = xen_obj_str_copy("EventLoop", 9);
+    xen_obj_class* class = xen_obj_class_new(name);
+
+    xen_obj_str* loop_name = xen_obj_str_copy("_loop", 5);
+    xen_obj_class_add_property(class, loop_name, INT_VAL(0), XEN_TRUE);
+
+    xen_obj_class_set_native_init(class, event_loop_init);
+
+    xen_obj_class_add_native_method(class, "watch", event_loop_watch, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "unwatch", event_loop_unwatch, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "wait", event_loop_wait, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "spawn", event_loop_spawn, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "run", event_loop_run, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "run_once", event_loop_run_once, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "stop", event_loop_stop, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "pending", event_loop_pending, XEN_FALSE);
+
+    return class;
+}
+
+#else
+
+static void event_loops_forget(socket_t fd) {}
+
+void xen_net_set_loop_hook(int fd, bool (*on_ready)(void* data), void* data) {}
+
+#endif
+
 //==============================================================//
 //                    Register Namespace                        //
 //==============================================================//
@@ -638,10 +1398,16 @@ static xen_obj_class* create_tcp_listener_class() {
 xen_obj_namespace* xen_builtin_net() {
     xen_obj_namespace* net = xen_obj_namespace_new("net");
 
-    g_tcp_stream_class = create_tcp_stream_class();
+    g_tcp_stream_class   = create_tcp_stream_class();
+    g_tcp_listener_class = create_tcp_listener_class();
 
-    xen_obj_namespace_set(net, "TcpListener", OBJ_VAL(create_tcp_listener_class()));
-    xen_obj_namespace_set(net, "TcpStream", OBJ_VAL(create_tcp_stream_class()));
+    xen_obj_namespace_set(net, "TcpListener", OBJ_VAL(g_tcp_listener_class));
+    xen_obj_namespace_set(net, "TcpStream", OBJ_VAL(g_tcp_stream_class));
+#ifdef PLATFORM_LINUX
+    xen_obj_namespace_set(net, "EventLoop", OBJ_VAL(create_event_loop_class()));
+#endif
+    xen_obj_namespace_set(net, "READABLE", INT_VAL(XEN_NET_READABLE));
+    xen_obj_namespace_set(net, "WRITABLE", INT_VAL(XEN_NET_WRITABLE));
 
     return net;
 }
@@ -26,6 +26,8 @@ typedef SOCKET socket_t;
     #define SHUTDOWN_READ SD_RECEIVE
     #define SHUTDOWN_WRITE SD_SEND
     #define SHUTDOWN_BOTH SD_BOTH
+    #define SOCKET_WOULD_BLOCK (WSAGetLastError() == WSAEWOULDBLOCK)
+    #define SOCKET_CONNECTION_LOST (WSAGetLastError() == WSAECONNRESET || WSAGetLastError() == WSAECONNABORTED)
 #else
     #include <unistd.h>
     #include <sys/socket.h>
@@ -41,8 +43,33 @@ typedef int socket_t;
     #define SHUTDOWN_READ SHUT_RD
     #define SHUTDOWN_WRITE SHUT_WR
     #define SHUTDOWN_BOTH SHUT_RDWR
+    #define SOCKET_WOULD_BLOCK (errno == EAGAIN || errno == EWOULDBLOCK)
+    #define SOCKET_CONNECTION_LOST (errno == ECONNRESET || errno == EPIPE)
 #endif
 
+// Readiness flags passed to EventLoop watches and waits (net.READABLE, net.WRITABLE)
+#define XEN_NET_READABLE 1
+#define XEN_NET_WRITABLE 2
+
+// Most parts a single gathered write sends
+#define XEN_NET_WRITEV_MAX 64
+
 xen_obj_namespace* xen_builtin_net();
 
+/// @brief Wraps a connected socket in a TcpStream instance, taking ownership of `fd`.
+xen_value xen_net_stream_new(socket_t fd, const struct sockaddr_in* remote);
+
+/// @brief Returns the fd of a TcpStream or TcpListener instance, or INVALID_SOCKET_FD for anything else.
+socket_t xen_net_socket_fd(xen_value socket);
+
+/// @brief Has every EventLoop of the calling thread poll `fd` along with its sockets and call `on_ready(data)` between
+/// dispatches whenever it is readable (xen --watch uses it to reload a script while its loop runs). The fd doesn't keep
+/// a loop running. `on_ready` returns false after raising a runtime error, which aborts the loop like a failing
+/// callback. Passing -1 removes the hook. A no-op where EventLoop isn't available.
+void xen_net_set_loop_hook(int fd, bool (*on_ready)(void* data), void* data);
+
+/// @brief Sends up to XEN_NET_WRITEV_MAX buffers with one gathered write (writev/WSASend).
+/// @return bytes written, or -1 with the error left in SOCKET_ERROR_CODE.
+ssize_t xen_net_writev(socket_t fd, const char** parts, const i32* sizes, i32 count);
+
 #endif
\ No newline at end of file
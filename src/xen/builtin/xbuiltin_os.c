@@ -134,7 +134,7 @@ static xen_value os_readbytes(i32 argc, array(xen_value) argv) {
 static xen_value os_exit(i32 argc, array(xen_value) argv) {
     i32 exit_code = 0;
     if (argc > 0 && VAL_IS_NUMBER(argv[0]))
-        exit_code = (i32)VAL_AS_NUMBER(argv[0]);
+        exit_code = (i32)VAL_AS_INTEGER(argv[0]);
 
     printf("Xen was terminated with exit code %d\n", exit_code);
     exit(exit_code);
@@ -174,7 +174,7 @@ static xen_value os_exec(i32 argc, array(xen_value) argv) {
     }
 
     i32 exit_code = system(cmd_buffer);
-    return NUMBER_VAL(exit_code);
+    return INT_VAL(exit_code);
 }
 
 static i32 remove_directory(const char* path, bool recursive) {
@@ -365,9 +365,9 @@ static xen_value os_exists(i32 argc, array(xen_value) argv) {
 // fn sleep(duration) -> error: null | number (duration slept)
 static xen_value os_sleep(i32 argc, array(xen_value) argv) {
     REQUIRE_ARG("duration", 0, TYPEID_NUMBER);
-    u32 duration = (u32)VAL_AS_NUMBER(argv[0]);
+    u32 duration = (u32)VAL_AS_INTEGER(argv[0]);
     sleep(duration);
-    return NUMBER_VAL(duration);
+    return INT_VAL(duration);
 }
 
 xen_obj_namespace* xen_builtin_os() {
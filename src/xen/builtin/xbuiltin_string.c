@@ -11,7 +11,7 @@
 xen_value xen_str_len(i32 argc, array(xen_value) argv) {
     if (argc < 1 || !OBJ_IS_STRING(argv[0]))
         return NULL_VAL;
-    return NUMBER_VAL(OBJ_AS_STRING(argv[0])->length);
+    return INT_VAL(OBJ_AS_STRING(argv[0])->length);
 }
 
 xen_value xen_str_upper(i32 argc, array(xen_value) argv) {
@@ -89,8 +89,8 @@ xen_value xen_str_substr(i32 argc, array(xen_value) argv) {
         return NULL_VAL;
 
     xen_obj_str* str = OBJ_AS_STRING(argv[0]);
-    i32 start        = (i32)VAL_AS_NUMBER(argv[1]);
-    i32 len          = (argc >= 3 && VAL_IS_NUMBER(argv[2])) ? (i32)VAL_AS_NUMBER(argv[2]) : str->length - start;
+    i32 start        = (i32)VAL_AS_INTEGER(argv[1]);
+    i32 len          = (argc >= 3 && VAL_IS_NUMBER(argv[2])) ? (i32)VAL_AS_INTEGER(argv[2]) : str->length - start;
 
     if (start < 0)
         start = 0;
@@ -104,16 +104,16 @@ xen_value xen_str_substr(i32 argc, array(xen_value) argv) {
 
 xen_value xen_str_find(i32 argc, array(xen_value) argv) {
     if (argc < 2 || !OBJ_IS_STRING(argv[0]) || !OBJ_IS_STRING(argv[1]))
-        return NUMBER_VAL(-1);
+        return INT_VAL(-1);
 
     xen_obj_str* haystack = OBJ_AS_STRING(argv[0]);
     xen_obj_str* needle   = OBJ_AS_STRING(argv[1]);
 
     char* found = strstr(haystack->str, needle->str);
     if (found) {
-        return NUMBER_VAL(found - haystack->str);
+        return INT_VAL(found - haystack->str);
     }
-    return NUMBER_VAL(-1);
+    return INT_VAL(-1);
 }
 
 xen_value xen_str_split(i32 argc, array(xen_value) argv) {
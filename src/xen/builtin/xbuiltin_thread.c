@@ -0,0 +1,1607 @@
+#include "xbuiltin_thread.h"
+#include "xbuiltin_common.h"
+#include "xbuiltin_net.h"
+
+#include "../object/xobj_string.h"
+#include "../object/xobj_array.h"
+#include "../object/xobj_dict.h"
+#include "../object/xobj_u8array.h"
+#include "../object/xobj_namespace.h"
+#include "../object/xobj_native_function.h"
+#include "../object/xobj_function.h"
+#include "../object/xobj_closure.h"
+#include "../object/xobj_class.h"
+#include "../object/xobj_instance.h"
+#include "../object/xobj_error.h"
+#include "../xbytecode.h"
+#include "../xmem.h"
+#include "../xvm.h"
+
+#ifndef PLATFORM_WINDOWS
+    #include <pthread.h>
+    #include <stdatomic.h>
+    #include <unistd.h>
+
+//==============================================================//
+//                          Globals                             //
+//==============================================================//
+
+typedef struct xen_channel xen_channel;
+
+static XEN_THREAD_LOCAL xen_obj_class* g_channel_class = NULL;
+static XEN_THREAD_LOCAL xen_obj_class* g_thread_class  = NULL;
+static XEN_THREAD_LOCAL i32 g_thread_id                = 0;  // 0 on the main thread
+static XEN_THREAD_LOCAL xen_channel** g_channels       = NULL;  // channels this thread's VM holds a reference to
+static XEN_THREAD_LOCAL i32 g_channel_count            = 0;
+static XEN_THREAD_LOCAL i32 g_channel_capacity         = 0;
+static atomic_int g_next_thread_id                     = 1;
+
+static xen_channel* channel_get(xen_value self);
+static void channel_hold(xen_channel*** list, i32* count, i32* capacity, xen_channel* ch);
+static void channel_release(xen_channel* ch);
+
+//==============================================================//
+//                          Messages                            //
+//==============================================================//
+
+// A value copied out of one VM, waiting to be rebuilt inside another. Plain malloc'd bytes, so it can be created on
+// one thread and consumed (and freed) on another.
+typedef struct {
+    u8* data;
+    size_t size;
+    size_t capacity;
+    xen_frozen** frozen;  // regions of the frozen values it points to, kept alive until it is freed
+    i32 frozen_count;
+    i32 frozen_capacity;
+    xen_channel** channels;  // channels it carries, likewise
+    i32 channel_count;
+    i32 channel_capacity;
+} xen_message;
+
+typedef enum {
+    MSG_NULL,
+    MSG_TRUE,
+    MSG_FALSE,
+    MSG_NUMBER,
+    MSG_INT,
+    MSG_STRING,
+    MSG_REF,     // an object that appeared earlier in the same message
+    MSG_FROZEN,  // a frozen object, passed by pointer
+    // every tag from here on is an object the reader remembers, in the order they appear
+    MSG_ARRAY,
+    MSG_DICT,
+    MSG_U8ARRAY,
+    MSG_U8ARRAY_MOVED,  // buffer handed over by pointer (transfer)
+    MSG_FUNCTION,
+    MSG_CLOSURE,
+    MSG_UPVALUE,
+    MSG_CLASS,
+    MSG_INSTANCE,
+    MSG_NAMESPACE,
+    MSG_ERROR,
+    MSG_CHANNEL,
+    MSG_NATIVE,  // a C function, valid in every VM of the process
+} xen_message_tag;
+
+typedef struct {
+    xen_obj* obj;
+    u32 index;
+} msg_seen_entry;
+
+typedef struct {
+    xen_message* msg;
+    msg_seen_entry* seen;  // objects written so far, so shared references (and cycles) stay shared on the other side
+    u32 seen_capacity;
+    u32 next_index;
+    array(xen_obj_u8array*) moved;  // arrays whose buffers the message takes over once it has been sent
+    i32 moved_count;
+    i32 moved_capacity;
+    bool transfer;
+    bool lenient;        // write values that can't be copied as null instead of failing
+    const char* failed;  // type of the first value that couldn't be copied
+} msg_writer;
+
+static void msg_put(msg_writer* w, const void* bytes, size_t size) {
+    xen_message* msg = w->msg;
+    if (msg->size + size > msg->capacity) {
+        size_t capacity = msg->capacity < 256 ? 256 : msg->capacity * 2;
+        while (capacity < msg->size + size)
+            capacity *= 2;
+        msg->data     = realloc(msg->data, capacity);
+        msg->capacity = capacity;
+    }
+    memcpy(msg->data + msg->size, bytes, size);
+    msg->size += size;
+}
+
+static void msg_put_tag(msg_writer* w, xen_message_tag tag) {
+    const u8 byte = (u8)tag;
+    msg_put(w, &byte, 1);
+}
+
+static void msg_put_u32(msg_writer* w, u32 value) {
+    msg_put(w, &value, sizeof(value));
+}
+
+static u32 msg_hash_ptr(const void* ptr) {
+    return (u32)(((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ull >> 32);
+}
+
+// Returns true (and the object's index) if `obj` has already been written, otherwise remembers it under the next index
+static bool msg_seen(msg_writer* w, xen_obj* obj, u32* index) {
+    if ((w->next_index + 1) * 2 > w->seen_capacity) {
+        const u32 old_capacity   = w->seen_capacity;
+        msg_seen_entry* old_seen = w->seen;
+        w->seen_capacity         = old_capacity < 64 ? 64 : old_capacity * 2;
+        w->seen                  = calloc(w->seen_capacity, sizeof(msg_seen_entry));
+        for (u32 i = 0; i < old_capacity; i++) {
+            if (old_seen[i].obj == NULL)
+                continue;
+            u32 slot = msg_hash_ptr(old_seen[i].obj) & (w->seen_capacity - 1);
+            while (w->seen[slot].obj != NULL)
+                slot = (slot + 1) & (w->seen_capacity - 1);
+            w->seen[slot] = old_seen[i];
+        }
+        free(old_seen);
+    }
+
+    u32 slot = msg_hash_ptr(obj) & (w->seen_capacity - 1);
+    while (w->seen[slot].obj != NULL) {
+        if (w->seen[slot].obj == obj) {
+            *index = w->seen[slot].index;
+            return XEN_TRUE;
+        }
+        slot = (slot + 1) & (w->seen_capacity - 1);
+    }
+    w->seen[slot] = (msg_seen_entry) {obj, w->next_index++};
+    return XEN_FALSE;
+}
+
+// Classes implemented in C keep native state in their instances, only classes defined by scripts can be copied
+static bool msg_class_is_copyable(const xen_obj_class* class) {
+    if (class->native_initializer != NULL)
+        return XEN_FALSE;
+    const xen_table* tables[2] = {&class->methods, &class->private_methods};
+    for (i32 t = 0; t < 2; t++) {
+        for (u64 i = 0; i < tables[t]->capacity; i++) {
+            if (tables[t]->entries[i].key != NULL && !OBJ_IS_FUNCTION(tables[t]->entries[i].value))
+                return XEN_FALSE;
+        }
+    }
+    return XEN_TRUE;
+}
+
+static bool msg_write_value(msg_writer* w, xen_value value);
+
+static void msg_write_string(msg_writer* w, const xen_obj_str* str) {
+    msg_put_tag(w, MSG_STRING);
+    msg_put_u32(w, (u32)str->length);
+    msg_put(w, str->str, (size_t)str->length);
+}
+
+static void msg_write_cstring(msg_writer* w, const char* str) {
+    const u32 length = (u32)strlen(str);
+    msg_put_tag(w, MSG_STRING);
+    msg_put_u32(w, length);
+    msg_put(w, str, length);
+}
+
+static bool msg_write_table(msg_writer* w, const xen_table* table) {
+    u32 count = 0;
+    for (u64 i = 0; i < table->capacity; i++) {
+        if (table->entries[i].key != NULL)
+            count++;
+    }
+    msg_put_u32(w, count);
+    for (u64 i = 0; i < table->capacity; i++) {
+        const xen_table_entry* entry = &table->entries[i];
+        if (entry->key == NULL)
+            continue;
+        msg_write_string(w, entry->key);
+        if (!msg_write_value(w, entry->value))
+            return XEN_FALSE;
+    }
+    return XEN_TRUE;
+}
+
+static bool msg_write_function(msg_writer* w, xen_obj_func* fn) {
+    // the receiving VM has no image to decode from, so a function of a .xenb module is sent fully decoded
+    if (fn->module != NULL && !xen_bytecode_load_function(fn)) {
+        w->failed = "Function";
+        return XEN_FALSE;
+    }
+
+    msg_put_tag(w, MSG_FUNCTION);
+    msg_put(w, &fn->arity, sizeof(fn->arity));
+    msg_put(w, &fn->upvalue_count, sizeof(fn->upvalue_count));
+    if (fn->name != NULL)
+        msg_write_string(w, fn->name);
+    else
+        msg_put_tag(w, MSG_NULL);
+
+    const xen_chunk* chunk = &fn->chunk;
+    msg_put(w, &chunk->count, sizeof(chunk->count));
+    msg_put(w, chunk->code, chunk->count);
+    if (chunk->lines != NULL) {
+        msg_put(w, chunk->lines, chunk->count * sizeof(u64));
+    } else {
+        // loaded from a .xenb image, the receiving VM gets a line per byte like any other copied function
+        u64* lines = XEN_ALLOCATE(u64, chunk->count > 0 ? chunk->count : 1);
+        xen_chunk_copy_lines(chunk, lines);
+        msg_put(w, lines, chunk->count * sizeof(u64));
+        free(lines);
+    }
+    msg_put_u32(w, (u32)chunk->constants.count);
+    for (u64 i = 0; i < chunk->constants.count; i++) {
+        if (!msg_write_value(w, chunk->constants.values[i]))
+            return XEN_FALSE;
+    }
+    return XEN_TRUE;
+}
+
+static bool msg_write_class(msg_writer* w, const xen_obj_class* class) {
+    msg_put_tag(w, MSG_CLASS);
+    msg_write_string(w, class->name);
+    msg_put_u32(w, (u32)class->property_count);
+    for (i32 i = 0; i < class->property_count; i++) {
+        const xen_property_def* prop = &class->properties[i];
+        const u8 is_private          = prop->is_private;
+        msg_write_string(w, prop->name);
+        msg_put(w, &is_private, 1);
+        if (!msg_write_value(w, prop->default_value))
+            return XEN_FALSE;
+    }
+    if (!msg_write_table(w, &class->methods) || !msg_write_table(w, &class->private_methods))
+        return XEN_FALSE;
+    return msg_write_value(w, class->initializer != NULL ? OBJ_VAL(class->initializer) : NULL_VAL);
+}
+
+static bool msg_write_object(msg_writer* w, xen_obj* obj) {
+    const xen_value value = OBJ_VAL(obj);
+    if (obj->frozen) {
+        xen_message* msg = w->msg;
+        xen_frozen_hold(&msg->frozen, &msg->frozen_count, &msg->frozen_capacity, xen_frozen_of(obj));
+        msg_put_tag(w, MSG_FROZEN);
+        msg_put(w, &obj, sizeof(obj));
+        return XEN_TRUE;
+    }
+    if (obj->type == OBJ_STRING) {
+        msg_write_string(w, (xen_obj_str*)obj);
+        return XEN_TRUE;
+    }
+
+    // decide whether the object can be copied before it takes up an index
+    bool copyable;
+    switch (obj->type) {
+        case OBJ_ARRAY:
+        case OBJ_DICT:
+        case OBJ_U8ARRAY:
+        case OBJ_FUNCTION:
+        case OBJ_CLOSURE:
+        case OBJ_UPVALUE:
+        case OBJ_NAMESPACE:
+        case OBJ_ERROR:
+        case OBJ_NATIVE_FUNC:
+            copyable = XEN_TRUE;
+            break;
+        case OBJ_CLASS:
+            copyable = msg_class_is_copyable((xen_obj_class*)obj);
+            break;
+        case OBJ_INSTANCE: {
+            const xen_obj_class* class = ((xen_obj_instance*)obj)->class;
+            copyable                   = class == g_channel_class || msg_class_is_copyable(class);
+            break;
+        }
+        default:
+            copyable = XEN_FALSE;
+            break;
+    }
+    if (!copyable) {
+        if (w->lenient) {
+            msg_put_tag(w, MSG_NULL);
+            return XEN_TRUE;
+        }
+        w->failed = xen_value_type_to_str(value);
+        return XEN_FALSE;
+    }
+
+    u32 index;
+    if (msg_seen(w, obj, &index)) {
+        msg_put_tag(w, MSG_REF);
+        msg_put_u32(w, index);
+        return XEN_TRUE;
+    }
+
+    switch (obj->type) {
+        case OBJ_ARRAY: {
+            const xen_value_array* array = &((xen_obj_array*)obj)->array;
+            msg_put_tag(w, MSG_ARRAY);
+            msg_put_u32(w, (u32)array->count);
+            for (u64 i = 0; i < array->count; i++) {
+                if (!msg_write_value(w, array->values[i]))
+                    return XEN_FALSE;
+            }
+            return XEN_TRUE;
+        }
+        case OBJ_DICT:
+            msg_put_tag(w, MSG_DICT);
+            return msg_write_table(w, &((xen_obj_dict*)obj)->table);
+        case OBJ_U8ARRAY: {
+            xen_obj_u8array* array = (xen_obj_u8array*)obj;
+            if (w->transfer) {
+                msg_put_tag(w, MSG_U8ARRAY_MOVED);
+                msg_put(w, &array->values, sizeof(array->values));
+                msg_put(w, &array->count, sizeof(array->count));
+                msg_put(w, &array->capacity, sizeof(array->capacity));
+                if (w->moved_count == w->moved_capacity) {
+                    const i32 old_capacity = w->moved_capacity;
+                    w->moved_capacity      = XEN_GROW_CAPACITY(old_capacity);
+                    w->moved = realloc(w->moved, sizeof(xen_obj_u8array*) * (size_t)w->moved_capacity);
+                }
+                w->moved[w->moved_count++] = array;
+            } else {
+                msg_put_tag(w, MSG_U8ARRAY);
+                msg_put_u32(w, (u32)array->count);
+                msg_put(w, array->values, (size_t)array->count);
+            }
+            return XEN_TRUE;
+        }
+        case OBJ_FUNCTION:
+            return msg_write_function(w, (xen_obj_func*)obj);
+        case OBJ_CLOSURE: {
+            const xen_obj_closure* closure = (xen_obj_closure*)obj;
+            msg_put_tag(w, MSG_CLOSURE);
+            if (!msg_write_value(w, OBJ_VAL(closure->fn)))
+                return XEN_FALSE;
+            msg_put_u32(w, (u32)closure->upvalue_count);
+            for (i32 i = 0; i < closure->upvalue_count; i++) {
+                if (!msg_write_value(w, OBJ_VAL(closure->upvalues[i])))
+                    return XEN_FALSE;
+            }
+            return XEN_TRUE;
+        }
+        case OBJ_UPVALUE:
+            // the copy is always closed, whatever the original's state
+            msg_put_tag(w, MSG_UPVALUE);
+            return msg_write_value(w, *((xen_obj_upvalue*)obj)->location);
+        case OBJ_CLASS:
+            return msg_write_class(w, (xen_obj_class*)obj);
+        case OBJ_INSTANCE: {
+            const xen_obj_instance* instance = (xen_obj_instance*)obj;
+            if (instance->class == g_channel_class) {
+                const i64 channel = VAL_AS_INTEGER(instance->fields[0]);
+                xen_message* msg  = w->msg;
+                channel_hold(&msg->channels, &msg->channel_count, &msg->channel_capacity, channel_get(OBJ_VAL(obj)));
+                msg_put_tag(w, MSG_CHANNEL);
+                msg_put(w, &channel, sizeof(channel));
+                return XEN_TRUE;
+            }
+            msg_put_tag(w, MSG_INSTANCE);
+            if (!msg_write_value(w, OBJ_VAL(instance->class)))
+                return XEN_FALSE;
+            msg_put_u32(w, (u32)instance->class->property_count);
+            for (i32 i = 0; i < instance->class->property_count; i++) {
+                if (!msg_write_value(w, instance->fields[i]))
+                    return XEN_FALSE;
+            }
+            return XEN_TRUE;
+        }
+        case OBJ_NAMESPACE: {
+            // builtin namespaces exist in every VM and are looked up by name, others (env) are copied
+            const xen_obj_namespace* ns = (xen_obj_namespace*)obj;
+            xen_obj_str* name           = xen_obj_str_copy(ns->name, (i32)strlen(ns->name));
+            xen_value registered;
+            const u8 is_builtin = xen_table_get(&g_vm->namespace_registry, name, &registered) &&
+                                  VAL_AS_OBJ(registered) == obj;
+            msg_put_tag(w, MSG_NAMESPACE);
+            msg_write_string(w, name);
+            msg_put(w, &is_builtin, 1);
+            if (is_builtin)
+                return XEN_TRUE;
+            msg_put_u32(w, (u32)ns->count);
+            for (i32 i = 0; i < ns->count; i++) {
+                msg_write_cstring(w, ns->entries[i].name);
+                if (!msg_write_value(w, ns->entries[i].value))
+                    return XEN_FALSE;
+            }
+            return XEN_TRUE;
+        }
+        case OBJ_ERROR:
+            msg_put_tag(w, MSG_ERROR);
+            msg_write_string(w, ((xen_obj_error*)obj)->msg);
+            return XEN_TRUE;
+        case OBJ_NATIVE_FUNC: {
+            const xen_obj_native_func* native = (xen_obj_native_func*)obj;
+            msg_put_tag(w, MSG_NATIVE);
+            msg_put(w, &native->function, sizeof(native->function));
+            msg_put(w, &native->name, sizeof(native->name));
+            return XEN_TRUE;
+        }
+        default:
+            return XEN_FALSE;
+    }
+}
+
+static bool msg_write_value(msg_writer* w, xen_value value) {
+    switch (value.type) {
+        case VAL_NULL:
+            msg_put_tag(w, MSG_NULL);
+            return XEN_TRUE;
+        case VAL_BOOL:
+            msg_put_tag(w, VAL_AS_BOOL(value) ? MSG_TRUE : MSG_FALSE);
+            return XEN_TRUE;
+        case VAL_NUMBER:
+            msg_put_tag(w, MSG_NUMBER);
+            msg_put(w, &value.as.number, sizeof(f64));
+            return XEN_TRUE;
+        case VAL_INT:
+            msg_put_tag(w, MSG_INT);
+            msg_put(w, &value.as.integer, sizeof(i64));
+            return XEN_TRUE;
+        case VAL_OBJECT:
+            return msg_write_object(w, VAL_AS_OBJ(value));
+    }
+    return XEN_FALSE;
+}
+
+static void msg_writer_init(msg_writer* w, bool transfer) {
+    memset(w, 0, sizeof(msg_writer));
+    w->msg      = calloc(1, sizeof(xen_message));
+    w->transfer = transfer;
+}
+
+static void msg_free(xen_message* msg) {
+    for (i32 i = 0; i < msg->frozen_count; i++) {
+        xen_frozen_release(msg->frozen[i]);
+    }
+    XEN_FREE_ARRAY(xen_frozen*, msg->frozen, msg->frozen_capacity);
+    for (i32 i = 0; i < msg->channel_count; i++) {
+        channel_release(msg->channels[i]);
+    }
+    XEN_FREE_ARRAY(xen_channel*, msg->channels, msg->channel_capacity);
+    free(msg->data);
+    free(msg);
+}
+
+// Releases the writer's bookkeeping. On success the message is returned and moved arrays are emptied, since their
+// buffers now belong to it; otherwise the message is discarded and the arrays are left alone.
+static xen_message* msg_writer_finish(msg_writer* w, bool ok) {
+    xen_message* msg = w->msg;
+    if (ok) {
+        for (i32 i = 0; i < w->moved_count; i++) {
+            w->moved[i]->values   = NULL;
+            w->moved[i]->count    = 0;
+            w->moved[i]->capacity = 0;
+        }
+    } else {
+        msg_free(msg);
+        msg = NULL;
+    }
+    free(w->seen);
+    free(w->moved);
+    return msg;
+}
+
+
+// Copies a single value into a new message, reporting a runtime error (and returning NULL) if it can't be copied
+static xen_message* msg_from_value(xen_value value, bool transfer, const char* what) {
+    msg_writer w;
+    msg_writer_init(&w, transfer);
+    const bool ok = msg_write_value(&w, value);
+    if (!ok)
+        xen_runtime_error("[thread] %s: cannot copy values of type %s to another thread", what, w.failed);
+    return msg_writer_finish(&w, ok);
+}
+
+typedef struct {
+    const u8* data;
+    size_t position;
+    array(xen_value) objects;  // by index, see MSG_REF
+    u32 object_count;
+    u32 object_capacity;
+} msg_reader;
+
+static void msg_take(msg_reader* r, void* out, size_t size) {
+    memcpy(out, r->data + r->position, size);
+    r->position += size;
+}
+
+static u32 msg_take_u32(msg_reader* r) {
+    u32 value;
+    msg_take(r, &value, sizeof(value));
+    return value;
+}
+
+static u32 msg_remember(msg_reader* r, xen_value value) {
+    if (r->object_count == r->object_capacity) {
+        r->object_capacity = r->object_capacity < 64 ? 64 : r->object_capacity * 2;
+        r->objects         = realloc(r->objects, sizeof(xen_value) * r->object_capacity);
+    }
+    r->objects[r->object_count] = value;
+    return r->object_count++;
+}
+
+static xen_value channel_wrap(i64 channel);
+static xen_value msg_read_value(msg_reader* r);
+
+static xen_obj_str* msg_read_string(msg_reader* r) {
+    return OBJ_AS_STRING(msg_read_value(r));
+}
+
+static void msg_read_table(msg_reader* r, xen_table* table) {
+    const u32 count = msg_take_u32(r);
+    for (u32 i = 0; i < count; i++) {
+        xen_obj_str* key      = msg_read_string(r);
+        const xen_value value = msg_read_value(r);
+        xen_table_set(table, key, value);
+    }
+}
+
+static xen_value msg_read_function(msg_reader* r) {
+    xen_obj_func* fn = xen_obj_func_new();
+    msg_remember(r, OBJ_VAL(fn));
+    msg_take(r, &fn->arity, sizeof(fn->arity));
+    msg_take(r, &fn->upvalue_count, sizeof(fn->upvalue_count));
+    const xen_value name = msg_read_value(r);
+    fn->name             = VAL_IS_NULL(name) ? NULL : OBJ_AS_STRING(name);
+
+    xen_chunk* chunk = &fn->chunk;
+    msg_take(r, &chunk->count, sizeof(chunk->count));
+    chunk->capacity = chunk->count;
+    chunk->code     = XEN_ALLOCATE(u8, chunk->count);
+    chunk->lines    = XEN_ALLOCATE(u64, chunk->count);
+    msg_take(r, chunk->code, chunk->count);
+    msg_take(r, chunk->lines, chunk->count * sizeof(u64));
+    const u32 constant_count = msg_take_u32(r);
+    for (u32 i = 0; i < constant_count; i++) {
+        xen_value_array_write(&chunk->constants, msg_read_value(r));
+    }
+    return OBJ_VAL(fn);
+}
+
+static xen_value msg_read_class(msg_reader* r) {
+    // the slot is taken before the name is read, in the order the writer numbered the objects
+    const u32 index      = msg_remember(r, NULL_VAL);
+    xen_obj_class* class = xen_obj_class_new(msg_read_string(r));
+    r->objects[index]    = OBJ_VAL(class);
+
+    const u32 property_count = msg_take_u32(r);
+    for (u32 i = 0; i < property_count; i++) {
+        xen_obj_str* name = msg_read_string(r);
+        u8 is_private;
+        msg_take(r, &is_private, 1);
+        xen_obj_class_add_property(class, name, msg_read_value(r), is_private);
+    }
+    msg_read_table(r, &class->methods);
+    msg_read_table(r, &class->private_methods);
+    const xen_value initializer = msg_read_value(r);
+    class->initializer          = VAL_IS_NULL(initializer) ? NULL : OBJ_AS_FUNCTION(initializer);
+    return OBJ_VAL(class);
+}
+
+static xen_value msg_read_value(msg_reader* r) {
+    u8 tag;
+    msg_take(r, &tag, 1);
+
+    switch ((xen_message_tag)tag) {
+        case MSG_NULL:
+            return NULL_VAL;
+        case MSG_TRUE:
+            return BOOL_VAL(XEN_TRUE);
+        case MSG_FALSE:
+            return BOOL_VAL(XEN_FALSE);
+        case MSG_NUMBER: {
+            f64 number;
+            msg_take(r, &number, sizeof(number));
+            return NUMBER_VAL(number);
+        }
+        case MSG_INT: {
+            i64 integer;
+            msg_take(r, &integer, sizeof(integer));
+            return INT_VAL(integer);
+        }
+        case MSG_STRING: {
+            const u32 length = msg_take_u32(r);
+            xen_obj_str* str = xen_obj_str_copy((const char*)r->data + r->position, (i32)length);
+            r->position += length;
+            return OBJ_VAL(str);
+        }
+        case MSG_REF:
+            return r->objects[msg_take_u32(r)];
+        case MSG_FROZEN: {
+            xen_obj* obj;
+            msg_take(r, &obj, sizeof(obj));
+            xen_frozen_adopt(xen_frozen_of(obj));
+            return OBJ_VAL(obj);
+        }
+        case MSG_ARRAY: {
+            const u32 count    = msg_take_u32(r);
+            xen_obj_array* arr = xen_obj_array_new_with_capacity((i32)count);
+            msg_remember(r, OBJ_VAL(arr));
+            for (u32 i = 0; i < count; i++) {
+                xen_obj_array_push(arr, msg_read_value(r));
+            }
+            return OBJ_VAL(arr);
+        }
+        case MSG_DICT: {
+            xen_obj_dict* dict = xen_obj_dict_new();
+            msg_remember(r, OBJ_VAL(dict));
+            msg_read_table(r, &dict->table);
+            return OBJ_VAL(dict);
+        }
+        case MSG_U8ARRAY: {
+            const u32 count        = msg_take_u32(r);
+            xen_obj_u8array* array = xen_obj_u8array_new_with_capacity((i32)count);
+            msg_take(r, array->values, count);
+            array->count = (i32)count;
+            msg_remember(r, OBJ_VAL(array));
+            return OBJ_VAL(array);
+        }
+        case MSG_U8ARRAY_MOVED: {
+            xen_obj_u8array* array = xen_obj_u8array_new();
+            msg_take(r, &array->values, sizeof(array->values));
+            msg_take(r, &array->count, sizeof(array->count));
+            msg_take(r, &array->capacity, sizeof(array->capacity));
+            msg_remember(r, OBJ_VAL(array));
+            return OBJ_VAL(array);
+        }
+        case MSG_FUNCTION:
+            return msg_read_function(r);
+        case MSG_CLOSURE: {
+            const u32 index          = msg_remember(r, NULL_VAL);
+            xen_obj_closure* closure = xen_obj_closure_new(OBJ_AS_FUNCTION(msg_read_value(r)));
+            r->objects[index]        = OBJ_VAL(closure);
+            const u32 count          = msg_take_u32(r);
+            for (u32 i = 0; i < count; i++) {
+                closure->upvalues[i] = (xen_obj_upvalue*)VAL_AS_OBJ(msg_read_value(r));
+            }
+            return OBJ_VAL(closure);
+        }
+        case MSG_UPVALUE: {
+            xen_obj_upvalue* upvalue = xen_obj_upvalue_new(NULL);
+            upvalue->location        = &upvalue->closed;
+            msg_remember(r, OBJ_VAL(upvalue));
+            upvalue->closed = msg_read_value(r);
+            return OBJ_VAL(upvalue);
+        }
+        case MSG_CLASS:
+            return msg_read_class(r);
+        case MSG_INSTANCE: {
+            const u32 index            = msg_remember(r, NULL_VAL);
+            xen_obj_instance* instance = xen_obj_instance_new(OBJ_AS_CLASS(msg_read_value(r)));
+            r->objects[index]          = OBJ_VAL(instance);
+            const u32 count            = msg_take_u32(r);
+            for (u32 i = 0; i < count; i++) {
+                instance->fields[i] = msg_read_value(r);
+            }
+            return OBJ_VAL(instance);
+        }
+        case MSG_NAMESPACE: {
+            const u32 index   = msg_remember(r, NULL_VAL);
+            xen_obj_str* name = msg_read_string(r);
+            u8 is_builtin;
+            msg_take(r, &is_builtin, 1);
+            if (is_builtin) {
+                xen_value ns = NULL_VAL;
+                xen_table_get(&g_vm->namespace_registry, name, &ns);
+                r->objects[index] = ns;
+                return ns;
+            }
+            xen_obj_namespace* ns = xen_obj_namespace_new(name->str);
+            r->objects[index]     = OBJ_VAL(ns);
+            const u32 count       = msg_take_u32(r);
+            for (u32 i = 0; i < count; i++) {
+                xen_obj_str* entry = msg_read_string(r);
+                xen_obj_namespace_set(ns, entry->str, msg_read_value(r));
+            }
+            return OBJ_VAL(ns);
+        }
+        case MSG_ERROR: {
+            const u32 index   = msg_remember(r, NULL_VAL);
+            xen_obj_error* e  = xen_obj_error_new(msg_read_string(r)->str);
+            r->objects[index] = OBJ_VAL(e);
+            return OBJ_VAL(e);
+        }
+        case MSG_CHANNEL: {
+            i64 channel;
+            msg_take(r, &channel, sizeof(channel));
+            const xen_value wrapped = channel_wrap(channel);
+            msg_remember(r, wrapped);
+            return wrapped;
+        }
+        case MSG_NATIVE: {
+            xen_native_fn function;
+            const char* name;
+            msg_take(r, &function, sizeof(function));
+            msg_take(r, &name, sizeof(name));
+            xen_obj_native_func* native = xen_obj_native_func_new(function, name);
+            msg_remember(r, OBJ_VAL(native));
+            return OBJ_VAL(native);
+        }
+    }
+    return NULL_VAL;
+}
+
+static void msg_reader_init(msg_reader* r, const xen_message* msg) {
+    memset(r, 0, sizeof(msg_reader));
+    r->data = msg->data;
+}
+
+// Rebuilds the value inside the calling thread's VM and frees the message
+static xen_value msg_to_value(xen_message* msg) {
+    msg_reader r;
+    msg_reader_init(&r, msg);
+    const xen_value value = msg_read_value(&r);
+    free(r.objects);
+    msg_free(msg);
+    return value;
+}
+
+// Workers start from a copy of the spawning VM's globals so functions can use the script's other functions, classes
+// and constants. Natives are skipped (every VM has its own) and values that can't be copied become null, as does
+// `skip` (an object the worker gets some other way).
+static void msg_write_globals(msg_writer* w, const xen_obj* skip) {
+    const xen_table* globals = &g_vm->globals;
+    u32 global_count         = 0;
+    for (u64 i = 0; i < globals->capacity; i++) {
+        if (globals->entries[i].key != NULL && !OBJ_IS_NATIVE_FUNC(globals->entries[i].value))
+            global_count++;
+    }
+
+    w->lenient = XEN_TRUE;
+    msg_put_u32(w, global_count);
+    for (u64 i = 0; i < globals->capacity; i++) {
+        const xen_table_entry* entry = &globals->entries[i];
+        if (entry->key == NULL || OBJ_IS_NATIVE_FUNC(entry->value))
+            continue;
+        msg_write_string(w, entry->key);
+        if (VAL_IS_OBJ(entry->value) && VAL_AS_OBJ(entry->value) == skip)
+            msg_put_tag(w, MSG_NULL);
+        else
+            msg_write_value(w, entry->value);
+    }
+    w->lenient = XEN_FALSE;
+}
+
+static void msg_read_globals(msg_reader* r) {
+    const u32 global_count = msg_take_u32(r);
+    for (u32 i = 0; i < global_count; i++) {
+        xen_obj_str* name     = msg_read_string(r);
+        const xen_value value = msg_read_value(r);
+        xen_table_set(&g_vm->globals, name, value);
+    }
+}
+
+//==============================================================//
+//                          Channel                             //
+//==============================================================//
+
+// Bounded MPMC queue (Vyukov): every cell carries a sequence number telling producers and consumers whose turn it is,
+// so sending and receiving are a single CAS on the shared position when the queue is neither full nor empty. The
+// mutex and condition variable are only touched to sleep on a full or empty queue and to wake sleepers up.
+// Channels are reference counted like frozen regions: every VM that holds a handle to one owns a reference, released
+// when the VM is freed, and so does every message in flight that carries one. The last release frees the channel
+// along with whatever is still queued in it.
+
+typedef struct {
+    atomic_size_t sequence;
+    xen_message* msg;
+} xen_channel_cell;
+
+struct xen_channel {
+    xen_channel_cell* cells;
+    size_t mask;
+    _Alignas(64) atomic_size_t enqueue_pos;
+    _Alignas(64) atomic_size_t dequeue_pos;
+    _Alignas(64) atomic_int waiters;
+    atomic_bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    atomic_int refs;
+};
+
+static xen_channel* channel_new(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    xen_channel* ch = aligned_alloc(64, XEN_ALIGN_UP(sizeof(xen_channel), 64));
+    memset(ch, 0, sizeof(xen_channel));
+    ch->cells = calloc(size, sizeof(xen_channel_cell));
+    ch->mask  = size - 1;
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&ch->cells[i].sequence, i);
+    }
+    pthread_mutex_init(&ch->lock, NULL);
+    pthread_cond_init(&ch->changed, NULL);
+    return ch;
+}
+
+static bool channel_try_push(xen_channel* ch, xen_message* msg) {
+    size_t pos = atomic_load_explicit(&ch->enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        xen_channel_cell* cell = &ch->cells[pos & ch->mask];
+        const size_t sequence  = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        const intptr_t diff    = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                  &ch->enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                cell->msg = msg;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                return XEN_TRUE;
+            }
+        } else if (diff < 0) {
+            return XEN_FALSE;  // full
+        } else {
+            pos = atomic_load_explicit(&ch->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static xen_message* channel_try_pop(xen_channel* ch) {
+    size_t pos = atomic_load_explicit(&ch->dequeue_pos, memory_order_relaxed);
+    for (;;) {
+        xen_channel_cell* cell = &ch->cells[pos & ch->mask];
+        const size_t sequence  = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        const intptr_t diff    = (intptr_t)sequence - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                  &ch->dequeue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                xen_message* msg = cell->msg;
+                atomic_store_explicit(&cell->sequence, pos + ch->mask + 1, memory_order_release);
+                return msg;
+            }
+        } else if (diff < 0) {
+            return NULL;  // empty
+        } else {
+            pos = atomic_load_explicit(&ch->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static bool channel_is_full(xen_channel* ch) {
+    const size_t pos = atomic_load(&ch->enqueue_pos);
+    return (intptr_t)atomic_load(&ch->cells[pos & ch->mask].sequence) - (intptr_t)pos < 0;
+}
+
+static bool channel_is_empty(xen_channel* ch) {
+    const size_t pos = atomic_load(&ch->dequeue_pos);
+    return (intptr_t)atomic_load(&ch->cells[pos & ch->mask].sequence) - (intptr_t)(pos + 1) < 0;
+}
+
+// Called after every successful push/pop and on close. Sleepers register in `waiters` before re-checking the queue,
+// so with the fence either this sees them or they see the change.
+static void channel_wake(xen_channel* ch) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&ch->waiters) > 0) {
+        pthread_mutex_lock(&ch->lock);
+        pthread_cond_broadcast(&ch->changed);
+        pthread_mutex_unlock(&ch->lock);
+    }
+}
+
+// Sleeps until the channel is closed or, depending on `for_space`, no longer full or no longer empty
+static void channel_wait(xen_channel* ch, bool for_space) {
+    pthread_mutex_lock(&ch->lock);
+    atomic_fetch_add(&ch->waiters, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load(&ch->closed) && (for_space ? channel_is_full(ch) : channel_is_empty(ch))) {
+        pthread_cond_wait(&ch->changed, &ch->lock);
+    }
+    atomic_fetch_sub(&ch->waiters, 1);
+    pthread_mutex_unlock(&ch->lock);
+}
+
+static bool channel_send(xen_channel* ch, xen_message* msg, bool block) {
+    for (;;) {
+        if (atomic_load(&ch->closed))
+            return XEN_FALSE;
+        if (channel_try_push(ch, msg)) {
+            channel_wake(ch);
+            return XEN_TRUE;
+        }
+        if (!block)
+            return XEN_FALSE;
+        channel_wait(ch, XEN_TRUE);
+    }
+}
+
+// Returns NULL once the channel is empty and either closed or `block` is false
+static xen_message* channel_receive(xen_channel* ch, bool block) {
+    for (;;) {
+        xen_message* msg = channel_try_pop(ch);
+        if (msg != NULL) {
+            channel_wake(ch);
+            return msg;
+        }
+        if (!block || atomic_load(&ch->closed)) {
+            // anything sent before close() was called is still delivered
+            msg = channel_try_pop(ch);
+            if (msg != NULL)
+                channel_wake(ch);
+            return msg;
+        }
+        channel_wait(ch, XEN_FALSE);
+    }
+}
+
+static void channel_destroy(xen_channel* ch) {
+    xen_message* msg;
+    while ((msg = channel_try_pop(ch)) != NULL) {
+        msg_free(msg);
+    }
+    pthread_cond_destroy(&ch->changed);
+    pthread_mutex_destroy(&ch->lock);
+    free(ch->cells);
+    free(ch);
+}
+
+static void channel_release(xen_channel* ch) {
+    if (atomic_fetch_sub_explicit(&ch->refs, 1, memory_order_acq_rel) == 1)
+        channel_destroy(ch);
+}
+
+// Adds `ch` to a list of held channels, taking a reference, unless the list already holds it
+static void channel_hold(xen_channel*** list, i32* count, i32* capacity, xen_channel* ch) {
+    for (i32 i = *count - 1; i >= 0; i--) {
+        if ((*list)[i] == ch)
+            return;
+    }
+    if (*count == *capacity) {
+        const i32 old_capacity = *capacity;
+        *capacity              = XEN_GROW_CAPACITY(old_capacity);
+        *list                  = XEN_GROW_ARRAY(xen_channel*, *list, old_capacity, *capacity);
+    }
+    (*list)[(*count)++] = ch;
+    atomic_fetch_add_explicit(&ch->refs, 1, memory_order_relaxed);
+}
+
+void xen_thread_release_channels() {
+    for (i32 i = 0; i < g_channel_count; i++) {
+        channel_release(g_channels[i]);
+    }
+    XEN_FREE_ARRAY(xen_channel*, g_channels, g_channel_capacity);
+    g_channels         = NULL;
+    g_channel_count    = 0;
+    g_channel_capacity = 0;
+}
+
+//==============================================================//
+//                       Channel Class                          //
+//==============================================================//
+
+static xen_channel* channel_get(xen_value self) {
+    return (xen_channel*)(intptr_t)VAL_AS_INTEGER(OBJ_AS_INSTANCE(self)->fields[0]);
+}
+
+// A handle to an existing channel in the calling thread's VM, which becomes one of its holders
+static xen_value channel_wrap(i64 channel) {
+    xen_obj_instance* instance = xen_obj_instance_new(g_channel_class);
+    instance->fields[0]        = INT_VAL(channel);
+    channel_hold(&g_channels, &g_channel_count, &g_channel_capacity, (xen_channel*)(intptr_t)channel);
+    return OBJ_VAL(instance);
+}
+
+// Constructor: Channel(capacity = 64)
+static xen_value thread_channel_init(i32 argc, array(xen_value) argv) {
+    xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
+
+    i64 capacity = XEN_CHANNEL_DEFAULT_CAPACITY;
+    if (argc > 1 && VAL_IS_NUMBER(argv[1])) {
+        capacity = VAL_AS_INTEGER(argv[1]);
+        if (capacity < 1) {
+            xen_runtime_error("[Channel] capacity must be at least 1");
+            return NULL_VAL;
+        }
+    }
+
+    xen_channel* ch = channel_new((size_t)capacity);
+    channel_hold(&g_channels, &g_channel_count, &g_channel_capacity, ch);
+    self->fields[0] = INT_VAL((i64)(intptr_t)ch);
+    return OBJ_VAL(self);
+}
+
+static xen_value channel_send_common(i32 argc, array(xen_value) argv, bool block, const char* what) {
+    if (argc < 2) {
+        xen_runtime_error("[Channel] %s() requires a value", what);
+        return BOOL_VAL(XEN_FALSE);
+    }
+    xen_channel* ch     = channel_get(argv[0]);
+    const bool transfer = argc > 2 && VAL_IS_BOOL(argv[2]) && VAL_AS_BOOL(argv[2]);
+
+    msg_writer w;
+    msg_writer_init(&w, transfer);
+    if (!msg_write_value(&w, argv[1])) {
+        xen_runtime_error("[Channel] %s(): cannot send values of type %s", what, w.failed);
+        msg_writer_finish(&w, XEN_FALSE);
+        return BOOL_VAL(XEN_FALSE);
+    }
+
+    // moved buffers only change hands once the message is actually in the queue
+    const bool sent = channel_send(ch, w.msg, block);
+    msg_writer_finish(&w, sent);
+    return BOOL_VAL(sent);
+}
+
+// Method: send(value, transfer = false) -> false if the channel is closed. Blocks while the channel is full.
+static xen_value thread_channel_send(i32 argc, array(xen_value) argv) {
+    return channel_send_common(argc, argv, XEN_TRUE, "send");
+}
+
+// Method: try_send(value, transfer = false) -> false if the channel is full or closed
+static xen_value thread_channel_try_send(i32 argc, array(xen_value) argv) {
+    return channel_send_common(argc, argv, XEN_FALSE, "try_send");
+}
+
+// Method: recv() -> next value, blocking while the channel is empty. null once it is closed and drained.
+static xen_value thread_channel_recv(i32 argc, array(xen_value) argv) {
+    xen_message* msg = channel_receive(channel_get(argv[0]), XEN_TRUE);
+    return msg != NULL ? msg_to_value(msg) : NULL_VAL;
+}
+
+// Method: try_recv() -> next value, or null if the channel is empty
+static xen_value thread_channel_try_recv(i32 argc, array(xen_value) argv) {
+    xen_message* msg = channel_receive(channel_get(argv[0]), XEN_FALSE);
+    return msg != NULL ? msg_to_value(msg) : NULL_VAL;
+}
+
+// Method: close(). Further sends fail, receivers get what is left and then null.
+static xen_value thread_channel_close(i32 argc, array(xen_value) argv) {
+    xen_channel* ch = channel_get(argv[0]);
+    atomic_store(&ch->closed, XEN_TRUE);
+    pthread_mutex_lock(&ch->lock);
+    pthread_cond_broadcast(&ch->changed);
+    pthread_mutex_unlock(&ch->lock);
+    return NULL_VAL;
+}
+
+// Method: len() -> number of queued values (a snapshot, other threads may change it right away)
+static xen_value thread_channel_len(i32 argc, array(xen_value) argv) {
+    xen_channel* ch   = channel_get(argv[0]);
+    const size_t head = atomic_load(&ch->dequeue_pos);
+    const size_t tail = atomic_load(&ch->enqueue_pos);
+    return INT_VAL(tail > head ? (i64)(tail - head) : 0);
+}
+
+static xen_obj_class* create_channel_class() {
+    xen_obj_str* name    = xen_obj_str_copy("Channel", 7);
+    xen_obj_class* class = xen_obj_class_new(name);
+
+    xen_obj_class_add_property(class, xen_obj_str_copy("_channel", 8), INT_VAL(0), XEN_TRUE);
+
+    xen_obj_class_set_native_init(class, thread_channel_init);
+
+    xen_obj_class_add_native_method(class, "send", thread_channel_send, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "try_send", thread_channel_try_send, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "recv", thread_channel_recv, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "try_recv", thread_channel_try_recv, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "close", thread_channel_close, XEN_FALSE);
+    xen_obj_class_add_native_method(class, "len", thread_channel_len, XEN_FALSE);
+
+    return class;
+}
+
+//==============================================================//
+//                           Threads                            //
+//==============================================================//
+
+typedef struct {
+    pthread_t handle;
+    i32 id;
+    xen_vm_config config;
+    xen_message* job;     // globals snapshot, function and arguments, consumed by the worker
+    xen_message* result;  // the function's return value, NULL if it failed
+} xen_thread;
+
+// Field indices of thread.Thread, in the order they are added in create_thread_class()
+enum {
+    THREAD_HANDLE,
+    THREAD_ID,
+    THREAD_RESULT,
+};
+
+static void* thread_main(void* arg) {
+    xen_thread* thread = arg;
+    g_thread_id        = thread->id;
+    xen_vm* vm         = xen_vm_new(thread->config);
+
+    msg_reader r;
+    msg_reader_init(&r, thread->job);
+    msg_read_globals(&r);
+    const xen_value fn  = msg_read_value(&r);
+    xen_obj_array* args = OBJ_AS_ARRAY(msg_read_value(&r));
+    free(r.objects);
+    msg_free(thread->job);
+    thread->job = NULL;
+
+    xen_value result;
+    if (xen_vm_call(fn, (i32)args->array.count, args->array.values, &result)) {
+        thread->result = msg_from_value(result, XEN_FALSE, "return value");
+    }
+
+    xen_vm_free(vm);
+    return NULL;
+}
+
+// thread.spawn(fn, args...) -> Thread running fn(args...) in a new VM
+static xen_value thread_spawn(i32 argc, array(xen_value) argv) {
+    if (argc < 1 || !(OBJ_IS_FUNCTION(argv[0]) || OBJ_IS_CLOSURE(argv[0]))) {
+        xen_runtime_error("[thread] spawn() expects a script function");
+        return NULL_VAL;
+    }
+
+    msg_writer w;
+    msg_writer_init(&w, XEN_FALSE);
+    msg_write_globals(&w, NULL);
+    bool ok = msg_write_value(&w, argv[0]);
+    if (ok) {
+        msg_put_tag(&w, MSG_ARRAY);
+        w.next_index++;
+        msg_put_u32(&w, (u32)(argc - 1));
+        for (i32 i = 1; i < argc && ok; i++) {
+            ok = msg_write_value(&w, argv[i]);
+        }
+    }
+    if (!ok) {
+        xen_runtime_error("[thread] spawn(): cannot copy values of type %s to another thread", w.failed);
+        msg_writer_finish(&w, XEN_FALSE);
+        return NULL_VAL;
+    }
+
+    xen_thread* thread = calloc(1, sizeof(xen_thread));
+    thread->id         = atomic_fetch_add(&g_next_thread_id, 1);
+    thread->config     = g_vm->config;
+    thread->job        = msg_writer_finish(&w, XEN_TRUE);
+
+    if (pthread_create(&thread->handle, NULL, thread_main, thread) != 0) {
+        xen_runtime_error("[thread] spawn(): failed to create thread: %s", strerror(errno));
+        msg_free(thread->job);
+        free(thread);
+        return NULL_VAL;
+    }
+
+    xen_obj_instance* instance      = xen_obj_instance_new(g_thread_class);
+    instance->fields[THREAD_HANDLE] = INT_VAL((i64)(intptr_t)thread);
+    instance->fields[THREAD_ID]     = INT_VAL(thread->id);
+    return OBJ_VAL(instance);
+}
+
+// Method: join() -> the function's return value (null if it failed). Waits for the thread to finish.
+static xen_value thread_join(i32 argc, array(xen_value) argv) {
+    xen_obj_instance* self = OBJ_AS_INSTANCE(argv[0]);
+    xen_thread* thread     = (xen_thread*)(intptr_t)VAL_AS_INTEGER(self->fields[THREAD_HANDLE]);
+    if (thread == NULL) {
+        // already joined (or never spawned)
+        return self->fields[THREAD_RESULT];
+    }
+
+    pthread_join(thread->handle, NULL);
+    if (thread->result != NULL) {
+        self->fields[THREAD_RESULT] = msg_to_value(thread->result);
+    }
+    self->fields[THREAD_HANDLE] = INT_VAL(0);
+    free(thread);
+    return self->fields[THREAD_RESULT];
+}
+
+static xen_obj_class* create_thread_class() {
+    xen_obj_str* name    = xen_obj_str_copy("Thread", 6);
+    xen_obj_class* class = xen_obj_class_new(name);
+
+    xen_obj_class_add_property(class, xen_obj_str_copy("_thread", 7), INT_VAL(0), XEN_TRUE);
+    xen_obj_class_add_property(class, xen_obj_str_copy("id", 2), INT_VAL(0), XEN_FALSE);
+    xen_obj_class_add_property(class, xen_obj_str_copy("_result", 7), NULL_VAL, XEN_TRUE);
+
+    xen_obj_class_add_native_method(class, "join", thread_join, XEN_FALSE);
+
+    return class;
+}
+
+// thread.id() -> id of the calling thread, 0 for the main script
+static xen_value thread_id(i32 argc, array(xen_value) argv) {
+    return INT_VAL(g_thread_id);
+}
+
+// thread.cpu_count() -> number of online CPUs
+static xen_value thread_cpu_count(i32 argc, array(xen_value) argv) {
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return INT_VAL(count > 0 ? count : 1);
+}
+
+//==============================================================//
+//                      Parallel Arrays                         //
+//==============================================================//
+
+// Array.par_map() and Array.par_reduce() split the array into chunks that the calling VM and a few worker VMs run
+// side by side. Workers start from a copy of the globals and the function, like spawned threads. Each participant
+// owns a contiguous range of chunks and takes them from the front; once its range is empty it steals the back half
+// of someone else's, so expensive chunks don't leave the other cores idle. Primitive items and results are read and
+// written in place, only objects are copied through messages.
+
+typedef enum {
+    PAR_MAP,
+    PAR_REDUCE,
+} par_kind;
+
+// Chunks a participant has yet to run, [next, end) packed into one word so that taking and stealing are a single CAS
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t range;
+} par_queue;
+
+#define PAR_RANGE(next, end) (((u64)(end) << 32) | (u64)(next))
+#define PAR_NEXT(range) ((u32)(range))
+#define PAR_END(range) ((u32)((range) >> 32))
+#define PAR_CHUNKS_PER_WORKER 16
+
+typedef struct {
+    par_kind kind;
+    xen_vm_config config;
+    xen_message* setup;    // globals and the function, rebuilt in every worker VM
+    const xen_obj* array;  // left out of the globals workers get, they only see its items
+    xen_value* items;      // copy of the array's values, the function may change the array itself
+    u32 count;
+    u32 chunk_size;
+    u32 chunk_count;
+    xen_message** inputs;   // per chunk: its object items, NULL if it only holds primitives
+    xen_value* results;     // per item (map) or per chunk (reduce), null where a worker returned an object
+    xen_message** outputs;  // per chunk: (slot, object) pairs returned by a worker
+    par_queue* queues;
+    i32 participants;
+    atomic_bool failed;
+    bool failed_locally;              // the calling VM has already reported the error
+    _Atomic(const char*) uncopyable;  // type of a result that couldn't be copied back
+} par_job;
+
+typedef struct {
+    par_job* job;
+    i32 index;
+    pthread_t handle;
+    bool started;
+} par_worker;
+
+static bool par_take(par_queue* queue, u32* chunk) {
+    u64 range = atomic_load(&queue->range);
+    while (PAR_NEXT(range) < PAR_END(range)) {
+        if (atomic_compare_exchange_weak(&queue->range, &range, PAR_RANGE(PAR_NEXT(range) + 1, PAR_END(range)))) {
+            *chunk = PAR_NEXT(range);
+            return XEN_TRUE;
+        }
+    }
+    return XEN_FALSE;
+}
+
+// Only called once the participant's own range is empty, so nobody else writes to it while it is refilled
+static bool par_steal(par_job* job, i32 self, u32* chunk) {
+    for (i32 i = 1; i < job->participants; i++) {
+        par_queue* victim = &job->queues[(self + i) % job->participants];
+        u64 range         = atomic_load(&victim->range);
+        while (PAR_NEXT(range) < PAR_END(range)) {
+            const u32 half  = (PAR_END(range) - PAR_NEXT(range) + 1) / 2;
+            const u32 first = PAR_END(range) - half;
+            if (atomic_compare_exchange_weak(&victim->range, &range, PAR_RANGE(PAR_NEXT(range), first))) {
+                atomic_store(&job->queues[self].range, PAR_RANGE(first + 1, first + half));
+                *chunk = first;
+                return XEN_TRUE;
+            }
+        }
+    }
+    return XEN_FALSE;
+}
+
+static bool par_store(par_job* job, msg_writer* out, u32 slot, xen_value value, bool local) {
+    if (local || !VAL_IS_OBJ(value)) {
+        job->results[slot] = value;
+        return XEN_TRUE;
+    }
+    if (out->msg == NULL)
+        msg_writer_init(out, XEN_FALSE);
+    msg_put_u32(out, slot);
+    if (!msg_write_value(out, value)) {
+        atomic_store(&job->uncopyable, out->failed);
+        return XEN_FALSE;
+    }
+    return XEN_TRUE;
+}
+
+// Runs one chunk with `fn`, which lives in the calling thread's VM. `local` is set for the VM that owns the array.
+static bool par_run_chunk(par_job* job, u32 chunk, xen_value fn, bool local) {
+    const u32 begin = chunk * job->chunk_size;
+    const u32 end   = XEN_MIN(begin + job->chunk_size, job->count);
+
+    msg_reader in  = {0};
+    msg_writer out = {0};
+    if (!local && job->inputs[chunk] != NULL)
+        msg_reader_init(&in, job->inputs[chunk]);
+
+    bool ok = XEN_TRUE;
+    xen_value acc;
+    for (u32 i = begin; i < end && ok; i++) {
+        xen_value item = job->items[i];
+        if (!local && VAL_IS_OBJ(item))
+            item = msg_read_value(&in);
+
+        if (job->kind == PAR_MAP) {
+            xen_value result;
+            ok = xen_vm_call(fn, 1, &item, &result) && par_store(job, &out, i, result, local);
+        } else if (i == begin) {
+            acc = item;
+        } else {
+            xen_value args[2] = {acc, item};
+            ok                = xen_vm_call(fn, 2, args, &acc);
+        }
+    }
+    if (ok && job->kind == PAR_REDUCE)
+        ok = par_store(job, &out, chunk, acc, local);
+
+    free(in.objects);
+    if (out.msg != NULL)
+        job->outputs[chunk] = msg_writer_finish(&out, ok);
+    return ok;
+}
+
+static void par_work(par_job* job, i32 self, xen_value fn, bool local) {
+    u32 chunk;
+    while (!atomic_load_explicit(&job->failed, memory_order_relaxed)) {
+        if (!par_take(&job->queues[self], &chunk) && !par_steal(job, self, &chunk))
+            return;
+        if (!par_run_chunk(job, chunk, fn, local)) {
+            if (local)
+                job->failed_locally = XEN_TRUE;
+            atomic_store(&job->failed, XEN_TRUE);
+        }
+    }
+}
+
+static void* par_worker_main(void* arg) {
+    par_worker* worker = arg;
+    par_job* job       = worker->job;
+    g_thread_id        = atomic_fetch_add(&g_next_thread_id, 1);
+    xen_vm* vm         = xen_vm_new(job->config);
+
+    msg_reader r;
+    msg_reader_init(&r, job->setup);
+    msg_read_globals(&r);
+    const xen_value fn = msg_read_value(&r);
+    free(r.objects);
+
+    par_work(job, worker->index, fn, XEN_FALSE);
+
+    xen_vm_free(vm);
+    return NULL;
+}
+
+static void par_job_free(par_job* job) {
+    for (u32 i = 0; i < job->chunk_count; i++) {
+        if (job->inputs[i] != NULL)
+            msg_free(job->inputs[i]);
+        if (job->outputs[i] != NULL)
+            msg_free(job->outputs[i]);
+    }
+    if (job->setup != NULL)
+        msg_free(job->setup);
+    free(job->inputs);
+    free(job->outputs);
+    free(job->items);
+    free(job->results);
+    free(job->queues);
+}
+
+// Copies what the workers need out of the calling VM: the setup message and the object items of every chunk
+static bool par_prepare_messages(par_job* job, xen_value fn, const char* what) {
+    msg_writer w;
+    msg_writer_init(&w, XEN_FALSE);
+    msg_write_globals(&w, job->array);
+    const bool ok = msg_write_value(&w, fn);
+    job->setup    = msg_writer_finish(&w, ok);
+    if (!ok) {
+        xen_runtime_error("[Array] %s(): cannot copy the function (%s) to a worker thread", what, w.failed);
+        return XEN_FALSE;
+    }
+
+    for (u32 chunk = 0; chunk < job->chunk_count; chunk++) {
+        const u32 begin = chunk * job->chunk_size;
+        const u32 end   = XEN_MIN(begin + job->chunk_size, job->count);
+        msg_writer items;
+        bool has_objects = XEN_FALSE;
+        for (u32 i = begin; i < end; i++) {
+            if (!VAL_IS_OBJ(job->items[i]))
+                continue;
+            if (!has_objects)
+                msg_writer_init(&items, XEN_FALSE);
+            has_objects = XEN_TRUE;
+            if (!msg_write_value(&items, job->items[i])) {
+                xen_runtime_error("[Array] %s(): cannot copy values of type %s to a worker thread", what, items.failed);
+                msg_writer_finish(&items, XEN_FALSE);
+                return XEN_FALSE;
+            }
+        }
+        if (has_objects)
+            job->inputs[chunk] = msg_writer_finish(&items, XEN_TRUE);
+    }
+    return XEN_TRUE;
+}
+
+// Runs the job on the calling VM and `job->participants - 1` worker threads. Returns false if the function failed
+// anywhere; errors in the calling VM have been reported by the VM, everything else is reported here.
+static bool par_execute(par_job* job, xen_value fn, const char* what) {
+    const u32 results = job->kind == PAR_MAP ? job->count : job->chunk_count;
+    job->results      = malloc(sizeof(xen_value) * results);
+    for (u32 i = 0; i < results; i++) {
+        job->results[i] = NULL_VAL;
+    }
+    job->inputs  = calloc(job->chunk_count, sizeof(xen_message*));
+    job->outputs = calloc(job->chunk_count, sizeof(xen_message*));
+    job->queues  = aligned_alloc(64, sizeof(par_queue) * (size_t)job->participants);
+    for (i32 p = 0; p < job->participants; p++) {
+        const u32 first = (u32)((u64)job->chunk_count * (u64)p / (u64)job->participants);
+        const u32 last  = (u32)((u64)job->chunk_count * (u64)(p + 1) / (u64)job->participants);
+        atomic_init(&job->queues[p].range, PAR_RANGE(first, last));
+    }
+    atomic_init(&job->failed, XEN_FALSE);
+    atomic_init(&job->uncopyable, NULL);
+
+    if (job->participants > 1 && !par_prepare_messages(job, fn, what))
+        return XEN_FALSE;
+
+    // a worker that can't be started simply doesn't show up, the others steal its chunks
+    par_worker* workers = calloc((size_t)job->participants, sizeof(par_worker));
+    for (i32 p = 1; p < job->participants; p++) {
+        workers[p].job     = job;
+        workers[p].index   = p;
+        workers[p].started = pthread_create(&workers[p].handle, NULL, par_worker_main, &workers[p]) == 0;
+    }
+    par_work(job, 0, fn, XEN_TRUE);
+    for (i32 p = 1; p < job->participants; p++) {
+        if (workers[p].started)
+            pthread_join(workers[p].handle, NULL);
+    }
+    free(workers);
+
+    if (!atomic_load(&job->failed))
+        return XEN_TRUE;
+    if (job->failed_locally)
+        return XEN_FALSE;
+    const char* uncopyable = atomic_load(&job->uncopyable);
+    if (uncopyable != NULL)
+        xen_runtime_error("[Array] %s(): cannot copy values of type %s back from a worker thread", what, uncopyable);
+    else
+        xen_runtime_error("[Array] %s(): the function failed in a worker thread", what);
+    return XEN_FALSE;
+}
+
+// Rebuilds the objects workers returned in the calling VM
+static void par_collect(par_job* job) {
+    for (u32 chunk = 0; chunk < job->chunk_count; chunk++) {
+        xen_message* msg = job->outputs[chunk];
+        if (msg == NULL)
+            continue;
+        msg_reader r;
+        msg_reader_init(&r, msg);
+        while (r.position < msg->size) {
+            const u32 slot     = msg_take_u32(&r);
+            job->results[slot] = msg_read_value(&r);
+        }
+        free(r.objects);
+    }
+}
+
+static void par_job_init(par_job* job, par_kind kind, xen_obj_array* array, i32 workers) {
+    memset(job, 0, sizeof(par_job));
+    job->kind   = kind;
+    job->config = g_vm->config;
+    job->array  = (xen_obj*)array;
+    job->count  = (u32)array->array.count;
+    job->items  = malloc(sizeof(xen_value) * (job->count > 0 ? job->count : 1));
+    if (job->count > 0)
+        memcpy(job->items, array->array.values, sizeof(xen_value) * job->count);  // values is NULL while empty
+
+    i32 participants = workers > 0 ? workers : (i32)VAL_AS_INTEGER(thread_cpu_count(0, NULL));
+    job->chunk_size  = XEN_MAX(1u, job->count / ((u32)participants * PAR_CHUNKS_PER_WORKER));
+    job->chunk_count = (job->count + job->chunk_size - 1) / job->chunk_size;
+    // reduce needs at least two items per chunk for the function to do anything in parallel
+    if (kind == PAR_REDUCE && job->chunk_size == 1 && job->count > 1) {
+        job->chunk_size  = 2;
+        job->chunk_count = (job->count + 1) / 2;
+    }
+    job->participants = XEN_MAX(1, XEN_MIN(participants, (i32)job->chunk_count));
+}
+
+xen_value xen_thread_par_map(xen_obj_array* array, xen_value fn, i32 workers) {
+    par_job job;
+    par_job_init(&job, PAR_MAP, array, workers);
+    if (!par_execute(&job, fn, "par_map")) {
+        par_job_free(&job);
+        return NULL_VAL;
+    }
+    par_collect(&job);
+
+    xen_obj_array* mapped = xen_obj_array_new_with_capacity((i32)job.count);
+    for (u32 i = 0; i < job.count; i++) {
+        xen_obj_array_push(mapped, job.results[i]);
+    }
+    par_job_free(&job);
+    return OBJ_VAL(mapped);
+}
+
+xen_value xen_thread_par_reduce(xen_obj_array* array, xen_value fn, xen_value init, i32 workers) {
+    par_job job;
+    par_job_init(&job, PAR_REDUCE, array, workers);
+    if (!par_execute(&job, fn, "par_reduce")) {
+        par_job_free(&job);
+        return NULL_VAL;
+    }
+    par_collect(&job);
+
+    // partial results are combined in array order, so the function only has to be associative
+    xen_value acc = init;
+    for (u32 i = 0; i < job.chunk_count; i++) {
+        xen_value args[2] = {acc, job.results[i]};
+        if (!xen_vm_call(fn, 2, args, &acc)) {
+            par_job_free(&job);
+            return NULL_VAL;
+        }
+    }
+    par_job_free(&job);
+    return acc;
+}
+
+//==============================================================//
+//                    Register Namespace                        //
+//==============================================================//
+
+xen_obj_namespace* xen_builtin_thread() {
+    xen_obj_namespace* thread = xen_obj_namespace_new("thread");
+
+    g_channel_class = create_channel_class();
+    g_thread_class  = create_thread_class();
+
+    xen_obj_namespace_set(thread, "Channel", OBJ_VAL(g_channel_class));
+    xen_obj_namespace_set(thread, "Thread", OBJ_VAL(g_thread_class));
+    xen_obj_namespace_set(thread, "spawn", OBJ_VAL(xen_obj_native_func_new(thread_spawn, "spawn")));
+    xen_obj_namespace_set(thread, "id", OBJ_VAL(xen_obj_native_func_new(thread_id, "id")));
+    xen_obj_namespace_set(thread, "cpu_count", OBJ_VAL(xen_obj_native_func_new(thread_cpu_count, "cpu_count")));
+
+    return thread;
+}
+
+#else
+
+static xen_value thread_cpu_count(i32 argc, array(xen_value) argv) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return INT_VAL(info.dwNumberOfProcessors);
+}
+
+// No worker threads here, the parallel array operations run on the calling VM
+
+xen_value xen_thread_par_map(xen_obj_array* array, xen_value fn, i32 workers) {
+    const i32 count       = array->array.count;
+    xen_obj_array* mapped = xen_obj_array_new_with_capacity(count);
+    for (i32 i = 0; i < count && i < array->array.count; i++) {
+        xen_value result;
+        if (!xen_vm_call(fn, 1, &array->array.values[i], &result))
+            return NULL_VAL;
+        xen_obj_array_push(mapped, result);
+    }
+    return OBJ_VAL(mapped);
+}
+
+xen_value xen_thread_par_reduce(xen_obj_array* array, xen_value fn, xen_value init, i32 workers) {
+    xen_value acc = init;
+    for (i32 i = 0; i < array->array.count; i++) {
+        xen_value args[2] = {acc, array->array.values[i]};
+        if (!xen_vm_call(fn, 2, args, &acc))
+            return NULL_VAL;
+    }
+    return acc;
+}
+
+void xen_thread_release_channels() {}
+
+xen_obj_namespace* xen_builtin_thread() {
+    xen_obj_namespace* thread = xen_obj_namespace_new("thread");
+    xen_obj_namespace_set(thread, "cpu_count", OBJ_VAL(xen_obj_native_func_new(thread_cpu_count, "cpu_count")));
+    return thread;
+}
+
+#endif
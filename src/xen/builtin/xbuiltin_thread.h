@@ -0,0 +1,33 @@
+#ifndef X_BUILTIN_THREAD_H
+#define X_BUILTIN_THREAD_H
+
+#include "../xcommon.h"
+#include "../xvalue.h"
+
+/*
+ * Worker threads (thread namespace)
+ *
+ * thread.spawn(fn, args...) runs a script function on a new OS thread inside a VM of its own. VMs share nothing: the
+ * function, its arguments and a snapshot of the spawning script's globals are copied into the worker's VM, and join()
+ * copies the function's return value back. Running threads talk through thread.Channel, a bounded lock-free
+ * multi-producer/multi-consumer queue. Values sent through a channel are copied as well (strings, arrays, dicts,
+ * UInt8Arrays, functions, script classes and their instances, other channels), except that sending with `transfer`
+ * hands UInt8Array buffers over instead of copying them, leaving the sender's arrays empty.
+ */
+
+#define XEN_CHANNEL_DEFAULT_CAPACITY 64
+
+xen_obj_namespace* xen_builtin_thread();
+
+// Drops the references the calling thread's VM holds on channels, called when the VM is freed. A channel is freed
+// with whatever is still queued in it once no VM and no message in flight holds it anymore.
+void xen_thread_release_channels();
+
+// Array.par_map() and Array.par_reduce(): fn runs over the array's items on the calling VM and up to `workers` - 1
+// worker VMs (one VM per CPU when `workers` <= 0). par_reduce() combines the per-chunk results in order, starting
+// from `init`, so fn has to be associative. Worker VMs get a copy of the globals without the array itself. Without
+// threads (Windows) both run on the calling VM only.
+xen_value xen_thread_par_map(xen_obj_array* array, xen_value fn, i32 workers);
+xen_value xen_thread_par_reduce(xen_obj_array* array, xen_value fn, xen_value init, i32 workers);
+
+#endif
@@ -4,6 +4,11 @@
 #include "xscanner.h"
 #include "xversion.h"
 #include "xvm.h"
+#include "xbytecode.h"
+#include "xcache.h"
+#include "xsnapshot.h"
+#include "xwatch.h"
+#include "xjit.h"
 #include "xutils.h"
 
 #define MAX_LINE_SIZE 1024
@@ -12,7 +17,11 @@
 #ifdef _WIN32
     #include <conio.h>
 #else
+    #include <errno.h>
+    #include <signal.h>
+    #include <sys/wait.h>
     #include <termios.h>
+    #include <time.h>
     #include <unistd.h>
 #endif
 
@@ -186,9 +195,19 @@ static void print_help() {
     printf(COLOR_BOLD COLOR_BRIGHT_BLUE "Xen" COLOR_RESET COLOR_DIM " - Copyright (C) 2025 Jake Rieger\n" COLOR_RESET);
     printf(COLOR_DIM "version " COLOR_RESET COLOR_BOLD VERSION_STRING_FULL COLOR_RESET "\n\n");
     printf("USAGE\n");
-    printf("  xen  " COLOR_DIM "-or-" COLOR_RESET "  xen <filename>\n\n");
+    printf("  xen  " COLOR_DIM "-or-" COLOR_RESET "  xen [options] <filename>\n\n");
+    printf("  <filename> is a script (.xen), a script compiled with xenc (.xenb) or a snapshot image\n\n");
     printf("ARGUMENTS\n");
     printf("  -h, --help  Show this help page\n");
+    printf("  --jit       Compile hot functions to native code (x86-64 Linux only)\n");
+    printf("  --workers N Run N processes of the script, each with its own VM (0 = one per CPU, POSIX only)\n");
+    printf("  --watch     Keep running and reload the script whenever it's saved, recompiling only the declarations\n");
+    printf("              that changed, also while an EventLoop is running (.xen scripts, Linux only)\n");
+    printf("  --snapshot <image>\n");
+    printf("              Run the script, then save its globals to <image>. `xen <image>` restores them and calls\n");
+    printf("              the script's main()\n\n");
+    printf("ENVIRONMENT\n");
+    printf("  " XEN_CACHE_DISABLE_ENV "  Don't cache compiled scripts in " XEN_CACHE_DIR "/ next to them\n");
     printf("\n");
 }
 
@@ -213,6 +232,141 @@ static void print_vm_config(const xen_vm_config* config) {
     printf("Memory (Gen)  : %lu %s\n", g_scaled, g_oom);
     printf("Memory (Temp) : %lu %s\n", t_scaled, t_oom);
     printf("Stack Size    : %lu %s\n", stack_scaled, stack_oom);
+    printf("JIT Threshold : %u%s\n", config->jit_threshold, config->jit_threshold == 0 ? " (disabled)" : "");
+}
+
+#ifndef _WIN32
+// Workers that die from a signal sooner than this after starting aren't restarted, so a script that crashes on
+// startup doesn't turn into a fork loop
+    #define WORKER_MIN_LIFETIME_SEC 1
+
+static volatile sig_atomic_t g_supervisor_signal = 0;
+
+static void supervisor_on_signal(int sig) {
+    g_supervisor_signal = sig;
+}
+
+// Forks a worker with its index in XEN_WORKER_ID, returns 0 in the worker and its pid in the supervisor
+static pid_t spawn_worker(i32 id) {
+    fflush(stdout);
+    fflush(stderr);
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+
+        char id_str[16];
+        snprintf(id_str, sizeof(id_str), "%d", id);
+        setenv(XEN_WORKER_ID_ENV, id_str, 1);
+    } else if (pid < 0) {
+        fprintf(stderr, "[xen] failed to start worker %d: %s\n", id, strerror(errno));
+    }
+
+    return pid;
+}
+
+// Prefork mode: starts `count` copies of this process and supervises them. Listeners bound in workers get
+// SO_REUSEPORT, so each worker accepts on its own socket and the kernel balances connections across them. Returns
+// XEN_TRUE in a worker, which carries on running the script, and XEN_FALSE in the supervisor once every worker has
+// exited. SIGINT/SIGTERM are forwarded to the workers, workers killed by a signal are restarted.
+static bool run_workers(i32 count) {
+    pid_t* pids     = calloc(count, sizeof(pid_t));
+    time_t* started = calloc(count, sizeof(time_t));
+    i32 alive       = 0;
+
+    for (i32 i = 0; i < count; i++) {
+        pids[i] = spawn_worker(i);
+        if (pids[i] == 0) {
+            free(pids);
+            free(started);
+            return XEN_TRUE;
+        }
+        if (pids[i] > 0) {
+            started[i] = time(NULL);
+            alive++;
+        }
+    }
+
+    // no SA_RESTART, a signal has to interrupt waitpid() so it can be forwarded
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = supervisor_on_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    bool forwarded = XEN_FALSE;
+    while (alive > 0) {
+        if (g_supervisor_signal != 0 && !forwarded) {
+            for (i32 i = 0; i < count; i++) {
+                if (pids[i] > 0) {
+                    kill(pids[i], g_supervisor_signal);
+                }
+            }
+            forwarded = XEN_TRUE;
+        }
+
+        int status;
+        const pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        i32 id = -1;
+        for (i32 i = 0; i < count; i++) {
+            if (pids[i] == pid) {
+                id = i;
+                break;
+            }
+        }
+        if (id < 0) {
+            continue;
+        }
+        pids[id] = 0;
+        alive--;
+
+        if (!WIFSIGNALED(status) || g_supervisor_signal != 0) {
+            continue;
+        }
+
+        if (time(NULL) - started[id] < WORKER_MIN_LIFETIME_SEC) {
+            fprintf(stderr, "[xen] worker %d died on startup (signal %d), not restarting\n", id, WTERMSIG(status));
+            continue;
+        }
+
+        fprintf(stderr, "[xen] worker %d (pid %d) killed by signal %d, restarting\n", id, (int)pid, WTERMSIG(status));
+        pids[id] = spawn_worker(id);
+        if (pids[id] == 0) {
+            free(pids);
+            free(started);
+            return XEN_TRUE;
+        }
+        if (pids[id] > 0) {
+            started[id] = time(NULL);
+            alive++;
+        }
+    }
+
+    free(pids);
+    free(started);
+    return XEN_FALSE;
+}
+#endif
+
+// Set by --snapshot: the state the script leaves behind is saved there once it has run
+static const char* g_snapshot_path = NULL;
+
+// Set by --watch, see xwatch.h
+static bool g_watch = XEN_FALSE;
+
+static void take_snapshot() {
+    if (g_snapshot_path != NULL && !xen_snapshot_write(g_snapshot_path)) {
+        xen_panic(XEN_ERR_EXEC_RUNTIME, "failed to write snapshot %s", g_snapshot_path);
+    }
 }
 
 static int execute_file(const char* filename, char** args, i32 arg_count) {
@@ -221,8 +375,13 @@ static int execute_file(const char* filename, char** args, i32 arg_count) {
         return XEN_FAIL;
     }
 
-    xen_exec_result exec_result = xen_vm_exec(source, args, arg_count);
+    // a snapshot keeps pointing at the code it saves, which can't be a cached image that's unmapped right after
+    xen_exec_result exec_result = g_snapshot_path != NULL ? xen_vm_exec(source, args, arg_count)
+                                                          : xen_vm_exec_file(filename, source, args, arg_count);
     free(source);
+    if (exec_result == EXEC_OK) {
+        take_snapshot();
+    }
 
     if (exec_result != EXEC_OK) {
         if (exec_result == EXEC_COMPILE_ERROR) {
@@ -233,23 +392,114 @@ static int execute_file(const char* filename, char** args, i32 arg_count) {
     return XEN_OK;
 }
 
+static int execute_bytecode_file(const char* filename, char** args, i32 arg_count) {
+    xen_bytecode_image image;
+    if (!xen_bytecode_image_open(filename, &image)) {
+        xen_panic(XEN_ERR_OPEN_FILE, "failed to open file: %s", filename);
+    }
+
+    xen_exec_result exec_result = xen_vm_exec_bytecode(image.data, image.size, args, arg_count);
+    if (exec_result == EXEC_OK) {
+        take_snapshot();
+    }
+    xen_bytecode_image_close(&image);
+
+    if (exec_result == EXEC_COMPILE_ERROR) {
+        xen_panic(XEN_ERR_EXEC_COMPILE, "failed to load bytecode");
+    }
+
+    return XEN_OK;
+}
+
+static int execute_snapshot_file(const char* filename, char** args, i32 arg_count) {
+    xen_bytecode_image image;
+    if (!xen_bytecode_image_open(filename, &image)) {
+        xen_panic(XEN_ERR_OPEN_FILE, "failed to open file: %s", filename);
+    }
+
+    xen_exec_result exec_result = xen_vm_exec_snapshot(image.data, image.size, args, arg_count);
+    xen_bytecode_image_close(&image);
+
+    if (exec_result == EXEC_COMPILE_ERROR) {
+        xen_panic(XEN_ERR_EXEC_COMPILE, "failed to restore snapshot");
+    }
+
+    return XEN_OK;
+}
+
+static bool is_snapshot_file(const char* filename) {
+    u8 magic[4];
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) {
+        return XEN_FALSE;
+    }
+    const size_t read = fread(magic, 1, sizeof(magic), fp);
+    fclose(fp);
+    return xen_snapshot_is_image(magic, read);
+}
+
 int main(int argc, char* argv[]) {
     xen_vm_config config;
     config.mem_size_permanent  = XEN_MB(64);
     config.mem_size_generation = XEN_MB(64);
     config.mem_size_temporary  = XEN_MB(4);
     config.stack_size          = XEN_KB(1);
+    config.jit_threshold       = 0;
+
+    // runtime options come before the script name, everything after it belongs to the script
+    i32 first_arg = 1;
+    i32 workers   = -1;
+    while (first_arg < argc) {
+        if (strcmp(argv[first_arg], "--jit") == 0) {
+            config.jit_threshold = XEN_JIT_DEFAULT_THRESHOLD;
+            first_arg++;
+        } else if (strcmp(argv[first_arg], "--workers") == 0 && first_arg + 1 < argc) {
+            char* end;
+            workers = (i32)strtol(argv[first_arg + 1], &end, 10);
+            if (*end != '\0' || workers < 0) {
+                xen_panic(XEN_ERR_INVALID_ARGS, "--workers expects a worker count, got '%s'", argv[first_arg + 1]);
+            }
+            first_arg += 2;
+        } else if (strcmp(argv[first_arg], "--watch") == 0) {
+            g_watch = XEN_TRUE;
+            first_arg++;
+        } else if (strcmp(argv[first_arg], "--snapshot") == 0 && first_arg + 1 < argc) {
+            g_snapshot_path = argv[first_arg + 1];
+            first_arg += 2;
+        } else {
+            break;
+        }
+    }
+
+    if (workers >= 0) {
+        if (argc - first_arg < 1) {
+            xen_panic(XEN_ERR_INVALID_ARGS, "--workers needs a script to run");
+        }
+#ifdef _WIN32
+        xen_panic(XEN_ERR_INVALID_ARGS, "--workers is not supported on Windows");
+#else
+        if (workers == 0) {
+            workers = (i32)sysconf(_SC_NPROCESSORS_ONLN);
+            if (workers < 1) {
+                workers = 1;
+            }
+        }
+        if (!run_workers(workers)) {
+            return XEN_OK;
+        }
+#endif
+    }
 
     xen_vm_init(config);
 
-    if (argc < 2) {
+    if (argc - first_arg < 1) {
         repl();
         return XEN_OK;
     }
 
-    char* arg1 = argv[1];
+    char* arg1 = argv[first_arg];
 
-    if (strcmp(arg1, "--help") == 0 || strcmp(argv[1], "-h") == 0) {
+    if (strcmp(arg1, "--help") == 0 || strcmp(arg1, "-h") == 0) {
         print_help();
         return XEN_OK;
     }
@@ -264,29 +514,47 @@ int main(int argc, char* argv[]) {
         return XEN_OK;
     }
 
-    // check supplied file extension so we know whether this is source or bytecode
-    const char* ext = strrchr(arg1, '.');
-    if (!ext) {
+    // check supplied file extension so we know whether this is source or bytecode, snapshots are told by their contents
+    const char* ext     = strrchr(arg1, '.');
+    const bool snapshot = (ext == NULL || (strcmp(ext, ".xen") != 0 && strcmp(ext, ".xenb") != 0)) &&
+                          is_snapshot_file(arg1);
+    if (!ext && !snapshot) {
         xen_panic(XEN_ERR_INVALID_ARGS, "supplied filename is invalid (no extension)");
     }
 
-    if (strcmp(ext, ".xen") == 0) {
+    if (snapshot || strcmp(ext, ".xen") == 0 || strcmp(ext, ".xenb") == 0) {
         // TODO: Capture remaining args and pass them to the VM so scripts can utilize them
         // The VM is responsible for releasing them
 
-        const i32 remaining_argc = argc - 2;  // One for the current process and one for the script name
+        const i32 remaining_argc = argc - first_arg - 1;  // Everything up to and including the script name
         char** script_args       = NULL;
         if (remaining_argc > 0) {
             script_args = malloc(sizeof(char*) * remaining_argc);
-            for (i32 i = 2; i < argc; i++) {
-                char* arg          = argv[i];
-                script_args[i - 2] = arg;
+            for (i32 i = first_arg + 1; i < argc; i++) {
+                char* arg                      = argv[i];
+                script_args[i - first_arg - 1] = arg;
             }
         }
 
-        execute_file(arg1, script_args, remaining_argc);
+        if (g_watch) {
+            if (snapshot || strcmp(ext, ".xen") != 0 || g_snapshot_path != NULL) {
+                xen_panic(XEN_ERR_INVALID_ARGS, "--watch needs a .xen script and can't be combined with --snapshot");
+            }
+            if (!xen_watch(arg1, script_args, remaining_argc)) {
+                xen_panic(XEN_ERR_INVALID_ARGS, "--watch is only supported on Linux");
+            }
+        } else if (snapshot) {
+            if (g_snapshot_path != NULL) {
+                xen_panic(XEN_ERR_INVALID_ARGS, "--snapshot needs a script, %s is already a snapshot", arg1);
+            }
+            execute_snapshot_file(arg1, script_args, remaining_argc);
+        } else if (strcmp(ext, ".xenb") == 0) {
+            execute_bytecode_file(arg1, script_args, remaining_argc);
+        } else {
+            execute_file(arg1, script_args, remaining_argc);
+        }
     } else {
-        xen_panic(XEN_ERR_INVALID_ARGS, "unrecognized file type '%s' (expected .xen)", ext);
+        xen_panic(XEN_ERR_INVALID_ARGS, "unrecognized file type '%s' (expected .xen or .xenb)", ext);
     }
 
     xen_vm_shutdown();
@@ -10,6 +10,8 @@
 #include "xobj_instance.h"
 #include "xobj_u8array.h"
 #include "xobj_error.h"
+#include "xobj_closure.h"
+#include "xobj_fiber.h"
 #include "../xutils.h"
 #include "../xvm.h"
 
@@ -102,14 +104,27 @@ void xen_obj_print(xen_value value) {
             printf("<Error: '%s'>", OBJ_ERROR_GET_MSG_CSTR(value));
             break;
         }
+        case OBJ_CLOSURE: {
+            print_function(OBJ_AS_CLOSURE(value)->fn);
+            break;
+        }
+        case OBJ_UPVALUE: {
+            printf("<Upvalue>");
+            break;
+        }
+        case OBJ_FIBER: {
+            printf("<Fiber>");
+            break;
+        }
     }
 }
 
 xen_obj* xen_obj_allocate(size_t size, xen_obj_type type) {
-    xen_obj* obj = (xen_obj*)xen_mem_realloc(NULL, 0, size);
-    obj->type    = type;
-    obj->next    = g_vm.objects;
-    g_vm.objects = obj;
+    xen_obj* obj  = (xen_obj*)xen_mem_realloc(NULL, 0, size);
+    obj->type     = type;
+    obj->frozen   = XEN_FALSE;
+    obj->next     = g_vm->objects;
+    g_vm->objects = obj;
     return obj;
 }
 
@@ -141,6 +156,8 @@ xen_native_fn xen_lookup_method(xen_value value, const char* name, bool* is_prop
             return lookup_in_table(k_dict_methods, name, is_property);
         case OBJ_ERROR:
             return lookup_in_table(k_error_methods, name, is_property);
+        case OBJ_FIBER:
+            return lookup_in_table(k_fiber_methods, name, is_property);
         default:
             return NULL;
     }
@@ -17,10 +17,14 @@ typedef enum {
     OBJ_INSTANCE,
     OBJ_U8ARRAY,
     OBJ_ERROR,
+    OBJ_CLOSURE,
+    OBJ_UPVALUE,
+    OBJ_FIBER,
 } xen_obj_type;
 
 struct xen_obj {
     xen_obj_type type;
+    bool frozen;  // immutable and shared by every VM, see xfrozen.h
     xen_obj* next;
 };
 
@@ -30,6 +34,7 @@ typedef xen_value (*xen_native_fn)(i32 arg_count, xen_value* args);
 xen_obj* xen_obj_allocate(size_t size, xen_obj_type type);
 
 #define OBJ_TYPE(v) (VAL_AS_OBJ(v)->type)
+#define OBJ_IS_FROZEN(v) (VAL_IS_OBJ(v) && VAL_AS_OBJ(v)->frozen)
 
 bool xen_obj_is_type(xen_value value, xen_obj_type type);
 void xen_obj_print(xen_value value);
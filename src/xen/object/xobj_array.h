@@ -30,6 +30,11 @@ static xen_method_entry k_array_methods[] = {{"len", xen_arr_len, XEN_TRUE},  //
                                              {"index_of", xen_arr_index_of, XEN_FALSE},
                                              {"reverse", xen_arr_reverse, XEN_FALSE},
                                              {"join", xen_arr_join, XEN_FALSE},
+                                             {"map", xen_arr_map, XEN_FALSE},
+                                             {"filter", xen_arr_filter, XEN_FALSE},
+                                             {"par_map", xen_arr_par_map, XEN_FALSE},
+                                             {"par_reduce", xen_arr_par_reduce, XEN_FALSE},
+                                             {"par_sort", xen_arr_par_sort, XEN_FALSE},
                                              {NULL, NULL, XEN_FALSE}};
 
 #endif
\ No newline at end of file
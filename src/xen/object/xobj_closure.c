@@ -0,0 +1,23 @@
+#include "xobj_closure.h"
+#include "../xmem.h"
+
+xen_obj_upvalue* xen_obj_upvalue_new(xen_value* slot) {
+    xen_obj_upvalue* upvalue = ALLOCATE_OBJ(xen_obj_upvalue, OBJ_UPVALUE);
+    upvalue->location        = slot;
+    upvalue->closed          = NULL_VAL;
+    upvalue->next            = NULL;
+    return upvalue;
+}
+
+xen_obj_closure* xen_obj_closure_new(xen_obj_func* fn) {
+    xen_obj_upvalue** upvalues = XEN_ALLOCATE(xen_obj_upvalue*, fn->upvalue_count);
+    for (i32 i = 0; i < fn->upvalue_count; i++) {
+        upvalues[i] = NULL;
+    }
+
+    xen_obj_closure* closure = ALLOCATE_OBJ(xen_obj_closure, OBJ_CLOSURE);
+    closure->fn              = fn;
+    closure->upvalues        = upvalues;
+    closure->upvalue_count   = fn->upvalue_count;
+    return closure;
+}
@@ -0,0 +1,30 @@
+#ifndef X_OBJ_CLOSURE_H
+#define X_OBJ_CLOSURE_H
+
+#include "xobj.h"
+#include "xobj_function.h"
+
+// A captured local. While the enclosing function is still running `location` points at its stack slot ("open"); once
+// the slot goes out of scope the value is copied into `closed` and `location` is redirected there.
+struct xen_obj_upvalue {
+    xen_obj obj;
+    xen_value* location;
+    xen_value closed;
+    xen_obj_upvalue* next;  // next open upvalue further down the stack
+};
+
+// A function together with the variables it captured. Functions that capture nothing are never wrapped.
+struct xen_obj_closure {
+    xen_obj obj;
+    xen_obj_func* fn;
+    xen_obj_upvalue** upvalues;
+    i32 upvalue_count;
+};
+
+#define OBJ_IS_CLOSURE(v) xen_obj_is_type(v, OBJ_CLOSURE)
+#define OBJ_AS_CLOSURE(v) ((xen_obj_closure*)VAL_AS_OBJ(v))
+
+xen_obj_upvalue* xen_obj_upvalue_new(xen_value* slot);
+xen_obj_closure* xen_obj_closure_new(xen_obj_func* fn);
+
+#endif
@@ -0,0 +1,58 @@
+#include "xobj_fiber.h"
+#include "../xerr.h"
+#include "../xmem.h"
+
+xen_obj_fiber* xen_obj_fiber_new(xen_value fn) {
+    xen_obj_fiber* fiber = ALLOCATE_OBJ(xen_obj_fiber, OBJ_FIBER);
+    fiber->fn            = fn;
+    fiber->state         = FIBER_NEW;
+    fiber->resumer       = NULL;
+
+    xen_exec_context* context = &fiber->context;
+    context->frames           = XEN_ALLOCATE(xen_call_frame, XEN_FIBER_FRAMES_INITIAL);
+    context->frame_count      = 0;
+    context->frame_capacity   = XEN_FIBER_FRAMES_INITIAL;
+    context->stack            = XEN_ALLOCATE(xen_value, XEN_FIBER_STACK_INITIAL);
+    context->stack_top        = context->stack;
+    context->stack_end        = context->stack + XEN_FIBER_STACK_INITIAL;
+    context->open_upvalues    = NULL;
+    context->native_depth     = 0;
+    return fiber;
+}
+
+void xen_obj_fiber_release_stack(xen_obj_fiber* fiber) {
+    xen_exec_context* context = &fiber->context;
+    XEN_FREE_ARRAY(xen_call_frame, context->frames, context->frame_capacity);
+    XEN_FREE_ARRAY(xen_value, context->stack, context->stack_end - context->stack);
+    context->frames         = NULL;
+    context->frame_count    = 0;
+    context->frame_capacity = 0;
+    context->stack          = NULL;
+    context->stack_top      = NULL;
+    context->stack_end      = NULL;
+}
+
+xen_value xen_obj_fiber_resume(i32 argc, xen_value* argv) {
+    if (argc < 1 || !OBJ_IS_FIBER(argv[0]))
+        return NULL_VAL;
+
+    xen_obj_fiber* fiber = OBJ_AS_FIBER(argv[0]);
+    if (fiber->state == FIBER_DONE) {
+        xen_runtime_error("cannot resume a finished fiber");
+        return NULL_VAL;
+    }
+    if (fiber->state == FIBER_RUNNING) {
+        xen_runtime_error("cannot resume a running fiber");
+        return NULL_VAL;
+    }
+
+    fiber->resumer = g_vm->fiber;
+    xen_vm_switch_fiber(fiber, argc > 1 ? argv[1] : NULL_VAL);
+    return NULL_VAL;  // replaced by the value the fiber yields or returns
+}
+
+xen_value xen_obj_fiber_done(i32 argc, xen_value* argv) {
+    if (argc < 1 || !OBJ_IS_FIBER(argv[0]))
+        return NULL_VAL;
+    return BOOL_VAL(OBJ_AS_FIBER(argv[0])->state == FIBER_DONE);
+}
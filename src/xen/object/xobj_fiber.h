@@ -0,0 +1,42 @@
+#ifndef X_OBJ_FIBER_H
+#define X_OBJ_FIBER_H
+
+#include "xobj.h"
+#include "../xvm.h"
+
+#define XEN_FIBER_STACK_INITIAL 512  // values, grows on demand
+#define XEN_FIBER_FRAMES_INITIAL 8
+#define XEN_FIBER_FRAMES_MAX 1024
+
+typedef enum {
+    FIBER_NEW,        // created, function not called yet
+    FIBER_SUSPENDED,  // yielded, waiting for resume()
+    FIBER_RUNNING,    // running, or waiting for a fiber it resumed
+    FIBER_DONE,       // function returned, stack released
+} xen_fiber_state;
+
+// A coroutine with its own value stack and call frames. Fibers are asymmetric: yield() always returns control to
+// whoever last resumed the fiber.
+struct xen_obj_fiber {
+    xen_obj obj;
+    xen_value fn;  // function or closure taking zero or one argument
+    xen_fiber_state state;
+    xen_exec_context context;  // saved registers while the fiber isn't running
+    xen_obj_fiber* resumer;    // NULL when resumed by the main script
+};
+
+#define OBJ_IS_FIBER(v) xen_obj_is_type(v, OBJ_FIBER)
+#define OBJ_AS_FIBER(v) ((xen_obj_fiber*)VAL_AS_OBJ(v))
+
+xen_obj_fiber* xen_obj_fiber_new(xen_value fn);
+void xen_obj_fiber_release_stack(xen_obj_fiber* fiber);
+xen_value xen_obj_fiber_resume(i32 argc, xen_value* argv);
+xen_value xen_obj_fiber_done(i32 argc, xen_value* argv);
+
+static xen_method_entry k_fiber_methods[] = {
+  {"resume", xen_obj_fiber_resume, XEN_FALSE},
+  {"done", xen_obj_fiber_done, XEN_TRUE},  // property
+  {NULL, NULL, XEN_FALSE},
+};
+
+#endif
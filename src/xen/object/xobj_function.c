@@ -1,9 +1,15 @@
 #include "xobj_function.h"
 
 xen_obj_func* xen_obj_func_new() {
-    xen_obj_func* fn = ALLOCATE_OBJ(xen_obj_func, OBJ_FUNCTION);
-    fn->arity        = 0;
-    fn->name         = NULL;
+    xen_obj_func* fn  = ALLOCATE_OBJ(xen_obj_func, OBJ_FUNCTION);
+    fn->arity         = 0;
+    fn->upvalue_count = 0;
+    fn->name          = NULL;
+    fn->hotness       = 0;
+    fn->jit           = NULL;
+    fn->aot           = NULL;
+    fn->module        = NULL;
+    fn->module_index  = 0;
     xen_chunk_init(&fn->chunk);
     return fn;
 }
\ No newline at end of file
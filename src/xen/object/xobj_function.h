@@ -3,11 +3,23 @@
 
 #include "xobj.h"
 
+// C translation of a function produced by `xenc --aot`, called like JIT code (see xaot.h)
+typedef void (*xen_aot_fn)(xen_call_frame* frame, xen_value** stack_top);
+
 struct xen_obj_func {
     xen_obj obj;
-    i32 arity;  // number of parameters
+    i32 arity;          // number of parameters
+    i32 upvalue_count;  // number of variables captured from enclosing functions
     xen_chunk chunk;
     xen_obj_str* name;
+    u32 hotness;        // call + loop back-edge counter, compiled by the JIT when it reaches the threshold
+    xen_jit_code* jit;  // native code or NULL while interpreted
+    xen_aot_fn aot;     // ahead-of-time compiled code, NULL unless the function comes from an `xenc --aot` binary
+
+    // Functions of a .xenb image are decoded on their first call: until then `module` is the image they come from
+    // and only the name, arity and code are set (see xen_bytecode_load_function)
+    xen_bytecode_module* module;
+    u32 module_index;
 };
 
 #define OBJ_IS_FUNCTION(v) xen_obj_is_type(v, OBJ_FUNCTION)
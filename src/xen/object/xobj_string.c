@@ -8,13 +8,13 @@ static xen_obj_str* allocate_str(char* chars, i32 length, u32 hash) {
     str->length      = length;
     str->str         = chars;
     str->hash        = hash;
-    xen_table_set(&g_vm.strings, str, NULL_VAL);
+    xen_table_set(&g_vm->strings, str, NULL_VAL);
     return str;
 }
 
 xen_obj_str* xen_obj_str_take(char* chars, i32 length) {
     u32 hash              = xen_hash_string(chars, length);
-    xen_obj_str* interned = xen_table_find_str(&g_vm.strings, chars, length, hash);
+    xen_obj_str* interned = xen_table_find_str(&g_vm->strings, chars, length, hash);
     if (interned != NULL) {
         XEN_FREE_ARRAY(char, chars, length + 1);
         return interned;
@@ -24,7 +24,7 @@ xen_obj_str* xen_obj_str_take(char* chars, i32 length) {
 
 xen_obj_str* xen_obj_str_copy(const char* chars, i32 length) {
     u32 hash              = xen_hash_string(chars, length);
-    xen_obj_str* interned = xen_table_find_str(&g_vm.strings, chars, length, hash);
+    xen_obj_str* interned = xen_table_find_str(&g_vm->strings, chars, length, hash);
     if (interned != NULL)
         return interned;
 
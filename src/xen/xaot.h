@@ -0,0 +1,232 @@
+#ifndef X_AOT_H
+#define X_AOT_H
+
+#include "xcommon.h"
+#include "xvm.h"
+#include "xtable.h"
+#include "object/xobj_array.h"
+#include "object/xobj_class.h"
+#include "object/xobj_closure.h"
+#include "object/xobj_dict.h"
+#include "object/xobj_function.h"
+#include "object/xobj_instance.h"
+#include "object/xobj_string.h"
+#include "object/xobj_u8array.h"
+
+/*
+ * Ahead-of-time compiled functions
+ *
+ * `xenc --aot script.xen` translates every function of a script into a C function and builds it into a standalone
+ * binary together with the VM and the script's .xenb image (xen_vm_exec_aot). A translated function follows the JIT's
+ * contract (see xjit.h): the interpreter calls it with frame->ip at the instruction to continue from, it runs straight
+ * through its instructions, jumps included, and returns once it reaches one it leaves to the interpreter (calls,
+ * returns, closures, classes, ...) or a fast path below fails, with frame->ip pointing at that instruction and the
+ * VM stack holding the frame's values. The interpreter re-enters it after calls, returns and loop back-edges.
+ *
+ * While a translated function runs, its stack slots (locals and temporaries alike) are C locals, one per slot, since
+ * the depth of the stack is known at every instruction. They are loaded from the VM stack on entry and stored back
+ * before returning to the interpreter, which also covers every case where other code could look at the stack.
+ *
+ * The helpers below are the translated instructions' fast paths. Each returns false, without side effects, when the
+ * interpreter has to execute the instruction instead, typically to report an error.
+ */
+
+static inline bool xen_aot_is_falsy(xen_value value) {
+    return VAL_IS_NULL(value) || (VAL_IS_BOOL(value) && !VAL_AS_BOOL(value));
+}
+
+// OP_ADD, OP_SUBTRACT, OP_MULTIPLY, OP_DIVIDE, OP_MOD, OP_LESS and OP_GREATER on `*a` and `b`, result in `*a`
+static inline bool xen_aot_arith(u8 op, xen_value* a, xen_value b) {
+    if (VAL_PAIR_IS_INT(*a, b)) {
+        i64 result;
+        switch (op) {
+            case OP_ADD:
+                if (__builtin_add_overflow(a->as.integer, b.as.integer, &result))
+                    break;
+                a->as.integer = result;
+                return XEN_TRUE;
+            case OP_SUBTRACT:
+                if (__builtin_sub_overflow(a->as.integer, b.as.integer, &result))
+                    break;
+                a->as.integer = result;
+                return XEN_TRUE;
+            case OP_MULTIPLY:
+                if (__builtin_mul_overflow(a->as.integer, b.as.integer, &result))
+                    break;
+                a->as.integer = result;
+                return XEN_TRUE;
+            case OP_LESS:
+                *a = BOOL_VAL(a->as.integer < b.as.integer);
+                return XEN_TRUE;
+            case OP_GREATER:
+                *a = BOOL_VAL(a->as.integer > b.as.integer);
+                return XEN_TRUE;
+            default:
+                break;
+        }
+    } else if (VAL_PAIR_IS_NUMBER(*a, b)) {
+        switch (op) {
+            case OP_ADD:
+                a->as.number += b.as.number;
+                return XEN_TRUE;
+            case OP_SUBTRACT:
+                a->as.number -= b.as.number;
+                return XEN_TRUE;
+            case OP_MULTIPLY:
+                a->as.number *= b.as.number;
+                return XEN_TRUE;
+            case OP_DIVIDE:
+                a->as.number /= b.as.number;
+                return XEN_TRUE;
+            case OP_LESS:
+                *a = BOOL_VAL(a->as.number < b.as.number);
+                return XEN_TRUE;
+            case OP_GREATER:
+                *a = BOOL_VAL(a->as.number > b.as.number);
+                return XEN_TRUE;
+            default:
+                break;
+        }
+    }
+    return xen_vm_numeric_binary(op, *a, b, a);  // mixed operands, overflow, modulo
+}
+
+static inline bool xen_aot_negate(xen_value* value) {
+    if (VAL_IS_INT(*value) && value->as.integer != INT64_MIN) {
+        value->as.integer = -value->as.integer;
+        return XEN_TRUE;
+    }
+    if (VAL_IS_FLOAT(*value)) {
+        value->as.number = -value->as.number;
+        return XEN_TRUE;
+    }
+    return XEN_FALSE;
+}
+
+// OP_BIT_AND, OP_BIT_OR, OP_BIT_XOR, OP_SHIFT_LEFT and OP_SHIFT_RIGHT on two ints
+static inline bool xen_aot_bitwise(u8 op, xen_value* a, xen_value b) {
+    if (!VAL_PAIR_IS_INT(*a, b))
+        return XEN_FALSE;
+    const i64 x = a->as.integer, y = b.as.integer;
+    switch (op) {
+        case OP_BIT_AND:
+            a->as.integer = x & y;
+            return XEN_TRUE;
+        case OP_BIT_OR:
+            a->as.integer = x | y;
+            return XEN_TRUE;
+        case OP_BIT_XOR:
+            a->as.integer = x ^ y;
+            return XEN_TRUE;
+        case OP_SHIFT_LEFT:
+        case OP_SHIFT_RIGHT:
+            if (y < 0 || y > 63)
+                return XEN_FALSE;
+            a->as.integer = op == OP_SHIFT_LEFT ? (i64)((u64)x << y) : x >> y;
+            return XEN_TRUE;
+        default:
+            return XEN_FALSE;
+    }
+}
+
+static inline bool xen_aot_get_global(xen_obj_str* name, xen_value* out) {
+    return xen_table_get(&g_vm->globals, name, out);
+}
+
+static inline bool xen_aot_set_global(xen_obj_str* name, xen_value value) {
+    if (xen_table_set(&g_vm->globals, name, value)) {
+        xen_table_delete(&g_vm->globals, name);  // undefined variable, the interpreter raises the error
+        return XEN_FALSE;
+    }
+    return XEN_TRUE;
+}
+
+static inline xen_value* xen_aot_upvalue(const xen_call_frame* frame, u8 index) {
+    return frame->closure->upvalues[index]->location;
+}
+
+static inline bool xen_aot_array_len(xen_value* value) {
+    if (OBJ_IS_ARRAY(*value)) {
+        *value = INT_VAL(OBJ_AS_ARRAY(*value)->array.count);
+        return XEN_TRUE;
+    }
+    if (OBJ_IS_U8ARRAY(*value)) {
+        *value = INT_VAL(OBJ_AS_U8ARRAY(*value)->count);
+        return XEN_TRUE;
+    }
+    return XEN_FALSE;
+}
+
+// container[index] into `*out` for arrays and dictionaries
+static inline bool xen_aot_index_get(xen_value container, xen_value index, xen_value* out) {
+    if (OBJ_IS_ARRAY(container) && VAL_IS_NUMBER(index)) {
+        const xen_obj_array* arr = OBJ_AS_ARRAY(container);
+        const i64 i              = VAL_AS_INTEGER(index);
+        if (i < 0 || i >= arr->array.count)
+            return XEN_FALSE;
+        *out = arr->array.values[i];
+        return XEN_TRUE;
+    }
+    if (OBJ_IS_U8ARRAY(container) && VAL_IS_NUMBER(index)) {
+        const xen_obj_u8array* arr = OBJ_AS_U8ARRAY(container);
+        const i64 i                = VAL_AS_INTEGER(index);
+        if (i < 0 || i >= arr->count)
+            return XEN_FALSE;
+        *out = INT_VAL(arr->values[i]);
+        return XEN_TRUE;
+    }
+    if (OBJ_IS_DICT(container)) {
+        if (!xen_obj_dict_get(OBJ_AS_DICT(container), index, out))
+            *out = NULL_VAL;
+        return XEN_TRUE;
+    }
+    return XEN_FALSE;
+}
+
+static inline bool xen_aot_index_set(xen_value container, xen_value index, xen_value value) {
+    if (OBJ_IS_FROZEN(container))
+        return XEN_FALSE;
+    if (OBJ_IS_ARRAY(container) && VAL_IS_NUMBER(index)) {
+        xen_obj_array* arr = OBJ_AS_ARRAY(container);
+        const i64 i        = VAL_AS_INTEGER(index);
+        if (i < 0 || i >= arr->array.count)
+            return XEN_FALSE;
+        arr->array.values[i] = value;
+        return XEN_TRUE;
+    }
+    if (OBJ_IS_DICT(container)) {
+        xen_obj_dict_set(OBJ_AS_DICT(container), index, value);
+        return XEN_TRUE;
+    }
+    return XEN_FALSE;
+}
+
+// Public fields of instances, methods and private fields go through the interpreter
+static inline bool xen_aot_get_field(xen_value object, xen_obj_str* name, xen_value* out) {
+    if (!OBJ_IS_INSTANCE(object))
+        return XEN_FALSE;
+    xen_obj_instance* instance = OBJ_AS_INSTANCE(object);
+    const i32 index            = xen_find_property_index(instance->class, name);
+    if (index < 0 || instance->class->properties[index].is_private)
+        return XEN_FALSE;
+    return xen_obj_instance_get(instance, name, out);
+}
+
+static inline bool xen_aot_set_field(xen_value object, xen_obj_str* name, xen_value value) {
+    if (!OBJ_IS_INSTANCE(object))
+        return XEN_FALSE;
+    xen_obj_instance* instance = OBJ_AS_INSTANCE(object);
+    const i32 index            = xen_find_property_index(instance->class, name);
+    if (index < 0 || instance->class->properties[index].is_private)
+        return XEN_FALSE;
+    return xen_obj_instance_set(instance, name, value);
+}
+
+static inline xen_value xen_aot_array_new(const xen_value* elements, i32 count) {
+    xen_obj_array* arr = xen_obj_array_new_with_capacity(count);
+    arr->array.count   = count;
+    memcpy(arr->array.values, elements, count * sizeof(xen_value));
+    return OBJ_VAL(arr);
+}
+
+#endif
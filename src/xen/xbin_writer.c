@@ -4,22 +4,7 @@
 #include <string.h>
 #include <assert.h>
 
-static bool ensure_space(xen_bin_writer* writer, size_t needed) {
-    if (writer->error) {
-        return false;
-    }
-
-    size_t required = writer->position + needed;
-
-    if (required <= writer->capacity) {
-        return true;
-    }
-
-    if (!writer->auto_grow) {
-        writer->error = true;
-        return false;
-    }
-
+static bool grow(xen_bin_writer* writer, size_t required) {
     // Grow by at least 1.5x, or enough to fit the required size
     size_t new_capacity = writer->capacity + (writer->capacity >> 1);
     if (new_capacity < required) {
@@ -47,6 +32,33 @@ static bool ensure_space(xen_bin_writer* writer, size_t needed) {
     return true;
 }
 
+static bool ensure_space(xen_bin_writer* writer, size_t needed) {
+    if (writer->error) {
+        return false;
+    }
+
+    size_t required = writer->position + needed;
+
+    if (required <= writer->capacity) {
+        return true;
+    }
+
+    if (writer->stream) {
+        // Make room by flushing, a single value larger than the whole buffer still grows it
+        if (!xen_bin_writer_flush(writer)) {
+            return false;
+        }
+        return needed <= writer->capacity || grow(writer, needed);
+    }
+
+    if (!writer->auto_grow) {
+        writer->error = true;
+        return false;
+    }
+
+    return grow(writer, required);
+}
+
 void xen_bin_writer_init(xen_bin_writer* writer, size_t capacity, bool auto_grow) {
     assert(writer != NULL);
     assert(capacity > 0);
@@ -57,6 +69,8 @@ void xen_bin_writer_init(xen_bin_writer* writer, size_t capacity, bool auto_grow
         writer->position  = 0;
         writer->auto_grow = false;
         writer->error     = true;
+        writer->stream    = NULL;
+        writer->flushed   = 0;
         return;
     }
 
@@ -64,9 +78,35 @@ void xen_bin_writer_init(xen_bin_writer* writer, size_t capacity, bool auto_grow
     writer->position  = 0;
     writer->auto_grow = auto_grow;
     writer->error     = false;
+    writer->stream    = NULL;
+    writer->flushed   = 0;
+}
+
+void xen_bin_writer_init_stream(xen_bin_writer* writer, FILE* stream, size_t buffer_size) {
+    assert(stream != NULL);
+
+    xen_bin_writer_init(writer, buffer_size, false);
+    writer->stream = stream;
+}
+
+bool xen_bin_writer_flush(xen_bin_writer* writer) {
+    if (!writer->stream || writer->position == 0) {
+        return !writer->error;
+    }
+    if (fwrite(writer->data, 1, writer->position, writer->stream) != writer->position) {
+        writer->error = true;
+        return false;
+    }
+    writer->flushed += writer->position;
+    writer->position = 0;
+    return !writer->error;
 }
 
 void xen_bin_writer_free(xen_bin_writer* writer) {
+    if (writer && writer->stream) {
+        xen_bin_writer_flush(writer);
+        writer->stream = NULL;
+    }
     if (writer && writer->data) {
         free(writer->data);
         writer->data     = NULL;
@@ -84,11 +124,11 @@ void xen_bin_writer_clear_error(xen_bin_writer* writer) {
 }
 
 size_t xen_bin_writer_position(const xen_bin_writer* writer) {
-    return writer->position;
+    return writer->flushed + writer->position;
 }
 
 size_t xen_bin_writer_size(const xen_bin_writer* writer) {
-    return writer->position;
+    return writer->flushed + writer->position;
 }
 
 size_t xen_bin_writer_remaining(const xen_bin_writer* writer) {
@@ -96,11 +136,11 @@ size_t xen_bin_writer_remaining(const xen_bin_writer* writer) {
 }
 
 bool xen_bin_writer_seek(xen_bin_writer* writer, size_t position) {
-    if (position > writer->capacity) {
+    if (position < writer->flushed || position - writer->flushed > writer->capacity) {
         writer->error = true;
         return false;
     }
-    writer->position = position;
+    writer->position = position - writer->flushed;
     return true;
 }
 
@@ -187,12 +227,41 @@ bool xen_bin_write_bool(xen_bin_writer* writer, bool value) {
     return xen_bin_write_u8(writer, value ? 1 : 0);
 }
 
+bool xen_bin_write_varint(xen_bin_writer* writer, uint64_t value) {
+    if (!ensure_space(writer, 10)) {
+        return false;
+    }
+
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value != 0) {
+            byte |= 0x80;
+        }
+        writer->data[writer->position++] = byte;
+    } while (value != 0);
+    return true;
+}
+
 bool xen_bin_write_bytes(xen_bin_writer* writer, const void* data, size_t length) {
     if (!data && length > 0) {
         writer->error = true;
         return false;
     }
 
+    if (writer->stream && length >= writer->capacity) {
+        // Large blocks skip the buffer
+        if (!xen_bin_writer_flush(writer)) {
+            return false;
+        }
+        if (fwrite(data, 1, length, writer->stream) != length) {
+            writer->error = true;
+            return false;
+        }
+        writer->flushed += length;
+        return true;
+    }
+
     if (!ensure_space(writer, length)) {
         return false;
     }
@@ -253,8 +322,9 @@ size_t xen_bin_writer_align_offset(size_t offset, size_t alignment) {
 }
 
 bool xen_bin_write_align(xen_bin_writer* writer, size_t alignment) {
-    size_t aligned_pos = xen_bin_writer_align_offset(writer->position, alignment);
-    size_t padding     = aligned_pos - writer->position;
+    size_t position    = xen_bin_writer_position(writer);
+    size_t aligned_pos = xen_bin_writer_align_offset(position, alignment);
+    size_t padding     = aligned_pos - position;
 
     if (padding == 0) {
         return true;
@@ -266,6 +336,6 @@ bool xen_bin_write_align(xen_bin_writer* writer, size_t alignment) {
 
     // Write zeros for padding
     memset(writer->data + writer->position, 0, padding);
-    writer->position = aligned_pos;
+    writer->position += padding;
     return true;
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 
 typedef struct {
     uint8_t* data;
@@ -11,17 +12,27 @@ typedef struct {
     size_t position;
     bool auto_grow;  // Automatically resize when capacity is exceeded
     bool error;      // Track if an error occurred
+    FILE* stream;    // Streaming writers flush `data` here whenever it fills up
+    size_t flushed;  // Bytes already written to `stream`
 } xen_bin_writer;
 
 // Initialize writer with optional auto-grow
 void xen_bin_writer_init(xen_bin_writer* writer, size_t capacity, bool auto_grow);
 void xen_bin_writer_free(xen_bin_writer* writer);
 
+// Initialize a writer that streams to `stream` through a buffer of `buffer_size` bytes, so its output has no size
+// ceiling. Seeking is limited to the bytes still buffered. xen_bin_writer_free flushes the buffer but leaves the
+// stream open.
+void xen_bin_writer_init_stream(xen_bin_writer* writer, FILE* stream, size_t buffer_size);
+
+// Write buffered bytes out to the stream, a no-op for in-memory writers
+bool xen_bin_writer_flush(xen_bin_writer* writer);
+
 // Check if writer has encountered an error
 bool xen_bin_writer_has_error(const xen_bin_writer* writer);
 void xen_bin_writer_clear_error(xen_bin_writer* writer);
 
-// Get current position and size
+// Get current position and size, streamed bytes included
 size_t xen_bin_writer_position(const xen_bin_writer* writer);
 size_t xen_bin_writer_size(const xen_bin_writer* writer);
 size_t xen_bin_writer_remaining(const xen_bin_writer* writer);
@@ -46,6 +57,9 @@ bool xen_bin_write_f32(xen_bin_writer* writer, float value);
 bool xen_bin_write_f64(xen_bin_writer* writer, double value);
 bool xen_bin_write_bool(xen_bin_writer* writer, bool value);
 
+// Write unsigned LEB128 varint (7 bits per byte, high bit set on all but the last)
+bool xen_bin_write_varint(xen_bin_writer* writer, uint64_t value);
+
 // Write raw bytes
 bool xen_bin_write_bytes(xen_bin_writer* writer, const void* data, size_t length);
 
@@ -0,0 +1,672 @@
+#include "xbytecode.h"
+#include "xchunk.h"
+#include "xmem.h"
+#include "xtable.h"
+#include "xutils.h"
+#include "xvm.h"
+
+#include "object/xobj_function.h"
+#include "object/xobj_string.h"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#define XENB_HEADER_SIZE 8
+#define XENB_SECTION_ENTRY_SIZE 12
+#define XENB_FUNCTION_RECORD_SIZE 32
+#define XENB_SECTION_ALIGNMENT 8
+#define XENB_CODE_ALIGNMENT 4096  // a page, so mapped code shares pages with nothing else
+
+typedef enum {
+    SECTION_STRINGS,
+    SECTION_FUNCTIONS,
+    SECTION_CONSTANTS,
+    SECTION_CODE,
+    SECTION_LINES,
+    SECTION_COUNT,
+} xenb_section;
+
+static const char k_section_ids[SECTION_COUNT][4] = {
+  {'S', 'T', 'R', 'S'},
+  {'F', 'U', 'N', 'C'},
+  {'C', 'N', 'S', 'T'},
+  {'C', 'O', 'D', 'E'},
+  {'L', 'I', 'N', 'E'},
+};
+
+//==============================================================//
+//                           Encoding                           //
+//==============================================================//
+
+typedef struct {
+    xen_bin_writer sections[SECTION_COUNT];  // STRS only holds the string bytes until the image is assembled
+    xen_bin_writer string_entries;
+    xen_table string_index;  // string -> INT_VAL(its index in the pool)
+    u32 string_count;
+    array(xen_obj_func*) functions;  // by index, written in this order
+    u32 function_count;
+    u32 function_capacity;
+    const char* failed;
+} xenb_encoder;
+
+static u32 encode_string(xenb_encoder* e, xen_obj_str* str) {
+    xen_value index;
+    if (xen_table_get(&e->string_index, str, &index))
+        return (u32)VAL_AS_INT(index);
+
+    xen_bin_writer* data = &e->sections[SECTION_STRINGS];
+    xen_bin_write_u32(&e->string_entries, (u32)xen_bin_writer_position(data));
+    xen_bin_write_u32(&e->string_entries, (u32)str->length);
+    xen_bin_write_bytes(data, str->str, (size_t)str->length);
+    xen_table_set(&e->string_index, str, INT_VAL(e->string_count));
+    return e->string_count++;
+}
+
+// Functions are numbered in the order they are found, each one is written once its parent has been
+static u32 encode_function_ref(xenb_encoder* e, xen_obj_func* fn) {
+    if (e->function_count == e->function_capacity) {
+        const u32 old_capacity = e->function_capacity;
+        e->function_capacity   = XEN_GROW_CAPACITY(old_capacity);
+        e->functions           = XEN_GROW_ARRAY(xen_obj_func*, e->functions, old_capacity, e->function_capacity);
+    }
+    e->functions[e->function_count] = fn;
+    return e->function_count++;
+}
+
+static bool encode_constant(xenb_encoder* e, xen_value constant) {
+    xen_bin_writer* w = &e->sections[SECTION_CONSTANTS];
+    switch (constant.type) {
+        case VAL_NULL:
+            return xen_bin_write_u8(w, XENB_CONST_NULL);
+        case VAL_BOOL:
+            return xen_bin_write_u8(w, VAL_AS_BOOL(constant) ? XENB_CONST_TRUE : XENB_CONST_FALSE);
+        case VAL_INT:
+            xen_bin_write_u8(w, XENB_CONST_INT);
+            return xen_bin_write_i64(w, VAL_AS_INT(constant));
+        case VAL_NUMBER:
+            xen_bin_write_u8(w, XENB_CONST_NUMBER);
+            return xen_bin_write_f64(w, constant.as.number);
+        case VAL_OBJECT:
+            break;
+    }
+
+    if (OBJ_IS_STRING(constant)) {
+        const u32 index = encode_string(e, OBJ_AS_STRING(constant));
+        xen_bin_write_u8(w, XENB_CONST_STRING);
+        return xen_bin_write_u32(w, index);
+    }
+    if (OBJ_IS_FUNCTION(constant)) {
+        const u32 index = encode_function_ref(e, OBJ_AS_FUNCTION(constant));
+        xen_bin_write_u8(w, XENB_CONST_FUNCTION);
+        return xen_bin_write_u32(w, index);
+    }
+    e->failed = "constant of an unsupported type";
+    return XEN_FALSE;
+}
+
+static void encode_lines(xenb_encoder* e, const xen_chunk* chunk) {
+    xen_bin_writer* w = &e->sections[SECTION_LINES];
+    i64 previous      = 0;
+    for (u64 i = 0; i < chunk->count;) {
+        const i64 line = (i64)chunk->lines[i];
+        u64 run        = 1;
+        while (i + run < chunk->count && chunk->lines[i + run] == chunk->lines[i])
+            run++;
+        xen_bin_write_varint(w, run);
+        xen_bin_write_varint(w, xen_zigzag_encode(line - previous));
+        previous = line;
+        i += run;
+    }
+}
+
+static bool encode_function(xenb_encoder* e, xen_obj_func* fn) {
+    const xen_chunk* chunk    = &fn->chunk;
+    xen_bin_writer* record    = &e->sections[SECTION_FUNCTIONS];
+    xen_bin_writer* code      = &e->sections[SECTION_CODE];
+    xen_bin_writer* constants = &e->sections[SECTION_CONSTANTS];
+    xen_bin_writer* lines     = &e->sections[SECTION_LINES];
+
+    const u32 code_offset     = (u32)xen_bin_writer_position(code);
+    const u32 constant_offset = (u32)xen_bin_writer_position(constants);
+    const u32 line_offset     = (u32)xen_bin_writer_position(lines);
+
+    xen_bin_write_bytes(code, chunk->code, chunk->count);
+    for (u64 i = 0; i < chunk->constants.count; i++) {
+        if (!encode_constant(e, chunk->constants.values[i]))
+            return XEN_FALSE;
+    }
+    encode_lines(e, chunk);
+
+    xen_bin_write_u32(record, fn->name != NULL ? encode_string(e, fn->name) : XENB_NO_NAME);
+    xen_bin_write_u16(record, (u16)fn->arity);
+    xen_bin_write_u16(record, (u16)fn->upvalue_count);
+    xen_bin_write_u32(record, code_offset);
+    xen_bin_write_u32(record, (u32)chunk->count);
+    xen_bin_write_u32(record, constant_offset);
+    xen_bin_write_u32(record, (u32)chunk->constants.count);
+    xen_bin_write_u32(record, line_offset);
+    return xen_bin_write_u32(record, (u32)xen_bin_writer_position(lines) - line_offset);
+}
+
+static size_t section_alignment(i32 section) {
+    return section == SECTION_CODE ? XENB_CODE_ALIGNMENT : XENB_SECTION_ALIGNMENT;
+}
+
+// Header, section table and the sections themselves, each aligned so a mapped image can be read in place. Offsets are
+// relative to where the image starts in `w`, which may already hold other data (see xcache.c).
+static bool encode_image(xenb_encoder* e, xen_bin_writer* w) {
+    const size_t base           = xen_bin_writer_position(w);
+    const u32 string_table_size = sizeof(u32) + e->string_count * 2 * sizeof(u32);
+    size_t sizes[SECTION_COUNT];
+    for (i32 i = 0; i < SECTION_COUNT; i++) {
+        sizes[i] = xen_bin_writer_size(&e->sections[i]);
+    }
+    sizes[SECTION_STRINGS] += string_table_size;
+    sizes[SECTION_FUNCTIONS] += sizeof(u32);
+
+    xen_bin_write_bytes(w, "XENB", 4);
+    xen_bin_write_u8(w, XENB_VERSION);
+    xen_bin_write_u8(w, 0);
+    xen_bin_write_u16(w, SECTION_COUNT);
+
+    size_t offsets[SECTION_COUNT];
+    size_t offset = XENB_HEADER_SIZE + SECTION_COUNT * XENB_SECTION_ENTRY_SIZE;
+    for (i32 i = 0; i < SECTION_COUNT; i++) {
+        offset     = xen_bin_writer_align_offset(offset, section_alignment(i));
+        offsets[i] = offset;
+        xen_bin_write_bytes(w, k_section_ids[i], 4);
+        xen_bin_write_u32(w, (u32)offset);
+        xen_bin_write_u32(w, (u32)sizes[i]);
+        offset += sizes[i];
+    }
+
+    static const u8 k_padding[XENB_CODE_ALIGNMENT] = {0};
+    for (i32 i = 0; i < SECTION_COUNT; i++) {
+        xen_bin_write_bytes(w, k_padding, base + offsets[i] - xen_bin_writer_position(w));
+        if (i == SECTION_STRINGS) {
+            // entry offsets are relative to the section, the bytes follow the entries
+            xen_bin_write_u32(w, e->string_count);
+            const u8* entries = e->string_entries.data;
+            for (u32 s = 0; s < e->string_count; s++) {
+                u32 data_offset, length;
+                memcpy(&data_offset, entries + s * 8, sizeof(u32));
+                memcpy(&length, entries + s * 8 + 4, sizeof(u32));
+                xen_bin_write_u32(w, data_offset + string_table_size);
+                xen_bin_write_u32(w, length);
+            }
+        } else if (i == SECTION_FUNCTIONS) {
+            xen_bin_write_u32(w, e->function_count);
+        }
+        xen_bin_write_bytes(w, e->sections[i].data, xen_bin_writer_size(&e->sections[i]));
+    }
+
+    return !xen_bin_writer_has_error(w);
+}
+
+bool xen_encode_bytecode(xen_obj_func* script, xen_bin_writer* writer) {
+    xenb_encoder e;
+    memset(&e, 0, sizeof(e));
+    for (i32 i = 0; i < SECTION_COUNT; i++) {
+        xen_bin_writer_init(&e.sections[i], 256, XEN_TRUE);
+    }
+    xen_bin_writer_init(&e.string_entries, 256, XEN_TRUE);
+    xen_table_init(&e.string_index);
+
+    encode_function_ref(&e, script);
+    bool ok = XEN_TRUE;
+    for (u32 i = 0; i < e.function_count && ok; i++) {
+        ok = encode_function(&e, e.functions[i]);
+    }
+    for (i32 i = 0; i < SECTION_COUNT && ok; i++) {
+        ok = !xen_bin_writer_has_error(&e.sections[i]);
+    }
+    if (ok) {
+        ok = !xen_bin_writer_has_error(&e.string_entries) && encode_image(&e, writer);
+    } else if (e.failed != NULL) {
+        fprintf(stderr, "failed to encode bytecode: %s\n", e.failed);
+    }
+
+    for (i32 i = 0; i < SECTION_COUNT; i++) {
+        xen_bin_writer_free(&e.sections[i]);
+    }
+    xen_bin_writer_free(&e.string_entries);
+    xen_table_free(&e.string_index);
+    XEN_FREE_ARRAY(xen_obj_func*, e.functions, e.function_capacity);
+    return ok;
+}
+
+//==============================================================//
+//                           Decoding                           //
+//==============================================================//
+
+// Bounds-checked view of one section. Reads past the end set `error` and return zeroes.
+typedef struct {
+    const u8* data;
+    size_t size;
+    size_t position;
+    bool error;
+} xenb_reader;
+
+static void reader_init(xenb_reader* r, const u8* data, size_t size, size_t position) {
+    r->data     = data;
+    r->size     = size;
+    r->position = position;
+    r->error    = position > size;
+}
+
+static bool reader_take(xenb_reader* r, void* out, size_t size) {
+    if (r->error || size > r->size - r->position) {
+        r->error = XEN_TRUE;
+        memset(out, 0, size);
+        return XEN_FALSE;
+    }
+    memcpy(out, r->data + r->position, size);
+    r->position += size;
+    return XEN_TRUE;
+}
+
+static u8 read_u8(xenb_reader* r) {
+    u8 value;
+    reader_take(r, &value, sizeof(value));
+    return value;
+}
+
+static u16 read_u16(xenb_reader* r) {
+    u16 value;
+    reader_take(r, &value, sizeof(value));
+    return value;
+}
+
+static u32 read_u32(xenb_reader* r) {
+    u32 value;
+    reader_take(r, &value, sizeof(value));
+    return value;
+}
+
+static u64 read_varint(xenb_reader* r) {
+    u64 value = 0;
+    for (u32 shift = 0; shift < 64; shift += 7) {
+        const u8 byte = read_u8(r);
+        value |= (u64)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0 || r->error)
+            return value;
+    }
+    r->error = XEN_TRUE;
+    return 0;
+}
+
+// What a VM keeps of a loaded image: functions and strings are only created from it when first needed
+struct xen_bytecode_module {
+    const u8* image;
+    size_t size;
+    xenb_reader sections[SECTION_COUNT];
+    array(xen_obj_str*) strings;     // by string index, NULL until a function refers to it
+    u32 string_count;
+    array(xen_obj_func*) functions;  // by function index, NULL until a constant refers to it
+    u32 function_count;
+    const xen_aot_fn* natives;  // C translations of the functions, by function index (NULL if there are none)
+    const char* failed;
+    xen_bytecode_module* next;  // the VM's other modules
+};
+
+static bool decode_fail(xen_bytecode_module* m, const char* why) {
+    m->failed = why;
+    return XEN_FALSE;
+}
+
+static bool decode_header(xen_bytecode_module* m) {
+    xenb_reader r;
+    reader_init(&r, m->image, m->size, 0);
+
+    char magic[4];
+    reader_take(&r, magic, sizeof(magic));
+    if (r.error || memcmp(magic, "XENB", 4) != 0)
+        return decode_fail(m, "not a .xenb file");
+
+    const u8 version = read_u8(&r);
+    if (version != XENB_VERSION)
+        return decode_fail(m, "unsupported version, recompile the script with this release's xenc");
+    read_u8(&r);  // flags
+
+    bool found[SECTION_COUNT] = {XEN_FALSE};
+    const u16 section_count   = read_u16(&r);
+    for (u16 i = 0; i < section_count && !r.error; i++) {
+        char id[4];
+        reader_take(&r, id, sizeof(id));
+        const u32 offset = read_u32(&r);
+        const u32 size   = read_u32(&r);
+        if ((u64)offset + size > m->size)
+            return decode_fail(m, "section out of bounds");
+
+        // unknown sections are skipped, so later versions can add some without breaking older readers
+        for (i32 s = 0; s < SECTION_COUNT; s++) {
+            if (memcmp(id, k_section_ids[s], 4) == 0) {
+                reader_init(&m->sections[s], m->image + offset, size, 0);
+                found[s] = XEN_TRUE;
+            }
+        }
+    }
+    if (r.error)
+        return decode_fail(m, "truncated header");
+    for (i32 s = 0; s < SECTION_COUNT; s++) {
+        if (!found[s])
+            return decode_fail(m, "missing section");
+    }
+    return XEN_TRUE;
+}
+
+static bool decode_strings(xen_bytecode_module* m) {
+    xenb_reader* r  = &m->sections[SECTION_STRINGS];
+    m->string_count = read_u32(r);
+    if (r->error || m->string_count > (r->size - sizeof(u32)) / 8)
+        return decode_fail(m, "corrupt string pool");
+
+    m->strings = calloc(m->string_count > 0 ? m->string_count : 1, sizeof(xen_obj_str*));
+    return XEN_TRUE;
+}
+
+static xen_obj_str* decode_string(xen_bytecode_module* m, u32 index) {
+    if (index >= m->string_count) {
+        decode_fail(m, "string index out of range");
+        return NULL;
+    }
+    if (m->strings[index] != NULL)
+        return m->strings[index];
+
+    xenb_reader entry;
+    const xenb_reader* pool = &m->sections[SECTION_STRINGS];
+    reader_init(&entry, pool->data, pool->size, sizeof(u32) + (size_t)index * 8);
+    const u32 offset = read_u32(&entry);
+    const u32 length = read_u32(&entry);
+    if (entry.error || (u64)offset + length > pool->size || length > INT32_MAX) {
+        decode_fail(m, "corrupt string pool");
+        return NULL;
+    }
+    m->strings[index] = xen_obj_str_copy((const char*)pool->data + offset, (i32)length);
+    return m->strings[index];
+}
+
+static bool decode_functions(xen_bytecode_module* m) {
+    xenb_reader* r    = &m->sections[SECTION_FUNCTIONS];
+    m->function_count = read_u32(r);
+    if (r->error || m->function_count == 0 || m->function_count > (r->size - sizeof(u32)) / XENB_FUNCTION_RECORD_SIZE)
+        return decode_fail(m, "corrupt function table");
+
+    m->functions = calloc(m->function_count, sizeof(xen_obj_func*));
+    return XEN_TRUE;
+}
+
+// Positions a reader on the record of function `index`, `field` bytes into it
+static void function_record(const xen_bytecode_module* m, u32 index, size_t field, xenb_reader* record) {
+    const xenb_reader* table = &m->sections[SECTION_FUNCTIONS];
+    reader_init(record, table->data, table->size, sizeof(u32) + (size_t)index * XENB_FUNCTION_RECORD_SIZE + field);
+}
+
+// The function at `index`, created from its record the first time: enough to be stored, printed and called
+static xen_obj_func* module_function(xen_bytecode_module* m, u32 index) {
+    if (index >= m->function_count) {
+        decode_fail(m, "function index out of range");
+        return NULL;
+    }
+    if (m->functions[index] != NULL)
+        return m->functions[index];
+
+    xenb_reader record;
+    function_record(m, index, 0, &record);
+    const u32 name          = read_u32(&record);
+    const u16 arity         = read_u16(&record);
+    const u16 upvalue_count = read_u16(&record);
+    const u32 code_offset   = read_u32(&record);
+    const u32 code_size     = read_u32(&record);
+    if (record.error) {
+        decode_fail(m, "truncated function table");
+        return NULL;
+    }
+
+    const xenb_reader* code = &m->sections[SECTION_CODE];
+    if ((u64)code_offset + code_size > code->size) {
+        decode_fail(m, "code out of bounds");
+        return NULL;
+    }
+
+    xen_obj_func* fn = xen_obj_func_new();
+    if (name != XENB_NO_NAME && (fn->name = decode_string(m, name)) == NULL)
+        return NULL;
+    fn->arity         = arity;
+    fn->upvalue_count = upvalue_count;
+    fn->module        = m;
+    fn->module_index  = index;
+    fn->aot           = m->natives != NULL ? m->natives[index] : NULL;
+
+    // executed in place, the image is writable because quickening rewrites instructions
+    xen_chunk* chunk = &fn->chunk;
+    chunk->capacity  = code_size;
+    chunk->count     = code_size;
+    chunk->code      = (u8*)code->data + code_offset;
+    chunk->borrowed  = XEN_TRUE;
+
+    m->functions[index] = fn;
+    return fn;
+}
+
+static bool decode_constant(xen_bytecode_module* m, xenb_reader* r, xen_value* out) {
+    switch ((xenb_constant_tag)read_u8(r)) {
+        case XENB_CONST_NULL:
+            *out = NULL_VAL;
+            break;
+        case XENB_CONST_TRUE:
+            *out = BOOL_VAL(XEN_TRUE);
+            break;
+        case XENB_CONST_FALSE:
+            *out = BOOL_VAL(XEN_FALSE);
+            break;
+        case XENB_CONST_INT: {
+            i64 value;
+            reader_take(r, &value, sizeof(value));
+            *out = INT_VAL(value);
+            break;
+        }
+        case XENB_CONST_NUMBER: {
+            f64 value;
+            reader_take(r, &value, sizeof(value));
+            *out = NUMBER_VAL(value);
+            break;
+        }
+        case XENB_CONST_STRING: {
+            xen_obj_str* str = decode_string(m, read_u32(r));
+            if (str == NULL)
+                return XEN_FALSE;
+            *out = OBJ_VAL(str);
+            break;
+        }
+        case XENB_CONST_FUNCTION: {
+            const u32 index = read_u32(r);
+            if (index == 0)
+                return decode_fail(m, "function index out of range");
+            xen_obj_func* fn = module_function(m, index);
+            if (fn == NULL)
+                return XEN_FALSE;
+            *out = OBJ_VAL(fn);
+            break;
+        }
+        default:
+            return decode_fail(m, "unknown constant tag");
+    }
+    return r->error ? decode_fail(m, "truncated constant table") : XEN_TRUE;
+}
+
+// The line table stays in the image (see xen_chunk_line), it is only checked to cover the code exactly
+static bool decode_lines(xen_bytecode_module* m, xen_chunk* chunk, u32 offset, u32 size) {
+    const xenb_reader* lines = &m->sections[SECTION_LINES];
+    if ((u64)offset + size > lines->size)
+        return decode_fail(m, "line table out of bounds");
+
+    xenb_reader r;
+    reader_init(&r, lines->data, (size_t)offset + size, offset);
+    u64 covered = 0;
+    while (r.position < r.size && !r.error) {
+        covered += read_varint(&r);
+        read_varint(&r);
+    }
+    if (r.error || covered != chunk->count)
+        return decode_fail(m, "corrupt line table");
+
+    chunk->line_runs      = lines->data + offset;
+    chunk->line_runs_size = size;
+    return XEN_TRUE;
+}
+
+static bool decode_body(xen_bytecode_module* m, xen_obj_func* fn) {
+    xenb_reader record;
+    function_record(m, fn->module_index, 16, &record);  // past name, arity, upvalue count and code
+    const u32 constant_offset = read_u32(&record);
+    const u32 constant_count  = read_u32(&record);
+    const u32 line_offset     = read_u32(&record);
+    const u32 line_size       = read_u32(&record);
+    if (record.error)
+        return decode_fail(m, "truncated function table");
+
+    xen_chunk* chunk = &fn->chunk;
+    if (!decode_lines(m, chunk, line_offset, line_size))
+        return XEN_FALSE;
+
+    xenb_reader constants;
+    reader_init(&constants, m->sections[SECTION_CONSTANTS].data, m->sections[SECTION_CONSTANTS].size, constant_offset);
+    for (u32 i = 0; i < constant_count; i++) {
+        xen_value constant;
+        if (!decode_constant(m, &constants, &constant))
+            return XEN_FALSE;
+        xen_chunk_add_constant(chunk, constant);
+    }
+    return XEN_TRUE;
+}
+
+bool xen_bytecode_load_function(xen_obj_func* fn) {
+    xen_bytecode_module* m = fn->module;
+    if (!decode_body(m, fn)) {
+        fn->chunk.constants.count = 0;  // a later call fails the same way instead of appending to what was decoded
+        fprintf(stderr, "invalid bytecode: %s\n", m->failed);
+        return XEN_FALSE;
+    }
+    fn->module = NULL;
+    return XEN_TRUE;
+}
+
+static void module_free(xen_bytecode_module* m) {
+    free(m->strings);
+    free(m->functions);
+    free(m);
+}
+
+xen_obj_func* xen_decode_bytecode(u8* bytecode, size_t size) {
+    return xen_decode_bytecode_aot(bytecode, size, NULL, 0);
+}
+
+xen_obj_func* xen_decode_bytecode_aot(u8* bytecode, size_t size, const xen_aot_fn* natives, u32 native_count) {
+    xen_bytecode_module* m = calloc(1, sizeof(xen_bytecode_module));
+    m->image               = bytecode;
+    m->size                = size;
+    m->natives             = natives;
+
+    xen_obj_func* script = NULL;
+    if (decode_header(m) && decode_strings(m) && decode_functions(m) && natives != NULL &&
+        native_count != m->function_count) {
+        decode_fail(m, "native code was generated for another image");
+    }
+    if (m->failed != NULL || (script = module_function(m, 0)) == NULL) {
+        fprintf(stderr, "invalid bytecode: %s\n", m->failed);
+        module_free(m);
+        return NULL;
+    }
+    // the script always runs, everything else waits for its first call
+    if (!xen_bytecode_load_function(script)) {
+        module_free(m);
+        return NULL;
+    }
+
+    m->next       = g_vm->modules;
+    g_vm->modules = m;
+    return script;
+}
+
+xen_obj_func* xen_bytecode_function(const u8* bytecode, u32 index) {
+    for (xen_bytecode_module* m = g_vm->modules; m != NULL; m = m->next) {
+        if (m->image != bytecode)
+            continue;
+        if (index >= m->function_count)
+            return NULL;
+        xen_obj_func* fn = module_function(m, index);
+        if (fn == NULL || (fn->module != NULL && !xen_bytecode_load_function(fn)))
+            return NULL;
+        return fn;
+    }
+    return NULL;
+}
+
+void xen_bytecode_modules_free() {
+    xen_bytecode_module* m = g_vm->modules;
+    while (m != NULL) {
+        xen_bytecode_module* next = m->next;
+        module_free(m);
+        m = next;
+    }
+    g_vm->modules = NULL;
+}
+
+//==============================================================//
+//                            Images                            //
+//==============================================================//
+
+#ifndef _WIN32
+bool xen_bytecode_image_open(const char* path, xen_bytecode_image* image) {
+    memset(image, 0, sizeof(xen_bytecode_image));
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return XEN_FALSE;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return XEN_FALSE;
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return XEN_FALSE;
+
+    image->data   = data;
+    image->size   = (size_t)st.st_size;
+    image->mapped = XEN_TRUE;
+    return XEN_TRUE;
+}
+#else
+bool xen_bytecode_image_open(const char* path, xen_bytecode_image* image) {
+    memset(image, 0, sizeof(xen_bytecode_image));
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return XEN_FALSE;
+    fclose(fp);
+
+    image->data = xen_read_bytecode(path, &image->size);
+    return XEN_TRUE;
+}
+#endif
+
+void xen_bytecode_image_close(xen_bytecode_image* image) {
+#ifndef _WIN32
+    if (image->mapped) {
+        munmap(image->data, image->size);
+    } else {
+        free(image->data);
+    }
+#else
+    free(image->data);
+#endif
+    image->data = NULL;
+    image->size = 0;
+}
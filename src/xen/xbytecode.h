@@ -0,0 +1,115 @@
+#ifndef X_BYTECODE_H
+#define X_BYTECODE_H
+
+#include "xcommon.h"
+#include "xbin_writer.h"
+#include "object/xobj.h"
+#include "object/xobj_function.h"
+
+/*
+ * Bytecode Binary Format (.xenb), version 2
+ *
+ * A compiled script: the top-level function and every function nested in it, so a script can be run without
+ * scanning or compiling its source. All integers are little-endian.
+ *
+ * Header
+ *   Magic           : 'XENB'         - 4 bytes
+ *   Version         : u8             - 1 byte
+ *   Flags           : u8             - 1 byte (reserved, 0)
+ *   Section Count   : u16            - 2 bytes
+ *   Sections        : entry[]        - 12 bytes each
+ *     Id            : char[4]        - one of the ids below
+ *     Offset        : u32            - from the start of the file, 8-byte aligned (CODE: 4096)
+ *     Size          : u32
+ *
+ * STRS - string pool, every string the script uses (names and constants) once
+ *   Count           : u32
+ *   Entries         : {u32 offset, u32 length}[] - offset relative to the section
+ *   Data            : u8[]
+ *
+ * FUNC - function table, fixed-size records so any function can be found by index, function 0 is the script itself
+ *   Count           : u32
+ *   Records         : 32 bytes each
+ *     Name          : u32            - string index, XENB_NO_NAME for the script
+ *     Arity         : u16
+ *     Upvalue Count : u16
+ *     Code          : u32, u32       - offset and size in CODE
+ *     Constants     : u32, u32       - offset in CNST and number of constants
+ *     Lines         : u32, u32       - offset and size in LINE
+ *
+ * CNST - constants of every function, a tag byte followed by its payload
+ *   XENB_CONST_NULL/TRUE/FALSE       - no payload
+ *   XENB_CONST_INT                   - i64
+ *   XENB_CONST_NUMBER                - f64
+ *   XENB_CONST_STRING                - u32 string index
+ *   XENB_CONST_FUNCTION              - u32 function index (nested functions, class methods and initializers)
+ *
+ * CODE - bytecode of every function, back to back. Page-aligned, loaded functions run it straight from the image
+ *
+ * LINE - line tables, per function a list of (run length, line delta) varint pairs: `run length` consecutive bytes
+ *        of code come from the line that is `line delta` (zigzag encoded) away from the previous run's
+ */
+
+#define XENB_VERSION 2
+#define XENB_NO_NAME UINT32_MAX
+
+typedef enum {
+    XENB_CONST_NULL,
+    XENB_CONST_TRUE,
+    XENB_CONST_FALSE,
+    XENB_CONST_INT,
+    XENB_CONST_NUMBER,
+    XENB_CONST_STRING,
+    XENB_CONST_FUNCTION,
+} xenb_constant_tag;
+
+// Line deltas of a line table (and of a snapshot's, which uses the same encoding) can be negative, zigzag encoding
+// maps small values of either sign to small varints: 0, -1, 1, -2 ... become 0, 1, 2, 3 ...
+static inline u64 xen_zigzag_encode(i64 value) {
+    return ((u64)value << 1) ^ (u64)(value >> 63);
+}
+
+static inline i64 xen_zigzag_decode(u64 value) {
+    return (i64)(value >> 1) ^ -(i64)(value & 1);
+}
+
+/// @brief Serializes a compiled script and everything it contains into `writer`.
+/// @return false if a constant can't be serialized or the writer failed.
+bool xen_encode_bytecode(xen_obj_func* script, xen_bin_writer* writer);
+
+/// @brief Loads a script serialized by xen_encode_bytecode into the calling thread's VM. Only the header and the script
+/// function are decoded up front, every other function is created from its FUNC record when something refers to it and
+/// gets its constants and line table on its first call (xen_bytecode_load_function). Code and line tables aren't
+/// copied: the functions run their code from `bytecode`, which must stay valid (and writable, the interpreter quickens
+/// instructions in place) for as long as the VM uses them.
+/// @return the script function, or NULL (after reporting why) if `bytecode` isn't a valid .xenb image. The layout is
+/// checked, the bytecode itself is trusted like the compiler's output.
+xen_obj_func* xen_decode_bytecode(u8* bytecode, size_t size);
+
+/// @brief xen_decode_bytecode for an image translated to C by `xenc --aot`: function `i` of the image runs
+/// `natives[i]` unless that is NULL. `native_count` has to match the image's function count.
+xen_obj_func* xen_decode_bytecode_aot(u8* bytecode, size_t size, const xen_aot_fn* natives, u32 native_count);
+
+/// @brief Function `index` of an image the calling thread's VM has decoded, with its constants loaded. NULL past the
+/// last function or if it can't be decoded.
+xen_obj_func* xen_bytecode_function(const u8* bytecode, u32 index);
+
+/// @brief Decodes the constants and line table of a function whose `module` is set, which is cleared afterwards.
+/// @return false (after reporting why) if its part of the image is corrupt.
+bool xen_bytecode_load_function(xen_obj_func* fn);
+
+/// @brief Frees the decoding state of every image the calling thread's VM has loaded, called when the VM is freed.
+void xen_bytecode_modules_free();
+
+// A .xenb file mapped into memory. The mapping is private: pages are shared with every other process running the
+// same file through the page cache until the interpreter writes to them.
+typedef struct {
+    u8* data;
+    size_t size;
+    bool mapped;  // false where the file had to be read into a heap buffer instead
+} xen_bytecode_image;
+
+bool xen_bytecode_image_open(const char* path, xen_bytecode_image* image);
+void xen_bytecode_image_close(xen_bytecode_image* image);
+
+#endif
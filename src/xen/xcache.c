@@ -0,0 +1,126 @@
+#include "xcache.h"
+#include "xversion.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #include <direct.h>
+    #include <process.h>
+    #define getpid _getpid
+#else
+    #include <unistd.h>
+#endif
+
+#define CACHE_PATH_LENGTH 1024
+#define CACHE_COMPILER_FLAGS 0  // options that change what the compiler emits, part of the key
+
+// What an entry was compiled from, compared as a whole
+typedef struct {
+    char magic[4];
+    u32 format;
+    char release[16];
+    u32 flags;
+    u64 source_size;
+    u64 source_hash;
+} cache_key;
+
+static u64 hash_source(const char* source, size_t length) {
+    u64 hash = 0xcbf29ce484222325ull;  // FNV-1a
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (u8)source[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static void make_key(const char* source, cache_key* key) {
+    const size_t length = strlen(source);
+    memset(key, 0, sizeof(cache_key));  // padding included, keys are compared with memcmp
+    memcpy(key->magic, "XENC", 4);
+    strncpy(key->release, VERSION_STRING, sizeof(key->release) - 1);
+    key->format      = XENB_VERSION;
+    key->flags       = CACHE_COMPILER_FLAGS;
+    key->source_size = length;
+    key->source_hash = hash_source(source, length);
+}
+
+// `dir/__xencache__` into `dir_out` and `dir/__xencache__/name.xenb` into `path_out`
+static bool cache_paths(const char* script, char* dir_out, char* path_out) {
+    const char* name = strrchr(script, '/');
+#ifdef _WIN32
+    const char* backslash = strrchr(script, '\\');
+    if (backslash > name)
+        name = backslash;
+#endif
+    name                  = name != NULL ? name + 1 : script;
+    const i32 dir_length  = (i32)(name - script);
+    const char* extension = strrchr(name, '.');
+    const i32 name_length = extension != NULL ? (i32)(extension - name) : (i32)strlen(name);
+
+    const i32 written = snprintf(dir_out, CACHE_PATH_LENGTH, "%.*s%s", dir_length, script, XEN_CACHE_DIR);
+    if (written < 0 || written >= CACHE_PATH_LENGTH)
+        return XEN_FALSE;
+    const i32 total = snprintf(path_out, CACHE_PATH_LENGTH, "%s/%.*s.xenb", dir_out, name_length, name);
+    return total > 0 && total < CACHE_PATH_LENGTH;
+}
+
+bool xen_cache_enabled() {
+    return getenv(XEN_CACHE_DISABLE_ENV) == NULL;
+}
+
+bool xen_cache_open(const char* script, const char* source, xen_bytecode_image* image) {
+    char dir[CACHE_PATH_LENGTH], path[CACHE_PATH_LENGTH];
+    if (!cache_paths(script, dir, path))
+        return XEN_FALSE;
+
+    if (!xen_bytecode_image_open(path, image))
+        return XEN_FALSE;
+
+    cache_key expected;
+    make_key(source, &expected);
+    if (image->size <= XEN_CACHE_HEADER_SIZE || memcmp(image->data, &expected, sizeof(cache_key)) != 0) {
+        xen_bytecode_image_close(image);
+        return XEN_FALSE;
+    }
+    return XEN_TRUE;
+}
+
+void xen_cache_store(const char* script, const char* source, xen_obj_func* fn) {
+    char dir[CACHE_PATH_LENGTH], path[CACHE_PATH_LENGTH], temp[CACHE_PATH_LENGTH + 32];
+    if (!cache_paths(script, dir, path))
+        return;
+
+#ifdef _WIN32
+    const int made = _mkdir(dir);
+#else
+    const int made = mkdir(dir, 0755);
+#endif
+    if (made != 0 && errno != EEXIST)
+        return;
+
+    cache_key key;
+    make_key(source, &key);
+    u8 header[XEN_CACHE_HEADER_SIZE] = {0};
+    memcpy(header, &key, sizeof(key));
+
+    // written next to the entry and renamed over it, so nobody maps a half-written file. The image is streamed into
+    // it, the header is padded so the image's own alignment carries over to the file.
+    snprintf(temp, sizeof(temp), "%s.%ld.tmp", path, (long)getpid());
+    FILE* fp = fopen(temp, "wb");
+    if (fp == NULL)
+        return;
+    xen_bin_writer image;
+    xen_bin_writer_init_stream(&image, fp, XEN_KB(64));
+    xen_bin_write_bytes(&image, header, sizeof(header));
+    const bool written = xen_encode_bytecode(fn, &image) && xen_bin_writer_flush(&image);
+    xen_bin_writer_free(&image);
+    const bool closed = fclose(fp) == 0;
+
+#ifdef _WIN32
+    if (written && closed)
+        remove(path);  // rename doesn't replace existing files here
+#endif
+    if (!written || !closed || rename(temp, path) != 0)
+        remove(temp);
+}
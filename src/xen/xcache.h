@@ -0,0 +1,36 @@
+#ifndef X_CACHE_H
+#define X_CACHE_H
+
+#include "xcommon.h"
+#include "xbytecode.h"
+
+/*
+ * Bytecode cache
+ *
+ * Running `dir/script.xen` compiles it once and keeps the result in `dir/__xencache__/script.xenb`; later runs map that
+ * image instead of compiling again. An entry is only used for exactly the source it was compiled from: it starts with a
+ * key holding the source's size and hash, the .xenb format version, the release that compiled it and the compiler
+ * flags (none exist yet, the field keeps the key stable once some do), followed by the image at XEN_CACHE_HEADER_SIZE
+ * so its code stays page-aligned. Entries are written to a temporary file and renamed into place, so concurrent runs
+ * (`--workers`) never see a partial one.
+ *
+ * Setting XEN_NO_CACHE in the environment disables the cache; a directory that can't be written to only costs the
+ * compile it would have saved.
+ */
+
+#define XEN_CACHE_DIR "__xencache__"
+#define XEN_CACHE_DISABLE_ENV "XEN_NO_CACHE"
+#define XEN_CACHE_HEADER_SIZE 4096
+
+/// @brief False when the cache is disabled through XEN_CACHE_DISABLE_ENV.
+bool xen_cache_enabled();
+
+/// @brief Maps the cached image of `script` if one was compiled from `source` by this release. The image itself starts
+/// XEN_CACHE_HEADER_SIZE bytes into `image->data`.
+bool xen_cache_open(const char* script, const char* source, xen_bytecode_image* image);
+
+/// @brief Serializes the freshly compiled `fn` as the cache entry of `script`. Must be called before `fn` runs, the
+/// interpreter rewrites its code as it goes. Failures are silent, the next run simply compiles again.
+void xen_cache_store(const char* script, const char* source, xen_obj_func* fn);
+
+#endif
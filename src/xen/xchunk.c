@@ -1,5 +1,6 @@
 #include "xchunk.h"
 #include "xalloc.h"
+#include "xbytecode.h"
 #include "xmem.h"
 #include "xvalue.h"
 
@@ -7,7 +8,10 @@ void xen_chunk_init(xen_chunk* chunk) {
     chunk->count    = 0;
     chunk->capacity = 0;
     chunk->code     = NULL;
-    chunk->lines    = NULL;
+    chunk->lines          = NULL;
+    chunk->line_runs      = NULL;
+    chunk->line_runs_size = 0;
+    chunk->borrowed       = XEN_FALSE;
     xen_value_array_init(&chunk->constants);
 }
 
@@ -25,7 +29,8 @@ void xen_chunk_write(xen_chunk* chunk, u8 byte, u64 line) {
 }
 
 void xen_chunk_cleanup(xen_chunk* chunk) {
-    XEN_FREE_ARRAY(u8, chunk->code, chunk->capacity);
+    if (!chunk->borrowed)
+        XEN_FREE_ARRAY(u8, chunk->code, chunk->capacity);
     XEN_FREE_ARRAY(u64, chunk->lines, chunk->capacity);
     xen_value_array_free(&chunk->constants);
     xen_chunk_init(chunk);
@@ -35,3 +40,102 @@ i32 xen_chunk_add_constant(xen_chunk* chunk, xen_value value) {
     xen_value_array_write(&chunk->constants, value);
     return chunk->constants.count - 1;  // I don't remember why we're returning the index
 }
+
+
+static u64 read_varint(const xen_chunk* chunk, u32* position) {
+    u64 value = 0;
+    for (u32 shift = 0; shift < 64 && *position < chunk->line_runs_size; shift += 7) {
+        const u8 byte = chunk->line_runs[(*position)++];
+        value |= (u64)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            break;
+    }
+    return value;
+}
+
+// Loaded chunks keep their line table encoded as (run length, zigzag line delta) pairs, see xbytecode.h. It is only
+// read for error reports and when a function is copied to another thread, not worth a line per byte of code.
+static u64 next_line_run(const xen_chunk* chunk, u32* position, i64* line) {
+    if (*position >= chunk->line_runs_size)
+        return 0;
+    const u64 run   = read_varint(chunk, position);
+    const u64 delta = read_varint(chunk, position);
+    *line += xen_zigzag_decode(delta);
+    return run;
+}
+
+u64 xen_chunk_line(const xen_chunk* chunk, u64 offset) {
+    if (chunk->lines != NULL)
+        return chunk->lines[offset];
+
+    u32 position = 0;
+    u64 end      = 0;
+    i64 line     = 0;
+    u64 run;
+    while ((run = next_line_run(chunk, &position, &line)) > 0) {
+        end += run;
+        if (offset < end)
+            break;
+    }
+    return (u64)line;
+}
+
+void xen_chunk_copy_lines(const xen_chunk* chunk, u64* out) {
+    if (chunk->lines != NULL) {
+        memcpy(out, chunk->lines, chunk->count * sizeof(u64));
+        return;
+    }
+
+    u32 position = 0;
+    u64 at       = 0;
+    i64 line     = 0;
+    u64 run;
+    while (at < chunk->count && (run = next_line_run(chunk, &position, &line)) > 0) {
+        for (u64 i = 0; i < run && at < chunk->count; i++) {
+            out[at++] = (u64)line;
+        }
+    }
+    while (at < chunk->count) {
+        out[at++] = (u64)line;
+    }
+}
+
+i32 xen_opcode_operand_bytes(u8 opcode) {
+    switch (opcode) {
+        case OP_CONSTANT:
+        case OP_DEFINE_GLOBAL:
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_CALL:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_INCLUDE:
+        case OP_GET_PROPERTY:
+        case OP_ARRAY_NEW:
+        case OP_CLASS:
+        case OP_SET_PROPERTY:
+        case OP_CALL_INIT:
+        case OP_IS_TYPE:
+        case OP_CAST:
+        case OP_GET_UPVALUE:
+        case OP_SET_UPVALUE:
+            return 1;
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_LOOP:
+        case OP_INVOKE:
+        case OP_METHOD:
+        case OP_PROPERTY:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+i32 xen_chunk_instruction_size(const xen_chunk* chunk, u64 offset) {
+    const u8 opcode = chunk->code[offset];
+    if (opcode == OP_CLOSURE) {
+        return 3 + 2 * chunk->code[offset + 2];
+    }
+    return 1 + xen_opcode_operand_bytes(opcode);
+}
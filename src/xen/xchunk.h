@@ -48,13 +48,41 @@ typedef enum {
     OP_CALL_INIT,
     OP_IS_TYPE,  // Check if value is of a specific type
     OP_CAST,
+    OP_BIT_AND,
+    OP_BIT_OR,
+    OP_BIT_XOR,
+    OP_BIT_NOT,
+    OP_SHIFT_LEFT,
+    OP_SHIFT_RIGHT,
+    OP_CLOSURE,        // fn constant, upvalue count, then (is_local, index) per upvalue
+    OP_GET_UPVALUE,
+    OP_SET_UPVALUE,
+    OP_CLOSE_UPVALUE,  // move the captured local on top of the stack into its upvalue, then pop it
+
+    // Quickened instructions. The interpreter rewrites generic arithmetic/comparison instructions in place once it
+    // has seen float or int operands and rewrites them back if a later execution sees anything else (or an int
+    // operation overflows). The compiler never emits these.
+    OP_ADD_NUM,
+    OP_SUBTRACT_NUM,
+    OP_MULTIPLY_NUM,
+    OP_DIVIDE_NUM,
+    OP_LESS_NUM,
+    OP_GREATER_NUM,
+    OP_ADD_INT,
+    OP_SUBTRACT_INT,
+    OP_MULTIPLY_INT,
+    OP_LESS_INT,
+    OP_GREATER_INT,
 } xen_opcode;
 
 typedef struct {
     u64 count;
     u64 capacity;
     u8* code;
-    array(u64) lines;
+    array(u64) lines;      // line of every byte of code, NULL when `line_runs` is used instead
+    const u8* line_runs;   // encoded line table of a chunk loaded from a .xenb image, see xbytecode.h
+    u32 line_runs_size;
+    bool borrowed;         // `code` and `line_runs` live in a bytecode image and aren't freed with the chunk
     xen_value_array constants;
 } xen_chunk;
 
@@ -63,4 +91,16 @@ void xen_chunk_write(xen_chunk* chunk, u8 byte, u64 line);
 void xen_chunk_cleanup(xen_chunk* chunk);
 i32 xen_chunk_add_constant(xen_chunk* chunk, xen_value value);
 
+// Source line of the byte of code at `offset`
+u64 xen_chunk_line(const xen_chunk* chunk, u64 offset);
+
+// Fills `out` (chunk->count entries) with the line of every byte of code
+void xen_chunk_copy_lines(const xen_chunk* chunk, u64* out);
+
+// Number of operand bytes that follow the given opcode in the instruction stream
+i32 xen_opcode_operand_bytes(u8 opcode);
+
+// Total size in bytes of the instruction starting at `offset`, including variable-length operands (OP_CLOSURE)
+i32 xen_chunk_instruction_size(const xen_chunk* chunk, u64 offset);
+
 #endif
@@ -54,7 +54,9 @@ typedef u8 byte;
 #define XEN_UNLIKELY(x) __builtin_expect(!!(x), 0)
 #define XEN_BARF_ON(condition) ((void)sizeof(char[1 - 2 * !!(condition)]))
 #define XEN_UNUSED(x) (void)(x)
+#define XEN_THREAD_LOCAL _Thread_local
 #define XEN_STREQ(a, b) strcmp(a, b) == 0
+#define XEN_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
 
 #define XEN_CLEANUP_FREE __attribute__((cleanup(xen_cleanup_free)))
 
@@ -13,6 +13,7 @@
 #include "object/xobj_function.h"
 #include "object/xobj_string.h"
 
+#include <errno.h>
 #include <math.h>
 #include <string.h>
 
@@ -28,7 +29,9 @@ typedef struct {
     // remember last variable parsed for postfix operators
     bool last_was_variable;
     xen_token last_variable;
-    bool last_was_local;
+    u8 last_get_op;
+    u8 last_set_op;
+    bool last_is_const;
     i32 last_variable_arg;
 } xen_parser;
 
@@ -39,9 +42,13 @@ typedef enum {
     PREC_AND,         // and
     PREC_EQUALITY,    // == !=
     PREC_COMPARISON,  // < > <= >=
+    PREC_BIT_OR,      // |
+    PREC_BIT_XOR,     // ^
+    PREC_BIT_AND,     // &
+    PREC_SHIFT,       // << >>
     PREC_TERM,        // + -
     PREC_FACTOR,      // * /
-    PREC_UNARY,       // ! -
+    PREC_UNARY,       // ! - ~
     PREC_CALL,        // . ()
     PREC_POSTFIX,     // ++ -- (postfix)
     PREC_PRIMARY
@@ -59,8 +66,15 @@ typedef struct {
     xen_token name;
     i32 depth;
     bool is_const;
+    bool is_captured;  // referenced by a nested function, must be closed over when it goes out of scope
 } xen_local;
 
+typedef struct {
+    u8 index;       // local slot in the enclosing function (is_local) or its upvalue index
+    bool is_local;
+    bool is_const;
+} xen_upvalue;
+
 typedef enum {
     TYPE_FUNCTION,
     TYPE_SCRIPT,
@@ -69,6 +83,7 @@ typedef enum {
 } xen_function_type;
 
 #define MAX_LOCALS 256
+#define MAX_UPVALUES UINT8_MAX
 
 typedef struct xen_compiler {
     struct xen_compiler* enclosing;
@@ -77,6 +92,7 @@ typedef struct xen_compiler {
 
     xen_local locals[MAX_LOCALS];
     i32 local_count;
+    xen_upvalue upvalues[MAX_UPVALUES];
     i32 scope_depth;
 } xen_compiler;
 
@@ -85,7 +101,7 @@ typedef struct class_compiler {
     xen_token name;
 } class_compiler;
 
-static class_compiler* current_class = NULL;
+static XEN_THREAD_LOCAL class_compiler* current_class = NULL;
 
 static bool is_valid_namespace(const char* name, i32 length) {
     for (i32 i = 0; xen_builtin_namespaces[i] != NULL; i++) {
@@ -116,10 +132,10 @@ typedef struct {
 // Globals
 // ============================================================================
 
-xen_parser parser;
-xen_compiler* current = NULL;
-static xen_include_tracker include_tracker;
-static char current_file_path[MAX_PATH_LENGTH] = ".";
+XEN_THREAD_LOCAL xen_parser parser;
+XEN_THREAD_LOCAL xen_compiler* current = NULL;
+static XEN_THREAD_LOCAL xen_include_tracker include_tracker;
+static XEN_THREAD_LOCAL char current_file_path[MAX_PATH_LENGTH] = ".";
 
 // ============================================================================
 // Forward Declarations
@@ -349,6 +365,7 @@ static void init_compiler(xen_compiler* compiler, xen_function_type type) {
     local->name.start  = "";
     local->name.length = 0;
     local->is_const    = XEN_FALSE;
+    local->is_captured = XEN_FALSE;
 
     if (type == TYPE_METHOD || type == TYPE_INITIALIZER) {
         // 'this' occupies slot 0
@@ -368,13 +385,19 @@ static void begin_scope() {
     current->scope_depth++;
 }
 
+// Discards the innermost local. Only locals captured by a closure pay for being moved into an upvalue, everything
+// else is a plain pop.
+static void discard_local() {
+    emit_byte(current->locals[current->local_count - 1].is_captured ? OP_CLOSE_UPVALUE : OP_POP);
+    current->local_count--;
+}
+
 static void end_scope() {
     current->scope_depth--;
 
     // Pop all locals in this scope
     while (current->local_count > 0 && current->locals[current->local_count - 1].depth > current->scope_depth) {
-        emit_byte(OP_POP);
-        current->local_count--;
+        discard_local();
     }
 }
 
@@ -405,16 +428,58 @@ static i32 resolve_local(xen_compiler* compiler, xen_token* name) {
     return -1;
 }
 
+static i32 add_upvalue(xen_compiler* compiler, u8 index, bool is_local, bool is_const) {
+    const i32 upvalue_count = compiler->function->upvalue_count;
+
+    for (i32 i = 0; i < upvalue_count; i++) {
+        xen_upvalue* upvalue = &compiler->upvalues[i];
+        if (upvalue->index == index && upvalue->is_local == is_local) {
+            return i;
+        }
+    }
+
+    if (upvalue_count == MAX_UPVALUES) {
+        error("too many captured variables in function");
+        return 0;
+    }
+
+    compiler->upvalues[upvalue_count].index    = index;
+    compiler->upvalues[upvalue_count].is_local = is_local;
+    compiler->upvalues[upvalue_count].is_const = is_const;
+    return compiler->function->upvalue_count++;
+}
+
+// Looks `name` up in the enclosing functions. Each function between the declaring one and `compiler` gets an upvalue
+// so the variable can be threaded through when the closures are created.
+static i32 resolve_upvalue(xen_compiler* compiler, xen_token* name) {
+    if (compiler->enclosing == NULL)
+        return -1;
+
+    const i32 local = resolve_local(compiler->enclosing, name);
+    if (local != -1) {
+        compiler->enclosing->locals[local].is_captured = XEN_TRUE;
+        return add_upvalue(compiler, (u8)local, XEN_TRUE, compiler->enclosing->locals[local].is_const);
+    }
+
+    const i32 upvalue = resolve_upvalue(compiler->enclosing, name);
+    if (upvalue != -1) {
+        return add_upvalue(compiler, (u8)upvalue, XEN_FALSE, compiler->enclosing->upvalues[upvalue].is_const);
+    }
+
+    return -1;
+}
+
 static void add_local(xen_token name, bool is_const) {
     if (current->local_count == MAX_LOCALS) {
         error("too many local variables in function");
         return;
     }
 
-    xen_local* local = &current->locals[current->local_count++];
-    local->name      = name;
-    local->depth     = -1;  // Mark as uninitialized
-    local->is_const  = is_const;
+    xen_local* local   = &current->locals[current->local_count++];
+    local->name        = name;
+    local->depth       = -1;  // Mark as uninitialized
+    local->is_const    = is_const;
+    local->is_captured = XEN_FALSE;
 }
 
 static void declare_variable() {
@@ -461,16 +526,43 @@ static bool is_local_const(xen_compiler* compiler, i32 slot) {
     return compiler->locals[slot].is_const;
 }
 
+static bool is_global_const(xen_token* name);
+
+// Resolves `name` to a local slot, an upvalue or a global (in that order) and returns the operand for the matching
+// get/set instructions
+static i32 resolve_variable(xen_token* name, u8* get_op, u8* set_op, bool* is_const) {
+    i32 arg = resolve_local(current, name);
+    if (arg != -1) {
+        *is_const = is_local_const(current, arg);
+        *get_op   = OP_GET_LOCAL;
+        *set_op   = OP_SET_LOCAL;
+        return arg;
+    }
+
+    arg = resolve_upvalue(current, name);
+    if (arg != -1) {
+        *is_const = current->upvalues[arg].is_const;
+        *get_op   = OP_GET_UPVALUE;
+        *set_op   = OP_SET_UPVALUE;
+        return arg;
+    }
+
+    *is_const = is_global_const(name);
+    *get_op   = OP_GET_GLOBAL;
+    *set_op   = OP_SET_GLOBAL;
+    return identifier_constant(name);
+}
+
 static bool is_global_const(xen_token* name) {
     xen_obj_str* name_str = xen_obj_str_copy(name->start, name->length);
     xen_value dummy;
-    bool result = xen_table_get(&g_vm.const_globals, name_str, &dummy);
+    bool result = xen_table_get(&g_vm->const_globals, name_str, &dummy);
     return result;
 }
 
 static void mark_global_const(xen_token* name) {
     xen_obj_str* name_str = xen_obj_str_copy(name->start, name->length);
-    xen_table_set(&g_vm.const_globals, name_str, BOOL_VAL(XEN_TRUE));
+    xen_table_set(&g_vm->const_globals, name_str, BOOL_VAL(XEN_TRUE));
 }
 
 static void define_variable(u8 global) {
@@ -484,26 +576,15 @@ static void define_variable(u8 global) {
 
 static void named_variable(xen_token name, bool can_assign) {
     u8 get_op, set_op;
-    i32 arg = resolve_local(current, &name);
-
-    bool is_local     = (arg != -1);
-    bool is_const_var = XEN_FALSE;
-
-    if (is_local) {
-        is_const_var = is_local_const(current, arg);
-        get_op       = OP_GET_LOCAL;
-        set_op       = OP_SET_LOCAL;
-    } else {
-        is_const_var = is_global_const(&name);
-        arg          = identifier_constant(&name);
-        get_op       = OP_GET_GLOBAL;
-        set_op       = OP_SET_GLOBAL;
-    }
+    bool is_const_var;
+    const i32 arg = resolve_variable(&name, &get_op, &set_op, &is_const_var);
 
     // record for potential postfix operator
     parser.last_was_variable = XEN_TRUE;
     parser.last_variable     = name;
-    parser.last_was_local    = is_local;
+    parser.last_get_op       = get_op;
+    parser.last_set_op       = set_op;
+    parser.last_is_const     = is_const_var;
     parser.last_variable_arg = arg;
 
     // check for any assignment to const variable
@@ -572,8 +653,31 @@ static void grouping(bool can_assign) {
 
 static void number(bool can_assign) {
     XEN_UNUSED(can_assign);
-    f64 value = strtod(parser.previous.start, NULL);
-    emit_constant(NUMBER_VAL(value));
+    const char* start = parser.previous.start;
+    const i32 length  = parser.previous.length;
+
+    // Literals without a fraction or exponent are ints, unless they don't fit in 64 bits
+    bool is_float = XEN_FALSE;
+    const bool is_hex = length > 2 && start[0] == '0' && (start[1] == 'x' || start[1] == 'X');
+    if (!is_hex) {
+        for (i32 i = 0; i < length; i++) {
+            if (start[i] == '.' || start[i] == 'e' || start[i] == 'E') {
+                is_float = XEN_TRUE;
+                break;
+            }
+        }
+    }
+
+    if (!is_float) {
+        errno           = 0;
+        const i64 value = strtoll(start, NULL, is_hex ? 16 : 10);
+        if (errno != ERANGE) {
+            emit_constant(INT_VAL(value));
+            return;
+        }
+    }
+
+    emit_constant(NUMBER_VAL(strtod(start, NULL)));
 }
 
 static void string(bool can_assign) {
@@ -597,6 +701,9 @@ static void unary(bool can_assign) {
         case TOKEN_BANG:
             emit_byte(OP_NOT);
             break;
+        case TOKEN_TILDE:
+            emit_byte(OP_BIT_NOT);
+            break;
         default:
             return;
     }
@@ -642,6 +749,21 @@ static void binary(bool can_assign) {
         case TOKEN_FORWARD_SLASH:
             emit_byte(OP_DIVIDE);
             break;
+        case TOKEN_AMPERSAND:
+            emit_byte(OP_BIT_AND);
+            break;
+        case TOKEN_PIPE:
+            emit_byte(OP_BIT_OR);
+            break;
+        case TOKEN_CARET:
+            emit_byte(OP_BIT_XOR);
+            break;
+        case TOKEN_LESS_LESS:
+            emit_byte(OP_SHIFT_LEFT);
+            break;
+        case TOKEN_GREATER_GREATER:
+            emit_byte(OP_SHIFT_RIGHT);
+            break;
         default:
             return;
     }
@@ -715,30 +837,24 @@ static void postfix_inc(bool can_assign) {
         return;
     }
 
-    bool is_const_var = XEN_FALSE;
-    if (parser.last_was_local) {
-        is_const_var = is_local_const(current, parser.last_variable_arg);
-    } else {
-        is_const_var = is_global_const(&parser.last_variable);
-    }
-    if (is_const_var) {
+    if (parser.last_is_const) {
         error("cannot modify constant variable with '++'");
         parser.last_was_variable = XEN_FALSE;
         return;
     }
 
-    u8 get_op = parser.last_was_local ? OP_GET_LOCAL : OP_GET_GLOBAL;
-    u8 set_op = parser.last_was_local ? OP_SET_LOCAL : OP_SET_GLOBAL;
+    u8 get_op = parser.last_get_op;
+    u8 set_op = parser.last_set_op;
     u8 arg    = (u8)parser.last_variable_arg;
 
     // Stack currently has [old_value] from the variable() call
     // We need: [old_value] but also increment the variable
 
-    emit_bytes(get_op, arg);       // [old, old]  (re-fetch, we'll increment this)
-    emit_constant(NUMBER_VAL(1));  // [old, old, 1]
-    emit_byte(OP_ADD);             // [old, new]
-    emit_bytes(set_op, arg);       // [old, new]
-    emit_byte(OP_POP);             // [old]
+    emit_bytes(get_op, arg);    // [old, old]  (re-fetch, we'll increment this)
+    emit_constant(INT_VAL(1));  // [old, old, 1]
+    emit_byte(OP_ADD);          // [old, new]
+    emit_bytes(set_op, arg);    // [old, new]
+    emit_byte(OP_POP);          // [old]
 
     parser.last_was_variable = XEN_FALSE;
 }
@@ -751,24 +867,18 @@ static void postfix_dec(bool can_assign) {
         return;
     }
 
-    bool is_const_var = XEN_FALSE;
-    if (parser.last_was_local) {
-        is_const_var = is_local_const(current, parser.last_variable_arg);
-    } else {
-        is_const_var = is_global_const(&parser.last_variable);
-    }
-    if (is_const_var) {
+    if (parser.last_is_const) {
         error("cannot modify constant variable with '--'");
         parser.last_was_variable = XEN_FALSE;
         return;
     }
 
-    u8 get_op = parser.last_was_local ? OP_GET_LOCAL : OP_GET_GLOBAL;
-    u8 set_op = parser.last_was_local ? OP_SET_LOCAL : OP_SET_GLOBAL;
+    u8 get_op = parser.last_get_op;
+    u8 set_op = parser.last_set_op;
     u8 arg    = (u8)parser.last_variable_arg;
 
     emit_bytes(get_op, arg);
-    emit_constant(NUMBER_VAL(1));
+    emit_constant(INT_VAL(1));
     emit_byte(OP_SUBTRACT);
     emit_bytes(set_op, arg);
     emit_byte(OP_POP);
@@ -784,34 +894,18 @@ static void prefix_inc(bool can_assign) {
 
     xen_token name = parser.previous;
     u8 get_op, set_op;
-    i32 arg = resolve_local(current, &name);
-
-    bool is_local     = (arg != -1);
-    bool is_const_var = XEN_FALSE;
-    if (is_local) {
-        is_const_var = is_local_const(current, arg);
-    } else {
-        is_const_var = is_global_const(&name);
-    }
+    bool is_const_var;
+    const i32 arg = resolve_variable(&name, &get_op, &set_op, &is_const_var);
     if (is_const_var) {
         error("cannot modify constant variable with '++'");
         return;
     }
 
-    if (is_local) {
-        get_op = OP_GET_LOCAL;
-        set_op = OP_SET_LOCAL;
-    } else {
-        arg    = identifier_constant(&name);
-        get_op = OP_GET_GLOBAL;
-        set_op = OP_SET_GLOBAL;
-    }
-
     // ++i: increment first, return new value
-    emit_bytes(get_op, (u8)arg);   // [old]
-    emit_constant(NUMBER_VAL(1));  // [old, 1]
-    emit_byte(OP_ADD);             // [new]
-    emit_bytes(set_op, (u8)arg);   // [new] (stored and left on stack)
+    emit_bytes(get_op, (u8)arg);  // [old]
+    emit_constant(INT_VAL(1));    // [old, 1]
+    emit_byte(OP_ADD);            // [new]
+    emit_bytes(set_op, (u8)arg);  // [new] (stored and left on stack)
 }
 
 static void prefix_dec(bool can_assign) {
@@ -821,31 +915,15 @@ static void prefix_dec(bool can_assign) {
 
     xen_token name = parser.previous;
     u8 get_op, set_op;
-    i32 arg = resolve_local(current, &name);
-
-    bool is_local     = (arg != -1);
-    bool is_const_var = XEN_FALSE;
-    if (is_local) {
-        is_const_var = is_local_const(current, arg);
-    } else {
-        is_const_var = is_global_const(&name);
-    }
+    bool is_const_var;
+    const i32 arg = resolve_variable(&name, &get_op, &set_op, &is_const_var);
     if (is_const_var) {
         error("cannot modify constant variable with '--'");
         return;
     }
 
-    if (is_local) {
-        get_op = OP_GET_LOCAL;
-        set_op = OP_SET_LOCAL;
-    } else {
-        arg    = identifier_constant(&name);
-        get_op = OP_GET_GLOBAL;
-        set_op = OP_SET_GLOBAL;
-    }
-
     emit_bytes(get_op, (u8)arg);
-    emit_constant(NUMBER_VAL(1));
+    emit_constant(INT_VAL(1));
     emit_byte(OP_SUBTRACT);
     emit_bytes(set_op, (u8)arg);
 }
@@ -998,6 +1076,12 @@ xen_parse_rule rules[] = {
     [TOKEN_GREATER_EQUAL]    = {NULL,       binary,      PREC_COMPARISON},
     [TOKEN_LESS]             = {NULL,       binary,      PREC_COMPARISON},
     [TOKEN_LESS_EQUAL]       = {NULL,       binary,      PREC_COMPARISON},
+    [TOKEN_AMPERSAND]        = {NULL,       binary,      PREC_BIT_AND},
+    [TOKEN_PIPE]             = {NULL,       binary,      PREC_BIT_OR},
+    [TOKEN_CARET]            = {NULL,       binary,      PREC_BIT_XOR},
+    [TOKEN_TILDE]            = {unary,      NULL,        PREC_NONE},
+    [TOKEN_LESS_LESS]        = {NULL,       binary,      PREC_SHIFT},
+    [TOKEN_GREATER_GREATER]  = {NULL,       binary,      PREC_SHIFT},
     [TOKEN_PLUS_PLUS]        = {prefix_inc, postfix_inc, PREC_POSTFIX},
     [TOKEN_MINUS_MINUS]      = {prefix_dec, postfix_dec, PREC_POSTFIX},
     [TOKEN_PLUS_EQUAL]       = {NULL,       NULL,        PREC_NONE},
@@ -1175,6 +1259,33 @@ static void while_statement() {
 
 static void var_declaration();
 
+// Compiles a loop body with `name` bound to a copy of the loop variable in `slot` rather than to the variable itself.
+// The copy is discarded at the end of every iteration, closing it if the body captured it, so each iteration's
+// closures see their own value, as with `for (var x in array)`. The copy is left on top of the stack for the caller to
+// write back into `slot`, assignments to it in the body then still steer the loop.
+static void loop_body(xen_token name, u8 slot) {
+    emit_bytes(OP_GET_LOCAL, slot);
+    add_local(name, XEN_FALSE);
+    mark_initialized();
+    statement();
+}
+
+// Ends a range loop's iteration: the counter is advanced from the body's copy, which is then discarded
+static void end_range_iteration(u8 slot) {
+    emit_bytes(OP_GET_LOCAL, (u8)(current->local_count - 1));
+    emit_constant(INT_VAL(1));
+    emit_byte(OP_ADD);
+    emit_bytes(OP_SET_LOCAL, slot);
+    emit_byte(OP_POP);
+    discard_local();
+}
+
+// Ends a C-style loop's iteration: the body's copy is written back before the increment clause runs, then discarded
+static void end_c_style_iteration(u8 slot) {
+    emit_bytes(OP_SET_LOCAL, slot);
+    discard_local();
+}
+
 /*
  * for-in statement: for (var i in start..end) { body }
  * Desugars to:
@@ -1182,8 +1293,9 @@ static void var_declaration();
  *     var i = start;
  *     var __end = end;  // hidden variable
  *     while (i < __end) {
+ *       var i' = i;  // what `i` names in the body, see loop_body
  *       body;
- *       i = i + 1;
+ *       i = i' + 1;
  *     }
  *   }
  */
@@ -1235,15 +1347,9 @@ static void for_in_statement() {
     i32 exit_jump = emit_jump(OP_JUMP_IF_FALSE);
     emit_byte(OP_POP);  // pop condition
 
-    // compile body
-    statement();
-
-    // increment: i = i + 1
-    emit_bytes(OP_GET_LOCAL, loop_var_slot);
-    emit_constant(NUMBER_VAL(1));
-    emit_byte(OP_ADD);
-    emit_bytes(OP_SET_LOCAL, loop_var_slot);
-    emit_byte(OP_POP);  // pop the result of the assignment
+    // compile body, then increment: i = i + 1
+    loop_body(loop_var, loop_var_slot);
+    end_range_iteration(loop_var_slot);
 
     // jump back to condition
     emit_loop(loop_start);
@@ -1263,10 +1369,14 @@ static void for_c_style_statement() {
     consume(TOKEN_LEFT_PAREN, "expected '(' after 'for'");
 
     // initializer clause
+    i32 loop_var_slot = -1;
+    xen_token loop_var;
     if (match_token(TOKEN_SEMICOLON)) {
         // no initializer
     } else if (match_token(TOKEN_VAR)) {
+        loop_var = parser.current;
         var_declaration();
+        loop_var_slot = current->local_count - 1;
     } else {
         expression_statement();
     }
@@ -1295,7 +1405,12 @@ static void for_c_style_statement() {
     }
 
     // body
-    statement();
+    if (loop_var_slot != -1) {
+        loop_body(loop_var, (u8)loop_var_slot);
+        end_c_style_iteration((u8)loop_var_slot);
+    } else {
+        statement();
+    }
     emit_loop(loop_start);
 
     if (exit_jump != -1) {
@@ -1346,7 +1461,8 @@ static void for_statement() {
                          * Desugars to:
                          *   var i = start;
                          *   var __end = end;
-                         *   while (i < __end) { body; i = i + 1; }
+                         *   while (i < __end) { var i' = i; body; i = i' + 1; }
+                         * where i' is the name `i` binds to in the body (see loop_body)
                          */
 
                         // The start value is already on the stack from expression() above
@@ -1381,15 +1497,9 @@ static void for_statement() {
                         i32 exit_jump = emit_jump(OP_JUMP_IF_FALSE);
                         emit_byte(OP_POP);
 
-                        // body
-                        statement();
-
-                        // increment: i = i + 1
-                        emit_bytes(OP_GET_LOCAL, loop_var_slot);
-                        emit_constant(NUMBER_VAL(1));
-                        emit_byte(OP_ADD);
-                        emit_bytes(OP_SET_LOCAL, loop_var_slot);
-                        emit_byte(OP_POP);
+                        // body, then increment: i = i + 1
+                        loop_body(loop_var, loop_var_slot);
+                        end_range_iteration(loop_var_slot);
 
                         emit_loop(loop_start);
 
@@ -1438,7 +1548,7 @@ static void for_statement() {
                         u8 len_slot = (u8)(current->local_count - 1);
 
                         // Initialize index __i = 0
-                        emit_constant(NUMBER_VAL(0));
+                        emit_constant(INT_VAL(0));
 
                         xen_token idx_token;
                         idx_token.start  = "__i";
@@ -1473,13 +1583,12 @@ static void for_statement() {
                         // body
                         statement();
 
-                        // Pop the loop variable (it goes out of scope each iteration)
-                        emit_byte(OP_POP);
-                        current->local_count--;
+                        // Pop the loop variable (it goes out of scope each iteration, so closures capture a fresh one)
+                        discard_local();
 
                         // increment: __i = __i + 1
                         emit_bytes(OP_GET_LOCAL, idx_slot);
-                        emit_constant(NUMBER_VAL(1));
+                        emit_constant(INT_VAL(1));
                         emit_byte(OP_ADD);
                         emit_bytes(OP_SET_LOCAL, idx_slot);
                         emit_byte(OP_POP);
@@ -1534,7 +1643,9 @@ static void for_statement() {
                         patch_jump(body_jump);
                     }
 
-                    statement();
+                    const u8 var_slot = (u8)(current->local_count - 1);
+                    loop_body(var_name, var_slot);
+                    end_c_style_iteration(var_slot);
                     emit_loop(loop_start);
 
                     if (exit_jump != -1) {
@@ -1717,6 +1828,9 @@ static void method(xen_function_type type) {
     }
 
     xen_obj_func* fn = end_compiler();
+    if (fn->upvalue_count > 0) {
+        error("methods cannot capture local variables of an enclosing function");
+    }
     emit_bytes(OP_CONSTANT, make_constant(OBJ_VAL(fn)));
 }
 
@@ -1813,7 +1927,18 @@ static void function(xen_function_type type) {
     }
 
     xen_obj_func* fn = end_compiler();
-    emit_bytes(OP_CONSTANT, make_constant(OBJ_VAL(fn)));
+    if (fn->upvalue_count == 0) {
+        // Nothing captured: the bare function is the value, so creating and calling it allocates nothing
+        emit_bytes(OP_CONSTANT, make_constant(OBJ_VAL(fn)));
+        return;
+    }
+
+    emit_bytes(OP_CLOSURE, make_constant(OBJ_VAL(fn)));
+    emit_byte((u8)fn->upvalue_count);
+    for (i32 i = 0; i < fn->upvalue_count; i++) {
+        emit_byte(compiler.upvalues[i].is_local ? 1 : 0);
+        emit_byte(compiler.upvalues[i].index);
+    }
 }
 
 static void fn_declaration() {
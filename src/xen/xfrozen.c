@@ -0,0 +1,281 @@
+#include "xfrozen.h"
+#include "xmem.h"
+#include "xtable.h"
+#include "xtypeid.h"
+#include "xvm.h"
+
+#include "object/xobj_string.h"
+#include "object/xobj_array.h"
+#include "object/xobj_dict.h"
+#include "object/xobj_u8array.h"
+
+#include <stdatomic.h>
+
+struct xen_frozen {
+    atomic_int refs;
+    xen_obj* objects;   // every object of the region, linked through obj.next
+    xen_frozen** deps;  // older regions this one points into
+    i32 dep_count;
+    i32 dep_capacity;
+};
+
+// Frozen objects are preceded by the region they belong to
+typedef union {
+    xen_frozen* region;
+    max_align_t align;
+} frozen_header;
+
+//==============================================================//
+//                           Regions                            //
+//==============================================================//
+
+static xen_obj* frozen_alloc(xen_frozen* region, size_t size, xen_obj_type type) {
+    frozen_header* header = xen_mem_realloc(NULL, 0, sizeof(frozen_header) + size);
+    header->region        = region;
+    xen_obj* obj          = (xen_obj*)(header + 1);
+    obj->type             = type;
+    obj->frozen           = XEN_TRUE;
+    obj->next             = region->objects;
+    region->objects       = obj;
+    return obj;
+}
+
+static void frozen_free_object(xen_obj* obj) {
+    switch (obj->type) {
+        case OBJ_STRING:
+            free(((xen_obj_str*)obj)->str);
+            break;
+        case OBJ_ARRAY:
+            free(((xen_obj_array*)obj)->array.values);
+            break;
+        case OBJ_DICT:
+            xen_table_free(&((xen_obj_dict*)obj)->table);
+            break;
+        case OBJ_U8ARRAY:
+            free(((xen_obj_u8array*)obj)->values);
+            break;
+        default:
+            break;
+    }
+    free((frozen_header*)obj - 1);
+}
+
+static void frozen_destroy(xen_frozen* region) {
+    xen_obj* obj = region->objects;
+    while (obj != NULL) {
+        xen_obj* next = obj->next;
+        frozen_free_object(obj);
+        obj = next;
+    }
+    for (i32 i = 0; i < region->dep_count; i++) {
+        xen_frozen_release(region->deps[i]);
+    }
+    free(region->deps);
+    free(region);
+}
+
+xen_frozen* xen_frozen_of(const xen_obj* obj) {
+    return ((const frozen_header*)obj - 1)->region;
+}
+
+void xen_frozen_retain(xen_frozen* region) {
+    atomic_fetch_add_explicit(&region->refs, 1, memory_order_relaxed);
+}
+
+void xen_frozen_release(xen_frozen* region) {
+    if (atomic_fetch_sub_explicit(&region->refs, 1, memory_order_acq_rel) == 1)
+        frozen_destroy(region);
+}
+
+void xen_frozen_hold(xen_frozen*** list, i32* count, i32* capacity, xen_frozen* region) {
+    for (i32 i = *count - 1; i >= 0; i--) {
+        if ((*list)[i] == region)
+            return;
+    }
+    if (*count == *capacity) {
+        const i32 old_capacity = *capacity;
+        *capacity              = XEN_GROW_CAPACITY(old_capacity);
+        *list                  = XEN_GROW_ARRAY(xen_frozen*, *list, old_capacity, *capacity);
+    }
+    (*list)[(*count)++] = region;
+    xen_frozen_retain(region);
+}
+
+void xen_frozen_adopt(xen_frozen* region) {
+    xen_frozen_hold(&g_vm->frozen, &g_vm->frozen_count, &g_vm->frozen_capacity, region);
+}
+
+void xen_frozen_release_all() {
+    for (i32 i = 0; i < g_vm->frozen_count; i++) {
+        xen_frozen_release(g_vm->frozen[i]);
+    }
+    XEN_FREE_ARRAY(xen_frozen*, g_vm->frozen, g_vm->frozen_capacity);
+    g_vm->frozen          = NULL;
+    g_vm->frozen_count    = 0;
+    g_vm->frozen_capacity = 0;
+}
+
+//==============================================================//
+//                           Freezing                           //
+//==============================================================//
+
+typedef struct {
+    xen_obj* from;
+    xen_obj* to;
+} freeze_entry;
+
+typedef struct {
+    xen_frozen* region;
+    freeze_entry* seen;  // originals already copied, so shared references (and cycles) stay shared in the copy
+    u32 seen_count;
+    u32 seen_capacity;
+    const char* failed;
+} freezer;
+
+static u32 freeze_hash(const void* ptr) {
+    return (u32)(((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ull >> 32);
+}
+
+static xen_obj* freeze_lookup(const freezer* f, const xen_obj* obj) {
+    if (f->seen_capacity == 0)
+        return NULL;
+    u32 slot = freeze_hash(obj) & (f->seen_capacity - 1);
+    while (f->seen[slot].from != NULL) {
+        if (f->seen[slot].from == obj)
+            return f->seen[slot].to;
+        slot = (slot + 1) & (f->seen_capacity - 1);
+    }
+    return NULL;
+}
+
+static void freeze_remember(freezer* f, xen_obj* from, xen_obj* to) {
+    if ((f->seen_count + 1) * 2 > f->seen_capacity) {
+        const u32 old_capacity = f->seen_capacity;
+        freeze_entry* old_seen = f->seen;
+        f->seen_capacity       = old_capacity < 64 ? 64 : old_capacity * 2;
+        f->seen                = calloc(f->seen_capacity, sizeof(freeze_entry));
+        for (u32 i = 0; i < old_capacity; i++) {
+            if (old_seen[i].from == NULL)
+                continue;
+            u32 slot = freeze_hash(old_seen[i].from) & (f->seen_capacity - 1);
+            while (f->seen[slot].from != NULL)
+                slot = (slot + 1) & (f->seen_capacity - 1);
+            f->seen[slot] = old_seen[i];
+        }
+        free(old_seen);
+    }
+
+    u32 slot = freeze_hash(from) & (f->seen_capacity - 1);
+    while (f->seen[slot].from != NULL)
+        slot = (slot + 1) & (f->seen_capacity - 1);
+    f->seen[slot] = (freeze_entry) {from, to};
+    f->seen_count++;
+}
+
+static xen_obj_str* freeze_string(freezer* f, const xen_obj_str* str) {
+    xen_obj* copy = freeze_lookup(f, (xen_obj*)str);
+    if (copy != NULL)
+        return (xen_obj_str*)copy;
+
+    xen_obj_str* frozen = (xen_obj_str*)frozen_alloc(f->region, sizeof(xen_obj_str), OBJ_STRING);
+    frozen->length      = str->length;
+    frozen->hash        = str->hash;
+    frozen->str         = XEN_ALLOCATE(char, str->length + 1);
+    memcpy(frozen->str, str->str, (size_t)str->length + 1);
+    freeze_remember(f, (xen_obj*)str, (xen_obj*)frozen);
+    return frozen;
+}
+
+static bool freeze_value(freezer* f, xen_value value, xen_value* out) {
+    if (!VAL_IS_OBJ(value)) {
+        *out = value;
+        return XEN_TRUE;
+    }
+
+    xen_obj* obj = VAL_AS_OBJ(value);
+    if (obj->frozen) {
+        // already shared, the new region keeps the one it lives in alive
+        xen_frozen_hold(&f->region->deps, &f->region->dep_count, &f->region->dep_capacity, xen_frozen_of(obj));
+        *out = value;
+        return XEN_TRUE;
+    }
+
+    xen_obj* copy = freeze_lookup(f, obj);
+    if (copy != NULL) {
+        *out = OBJ_VAL(copy);
+        return XEN_TRUE;
+    }
+
+    switch (obj->type) {
+        case OBJ_STRING:
+            *out = OBJ_VAL(freeze_string(f, (xen_obj_str*)obj));
+            return XEN_TRUE;
+        case OBJ_ARRAY: {
+            const xen_value_array* src = &((xen_obj_array*)obj)->array;
+            xen_obj_array* frozen      = (xen_obj_array*)frozen_alloc(f->region, sizeof(xen_obj_array), OBJ_ARRAY);
+            xen_value_array_init(&frozen->array);
+            frozen->array.values = XEN_ALLOCATE(xen_value, src->count > 0 ? src->count : 1);
+            frozen->array.count  = src->count;
+            frozen->array.cap    = src->count;
+            freeze_remember(f, obj, (xen_obj*)frozen);  // before the items, so cycles lead back to the copy
+            for (u64 i = 0; i < src->count; i++) {
+                if (!freeze_value(f, src->values[i], &frozen->array.values[i]))
+                    return XEN_FALSE;
+            }
+            *out = OBJ_VAL(frozen);
+            return XEN_TRUE;
+        }
+        case OBJ_DICT: {
+            const xen_table* src = &((xen_obj_dict*)obj)->table;
+            xen_obj_dict* frozen = (xen_obj_dict*)frozen_alloc(f->region, sizeof(xen_obj_dict), OBJ_DICT);
+            xen_table_init(&frozen->table);
+            freeze_remember(f, obj, (xen_obj*)frozen);
+            for (u64 i = 0; i < src->capacity; i++) {
+                const xen_table_entry* entry = &src->entries[i];
+                if (entry->key == NULL)
+                    continue;
+                xen_value item;
+                if (!freeze_value(f, entry->value, &item))
+                    return XEN_FALSE;
+                xen_table_set(&frozen->table, freeze_string(f, entry->key), item);
+            }
+            *out = OBJ_VAL(frozen);
+            return XEN_TRUE;
+        }
+        case OBJ_U8ARRAY: {
+            const xen_obj_u8array* src = (xen_obj_u8array*)obj;
+            xen_obj_u8array* frozen = (xen_obj_u8array*)frozen_alloc(f->region, sizeof(xen_obj_u8array), OBJ_U8ARRAY);
+            frozen->count           = src->count;
+            frozen->capacity        = src->count;
+            frozen->values          = XEN_ALLOCATE(u8, src->count > 0 ? src->count : 1);
+            memcpy(frozen->values, src->values, (size_t)src->count);
+            freeze_remember(f, obj, (xen_obj*)frozen);
+            *out = OBJ_VAL(frozen);
+            return XEN_TRUE;
+        }
+        default:
+            f->failed = xen_typeid_str(xen_typeid_get(value));
+            return XEN_FALSE;
+    }
+}
+
+bool xen_freeze(xen_value value, xen_value* out, const char** failed) {
+    if (!VAL_IS_OBJ(value) || VAL_AS_OBJ(value)->frozen) {
+        *out = value;
+        return XEN_TRUE;
+    }
+
+    freezer f = {0};
+    f.region  = calloc(1, sizeof(xen_frozen));
+    atomic_init(&f.region->refs, 0);
+
+    const bool ok = freeze_value(&f, value, out);
+    free(f.seen);
+    if (!ok) {
+        *failed = f.failed;
+        frozen_destroy(f.region);
+        return XEN_FALSE;
+    }
+    xen_frozen_adopt(f.region);
+    return XEN_TRUE;
+}
@@ -0,0 +1,41 @@
+#ifndef X_FROZEN_H
+#define X_FROZEN_H
+
+#include "xcommon.h"
+#include "xvalue.h"
+
+/*
+ * Frozen values
+ *
+ * freeze(value) deep-copies strings, arrays, dictionaries and UInt8Arrays into a region of their own, outside every
+ * VM's heap, and marks the copies immutable. Nothing can change a frozen object, so every VM of the process may read
+ * it concurrently without locks, and passing one to another thread (spawn arguments, channels, parallel array
+ * methods) hands over the pointer instead of a copy.
+ *
+ * Regions are reference counted: every VM that holds a value of a region owns one reference, released when the VM is
+ * freed, and a message in flight owns one until it is freed. A region that contains values of older regions keeps
+ * those alive as well.
+ */
+
+typedef struct xen_frozen xen_frozen;
+
+/// @brief Returns a frozen copy of `value` (primitives and frozen values are returned as they are). On failure returns
+/// false and sets `failed` to the type name of the first value that can't be frozen.
+bool xen_freeze(xen_value value, xen_value* out, const char** failed);
+
+/// @brief The region a frozen object belongs to.
+xen_frozen* xen_frozen_of(const xen_obj* obj);
+
+void xen_frozen_retain(xen_frozen* region);
+void xen_frozen_release(xen_frozen* region);
+
+/// @brief Adds `region` to a list of held regions, taking a reference, unless the list already holds it.
+void xen_frozen_hold(xen_frozen*** list, i32* count, i32* capacity, xen_frozen* region);
+
+/// @brief Makes the calling thread's VM a holder of `region`, see xen_frozen_hold.
+void xen_frozen_adopt(xen_frozen* region);
+
+/// @brief Drops every reference the calling thread's VM holds, called when the VM is freed.
+void xen_frozen_release_all();
+
+#endif
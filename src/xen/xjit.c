@@ -0,0 +1,577 @@
+#include "xjit.h"
+#include "xchunk.h"
+#include "xmem.h"
+#include "xtable.h"
+#include "xvalue.h"
+
+#include "object/xobj_function.h"
+#include "object/xobj_string.h"
+#include "object/xobj_closure.h"
+
+#if XEN_JIT_SUPPORTED
+
+    #include <sys/mman.h>
+    #include <unistd.h>
+
+// The templates below hardcode the value and frame layouts
+_Static_assert(sizeof(xen_value) == 16, "jit templates expect 16-byte values");
+_Static_assert(offsetof(xen_value, as) == 8, "jit templates expect the payload at offset 8");
+_Static_assert(offsetof(xen_call_frame, ip) == 8, "jit templates expect frame->ip at offset 8");
+_Static_assert(offsetof(xen_call_frame, slots) == 16, "jit templates expect frame->slots at offset 16");
+_Static_assert(offsetof(xen_call_frame, closure) == 24, "jit templates expect frame->closure at offset 24");
+_Static_assert(offsetof(xen_obj_closure, upvalues) < 128, "jit templates expect a disp8 upvalues offset");
+_Static_assert(offsetof(xen_obj_upvalue, location) < 128, "jit templates expect a disp8 location offset");
+
+static XEN_THREAD_LOCAL xen_jit_code* g_jit_blocks = NULL;
+static XEN_THREAD_LOCAL FILE* g_perf_map           = NULL;
+
+//=====================================================================================================================//
+//  Code buffer                                                                                                        //
+//=====================================================================================================================//
+
+typedef enum {
+    FIXUP_INSTRUCTION,  // rel32 to the native code of a bytecode offset
+    FIXUP_EXIT,         // rel32 to the side exit of a bytecode offset
+} jit_fixup_kind;
+
+typedef struct {
+    u32 at;
+    u32 target;
+    jit_fixup_kind kind;
+} jit_fixup;
+
+typedef struct {
+    array(u8) data;
+    size_t count;
+    size_t capacity;
+
+    array(jit_fixup) fixups;
+    size_t fixup_count;
+    size_t fixup_capacity;
+
+    u32 exit_common;
+} jit_buffer;
+
+static void emit_raw(jit_buffer* buf, const u8* bytes, size_t n) {
+    if (buf->count + n > buf->capacity) {
+        size_t old_cap = buf->capacity;
+        while (buf->count + n > buf->capacity)
+            buf->capacity = XEN_GROW_CAPACITY(buf->capacity);
+        buf->data = XEN_GROW_ARRAY(u8, buf->data, old_cap, buf->capacity);
+    }
+    memcpy(buf->data + buf->count, bytes, n);
+    buf->count += n;
+}
+
+    #define EMIT(buf, ...) emit_raw(buf, (const u8[]) {__VA_ARGS__}, sizeof((const u8[]) {__VA_ARGS__}))
+
+static void emit_u32(jit_buffer* buf, u32 v) {
+    emit_raw(buf, (const u8*)&v, sizeof(v));
+}
+
+static void emit_u64(jit_buffer* buf, u64 v) {
+    emit_raw(buf, (const u8*)&v, sizeof(v));
+}
+
+static void patch_rel32(jit_buffer* buf, u32 at, u32 dest) {
+    i32 rel = (i32)dest - (i32)(at + 4);
+    memcpy(buf->data + at, &rel, sizeof(rel));
+}
+
+// Emits a rel32 placeholder that is resolved once every instruction has been emitted
+static void emit_fixup(jit_buffer* buf, jit_fixup_kind kind, u32 target) {
+    if (buf->fixup_count >= buf->fixup_capacity) {
+        size_t old_cap      = buf->fixup_capacity;
+        buf->fixup_capacity = XEN_GROW_CAPACITY(old_cap);
+        buf->fixups         = XEN_GROW_ARRAY(jit_fixup, buf->fixups, old_cap, buf->fixup_capacity);
+    }
+    buf->fixups[buf->fixup_count++] = (jit_fixup) {(u32)buf->count, target, kind};
+    emit_u32(buf, 0);
+}
+
+//=====================================================================================================================//
+//  Templates                                                                                                          //
+//                                                                                                                     //
+//  Register assignment inside generated code:                                                                         //
+//    rbx = xen_call_frame*    r12 = cached stack top    r13 = frame->slots    r14 = &vm stack_top                     //
+//=====================================================================================================================//
+
+static void emit_prologue(jit_buffer* buf) {
+    EMIT(buf, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);  // push rbx, r12, r13, r14, r15
+    EMIT(buf, 0x48, 0x89, 0xFB);                                      // mov rbx, rdi
+    EMIT(buf, 0x4C, 0x8B, 0x6B, 0x10);                                // mov r13, [rbx + slots]
+    EMIT(buf, 0x49, 0x89, 0xD6);                                      // mov r14, rdx
+    EMIT(buf, 0x4D, 0x8B, 0x26);                                      // mov r12, [r14]
+    EMIT(buf, 0xFF, 0xE6);                                            // jmp rsi
+
+    // Shared exit path, expects the resume ip in rax
+    buf->exit_common = (u32)buf->count;
+    EMIT(buf, 0x48, 0x89, 0x43, 0x08);                                // mov [rbx + ip], rax
+    EMIT(buf, 0x4D, 0x89, 0x26);                                      // mov [r14], r12
+    EMIT(buf, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B);  // pop r15, r14, r13, r12, rbx
+    EMIT(buf, 0xC3);                                                  // ret
+}
+
+static void emit_exit(jit_buffer* buf, const u8* resume_ip) {
+    EMIT(buf, 0x48, 0xB8);  // mov rax, imm64
+    emit_u64(buf, (u64)resume_ip);
+    EMIT(buf, 0xE9);  // jmp exit_common
+    emit_u32(buf, 0);
+    patch_rel32(buf, (u32)buf->count - 4, buf->exit_common);
+}
+
+static void emit_push_xmm0(jit_buffer* buf) {
+    EMIT(buf, 0xF3, 0x41, 0x0F, 0x7F, 0x04, 0x24);  // movdqu [r12], xmm0
+    EMIT(buf, 0x49, 0x83, 0xC4, 0x10);              // add r12, 16
+}
+
+static void emit_push_literal(jit_buffer* buf, xen_value_type type, u32 payload) {
+    EMIT(buf, 0x41, 0xC7, 0x04, 0x24);  // mov dword [r12], type
+    emit_u32(buf, type);
+    EMIT(buf, 0x49, 0xC7, 0x44, 0x24, 0x08);  // mov qword [r12 + 8], payload
+    emit_u32(buf, payload);
+    EMIT(buf, 0x49, 0x83, 0xC4, 0x10);  // add r12, 16
+}
+
+// Side-exits unless the value `disp` bytes below the stack top is of the given type
+static void emit_guard_type(jit_buffer* buf, i8 disp, xen_value_type type, u32 offset) {
+    EMIT(buf, 0x41, 0x83, 0x7C, 0x24, (u8)disp, (u8)type);  // cmp dword [r12 + disp], type
+    EMIT(buf, 0x0F, 0x85);                                  // jne exit
+    emit_fixup(buf, FIXUP_EXIT, offset);
+}
+
+// Emits a short jump with an unresolved rel8 displacement and returns its position for bind_rel8()
+static u32 emit_jump8(jit_buffer* buf, u8 opcode) {
+    EMIT(buf, opcode, 0x00);
+    return (u32)buf->count - 1;
+}
+
+// Points a short jump emitted by emit_jump8() at the current position
+static void bind_rel8(jit_buffer* buf, u32 at) {
+    buf->data[at] = (u8)(buf->count - (at + 1));
+}
+
+// Loads the operand type pair into eax as (lhs type << 8) | rhs type, see VAL_PAIR_IS_NUMBER
+static void emit_load_pair_tag(jit_buffer* buf) {
+    EMIT(buf, 0x41, 0x8B, 0x44, 0x24, 0xE0);  // mov eax, [r12 - 32]
+    EMIT(buf, 0xC1, 0xE0, 0x08);              // shl eax, 8
+    EMIT(buf, 0x41, 0x0B, 0x44, 0x24, 0xF0);  // or eax, [r12 - 16]
+}
+
+static void emit_cmp_eax(jit_buffer* buf, u32 imm) {
+    EMIT(buf, 0x3D);  // cmp eax, imm32
+    emit_u32(buf, imm);
+}
+
+    #define INT_PAIR ((VAL_INT << 8) | VAL_INT)
+    #define NUMBER_PAIR ((VAL_NUMBER << 8) | VAL_NUMBER)
+
+// Two ints use checked integer math (overflow side-exits so the interpreter can promote to float), two floats use SSE,
+// anything else side-exits. Division always produces a float.
+static void emit_arith(jit_buffer* buf, xen_opcode op, u8 sse_op, u32 offset) {
+    emit_load_pair_tag(buf);
+    emit_cmp_eax(buf, INT_PAIR);
+    const u32 not_int = emit_jump8(buf, 0x75);  // jne not_int
+    if (op == OP_DIVIDE) {
+        EMIT(buf, 0xF2, 0x49, 0x0F, 0x2A, 0x44, 0x24, 0xE8);  // cvtsi2sd xmm0, qword [r12 - 24]
+        EMIT(buf, 0xF2, 0x49, 0x0F, 0x2A, 0x4C, 0x24, 0xF8);  // cvtsi2sd xmm1, qword [r12 - 8]
+        EMIT(buf, 0xF2, 0x0F, 0x5E, 0xC1);                    // divsd xmm0, xmm1
+        EMIT(buf, 0xF2, 0x41, 0x0F, 0x11, 0x44, 0x24, 0xE8);  // movsd [r12 - 24], xmm0
+        EMIT(buf, 0x41, 0xC7, 0x44, 0x24, 0xE0);              // mov dword [r12 - 32], VAL_NUMBER
+        emit_u32(buf, VAL_NUMBER);
+    } else {
+        EMIT(buf, 0x49, 0x8B, 0x44, 0x24, 0xE8);  // mov rax, [r12 - 24]
+        if (op == OP_ADD)
+            EMIT(buf, 0x49, 0x03, 0x44, 0x24, 0xF8);  // add rax, [r12 - 8]
+        else if (op == OP_SUBTRACT)
+            EMIT(buf, 0x49, 0x2B, 0x44, 0x24, 0xF8);  // sub rax, [r12 - 8]
+        else
+            EMIT(buf, 0x49, 0x0F, 0xAF, 0x44, 0x24, 0xF8);  // imul rax, [r12 - 8]
+        EMIT(buf, 0x0F, 0x80);                              // jo exit
+        emit_fixup(buf, FIXUP_EXIT, offset);
+        EMIT(buf, 0x49, 0x89, 0x44, 0x24, 0xE8);  // mov [r12 - 24], rax
+    }
+    const u32 done = emit_jump8(buf, 0xEB);  // jmp done
+
+    bind_rel8(buf, not_int);
+    emit_cmp_eax(buf, NUMBER_PAIR);
+    EMIT(buf, 0x0F, 0x85);  // jne exit
+    emit_fixup(buf, FIXUP_EXIT, offset);
+    EMIT(buf, 0xF2, 0x41, 0x0F, 0x10, 0x44, 0x24, 0xE8);    // movsd xmm0, [r12 - 24]
+    EMIT(buf, 0xF2, 0x41, 0x0F, sse_op, 0x44, 0x24, 0xF8);  // <op>sd xmm0, [r12 - 8]
+    EMIT(buf, 0xF2, 0x41, 0x0F, 0x11, 0x44, 0x24, 0xE8);    // movsd [r12 - 24], xmm0
+
+    bind_rel8(buf, done);
+    EMIT(buf, 0x49, 0x83, 0xEC, 0x10);  // sub r12, 16
+}
+
+// Replaces the two operands with the boolean in al
+static void emit_store_bool_result(jit_buffer* buf) {
+    EMIT(buf, 0x0F, 0xB6, 0xC0);                                      // movzx eax, al
+    EMIT(buf, 0x41, 0xC7, 0x44, 0x24, 0xE0, VAL_BOOL, 0x00, 0x00, 0x00);  // mov dword [r12 - 32], VAL_BOOL
+    EMIT(buf, 0x49, 0x89, 0x44, 0x24, 0xE8);                          // mov [r12 - 24], rax
+    EMIT(buf, 0x49, 0x83, 0xEC, 0x10);                                // sub r12, 16
+}
+
+static void emit_compare(jit_buffer* buf, xen_opcode op, u32 offset) {
+    emit_load_pair_tag(buf);
+    emit_cmp_eax(buf, INT_PAIR);
+    const u32 not_int = emit_jump8(buf, 0x75);  // jne not_int
+    EMIT(buf, 0x49, 0x8B, 0x44, 0x24, 0xE8);    // mov rax, [r12 - 24]
+    EMIT(buf, 0x49, 0x3B, 0x44, 0x24, 0xF8);    // cmp rax, [r12 - 8]
+    if (op == OP_LESS)
+        EMIT(buf, 0x0F, 0x9C, 0xC0);  // setl al
+    else if (op == OP_GREATER)
+        EMIT(buf, 0x0F, 0x9F, 0xC0);  // setg al
+    else
+        EMIT(buf, 0x0F, 0x94, 0xC0);  // sete al
+    const u32 done = emit_jump8(buf, 0xEB);  // jmp done
+
+    bind_rel8(buf, not_int);
+    emit_cmp_eax(buf, NUMBER_PAIR);
+    EMIT(buf, 0x0F, 0x85);  // jne exit
+    emit_fixup(buf, FIXUP_EXIT, offset);
+    if (op == OP_LESS) {
+        // a < b  <=>  b > a, which keeps unordered (NaN) comparisons false
+        EMIT(buf, 0xF2, 0x41, 0x0F, 0x10, 0x44, 0x24, 0xF8);  // movsd xmm0, [r12 - 8]
+        EMIT(buf, 0x66, 0x41, 0x0F, 0x2E, 0x44, 0x24, 0xE8);  // ucomisd xmm0, [r12 - 24]
+        EMIT(buf, 0x0F, 0x97, 0xC0);                          // seta al
+    } else if (op == OP_GREATER) {
+        EMIT(buf, 0xF2, 0x41, 0x0F, 0x10, 0x44, 0x24, 0xE8);  // movsd xmm0, [r12 - 24]
+        EMIT(buf, 0x66, 0x41, 0x0F, 0x2E, 0x44, 0x24, 0xF8);  // ucomisd xmm0, [r12 - 8]
+        EMIT(buf, 0x0F, 0x97, 0xC0);                          // seta al
+    } else {
+        EMIT(buf, 0xF2, 0x41, 0x0F, 0x10, 0x44, 0x24, 0xE8);  // movsd xmm0, [r12 - 24]
+        EMIT(buf, 0x66, 0x41, 0x0F, 0x2E, 0x44, 0x24, 0xF8);  // ucomisd xmm0, [r12 - 8]
+        EMIT(buf, 0x0F, 0x94, 0xC0);                          // sete al
+        EMIT(buf, 0x0F, 0x9B, 0xC1);                          // setnp cl
+        EMIT(buf, 0x20, 0xC8);                                // and al, cl
+    }
+
+    bind_rel8(buf, done);
+    emit_store_bool_result(buf);
+}
+
+// Leaves the address of the captured variable in rax: frame->closure->upvalues[index]->location
+static void emit_load_upvalue_location(jit_buffer* buf, u8 index) {
+    EMIT(buf, 0x48, 0x8B, 0x43, 0x18);                                     // mov rax, [rbx + closure]
+    EMIT(buf, 0x48, 0x8B, 0x40, (u8)offsetof(xen_obj_closure, upvalues));  // mov rax, [rax + upvalues]
+    EMIT(buf, 0x48, 0x8B, 0x80);                                           // mov rax, [rax + index * 8]
+    emit_u32(buf, (u32)index * sizeof(xen_obj_upvalue*));
+    EMIT(buf, 0x48, 0x8B, 0x40, (u8)offsetof(xen_obj_upvalue, location));  // mov rax, [rax + location]
+}
+
+// Calls `helper(arg)` with the stack synced to the VM. A false return side-exits so the interpreter can report the
+// error with a proper stack trace.
+static void emit_helper_call(jit_buffer* buf, bool (*helper)(xen_obj_str*), xen_obj_str* arg, u32 offset) {
+    EMIT(buf, 0x4D, 0x89, 0x26);  // mov [r14], r12
+    EMIT(buf, 0x48, 0xBF);        // mov rdi, imm64
+    emit_u64(buf, (u64)arg);
+    EMIT(buf, 0x48, 0xB8);  // mov rax, imm64
+    emit_u64(buf, (u64)helper);
+    EMIT(buf, 0xFF, 0xD0);        // call rax
+    EMIT(buf, 0x4D, 0x8B, 0x26);  // mov r12, [r14]
+    EMIT(buf, 0x84, 0xC0);        // test al, al
+    EMIT(buf, 0x0F, 0x84);        // je exit
+    emit_fixup(buf, FIXUP_EXIT, offset);
+}
+
+//=====================================================================================================================//
+//  Runtime helpers called from generated code                                                                         //
+//=====================================================================================================================//
+
+static bool jit_get_global(xen_obj_str* name) {
+    xen_value value;
+    if (!xen_table_get(&g_vm->globals, name, &value))
+        return XEN_FALSE;
+    *g_vm->stack_top++ = value;
+    return XEN_TRUE;
+}
+
+static bool jit_set_global(xen_obj_str* name) {
+    if (xen_table_set(&g_vm->globals, name, g_vm->stack_top[-1])) {
+        // assigning an undefined variable, let the interpreter raise the error
+        xen_table_delete(&g_vm->globals, name);
+        return XEN_FALSE;
+    }
+    return XEN_TRUE;
+}
+
+static bool jit_define_global(xen_obj_str* name) {
+    xen_table_set(&g_vm->globals, name, g_vm->stack_top[-1]);
+    g_vm->stack_top--;
+    return XEN_TRUE;
+}
+
+//=====================================================================================================================//
+//  Compilation                                                                                                        //
+//=====================================================================================================================//
+
+static void emit_instruction(jit_buffer* buf, xen_obj_func* fn, u32 offset) {
+    const xen_chunk* chunk = &fn->chunk;
+    const u8* ip           = chunk->code + offset;
+
+    switch (ip[0]) {
+        case OP_CONSTANT: {
+            EMIT(buf, 0x48, 0xB8);  // mov rax, &constant
+            emit_u64(buf, (u64)&chunk->constants.values[ip[1]]);
+            EMIT(buf, 0xF3, 0x0F, 0x6F, 0x00);  // movdqu xmm0, [rax]
+            emit_push_xmm0(buf);
+            break;
+        }
+        case OP_NULL:
+            emit_push_literal(buf, VAL_NULL, 0);
+            break;
+        case OP_TRUE:
+            emit_push_literal(buf, VAL_BOOL, 1);
+            break;
+        case OP_FALSE:
+            emit_push_literal(buf, VAL_BOOL, 0);
+            break;
+        case OP_POP:
+            EMIT(buf, 0x49, 0x83, 0xEC, 0x10);  // sub r12, 16
+            break;
+        case OP_GET_LOCAL: {
+            EMIT(buf, 0xF3, 0x41, 0x0F, 0x6F, 0x85);  // movdqu xmm0, [r13 + slot * 16]
+            emit_u32(buf, (u32)ip[1] * sizeof(xen_value));
+            emit_push_xmm0(buf);
+            break;
+        }
+        case OP_SET_LOCAL: {
+            EMIT(buf, 0xF3, 0x41, 0x0F, 0x6F, 0x44, 0x24, 0xF0);  // movdqu xmm0, [r12 - 16]
+            EMIT(buf, 0xF3, 0x41, 0x0F, 0x7F, 0x85);              // movdqu [r13 + slot * 16], xmm0
+            emit_u32(buf, (u32)ip[1] * sizeof(xen_value));
+            break;
+        }
+        case OP_GET_UPVALUE: {
+            emit_load_upvalue_location(buf, ip[1]);
+            EMIT(buf, 0xF3, 0x0F, 0x6F, 0x00);  // movdqu xmm0, [rax]
+            emit_push_xmm0(buf);
+            break;
+        }
+        case OP_SET_UPVALUE: {
+            emit_load_upvalue_location(buf, ip[1]);
+            EMIT(buf, 0xF3, 0x41, 0x0F, 0x6F, 0x44, 0x24, 0xF0);  // movdqu xmm0, [r12 - 16]
+            EMIT(buf, 0xF3, 0x0F, 0x7F, 0x00);                    // movdqu [rax], xmm0
+            break;
+        }
+        case OP_GET_GLOBAL:
+            emit_helper_call(buf, jit_get_global, OBJ_AS_STRING(chunk->constants.values[ip[1]]), offset);
+            break;
+        case OP_SET_GLOBAL:
+            emit_helper_call(buf, jit_set_global, OBJ_AS_STRING(chunk->constants.values[ip[1]]), offset);
+            break;
+        case OP_DEFINE_GLOBAL:
+            emit_helper_call(buf, jit_define_global, OBJ_AS_STRING(chunk->constants.values[ip[1]]), offset);
+            break;
+        case OP_ADD:
+        case OP_ADD_NUM:
+        case OP_ADD_INT:
+            emit_arith(buf, OP_ADD, 0x58, offset);
+            break;
+        case OP_SUBTRACT:
+        case OP_SUBTRACT_NUM:
+        case OP_SUBTRACT_INT:
+            emit_arith(buf, OP_SUBTRACT, 0x5C, offset);
+            break;
+        case OP_MULTIPLY:
+        case OP_MULTIPLY_NUM:
+        case OP_MULTIPLY_INT:
+            emit_arith(buf, OP_MULTIPLY, 0x59, offset);
+            break;
+        case OP_DIVIDE:
+        case OP_DIVIDE_NUM:
+            emit_arith(buf, OP_DIVIDE, 0x5E, offset);
+            break;
+        case OP_LESS:
+        case OP_LESS_NUM:
+        case OP_LESS_INT:
+            emit_compare(buf, OP_LESS, offset);
+            break;
+        case OP_GREATER:
+        case OP_GREATER_NUM:
+        case OP_GREATER_INT:
+            emit_compare(buf, OP_GREATER, offset);
+            break;
+        case OP_EQUAL:
+            emit_compare(buf, OP_EQUAL, offset);
+            break;
+        case OP_NEGATE: {
+            EMIT(buf, 0x41, 0x83, 0x7C, 0x24, 0xF0, VAL_INT);  // cmp dword [r12 - 16], VAL_INT
+            const u32 not_int = emit_jump8(buf, 0x75);         // jne not_int
+            EMIT(buf, 0x49, 0xF7, 0x5C, 0x24, 0xF8);           // neg qword [r12 - 8]
+            EMIT(buf, 0x0F, 0x80);                             // jo exit (INT64_MIN is left unchanged)
+            emit_fixup(buf, FIXUP_EXIT, offset);
+            const u32 done = emit_jump8(buf, 0xEB);  // jmp done
+
+            bind_rel8(buf, not_int);
+            emit_guard_type(buf, -16, VAL_NUMBER, offset);
+            EMIT(buf, 0x48, 0xB8);  // mov rax, sign bit
+            emit_u64(buf, 0x8000000000000000ull);
+            EMIT(buf, 0x49, 0x31, 0x44, 0x24, 0xF8);  // xor [r12 - 8], rax
+            bind_rel8(buf, done);
+            break;
+        }
+        case OP_NOT: {
+            EMIT(buf, 0x31, 0xC9);                                            // xor ecx, ecx
+            EMIT(buf, 0x41, 0x8B, 0x44, 0x24, 0xF0);                          // mov eax, [r12 - 16]
+            EMIT(buf, 0x83, 0xF8, VAL_NULL);                                  // cmp eax, VAL_NULL
+            EMIT(buf, 0x74, 0x0D);                                            // je falsy
+            EMIT(buf, 0x83, 0xF8, VAL_BOOL);                                  // cmp eax, VAL_BOOL
+            EMIT(buf, 0x75, 0x0D);                                            // jne store
+            EMIT(buf, 0x41, 0x80, 0x7C, 0x24, 0xF8, 0x00);                    // cmp byte [r12 - 8], 0
+            EMIT(buf, 0x75, 0x05);                                            // jne store
+            EMIT(buf, 0xB9, 0x01, 0x00, 0x00, 0x00);                          // falsy: mov ecx, 1
+            EMIT(buf, 0x41, 0xC7, 0x44, 0x24, 0xF0, VAL_BOOL, 0x00, 0x00, 0x00);  // store: mov dword [r12 - 16], VAL_BOOL
+            EMIT(buf, 0x49, 0x89, 0x4C, 0x24, 0xF8);                          // mov [r12 - 8], rcx
+            break;
+        }
+        case OP_JUMP: {
+            const u16 jump = (u16)((ip[1] << 8) | ip[2]);
+            EMIT(buf, 0xE9);  // jmp target
+            emit_fixup(buf, FIXUP_INSTRUCTION, offset + 3 + jump);
+            break;
+        }
+        case OP_LOOP: {
+            const u16 jump = (u16)((ip[1] << 8) | ip[2]);
+            EMIT(buf, 0xE9);  // jmp target
+            emit_fixup(buf, FIXUP_INSTRUCTION, offset + 3 - jump);
+            break;
+        }
+        case OP_JUMP_IF_FALSE: {
+            const u32 target = offset + 3 + (u16)((ip[1] << 8) | ip[2]);
+            EMIT(buf, 0x41, 0x8B, 0x44, 0x24, 0xF0);  // mov eax, [r12 - 16]
+            EMIT(buf, 0x83, 0xF8, VAL_NULL);          // cmp eax, VAL_NULL
+            EMIT(buf, 0x0F, 0x84);                    // je target
+            emit_fixup(buf, FIXUP_INSTRUCTION, target);
+            EMIT(buf, 0x83, 0xF8, VAL_BOOL);  // cmp eax, VAL_BOOL
+            EMIT(buf, 0x75, 0x0C);            // jne next
+            EMIT(buf, 0x41, 0x80, 0x7C, 0x24, 0xF8, 0x00);  // cmp byte [r12 - 8], 0
+            EMIT(buf, 0x0F, 0x84);                          // je target
+            emit_fixup(buf, FIXUP_INSTRUCTION, target);
+            break;
+        }
+        default:
+            // Everything else runs in the interpreter
+            emit_exit(buf, ip);
+            break;
+    }
+}
+
+static void perf_map_write(const xen_jit_code* jit, const xen_obj_func* fn) {
+    if (g_perf_map == NULL) {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/perf-%d.map", (i32)getpid());
+        g_perf_map = fopen(path, "a");
+        if (g_perf_map == NULL)
+            return;
+    }
+    fprintf(g_perf_map,
+            "%lx %lx xen::%s\n",
+            (unsigned long)jit->code,
+            (unsigned long)jit->size,
+            fn->name != NULL ? fn->name->str : "script");
+    fflush(g_perf_map);
+}
+
+void xen_jit_compile(xen_obj_func* fn) {
+    if (g_vm->jit_threshold == 0 || fn->jit != NULL || fn->aot != NULL || fn->chunk.count == 0)
+        return;
+
+    const xen_chunk* chunk = &fn->chunk;
+    jit_buffer buf         = {0};
+    array(u32) entries     = (u32*)malloc(chunk->count * sizeof(u32));
+    array(u32) exits       = (u32*)malloc(chunk->count * sizeof(u32));
+    if (entries == NULL || exits == NULL) {
+        free(entries);
+        free(exits);
+        return;
+    }
+    for (u64 i = 0; i < chunk->count; i++) {
+        entries[i] = XEN_JIT_NO_ENTRY;
+        exits[i]   = XEN_JIT_NO_ENTRY;
+    }
+
+    emit_prologue(&buf);
+    for (u32 offset = 0; offset < chunk->count; offset += xen_chunk_instruction_size(chunk, offset)) {
+        entries[offset] = (u32)buf.count;
+        emit_instruction(&buf, fn, offset);
+    }
+
+    // Cold side exits for failed guards, one per instruction
+    for (size_t i = 0; i < buf.fixup_count; i++) {
+        const jit_fixup* fixup = &buf.fixups[i];
+        if (fixup->kind == FIXUP_EXIT && exits[fixup->target] == XEN_JIT_NO_ENTRY) {
+            exits[fixup->target] = (u32)buf.count;
+            emit_exit(&buf, chunk->code + fixup->target);
+        }
+    }
+
+    bool ok = XEN_TRUE;
+    for (size_t i = 0; i < buf.fixup_count; i++) {
+        const jit_fixup* fixup = &buf.fixups[i];
+        const u32 dest         = fixup->kind == FIXUP_EXIT ? exits[fixup->target] : entries[fixup->target];
+        if (fixup->target >= chunk->count || dest == XEN_JIT_NO_ENTRY) {
+            ok = XEN_FALSE;  // malformed jump, leave the function to the interpreter
+            break;
+        }
+        patch_rel32(&buf, fixup->at, dest);
+    }
+
+    xen_jit_code* jit = NULL;
+    if (ok) {
+        const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        const size_t size = XEN_ALIGN_UP(buf.count, page);
+        void* mem         = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem != MAP_FAILED) {
+            memcpy(mem, buf.data, buf.count);
+            if (mprotect(mem, size, PROT_READ | PROT_EXEC) == 0) {
+                jit          = (xen_jit_code*)malloc(sizeof(xen_jit_code));
+                jit->code    = (u8*)mem;
+                jit->size    = size;
+                jit->entries = entries;
+                jit->next    = g_jit_blocks;
+                g_jit_blocks = jit;
+            } else {
+                munmap(mem, size);
+            }
+        }
+    }
+
+    XEN_FREE_ARRAY(u8, buf.data, buf.capacity);
+    XEN_FREE_ARRAY(jit_fixup, buf.fixups, buf.fixup_capacity);
+    free(exits);
+
+    if (jit == NULL) {
+        free(entries);
+        return;
+    }
+
+    fn->jit = jit;
+    perf_map_write(jit, fn);
+}
+
+void xen_jit_shutdown() {
+    while (g_jit_blocks != NULL) {
+        xen_jit_code* next = g_jit_blocks->next;
+        munmap(g_jit_blocks->code, g_jit_blocks->size);
+        free(g_jit_blocks->entries);
+        free(g_jit_blocks);
+        g_jit_blocks = next;
+    }
+
+    if (g_perf_map != NULL) {
+        fclose(g_perf_map);
+        g_perf_map = NULL;
+    }
+}
+
+#else
+
+void xen_jit_compile(xen_obj_func* fn) {
+    XEN_UNUSED(fn);
+}
+
+void xen_jit_shutdown() {}
+
+#endif
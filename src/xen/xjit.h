@@ -0,0 +1,53 @@
+#ifndef X_JIT_H
+#define X_JIT_H
+
+#include "xcommon.h"
+#include "xvm.h"
+#include "object/xobj_function.h"
+
+/*
+ * Baseline template JIT
+ *
+ * Functions whose call or back-edge counter reaches the configured threshold are translated into x86-64 machine code
+ * by stitching together a fixed template per opcode. Templates only cover the simple stack, local, arithmetic and
+ * branch instructions; everything else (and any fast-path guard that fails, e.g. a non-number operand) exits back to
+ * the interpreter with frame->ip pointing at the instruction that still has to be executed. The interpreter re-enters
+ * native code after calls, returns and loop back-edges, so hot loops spend most of their time in compiled code.
+ *
+ * Only available on x86-64 Linux. Everywhere else compilation is a no-op and the interpreter runs unchanged.
+ */
+
+#if defined(__x86_64__) && defined(__linux__)
+    #define XEN_JIT_SUPPORTED 1
+#else
+    #define XEN_JIT_SUPPORTED 0
+#endif
+
+#define XEN_JIT_DEFAULT_THRESHOLD 1000
+#define XEN_JIT_NO_ENTRY UINT32_MAX
+
+typedef void (*xen_jit_entry_fn)(xen_call_frame* frame, void* target, xen_value** stack_top);
+
+struct xen_jit_code {
+    u8* code;
+    size_t size;
+    array(u32) entries;  // native offset for every bytecode offset (XEN_JIT_NO_ENTRY if not an instruction start)
+    xen_jit_code* next;
+};
+
+/// @brief Compiles `fn` to native code. Failure is silent, the function simply stays interpreted.
+void xen_jit_compile(xen_obj_func* fn);
+
+/// @brief Runs native code for the frame starting at frame->ip. Returns once an instruction needs the interpreter.
+static inline void xen_jit_enter(xen_call_frame* frame, xen_value** stack_top) {
+    xen_jit_code* jit = frame->fn->jit;
+    const u32 native  = jit->entries[frame->ip - frame->fn->chunk.code];
+    if (native != XEN_JIT_NO_ENTRY) {
+        ((xen_jit_entry_fn)jit->code)(frame, jit->code + native, stack_top);
+    }
+}
+
+/// @brief Releases all generated code and closes the perf map.
+void xen_jit_shutdown();
+
+#endif
@@ -13,6 +13,8 @@
 #include "object/xobj_instance.h"
 #include "object/xobj_bound_method.h"
 #include "object/xobj_u8array.h"
+#include "object/xobj_closure.h"
+#include "object/xobj_fiber.h"
 
 void xen_vm_mem_init(xen_vm_mem* mem, size_t size_perm, size_t size_gen, size_t size_temp) {
     mem->permanent  = xen_alloc_create(size_perm);
@@ -40,7 +42,7 @@ void* xen_mem_realloc(void* ptr, size_t old_size, size_t new_size) {
 }
 
 void xen_mem_free_objects() {
-    xen_obj* obj = g_vm.objects;
+    xen_obj* obj = g_vm->objects;
     while (obj != NULL) {
         xen_obj* next = obj->next;
         xen_mem_free_object(obj);
@@ -122,6 +124,56 @@ static void xen_mem_free_object(xen_obj* obj) {
             XEN_FREE(xen_obj_u8array, obj);
             break;
         }
+        case OBJ_CLOSURE: {
+            xen_obj_closure* closure = (xen_obj_closure*)obj;
+            XEN_FREE_ARRAY(xen_obj_upvalue*, closure->upvalues, closure->upvalue_count);
+            XEN_FREE(xen_obj_closure, obj);
+            break;
+        }
+        case OBJ_UPVALUE: {
+            XEN_FREE(xen_obj_upvalue, obj);
+            break;
+        }
+        case OBJ_FIBER: {
+            xen_obj_fiber* fiber = (xen_obj_fiber*)obj;
+            if (fiber->context.stack != NULL)
+                xen_obj_fiber_release_stack(fiber);
+            XEN_FREE(xen_obj_fiber, obj);
+            break;
+        }
+    }
+}
+
+static i32 buffer_class_of(size_t size) {
+    i32 index = 0;
+    while (((size_t)1 << (XEN_BUFFER_CLASS_MIN_SHIFT + 2 * index)) < size)
+        index++;
+    return index;
+}
+
+void* xen_buffer_acquire(xen_buffer_pool* pool, size_t size) {
+    const i32 index = buffer_class_of(size);
+    if (pool->count[index] > 0)
+        return pool->free[index][--pool->count[index]];
+
+    void* buffer = malloc((size_t)1 << (XEN_BUFFER_CLASS_MIN_SHIFT + 2 * index));
+    if (buffer == NULL)
+        xen_panic(XEN_ERR_ALLOCATION_FAILED, "failed to allocate I/O buffer");
+    return buffer;
+}
+
+void xen_buffer_release(xen_buffer_pool* pool, void* buffer, size_t size) {
+    const i32 index = buffer_class_of(size);
+    if (pool->count[index] < XEN_BUFFER_POOL_DEPTH)
+        pool->free[index][pool->count[index]++] = buffer;
+    else
+        free(buffer);
+}
+
+void xen_buffer_pool_free(xen_buffer_pool* pool) {
+    for (i32 i = 0; i < XEN_BUFFER_CLASS_COUNT; i++) {
+        while (pool->count[i] > 0)
+            free(pool->free[i][--pool->count[i]]);
     }
 }
 
@@ -25,6 +25,24 @@ static void xen_mem_free_object(xen_obj* obj);
 #define XEN_FREE_ARRAY(type, pointer, old_count) xen_mem_realloc(pointer, sizeof(type) * (old_count), 0)
 #define XEN_FREE(type, pointer) xen_mem_realloc(pointer, sizeof(type), 0)
 
+// Pooled I/O buffers come in size classes of 4 KB, 16 KB, 64 KB, 256 KB and 1 MB
+#define XEN_BUFFER_CLASS_MIN_SHIFT 12
+#define XEN_BUFFER_CLASS_COUNT 5
+#define XEN_BUFFER_MAX ((size_t)1 << (XEN_BUFFER_CLASS_MIN_SHIFT + 2 * (XEN_BUFFER_CLASS_COUNT - 1)))
+#define XEN_BUFFER_POOL_DEPTH 8  // free buffers kept per size class, the rest go back to malloc
+
+// Recycles the scratch buffers socket reads go through, so a read costs no malloc/free pair once the pool is warm
+typedef struct {
+    void* free[XEN_BUFFER_CLASS_COUNT][XEN_BUFFER_POOL_DEPTH];
+    i32 count[XEN_BUFFER_CLASS_COUNT];
+} xen_buffer_pool;
+
+/// @brief Returns a buffer of at least `size` bytes (at most XEN_BUFFER_MAX), reusing a pooled one when available.
+void* xen_buffer_acquire(xen_buffer_pool* pool, size_t size);
+/// @brief Hands back a buffer obtained with xen_buffer_acquire for the same `size`.
+void xen_buffer_release(xen_buffer_pool* pool, void* buffer, size_t size);
+void xen_buffer_pool_free(xen_buffer_pool* pool);
+
 typedef struct {
     char** buffer;
     size_t head;
@@ -2,9 +2,16 @@
 #include "xalloc.h"
 #include "xcommon.h"
 
-xen_token_scanner scanner;
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+XEN_THREAD_LOCAL xen_token_scanner scanner;
+
+static void check_keywords();
 
 void xen_scanner_init(const char* source) {
+    check_keywords();
     scanner.start   = source;
     scanner.current = source;
     scanner.line    = 1;
@@ -57,14 +64,135 @@ static char peek_next() {
     return scanner.current[1];
 }
 
+//==============================================================//
+//                      Character classes                       //
+//==============================================================//
+
+#define CHAR_ALPHA 0x01  // [a-z] || [A-Z] || [_]
+#define CHAR_DIGIT 0x02  // [0-9]
+#define CHAR_HEX 0x04    // [0-9] || [a-f] || [A-F]
+#define CHAR_SPACE 0x08  // blanks that don't end a line: ' ', '\t', '\r'
+
+#define CHAR_RANGE_2(c, f) [(c)] = (f), [(c) + 1] = (f)
+#define CHAR_RANGE_4(c, f) CHAR_RANGE_2(c, f), CHAR_RANGE_2((c) + 2, f)
+#define CHAR_RANGE_16(c, f) CHAR_RANGE_4(c, f), CHAR_RANGE_4((c) + 4, f), CHAR_RANGE_4((c) + 8, f), CHAR_RANGE_4((c) + 12, f)
+
+// One lookup per character instead of a chain of comparisons. Bytes >= 0x80 have no class.
+static const u8 k_char_class[256] = {
+  CHAR_RANGE_4('a', CHAR_ALPHA | CHAR_HEX),
+  CHAR_RANGE_2('e', CHAR_ALPHA | CHAR_HEX),
+  CHAR_RANGE_16('g', CHAR_ALPHA),
+  CHAR_RANGE_4('w', CHAR_ALPHA),
+  CHAR_RANGE_4('A', CHAR_ALPHA | CHAR_HEX),
+  CHAR_RANGE_2('E', CHAR_ALPHA | CHAR_HEX),
+  CHAR_RANGE_16('G', CHAR_ALPHA),
+  CHAR_RANGE_4('W', CHAR_ALPHA),
+  CHAR_RANGE_4('0', CHAR_DIGIT | CHAR_HEX),
+  CHAR_RANGE_4('4', CHAR_DIGIT | CHAR_HEX),
+  CHAR_RANGE_2('8', CHAR_DIGIT | CHAR_HEX),
+  ['_']  = CHAR_ALPHA,
+  [' ']  = CHAR_SPACE,
+  ['\t'] = CHAR_SPACE,
+  ['\r'] = CHAR_SPACE,
+};
+
+static bool has_class(const char c, const u8 flags) {
+    return (k_char_class[(u8)c] & flags) != 0;
+}
+
+/// @brief [a-z] || [A-Z] || [_]
+static bool is_alpha(const char c) {
+    return has_class(c, CHAR_ALPHA);
+}
+
+/// @brief [0-9]
+static bool is_digit(const char c) {
+    return has_class(c, CHAR_DIGIT);
+}
+
+/// @brief [0-9] || [a-f] || [A-F]
+static bool is_hex_digit(const char c) {
+    return has_class(c, CHAR_HEX);
+}
+
+//==============================================================//
+//                          Skipping                            //
+//==============================================================//
+
+// Comment bodies, string bodies and runs of blanks are skipped 16 bytes at a time with SSE2; bytes before `p` in the
+// first block are masked out. The last block read can extend past the source's terminator, up to 15 bytes beyond the
+// end of its allocation. That is safe because loads are aligned: a 16-byte block never straddles a page boundary, so
+// the bytes past the end are on the same mapped page as the terminator, and no result depends on them since the scan
+// stops at the terminator. The sanitizer can't know this and would report the over-read, so these helpers opt out of
+// address checking instead of every caller having to pad its source buffer.
+#if defined(__SSE2__)
+static u32 block_mask(const char* p, const char** block) {
+    const uintptr_t offset = (uintptr_t)p & 15;
+    *block                 = p - offset;
+    return 0xFFFFu << offset;
+}
+
+// First of `a`, `b` or the terminator at or after `p`
+XEN_NO_SANITIZE_ADDRESS static const char* find_either(const char* p, const char a, const char b) {
+    const __m128i va   = _mm_set1_epi8(a);
+    const __m128i vb   = _mm_set1_epi8(b);
+    const __m128i zero = _mm_setzero_si128();
+    const char* block;
+    u32 mask = block_mask(p, &block);
+    for (;;) {
+        const __m128i chunk = _mm_load_si128((const __m128i*)block);
+        const __m128i hits  = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)),
+                                          _mm_cmpeq_epi8(chunk, zero));
+        mask &= (u32)_mm_movemask_epi8(hits);
+        if (mask != 0)
+            return block + __builtin_ctz(mask);
+        block += 16;
+        mask = 0xFFFFu;
+    }
+}
+
+// First byte at or after `p` that isn't a CHAR_SPACE blank
+XEN_NO_SANITIZE_ADDRESS static const char* skip_blanks(const char* p) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab   = _mm_set1_epi8('\t');
+    const __m128i cr    = _mm_set1_epi8('\r');
+    const char* block;
+    u32 mask = block_mask(p, &block);
+    for (;;) {
+        const __m128i chunk  = _mm_load_si128((const __m128i*)block);
+        const __m128i blanks = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                                            _mm_cmpeq_epi8(chunk, cr));
+        mask &= ~(u32)_mm_movemask_epi8(blanks) & 0xFFFFu;
+        if (mask != 0)
+            return block + __builtin_ctz(mask);
+        block += 16;
+        mask = 0xFFFFu;
+    }
+}
+#else
+static const char* find_either(const char* p, const char a, const char b) {
+    while (*p != a && *p != b && *p != '\0')
+        p++;
+    return p;
+}
+
+static const char* skip_blanks(const char* p) {
+    while (has_class(*p, CHAR_SPACE))
+        p++;
+    return p;
+}
+#endif
+
 static void skip_whitespace() {
     for (;;) {
-        const char c = peek();
-        switch (c) {
+        switch (peek()) {
             case ' ':
             case '\r':
             case '\t':
+                // a single blank between tokens is the common case, longer runs (indentation) are skipped in blocks
                 advance();
+                if (has_class(peek(), CHAR_SPACE))
+                    scanner.current = skip_blanks(scanner.current);
                 break;
             case '\n':
                 scanner.line++;
@@ -72,8 +200,8 @@ static void skip_whitespace() {
                 break;
             case '/':
                 if (peek_next() == '/') {
-                    while (peek() != '\n' && !is_at_end())
-                        advance();
+                    // the newline itself is left for the next iteration to count
+                    scanner.current = find_either(scanner.current, '\n', '\n');
                 } else {
                     return;
                 }
@@ -84,123 +212,100 @@ static void skip_whitespace() {
     }
 }
 
-/// @brief [a-z] || [A-Z] || [_]
-static bool is_alpha(const char c) {
-    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
-}
-
-/// @brief [0-9]
-static bool is_digit(const char c) {
-    return c >= '0' && c <= '9';
+//==============================================================//
+//                          Keywords                            //
+//==============================================================//
+
+// Perfect hash of the keywords on their first two characters and length: every keyword lands in its own slot, so an
+// identifier is a keyword only if it matches the one entry its hash selects. The multipliers were searched for to keep
+// the table at 32 entries.
+#define KEYWORD_HASH(c0, c1, length) ((((u32)(u8)(c0)) * 25u + ((u32)(u8)(c1)) * 6u + (u32)(length)) & 31u)
+#define KEYWORD_MAX_LENGTH 7
+
+// X(first char, second char, text, token type)
+#define XEN_KEYWORDS(X)                                                                                                \
+    X('a', 'n', "and", TOKEN_AND)                                                                                      \
+    X('a', 's', "as", TOKEN_AS)                                                                                        \
+    X('c', 'l', "class", TOKEN_CLASS)                                                                                  \
+    X('c', 'o', "const", TOKEN_CONST)                                                                                  \
+    X('e', 'l', "else", TOKEN_ELSE)                                                                                    \
+    X('f', 'a', "false", TOKEN_FALSE)                                                                                  \
+    X('f', 'o', "for", TOKEN_FOR)                                                                                      \
+    X('f', 'n', "fn", TOKEN_FN)                                                                                        \
+    X('i', 'f', "if", TOKEN_IF)                                                                                        \
+    X('i', 'n', "in", TOKEN_IN)                                                                                        \
+    X('i', 'n', "include", TOKEN_INCLUDE)                                                                              \
+    X('i', 'n', "init", TOKEN_INIT)                                                                                    \
+    X('i', 's', "is", TOKEN_IS)                                                                                        \
+    X('n', 'e', "new", TOKEN_NEW)                                                                                      \
+    X('n', 'u', "null", TOKEN_NULL)                                                                                    \
+    X('o', 'r', "or", TOKEN_OR)                                                                                        \
+    X('p', 'r', "private", TOKEN_PRIVATE)                                                                              \
+    X('r', 'e', "return", TOKEN_RETURN)                                                                                \
+    X('t', 'h', "this", TOKEN_THIS)                                                                                    \
+    X('t', 'r', "true", TOKEN_TRUE)                                                                                    \
+    X('v', 'a', "var", TOKEN_VAR)                                                                                      \
+    X('w', 'h', "while", TOKEN_WHILE)
+
+typedef struct {
+    const char* text;
+    i32 length;
+    xen_token_type type;
+} xen_keyword;
+
+#define KEYWORD_ENTRY(c0, c1, text, type) [KEYWORD_HASH(c0, c1, sizeof(text) - 1)] = {text, sizeof(text) - 1, type},
+static const xen_keyword k_keywords[32] = {XEN_KEYWORDS(KEYWORD_ENTRY)};
+
+// A collision would silently let one keyword's entry replace the other's in k_keywords, but duplicate case labels are a
+// hard error whatever the warning flags, so this switch stops the build instead. Debug builds also run it for every
+// keyword to check that the characters it is hashed on are its own and that its slot holds it.
+#define KEYWORD_CHECK(c0, c1, word, token)                                                                              \
+    case KEYWORD_HASH(c0, c1, sizeof(word) - 1):                                                                       \
+        assert((word)[0] == (c0) && (word)[1] == (c1));                                                                \
+        assert(k_keywords[slot].type == (token) && strcmp(k_keywords[slot].text, word) == 0);                          \
+        break;
+#define KEYWORD_CALL_CHECK(c0, c1, word, token) check_keyword_slot(KEYWORD_HASH(c0, c1, sizeof(word) - 1));
+
+static inline void check_keyword_slot(const u32 slot) {
+    switch (slot) {
+        XEN_KEYWORDS(KEYWORD_CHECK)
+        default:
+            break;
+    }
 }
 
-static xen_token_type check_keyword(const i32 start, const i32 length, const char* rest, const xen_token_type type) {
-    if (scanner.current - scanner.start == start + length && memcmp(scanner.start + start, rest, length) == 0) {
-        return type;
-    }
-    return TOKEN_IDENTIFIER;
+static void check_keywords() {
+#ifndef NDEBUG
+    XEN_KEYWORDS(KEYWORD_CALL_CHECK)
+#endif
 }
 
 static xen_token_type identifier_type() {
-    switch (scanner.start[0]) {
-        case 'a':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 's':
-                        return check_keyword(2, 0, "", TOKEN_AS);
-                    case 'n':
-                        return check_keyword(2, 1, "d", TOKEN_AND);
-                }
-            }
-            break;
-        case 'c':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'l':
-                        return check_keyword(2, 3, "ass", TOKEN_CLASS);
-                    case 'o':
-                        return check_keyword(2, 3, "nst", TOKEN_CONST);
-                }
-            }
-            break;
-        case 'e':
-            return check_keyword(1, 3, "lse", TOKEN_ELSE);
-        case 'f':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'a':
-                        return check_keyword(2, 3, "lse", TOKEN_FALSE);
-                    case 'o':
-                        return check_keyword(2, 1, "r", TOKEN_FOR);
-                    case 'n':
-                        return check_keyword(2, 0, "", TOKEN_FN);
-                }
-            }
-            break;
-        case 'i':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'f':
-                        return check_keyword(2, 0, "", TOKEN_IF);
-                    case 's':
-                        return check_keyword(2, 0, "", TOKEN_IS);
-                    case 'n':
-                        if (scanner.current - scanner.start == 2) {
-                            return TOKEN_IN;
-                        }
-                        if (scanner.current - scanner.start == 4) {
-                            return check_keyword(2, 2, "it", TOKEN_INIT);
-                        }
-                        return check_keyword(2, 5, "clude", TOKEN_INCLUDE);
-                }
-            }
-            break;
-        case 'n':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'u':
-                        return check_keyword(2, 2, "ll", TOKEN_NULL);
-                    case 'e':
-                        return check_keyword(2, 1, "w", TOKEN_NEW);
-                }
-            }
-            break;
-        case 'o':
-            return check_keyword(1, 1, "r", TOKEN_OR);
-        case 'p':
-            return check_keyword(1, 6, "rivate", TOKEN_PRIVATE);
-        case 'r':
-            return check_keyword(1, 5, "eturn", TOKEN_RETURN);
-        case 't':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'h':
-                        return check_keyword(2, 2, "is", TOKEN_THIS);
-                    case 'r':
-                        return check_keyword(2, 2, "ue", TOKEN_TRUE);
-                }
-            }
-            break;
-        case 'v':
-            return check_keyword(1, 2, "ar", TOKEN_VAR);
-        case 'w':
-            return check_keyword(1, 4, "hile", TOKEN_WHILE);
+    const i32 length = (i32)(scanner.current - scanner.start);
+    if (length < 2 || length > KEYWORD_MAX_LENGTH) {
+        return TOKEN_IDENTIFIER;
     }
 
+    const xen_keyword* keyword = &k_keywords[KEYWORD_HASH(scanner.start[0], scanner.start[1], length)];
+    if (keyword->length == length && memcmp(scanner.start, keyword->text, length) == 0) {
+        return keyword->type;
+    }
     return TOKEN_IDENTIFIER;
 }
 
 static xen_token make_identifier() {
-    while (is_alpha(peek()) || is_digit(peek())) {
+    while (has_class(peek(), CHAR_ALPHA | CHAR_DIGIT)) {
         advance();
     }
     return make_token(identifier_type());
 }
 
 static xen_token make_string() {
-    while (peek() != '"' && !is_at_end()) {
-        if (peek() == '\n')
-            scanner.line++;
+    for (;;) {
+        scanner.current = find_either(scanner.current, '"', '\n');
+        if (peek() != '\n')
+            break;
+        scanner.line++;
         advance();
     }
 
@@ -212,6 +317,13 @@ static xen_token make_string() {
 }
 
 static xen_token make_number() {
+    if (scanner.start[0] == '0' && (peek() == 'x' || peek() == 'X') && is_hex_digit(peek_next())) {
+        advance();
+        while (is_hex_digit(peek()))
+            advance();
+        return make_token(TOKEN_NUMBER);
+    }
+
     while (is_digit(peek()))
         advance();
 
@@ -293,9 +405,21 @@ xen_token xen_scanner_emit() {
             return make_token(TOKEN_EQUAL);
         }
         case '<':
+            if (match('<'))
+                return make_token(TOKEN_LESS_LESS);
             return make_token(match('=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
         case '>':
+            if (match('>'))
+                return make_token(TOKEN_GREATER_GREATER);
             return make_token(match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
+        case '&':
+            return make_token(TOKEN_AMPERSAND);
+        case '|':
+            return make_token(TOKEN_PIPE);
+        case '^':
+            return make_token(TOKEN_CARET);
+        case '~':
+            return make_token(TOKEN_TILDE);
         case '"':
             return make_string();
         default:
@@ -368,6 +492,18 @@ const char* xen_token_type_to_str(xen_token_type type) {
             return "<";
         case TOKEN_LESS_EQUAL:
             return "<=";
+        case TOKEN_LESS_LESS:
+            return "<<";
+        case TOKEN_GREATER_GREATER:
+            return ">>";
+        case TOKEN_AMPERSAND:
+            return "&";
+        case TOKEN_PIPE:
+            return "|";
+        case TOKEN_CARET:
+            return "^";
+        case TOKEN_TILDE:
+            return "~";
         case TOKEN_STRING:
             return "string";
         case TOKEN_AND:
@@ -24,6 +24,10 @@ typedef enum {
     TOKEN_PERCENT,
     TOKEN_COLON,
     TOKEN_COLON_COLON,
+    TOKEN_AMPERSAND,  // &
+    TOKEN_PIPE,       // |
+    TOKEN_CARET,      // ^
+    TOKEN_TILDE,      // ~
     // One or two character tokens
     TOKEN_BANG,
     TOKEN_BANG_EQUAL,
@@ -33,15 +37,17 @@ typedef enum {
     TOKEN_GREATER_EQUAL,
     TOKEN_LESS,
     TOKEN_LESS_EQUAL,
-    TOKEN_PLUS_EQUAL,      // +=
-    TOKEN_MINUS_EQUAL,     // -=
-    TOKEN_ASTERISK_EQUAL,  // *=
-    TOKEN_SLASH_EQUAL,     // /=
-    TOKEN_PLUS_PLUS,       // ++
-    TOKEN_MINUS_MINUS,     // --
-    TOKEN_DOT_DOT,         // ..
-    TOKEN_PERCENT_EQUAL,   // %=
-    TOKEN_ARROW,           // =>
+    TOKEN_PLUS_EQUAL,       // +=
+    TOKEN_MINUS_EQUAL,      // -=
+    TOKEN_ASTERISK_EQUAL,   // *=
+    TOKEN_SLASH_EQUAL,      // /=
+    TOKEN_PLUS_PLUS,        // ++
+    TOKEN_MINUS_MINUS,      // --
+    TOKEN_DOT_DOT,          // ..
+    TOKEN_PERCENT_EQUAL,    // %=
+    TOKEN_ARROW,            // =>
+    TOKEN_LESS_LESS,        // <<
+    TOKEN_GREATER_GREATER,  // >>
     // Literals
     TOKEN_IDENTIFIER,
     TOKEN_STRING,
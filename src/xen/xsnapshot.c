@@ -0,0 +1,878 @@
+#include "xsnapshot.h"
+#include "xbin_writer.h"
+#include "xbytecode.h"
+#include "xfrozen.h"
+#include "xmem.h"
+#include "xtable.h"
+#include "xtypeid.h"
+#include "xutils.h"
+#include "xversion.h"
+#include "xvm.h"
+
+#include "object/xobj_string.h"
+#include "object/xobj_array.h"
+#include "object/xobj_dict.h"
+#include "object/xobj_u8array.h"
+#include "object/xobj_namespace.h"
+#include "object/xobj_native_function.h"
+#include "object/xobj_function.h"
+#include "object/xobj_closure.h"
+#include "object/xobj_class.h"
+#include "object/xobj_instance.h"
+#include "object/xobj_error.h"
+
+#define SNAPSHOT_RELEASE_SIZE 16
+#define SNAPSHOT_NO_INDEX UINT32_MAX
+
+typedef enum {
+    SNAP_NULL,
+    SNAP_TRUE,
+    SNAP_FALSE,
+    SNAP_INT,
+    SNAP_NUMBER,
+    SNAP_REF,     // u32 number of an object stored earlier
+    SNAP_EXTERN,  // u32 index in the extern table
+    SNAP_FREEZE,  // the object that follows is frozen once it has been rebuilt
+    // every tag from here on is an object and takes the next number
+    SNAP_STRING,
+    SNAP_ARRAY,
+    SNAP_DICT,
+    SNAP_U8ARRAY,
+    SNAP_FUNCTION,
+    SNAP_CLOSURE,
+    SNAP_UPVALUE,
+    SNAP_CLASS,
+    SNAP_INSTANCE,
+    SNAP_NAMESPACE,
+    SNAP_ERROR,
+} snap_tag;
+
+//==============================================================//
+//                           Writing                            //
+//==============================================================//
+
+typedef struct {
+    xen_obj* obj;
+    u32 value;
+} snap_slot;
+
+// Object -> u32, open addressing on the object's address
+typedef struct {
+    snap_slot* slots;
+    u32 count;
+    u32 capacity;
+} snap_map;
+
+static u32 map_hash(const void* ptr) {
+    return (u32)(((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ull >> 32);
+}
+
+static bool map_get(const snap_map* map, const xen_obj* obj, u32* value) {
+    if (map->capacity == 0)
+        return XEN_FALSE;
+    u32 slot = map_hash(obj) & (map->capacity - 1);
+    while (map->slots[slot].obj != NULL) {
+        if (map->slots[slot].obj == obj) {
+            *value = map->slots[slot].value;
+            return XEN_TRUE;
+        }
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    return XEN_FALSE;
+}
+
+static void map_put(snap_map* map, xen_obj* obj, u32 value) {
+    if ((map->count + 1) * 2 > map->capacity) {
+        const u32 old_capacity = map->capacity;
+        snap_slot* old_slots   = map->slots;
+        map->capacity          = old_capacity < 64 ? 64 : old_capacity * 2;
+        map->slots             = calloc(map->capacity, sizeof(snap_slot));
+        for (u32 i = 0; i < old_capacity; i++) {
+            if (old_slots[i].obj == NULL)
+                continue;
+            u32 slot = map_hash(old_slots[i].obj) & (map->capacity - 1);
+            while (map->slots[slot].obj != NULL)
+                slot = (slot + 1) & (map->capacity - 1);
+            map->slots[slot] = old_slots[i];
+        }
+        free(old_slots);
+    }
+
+    u32 slot = map_hash(obj) & (map->capacity - 1);
+    while (map->slots[slot].obj != NULL)
+        slot = (slot + 1) & (map->capacity - 1);
+    map->slots[slot] = (snap_slot) {obj, value};
+    map->count++;
+}
+
+typedef struct {
+    xen_bin_writer body;  // globals, the header and extern table are put in front once they are known
+    snap_map seen;        // object -> its number
+    u32 object_count;
+
+    snap_map builtins;        // builtin object -> index in `symbols`
+    array(char*) symbols;     // path of every builtin object
+    array(u32) extern_index;  // by symbol, its index in the image's extern table or SNAPSHOT_NO_INDEX
+    u32 symbol_count;
+    u32 symbol_capacity;
+    array(u32) externs;  // symbols the image refers to, in extern table order
+    u32 extern_count;
+
+    const char* failed;  // type of the first value that can't be saved
+} snapshotter;
+
+// Returns false if `obj` already has a path, the first one found is kept
+static bool add_builtin(snapshotter* s, xen_obj* obj, const char* path) {
+    u32 existing;
+    if (map_get(&s->builtins, obj, &existing))
+        return XEN_FALSE;
+    if (s->symbol_count == s->symbol_capacity) {
+        const u32 old_capacity = s->symbol_capacity;
+        s->symbol_capacity     = XEN_GROW_CAPACITY(old_capacity);
+        s->symbols             = XEN_GROW_ARRAY(char*, s->symbols, old_capacity, s->symbol_capacity);
+        s->extern_index        = XEN_GROW_ARRAY(u32, s->extern_index, old_capacity, s->symbol_capacity);
+    }
+    s->symbols[s->symbol_count]      = xen_strdup((char*)path);
+    s->extern_index[s->symbol_count] = SNAPSHOT_NO_INDEX;
+    map_put(&s->builtins, obj, s->symbol_count++);
+    return XEN_TRUE;
+}
+
+static void add_builtin_namespace(snapshotter* s, xen_obj_namespace* ns, const char* path) {
+    if (!add_builtin(s, (xen_obj*)ns, path))
+        return;
+    for (i32 i = 0; i < ns->count; i++) {
+        const xen_value value = ns->entries[i].value;
+        if (!VAL_IS_OBJ(value))
+            continue;
+        char entry_path[256];
+        snprintf(entry_path, sizeof(entry_path), "%s.%s", path, ns->entries[i].name);
+        if (OBJ_IS_NAMESPACE(value))
+            add_builtin_namespace(s, OBJ_AS_NAMESPACE(value), entry_path);
+        else
+            add_builtin(s, VAL_AS_OBJ(value), entry_path);
+    }
+}
+
+// Everything a fresh VM has before running a script: the registered namespaces and the native globals, those still
+// under the name they were registered with (a script's `var p = io.println` isn't a builtin called `p`)
+static void collect_builtins(snapshotter* s) {
+    const xen_table* registry = &g_vm->namespace_registry;
+    for (u64 i = 0; i < registry->capacity; i++) {
+        if (registry->entries[i].key != NULL && OBJ_IS_NAMESPACE(registry->entries[i].value))
+            add_builtin_namespace(s, OBJ_AS_NAMESPACE(registry->entries[i].value), registry->entries[i].key->str);
+    }
+    const xen_table* globals = &g_vm->globals;
+    for (u64 i = 0; i < globals->capacity; i++) {
+        const xen_table_entry* entry = &globals->entries[i];
+        if (entry->key != NULL && OBJ_IS_NATIVE_FUNC(entry->value) &&
+            strcmp(OBJ_AS_NATIVE_FUNC(entry->value)->name, entry->key->str) == 0)
+            add_builtin(s, VAL_AS_OBJ(entry->value), entry->key->str);
+    }
+}
+
+static u32 use_extern(snapshotter* s, u32 symbol) {
+    if (s->extern_index[symbol] == SNAPSHOT_NO_INDEX) {
+        s->externs                  = XEN_GROW_ARRAY(u32, s->externs, s->extern_count, s->extern_count + 1);
+        s->externs[s->extern_count] = symbol;
+        s->extern_index[symbol]     = s->extern_count++;
+    }
+    return s->extern_index[symbol];
+}
+
+static bool write_value(snapshotter* s, xen_value value);
+
+static bool write_table(snapshotter* s, const xen_table* table) {
+    u32 count = 0;  // table->count includes tombstones
+    for (u64 i = 0; i < table->capacity; i++) {
+        if (table->entries[i].key != NULL)
+            count++;
+    }
+    xen_bin_write_u32(&s->body, count);
+    for (u64 i = 0; i < table->capacity; i++) {
+        const xen_table_entry* entry = &table->entries[i];
+        if (entry->key == NULL)
+            continue;
+        if (!write_value(s, OBJ_VAL(entry->key)) || !write_value(s, entry->value))
+            return XEN_FALSE;
+    }
+    return XEN_TRUE;
+}
+
+// Same encoding as a .xenb line table, so restored functions read it with xen_chunk_line
+static void write_lines(snapshotter* s, const xen_chunk* chunk) {
+    if (chunk->lines == NULL) {
+        xen_bin_write_u32(&s->body, chunk->line_runs_size);
+        xen_bin_write_bytes(&s->body, chunk->line_runs, chunk->line_runs_size);
+        return;
+    }
+
+    xen_bin_writer runs;
+    xen_bin_writer_init(&runs, 64, XEN_TRUE);
+    i64 previous = 0;
+    for (u64 i = 0; i < chunk->count;) {
+        u64 run = 1;
+        while (i + run < chunk->count && chunk->lines[i + run] == chunk->lines[i])
+            run++;
+        xen_bin_write_varint(&runs, run);
+        xen_bin_write_varint(&runs, xen_zigzag_encode((i64)chunk->lines[i] - previous));
+        previous = (i64)chunk->lines[i];
+        i += run;
+    }
+    xen_bin_write_u32(&s->body, (u32)xen_bin_writer_size(&runs));
+    xen_bin_write_bytes(&s->body, runs.data, xen_bin_writer_size(&runs));
+    xen_bin_writer_free(&runs);
+}
+
+static bool write_function(snapshotter* s, xen_obj_func* fn) {
+    const xen_chunk* chunk = &fn->chunk;
+    xen_bin_write_u8(&s->body, SNAP_FUNCTION);
+    xen_bin_write_i32(&s->body, fn->arity);
+    xen_bin_write_i32(&s->body, fn->upvalue_count);
+    if (!write_value(s, fn->name != NULL ? OBJ_VAL(fn->name) : NULL_VAL))
+        return XEN_FALSE;
+    xen_bin_write_u32(&s->body, (u32)chunk->count);
+    xen_bin_write_bytes(&s->body, chunk->code, chunk->count);
+    write_lines(s, chunk);
+    xen_bin_write_u32(&s->body, (u32)chunk->constants.count);
+    for (u64 i = 0; i < chunk->constants.count; i++) {
+        if (!write_value(s, chunk->constants.values[i]))
+            return XEN_FALSE;
+    }
+    return XEN_TRUE;
+}
+
+static bool write_class(snapshotter* s, const xen_obj_class* class) {
+    xen_bin_write_u8(&s->body, SNAP_CLASS);
+    if (!write_value(s, OBJ_VAL(class->name)))
+        return XEN_FALSE;
+    xen_bin_write_u32(&s->body, (u32)class->property_count);
+    for (i32 i = 0; i < class->property_count; i++) {
+        const xen_property_def* prop = &class->properties[i];
+        if (!write_value(s, OBJ_VAL(prop->name)))
+            return XEN_FALSE;
+        xen_bin_write_u8(&s->body, prop->is_private);
+        if (!write_value(s, prop->default_value))
+            return XEN_FALSE;
+    }
+    if (!write_table(s, &class->methods) || !write_table(s, &class->private_methods))
+        return XEN_FALSE;
+    return write_value(s, class->initializer != NULL ? OBJ_VAL(class->initializer) : NULL_VAL);
+}
+
+// Objects that only mean something inside the running process: native state, stacks, C functions nobody can name
+static bool is_storable(xen_obj* obj) {
+    switch (obj->type) {
+        case OBJ_CLASS:
+            return ((xen_obj_class*)obj)->native_initializer == NULL;
+        case OBJ_INSTANCE:
+            return ((xen_obj_instance*)obj)->class->native_initializer == NULL;
+        case OBJ_NATIVE_FUNC:
+        case OBJ_BOUND_METHOD:
+        case OBJ_FIBER:
+            return XEN_FALSE;
+        default:
+            return XEN_TRUE;
+    }
+}
+
+static bool write_object(snapshotter* s, xen_obj* obj) {
+    u32 index;
+    if (map_get(&s->builtins, obj, &index)) {
+        xen_bin_write_u8(&s->body, SNAP_EXTERN);
+        return xen_bin_write_u32(&s->body, use_extern(s, index));
+    }
+    if (map_get(&s->seen, obj, &index)) {
+        xen_bin_write_u8(&s->body, SNAP_REF);
+        return xen_bin_write_u32(&s->body, index);
+    }
+    if (!is_storable(obj)) {
+        s->failed = xen_typeid_str(xen_typeid_get(OBJ_VAL(obj)));
+        return XEN_FALSE;
+    }
+    if (obj->type == OBJ_FUNCTION && ((xen_obj_func*)obj)->module != NULL &&
+        !xen_bytecode_load_function((xen_obj_func*)obj)) {
+        s->failed = "Function";
+        return XEN_FALSE;
+    }
+
+    if (obj->frozen)
+        xen_bin_write_u8(&s->body, SNAP_FREEZE);
+    map_put(&s->seen, obj, s->object_count++);
+
+    switch (obj->type) {
+        case OBJ_STRING: {
+            const xen_obj_str* str = (xen_obj_str*)obj;
+            xen_bin_write_u8(&s->body, SNAP_STRING);
+            xen_bin_write_u32(&s->body, (u32)str->length);
+            return xen_bin_write_bytes(&s->body, str->str, (size_t)str->length);
+        }
+        case OBJ_ARRAY: {
+            const xen_value_array* array = &((xen_obj_array*)obj)->array;
+            xen_bin_write_u8(&s->body, SNAP_ARRAY);
+            xen_bin_write_u32(&s->body, (u32)array->count);
+            for (u64 i = 0; i < array->count; i++) {
+                if (!write_value(s, array->values[i]))
+                    return XEN_FALSE;
+            }
+            return XEN_TRUE;
+        }
+        case OBJ_DICT:
+            xen_bin_write_u8(&s->body, SNAP_DICT);
+            return write_table(s, &((xen_obj_dict*)obj)->table);
+        case OBJ_U8ARRAY: {
+            const xen_obj_u8array* array = (xen_obj_u8array*)obj;
+            xen_bin_write_u8(&s->body, SNAP_U8ARRAY);
+            xen_bin_write_u32(&s->body, (u32)array->count);
+            return xen_bin_write_bytes(&s->body, array->values, (size_t)array->count);
+        }
+        case OBJ_FUNCTION:
+            return write_function(s, (xen_obj_func*)obj);
+        case OBJ_CLOSURE: {
+            const xen_obj_closure* closure = (xen_obj_closure*)obj;
+            xen_bin_write_u8(&s->body, SNAP_CLOSURE);
+            if (!write_value(s, OBJ_VAL(closure->fn)))
+                return XEN_FALSE;
+            xen_bin_write_u32(&s->body, (u32)closure->upvalue_count);
+            for (i32 i = 0; i < closure->upvalue_count; i++) {
+                if (!write_value(s, OBJ_VAL(closure->upvalues[i])))
+                    return XEN_FALSE;
+            }
+            return XEN_TRUE;
+        }
+        case OBJ_UPVALUE:
+            // restored closed, the stack it may still point into isn't part of the image
+            xen_bin_write_u8(&s->body, SNAP_UPVALUE);
+            return write_value(s, *((xen_obj_upvalue*)obj)->location);
+        case OBJ_CLASS:
+            return write_class(s, (xen_obj_class*)obj);
+        case OBJ_INSTANCE: {
+            const xen_obj_instance* instance = (xen_obj_instance*)obj;
+            xen_bin_write_u8(&s->body, SNAP_INSTANCE);
+            if (!write_value(s, OBJ_VAL(instance->class)))
+                return XEN_FALSE;
+            xen_bin_write_u32(&s->body, (u32)instance->class->property_count);
+            for (i32 i = 0; i < instance->class->property_count; i++) {
+                if (!write_value(s, instance->fields[i]))
+                    return XEN_FALSE;
+            }
+            return XEN_TRUE;
+        }
+        case OBJ_NAMESPACE: {
+            const xen_obj_namespace* ns = (xen_obj_namespace*)obj;
+            xen_bin_write_u8(&s->body, SNAP_NAMESPACE);
+            write_value(s, OBJ_VAL(xen_obj_str_copy(ns->name, (i32)strlen(ns->name))));
+            xen_bin_write_u32(&s->body, (u32)ns->count);
+            for (i32 i = 0; i < ns->count; i++) {
+                const char* name = ns->entries[i].name;
+                if (!write_value(s, OBJ_VAL(xen_obj_str_copy(name, (i32)strlen(name)))) ||
+                    !write_value(s, ns->entries[i].value))
+                    return XEN_FALSE;
+            }
+            return XEN_TRUE;
+        }
+        case OBJ_ERROR:
+            xen_bin_write_u8(&s->body, SNAP_ERROR);
+            return write_value(s, OBJ_VAL(((xen_obj_error*)obj)->msg));
+        default:
+            return XEN_FALSE;
+    }
+}
+
+static bool write_value(snapshotter* s, xen_value value) {
+    switch (value.type) {
+        case VAL_NULL:
+            return xen_bin_write_u8(&s->body, SNAP_NULL);
+        case VAL_BOOL:
+            return xen_bin_write_u8(&s->body, VAL_AS_BOOL(value) ? SNAP_TRUE : SNAP_FALSE);
+        case VAL_INT:
+            xen_bin_write_u8(&s->body, SNAP_INT);
+            return xen_bin_write_i64(&s->body, VAL_AS_INT(value));
+        case VAL_NUMBER:
+            xen_bin_write_u8(&s->body, SNAP_NUMBER);
+            return xen_bin_write_f64(&s->body, value.as.number);
+        case VAL_OBJECT:
+            return write_object(s, VAL_AS_OBJ(value));
+    }
+    return XEN_FALSE;
+}
+
+// Builtin globals are there in every VM already, and `env` belongs to the run that restores the image
+static bool is_saved_global(snapshotter* s, const xen_table_entry* entry) {
+    if (entry->key == NULL || strcmp(entry->key->str, "env") == 0)
+        return XEN_FALSE;
+    u32 symbol;
+    if (VAL_IS_OBJ(entry->value) && map_get(&s->builtins, VAL_AS_OBJ(entry->value), &symbol))
+        return strcmp(s->symbols[symbol], entry->key->str) != 0 || OBJ_IS_NAMESPACE(entry->value);
+    return XEN_TRUE;
+}
+
+static bool write_globals(snapshotter* s) {
+    const xen_table* globals = &g_vm->globals;
+    u32 count                = 0;
+    for (u64 i = 0; i < globals->capacity; i++) {
+        if (is_saved_global(s, &globals->entries[i]))
+            count++;
+    }
+
+    xen_bin_write_u32(&s->body, count);
+    for (u64 i = 0; i < globals->capacity; i++) {
+        const xen_table_entry* entry = &globals->entries[i];
+        if (!is_saved_global(s, entry))
+            continue;
+        write_value(s, OBJ_VAL(entry->key));
+        if (!write_value(s, entry->value)) {
+            fprintf(stderr, "snapshot: global '%s' holds a value of type %s, which can't be saved\n", entry->key->str,
+                    s->failed);
+            return XEN_FALSE;
+        }
+    }
+    return !xen_bin_writer_has_error(&s->body);
+}
+
+static bool write_image(snapshotter* s, const char* path) {
+    xen_bin_writer header;
+    xen_bin_writer_init(&header, 256, XEN_TRUE);
+    xen_bin_write_bytes(&header, "XENS", 4);
+    xen_bin_write_u8(&header, XEN_SNAPSHOT_VERSION);
+    xen_bin_write_u8(&header, 0);
+    xen_bin_write_u16(&header, 0);
+    xen_bin_write_string_fixed(&header, VERSION_STRING, SNAPSHOT_RELEASE_SIZE);
+    xen_bin_write_u32(&header, s->object_count);
+    xen_bin_write_u32(&header, s->extern_count);
+    for (u32 i = 0; i < s->extern_count; i++) {
+        const char* symbol = s->symbols[s->externs[i]];
+        xen_bin_write_u32(&header, (u32)strlen(symbol));
+        xen_bin_write_bytes(&header, symbol, strlen(symbol));
+    }
+
+    FILE* fp = fopen(path, "wb");
+    bool ok  = fp != NULL && !xen_bin_writer_has_error(&header);
+    if (ok) {
+        ok = fwrite(header.data, 1, xen_bin_writer_size(&header), fp) == xen_bin_writer_size(&header) &&
+             fwrite(s->body.data, 1, xen_bin_writer_size(&s->body), fp) == xen_bin_writer_size(&s->body);
+    }
+    if (fp != NULL && fclose(fp) != 0)
+        ok = XEN_FALSE;
+    if (!ok)
+        fprintf(stderr, "snapshot: failed to write %s\n", path);
+    xen_bin_writer_free(&header);
+    return ok;
+}
+
+bool xen_snapshot_write(const char* path) {
+    snapshotter s;
+    memset(&s, 0, sizeof(s));
+    xen_bin_writer_init(&s.body, 4096, XEN_TRUE);
+    collect_builtins(&s);
+
+    const bool ok = write_globals(&s) && write_image(&s, path);
+
+    xen_bin_writer_free(&s.body);
+    free(s.seen.slots);
+    free(s.builtins.slots);
+    for (u32 i = 0; i < s.symbol_count; i++) {
+        free(s.symbols[i]);
+    }
+    XEN_FREE_ARRAY(char*, s.symbols, s.symbol_capacity);
+    XEN_FREE_ARRAY(u32, s.extern_index, s.symbol_capacity);
+    XEN_FREE_ARRAY(u32, s.externs, s.extern_count);
+    return ok;
+}
+
+//==============================================================//
+//                          Restoring                           //
+//==============================================================//
+
+typedef struct {
+    u8* data;
+    size_t size;
+    size_t position;
+    array(xen_value) objects;  // by number, see SNAP_REF
+    u32 object_count;
+    u32 object_limit;  // from the header
+    array(xen_value) externs;
+    u32 extern_count;
+    const char* failed;
+} snap_reader;
+
+static bool restore_fail(snap_reader* r, const char* why) {
+    if (r->failed == NULL)
+        r->failed = why;
+    return XEN_FALSE;
+}
+
+// Reads past the end fail the restore and return zeroes
+static const u8* take(snap_reader* r, size_t size) {
+    if (r->failed != NULL || size > r->size - r->position) {
+        restore_fail(r, "truncated image");
+        return NULL;
+    }
+    const u8* bytes = r->data + r->position;
+    r->position += size;
+    return bytes;
+}
+
+static void take_into(snap_reader* r, void* out, size_t size) {
+    const u8* bytes = take(r, size);
+    if (bytes != NULL)
+        memcpy(out, bytes, size);
+    else
+        memset(out, 0, size);
+}
+
+static u8 take_u8(snap_reader* r) {
+    u8 value;
+    take_into(r, &value, sizeof(value));
+    return value;
+}
+
+static u32 take_u32(snap_reader* r) {
+    u32 value;
+    take_into(r, &value, sizeof(value));
+    return value;
+}
+
+static i32 take_i32(snap_reader* r) {
+    i32 value;
+    take_into(r, &value, sizeof(value));
+    return value;
+}
+
+// Gives the next object its number, the slot is filled in by `set_object` where the object needs its parts first
+static u32 remember(snap_reader* r, xen_value value) {
+    if (r->object_count == r->object_limit) {
+        restore_fail(r, "more objects than the header declares");
+        return 0;
+    }
+    r->objects[r->object_count] = value;
+    return r->object_count++;
+}
+
+static void set_object(snap_reader* r, u32 index, xen_value value) {
+    if (r->failed == NULL)
+        r->objects[index] = value;
+}
+
+static xen_value read_value(snap_reader* r);
+
+static xen_obj_str* read_string(snap_reader* r) {
+    const xen_value value = read_value(r);
+    if (!OBJ_IS_STRING(value)) {
+        restore_fail(r, "expected a string");
+        return NULL;
+    }
+    return OBJ_AS_STRING(value);
+}
+
+static void read_table(snap_reader* r, xen_table* table) {
+    const u32 count = take_u32(r);
+    for (u32 i = 0; i < count && r->failed == NULL; i++) {
+        xen_obj_str* key      = read_string(r);
+        const xen_value value = read_value(r);
+        if (key != NULL)
+            xen_table_set(table, key, value);
+    }
+}
+
+static xen_value read_function(snap_reader* r) {
+    xen_obj_func* fn = xen_obj_func_new();
+    remember(r, OBJ_VAL(fn));
+    fn->arity            = take_i32(r);
+    fn->upvalue_count    = take_i32(r);
+    const xen_value name = read_value(r);
+    fn->name             = OBJ_IS_STRING(name) ? OBJ_AS_STRING(name) : NULL;
+
+    // executed in place like a mapped .xenb, the image is writable because quickening rewrites instructions
+    xen_chunk* chunk      = &fn->chunk;
+    const u32 code_size   = take_u32(r);
+    chunk->code           = (u8*)take(r, code_size);
+    chunk->count          = code_size;
+    chunk->capacity       = code_size;
+    chunk->borrowed       = XEN_TRUE;
+    chunk->line_runs_size = take_u32(r);
+    chunk->line_runs      = take(r, chunk->line_runs_size);
+
+    const u32 constant_count = take_u32(r);
+    for (u32 i = 0; i < constant_count && r->failed == NULL; i++) {
+        xen_chunk_add_constant(chunk, read_value(r));
+    }
+    return OBJ_VAL(fn);
+}
+
+static xen_value read_class(snap_reader* r) {
+    const u32 index   = remember(r, NULL_VAL);
+    xen_obj_str* name = read_string(r);
+    if (name == NULL)
+        return NULL_VAL;
+    xen_obj_class* class = xen_obj_class_new(name);
+    set_object(r, index, OBJ_VAL(class));
+
+    const u32 property_count = take_u32(r);
+    for (u32 i = 0; i < property_count && r->failed == NULL; i++) {
+        xen_obj_str* property   = read_string(r);
+        const bool is_private   = take_u8(r) != 0;
+        const xen_value initial = read_value(r);
+        if (property != NULL)
+            xen_obj_class_add_property(class, property, initial, is_private);
+    }
+    read_table(r, &class->methods);
+    read_table(r, &class->private_methods);
+    const xen_value initializer = read_value(r);
+    class->initializer          = OBJ_IS_FUNCTION(initializer) ? OBJ_AS_FUNCTION(initializer) : NULL;
+    return OBJ_VAL(class);
+}
+
+static xen_value read_value(snap_reader* r) {
+    const u8 tag = take_u8(r);
+    if (r->failed != NULL)
+        return NULL_VAL;
+
+    switch ((snap_tag)tag) {
+        case SNAP_NULL:
+            return NULL_VAL;
+        case SNAP_TRUE:
+            return BOOL_VAL(XEN_TRUE);
+        case SNAP_FALSE:
+            return BOOL_VAL(XEN_FALSE);
+        case SNAP_INT: {
+            i64 value;
+            take_into(r, &value, sizeof(value));
+            return INT_VAL(value);
+        }
+        case SNAP_NUMBER: {
+            f64 value;
+            take_into(r, &value, sizeof(value));
+            return NUMBER_VAL(value);
+        }
+        case SNAP_REF: {
+            const u32 index = take_u32(r);
+            if (index >= r->object_count) {
+                restore_fail(r, "reference to an object not read yet");
+                return NULL_VAL;
+            }
+            return r->objects[index];
+        }
+        case SNAP_EXTERN: {
+            const u32 index = take_u32(r);
+            if (index >= r->extern_count) {
+                restore_fail(r, "extern index out of range");
+                return NULL_VAL;
+            }
+            return r->externs[index];
+        }
+        case SNAP_FREEZE: {
+            // the object is rebuilt mutable and frozen once complete, later references get the frozen copy
+            const u32 index       = r->object_count;
+            const xen_value value = read_value(r);
+            xen_value frozen;
+            const char* failed;
+            if (r->failed != NULL || !xen_freeze(value, &frozen, &failed)) {
+                restore_fail(r, "frozen value can't be frozen again");
+                return NULL_VAL;
+            }
+            set_object(r, index, frozen);
+            return frozen;
+        }
+        case SNAP_STRING: {
+            const u32 length = take_u32(r);
+            const u8* bytes  = take(r, length);
+            if (bytes == NULL || length > INT32_MAX)
+                return NULL_VAL;
+            xen_obj_str* str = xen_obj_str_copy((const char*)bytes, (i32)length);
+            remember(r, OBJ_VAL(str));
+            return OBJ_VAL(str);
+        }
+        case SNAP_ARRAY: {
+            const u32 count = take_u32(r);
+            if (count > r->size - r->position) {
+                restore_fail(r, "truncated image");
+                return NULL_VAL;
+            }
+            xen_obj_array* array = xen_obj_array_new_with_capacity((i32)count);
+            remember(r, OBJ_VAL(array));
+            for (u32 i = 0; i < count && r->failed == NULL; i++) {
+                xen_obj_array_push(array, read_value(r));
+            }
+            return OBJ_VAL(array);
+        }
+        case SNAP_DICT: {
+            xen_obj_dict* dict = xen_obj_dict_new();
+            remember(r, OBJ_VAL(dict));
+            read_table(r, &dict->table);
+            return OBJ_VAL(dict);
+        }
+        case SNAP_U8ARRAY: {
+            const u32 count = take_u32(r);
+            const u8* bytes = take(r, count);
+            if (bytes == NULL || count > INT32_MAX)
+                return NULL_VAL;
+            xen_obj_u8array* array = xen_obj_u8array_new_with_capacity((i32)count);
+            memcpy(array->values, bytes, count);
+            array->count = (i32)count;
+            remember(r, OBJ_VAL(array));
+            return OBJ_VAL(array);
+        }
+        case SNAP_FUNCTION:
+            return read_function(r);
+        case SNAP_CLOSURE: {
+            const u32 index    = remember(r, NULL_VAL);
+            const xen_value fn = read_value(r);
+            const u32 count    = take_u32(r);
+            if (!OBJ_IS_FUNCTION(fn) || (i32)count != OBJ_AS_FUNCTION(fn)->upvalue_count) {
+                restore_fail(r, "corrupt closure");
+                return NULL_VAL;
+            }
+            xen_obj_closure* closure = xen_obj_closure_new(OBJ_AS_FUNCTION(fn));
+            set_object(r, index, OBJ_VAL(closure));
+            for (u32 i = 0; i < count && r->failed == NULL; i++) {
+                const xen_value upvalue = read_value(r);
+                if (!VAL_IS_OBJ(upvalue) || OBJ_TYPE(upvalue) != OBJ_UPVALUE) {
+                    restore_fail(r, "corrupt closure");
+                    return NULL_VAL;
+                }
+                closure->upvalues[i] = (xen_obj_upvalue*)VAL_AS_OBJ(upvalue);
+            }
+            return OBJ_VAL(closure);
+        }
+        case SNAP_UPVALUE: {
+            xen_obj_upvalue* upvalue = xen_obj_upvalue_new(NULL);
+            upvalue->location        = &upvalue->closed;
+            remember(r, OBJ_VAL(upvalue));
+            upvalue->closed = read_value(r);
+            return OBJ_VAL(upvalue);
+        }
+        case SNAP_CLASS:
+            return read_class(r);
+        case SNAP_INSTANCE: {
+            const u32 index       = remember(r, NULL_VAL);
+            const xen_value class = read_value(r);
+            const u32 count       = take_u32(r);
+            if (!OBJ_IS_CLASS(class) || (i32)count != OBJ_AS_CLASS(class)->property_count) {
+                restore_fail(r, "corrupt instance");
+                return NULL_VAL;
+            }
+            xen_obj_instance* instance = xen_obj_instance_new(OBJ_AS_CLASS(class));
+            set_object(r, index, OBJ_VAL(instance));
+            for (u32 i = 0; i < count && r->failed == NULL; i++) {
+                instance->fields[i] = read_value(r);
+            }
+            return OBJ_VAL(instance);
+        }
+        case SNAP_NAMESPACE: {
+            const u32 index   = remember(r, NULL_VAL);
+            xen_obj_str* name = read_string(r);
+            if (name == NULL)
+                return NULL_VAL;
+            xen_obj_namespace* ns = xen_obj_namespace_new(name->str);  // interned, the string outlives the namespace
+            set_object(r, index, OBJ_VAL(ns));
+            const u32 count = take_u32(r);
+            for (u32 i = 0; i < count && r->failed == NULL; i++) {
+                xen_obj_str* entry    = read_string(r);
+                const xen_value value = read_value(r);
+                if (entry != NULL)
+                    xen_obj_namespace_set(ns, entry->str, value);
+            }
+            return OBJ_VAL(ns);
+        }
+        case SNAP_ERROR: {
+            const u32 index  = remember(r, NULL_VAL);
+            xen_obj_str* msg = read_string(r);
+            if (msg == NULL)
+                return NULL_VAL;
+            xen_obj_error* error = xen_obj_error_new(msg->str);
+            set_object(r, index, OBJ_VAL(error));
+            return OBJ_VAL(error);
+        }
+    }
+    restore_fail(r, "unknown tag");
+    return NULL_VAL;
+}
+
+// Follows a path like "io.println" from the registered namespaces (or the globals, for the first part)
+static bool resolve_extern(const char* path, u32 length, xen_value* out) {
+    char part[256];
+    u32 start  = 0;
+    bool first = XEN_TRUE;
+    while (start <= length) {
+        u32 end = start;
+        while (end < length && path[end] != '.')
+            end++;
+        if (end - start >= sizeof(part))
+            return XEN_FALSE;
+        memcpy(part, path + start, end - start);
+        part[end - start] = '\0';
+
+        if (first) {
+            xen_obj_str* name = xen_obj_str_copy(part, (i32)(end - start));
+            if (!xen_table_get(&g_vm->namespace_registry, name, out) && !xen_table_get(&g_vm->globals, name, out))
+                return XEN_FALSE;
+            first = XEN_FALSE;
+        } else if (!OBJ_IS_NAMESPACE(*out) || !xen_obj_namespace_get(OBJ_AS_NAMESPACE(*out), part, out)) {
+            return XEN_FALSE;
+        }
+        start = end + 1;
+    }
+    return XEN_TRUE;
+}
+
+static bool read_header(snap_reader* r) {
+    const u8* magic = take(r, 4);
+    if (magic == NULL || memcmp(magic, "XENS", 4) != 0)
+        return restore_fail(r, "not a snapshot image");
+    if (take_u8(r) != XEN_SNAPSHOT_VERSION)
+        return restore_fail(r, "unsupported snapshot version");
+    take_u8(r);  // flags
+    take(r, 2);  // reserved
+
+    char release[SNAPSHOT_RELEASE_SIZE + 1] = {0};
+    take_into(r, release, SNAPSHOT_RELEASE_SIZE);
+    if (r->failed == NULL && strcmp(release, VERSION_STRING) != 0)
+        return restore_fail(r, "written by another release of xen, take the snapshot again");
+
+    r->object_limit = take_u32(r);
+    if (r->object_limit > r->size)  // every object takes at least a byte
+        return restore_fail(r, "corrupt object count");
+    r->objects = calloc(r->object_limit > 0 ? r->object_limit : 1, sizeof(xen_value));
+
+    r->extern_count = take_u32(r);
+    if (r->extern_count > r->size)
+        return restore_fail(r, "corrupt extern table");
+    r->externs = calloc(r->extern_count > 0 ? r->extern_count : 1, sizeof(xen_value));
+    for (u32 i = 0; i < r->extern_count && r->failed == NULL; i++) {
+        const u32 length = take_u32(r);
+        const char* path = (const char*)take(r, length);
+        if (path != NULL && !resolve_extern(path, length, &r->externs[i])) {
+            fprintf(stderr, "snapshot: this VM has no builtin '%.*s'\n", (int)length, path);
+            return restore_fail(r, "unknown builtin");
+        }
+    }
+    return r->failed == NULL;
+}
+
+bool xen_snapshot_is_image(const u8* data, size_t size) {
+    return size >= 4 && memcmp(data, "XENS", 4) == 0;
+}
+
+bool xen_snapshot_restore(u8* image, size_t size) {
+    snap_reader r;
+    memset(&r, 0, sizeof(r));
+    r.data = image;
+    r.size = size;
+
+    if (read_header(&r)) {
+        const u32 count = take_u32(&r);
+        for (u32 i = 0; i < count && r.failed == NULL; i++) {
+            xen_obj_str* name     = read_string(&r);
+            const xen_value value = read_value(&r);
+            if (name != NULL)
+                xen_table_set(&g_vm->globals, name, value);
+        }
+    }
+    if (r.failed != NULL)
+        fprintf(stderr, "invalid snapshot: %s\n", r.failed);
+
+    free(r.objects);
+    free(r.externs);
+    return r.failed == NULL;
+}
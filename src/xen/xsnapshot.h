@@ -0,0 +1,48 @@
+#ifndef X_SNAPSHOT_H
+#define X_SNAPSHOT_H
+
+#include "xcommon.h"
+
+/*
+ * Heap snapshots
+ *
+ * `xen --snapshot app.img app.xen` runs the script and saves the state it leaves behind: every global and everything
+ * reachable from it (functions with their code, closures, classes, instances, arrays, dictionaries, strings). `xen
+ * app.img` rebuilds that state in a fresh VM and calls the script's `main` function, so neither compiling the script
+ * nor running its initialization is repeated.
+ *
+ * Image layout, little-endian
+ *   Magic           : 'XENS'         - 4 bytes
+ *   Version         : u8
+ *   Flags           : u8             - reserved, 0
+ *   Reserved        : u16
+ *   Release         : char[16]       - VERSION_STRING of the xen that wrote it, images only load into that release
+ *   Object Count    : u32            - objects stored in the image
+ *   Externs         : u32 count, then {u32 length, bytes}[]
+ *   Globals         : u32 count, then {value name, value}[]
+ *
+ * Values are a tag byte followed by its payload. Objects are numbered in the order they first appear and every later
+ * reference to one is stored as its number, so shared references and cycles come back as they were. Builtins (native
+ * functions, builtin namespaces and what they contain) aren't stored: they are externs, referred to by the path that
+ * reaches them in a fresh VM ("typeof", "io", "io.println") and looked up by the loading VM. Function code and line
+ * tables stay in the image and run in place like those of a .xenb file.
+ */
+
+#define XEN_SNAPSHOT_VERSION 1
+#define XEN_SNAPSHOT_ENTRY "main"  // called once an image has been restored
+
+/// @brief Saves the globals of the calling thread's VM, and everything they reach, to an image at `path`.
+/// @return false (after reporting why) if the state holds a value that can't outlive the process, like a socket, a
+/// thread or a fiber, or if the file can't be written.
+bool xen_snapshot_write(const char* path);
+
+/// @brief True if `data` starts like a snapshot image.
+bool xen_snapshot_is_image(const u8* data, size_t size);
+
+/// @brief Rebuilds the globals saved in `image` in the calling thread's VM. Functions run their code from `image`,
+/// which must stay valid and writable for as long as the VM uses them, like a .xenb image.
+/// @return false (after reporting why) if the image is corrupt, comes from another release or refers to a builtin
+/// this VM doesn't have.
+bool xen_snapshot_restore(u8* image, size_t size);
+
+#endif
@@ -29,6 +29,10 @@ static xen_table_entry* find_entry(array(xen_table_entry) entries, i32 capacity,
             }
         } else if (entry->key == key) {
             return entry;
+        } else if ((entry->key->obj.frozen || key->obj.frozen) && entry->key->hash == key->hash &&
+                   entry->key->length == key->length && memcmp(entry->key->str, key->str, key->length) == 0) {
+            // frozen strings live outside the VM's string table, so equal ones aren't the same object
+            return entry;
         }
 
         index = (index + 1) % capacity;
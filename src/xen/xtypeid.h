@@ -7,6 +7,7 @@
 #define TYPEID_BOOL (VAL_BOOL)
 #define TYPEID_NULL (VAL_NULL)
 #define TYPEID_NUMBER (VAL_NUMBER)
+#define TYPEID_INT (VAL_INT)
 #define TYPEID_STRING (VAL_OBJECT + OBJ_STRING)
 #define TYPEID_FUNC (VAL_OBJECT + OBJ_FUNCTION)
 #define TYPEID_NATIVE_FUNC (VAL_OBJECT + OBJ_NATIVE_FUNC)
@@ -18,6 +19,7 @@
 #define TYPEID_INSTANCE (VAL_OBJECT + OBJ_INSTANCE)
 #define TYPEID_U8ARRAY (VAL_OBJECT + OBJ_U8ARRAY)
 #define TYPEID_ERROR (VAL_OBJECT + OBJ_ERROR)
+#define TYPEID_FIBER (VAL_OBJECT + OBJ_FIBER)
 
 inline static i32 xen_typeid_get(xen_value value) {
     switch (value.type) {
@@ -27,6 +29,8 @@ inline static i32 xen_typeid_get(xen_value value) {
             return TYPEID_NULL;
         case VAL_NUMBER:
             return TYPEID_NUMBER;
+        case VAL_INT:
+            return TYPEID_INT;
         case VAL_OBJECT: {
             switch (OBJ_TYPE(value)) {
                 case OBJ_STRING:
@@ -51,6 +55,12 @@ inline static i32 xen_typeid_get(xen_value value) {
                     return TYPEID_U8ARRAY;
                 case OBJ_ERROR:
                     return TYPEID_ERROR;
+                case OBJ_CLOSURE:
+                    return TYPEID_FUNC;  // closures are plain functions as far as scripts are concerned
+                case OBJ_UPVALUE:
+                    return TYPEID_UNDEFINED;
+                case OBJ_FIBER:
+                    return TYPEID_FIBER;
             }
         }
     }
@@ -65,6 +75,8 @@ inline static const char* xen_typeid_str(i32 typeid) {
             return "Null";
         case TYPEID_NUMBER:
             return "Number";
+        case TYPEID_INT:
+            return "Int";
         case TYPEID_STRING:
             return "String";
         case TYPEID_FUNC:
@@ -87,10 +99,18 @@ inline static const char* xen_typeid_str(i32 typeid) {
             return "U8Array";
         case TYPEID_ERROR:
             return "Error";
+        case TYPEID_FIBER:
+            return "Fiber";
         case TYPEID_UNDEFINED:
         default:
             return "Undefined";
     }
 }
 
+// Whether a value satisfies an expected typeid. Ints are accepted wherever a Number is expected.
+inline static bool xen_typeid_accepts(i32 expected, xen_value value) {
+    const i32 actual = xen_typeid_get(value);
+    return expected == TYPEID_UNDEFINED || expected == actual || (expected == TYPEID_NUMBER && actual == TYPEID_INT);
+}
+
 #endif
@@ -85,27 +85,26 @@ inline static char* xen_read_line(FILE* file) {
     return line;
 }
 
-inline static xen_chunk xen_read_bytecode(const char* filename) {
+/// @brief Reads a compiled (.xenb) file into a byte buffer
+inline static u8* xen_read_bytecode(const char* filename, size_t* size_out) {
     FILE* fp = fopen(filename, "rb");
     if (!fp) {
         xen_panic(XEN_ERR_OPEN_FILE, "failed to open file: %s", filename);
     }
 
     fseek(fp, 0, SEEK_END);
-    i32 fp_size = ftell(fp);
+    const long fp_size = ftell(fp);
     fseek(fp, 0, SEEK_SET);
 
-    u8* buffer        = (u8*)malloc(fp_size);
-    size_t read_bytes = fread(buffer, 1, fp_size, fp);
-    fclose(fp);
+    u8* buffer = (u8*)malloc(fp_size > 0 ? fp_size : 1);
+    if (!buffer) {
+        xen_panic(XEN_ERR_ALLOCATION_FAILED, "failed to allocate bytecode buffer");
+    }
 
-    xen_chunk chunk;
-    xen_chunk_init(&chunk);
-    chunk.code     = buffer;
-    chunk.capacity = fp_size;
-    chunk.count    = fp_size;
+    *size_out = fread(buffer, 1, fp_size, fp);
+    fclose(fp);
 
-    return chunk;
+    return buffer;
 }
 
 /// @brief Returns the corresponding order of magnitude suffix for the given
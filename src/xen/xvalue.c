@@ -2,6 +2,8 @@
 #include "xmem.h"
 #include "math.h"
 
+#include <inttypes.h>
+
 #include "object/xobj_string.h"
 #include "object/xobj_array.h"
 #include "object/xobj_dict.h"
@@ -11,14 +13,20 @@
 #include "object/xobj_bound_method.h"
 
 bool xen_value_equal(xen_value a, xen_value b) {
-    if (a.type != b.type)
+    if (a.type != b.type) {
+        // 1 == 1.0
+        if (VAL_IS_NUMBER(a) && VAL_IS_NUMBER(b))
+            return VAL_AS_NUMBER(a) == VAL_AS_NUMBER(b);
         return XEN_FALSE;
+    }
 
     switch (a.type) {
         case VAL_BOOL:
             return VAL_AS_BOOL(a) == VAL_AS_BOOL(b);
         case VAL_NUMBER:
-            return VAL_AS_NUMBER(a) == VAL_AS_NUMBER(b);
+            return a.as.number == b.as.number;
+        case VAL_INT:
+            return a.as.integer == b.as.integer;
         case VAL_OBJECT: {
             xen_obj* obj_a = VAL_AS_OBJ(a);
             xen_obj* obj_b = VAL_AS_OBJ(b);
@@ -121,6 +129,9 @@ void xen_value_print(xen_value value) {
             printf("%s", buffer);
             break;
         }
+        case VAL_INT:
+            printf("%" PRId64, VAL_AS_INT(value));
+            break;
         case VAL_OBJECT: {
             xen_obj_print(value);
         } break;
@@ -139,6 +150,8 @@ char* xen_value_type_to_str(xen_value value) {
             return "null";
         case VAL_NUMBER:
             return "number";
+        case VAL_INT:
+            return "int";
         case VAL_OBJECT: {
             if (OBJ_IS_STRING(value)) {
                 return "string";
@@ -21,12 +21,19 @@ typedef struct xen_obj_dict          xen_obj_dict;
 typedef struct xen_obj_class         xen_obj_class;
 typedef struct xen_obj_u8array       xen_obj_u8array;
 typedef struct xen_obj_error         xen_obj_error;
+typedef struct xen_obj_closure       xen_obj_closure;
+typedef struct xen_obj_upvalue       xen_obj_upvalue;
+typedef struct xen_obj_fiber         xen_obj_fiber;
+typedef struct xen_jit_code          xen_jit_code;
+typedef struct xen_bytecode_module   xen_bytecode_module;
+typedef struct xen_call_frame        xen_call_frame;
 // clang-format on
 
 typedef enum {
     VAL_BOOL,
     VAL_NULL,
-    VAL_NUMBER,
+    VAL_NUMBER,  // 64-bit float
+    VAL_INT,     // 64-bit signed integer
     VAL_OBJECT,
 } xen_value_type;
 
@@ -36,6 +43,7 @@ typedef struct {
     union {
         bool boolean;
         f64 number;
+        i64 integer;
         xen_obj* obj;
     } as;
 } xen_value;
@@ -48,18 +56,34 @@ typedef struct {
 
 #define VAL_IS_BOOL(v) ((v).type == VAL_BOOL)
 #define VAL_IS_NULL(v) ((v).type == VAL_NULL)
-#define VAL_IS_NUMBER(v) ((v).type == VAL_NUMBER)
+#define VAL_IS_NUMBER(v) ((v).type == VAL_NUMBER || (v).type == VAL_INT)  // any numeric value
+#define VAL_IS_FLOAT(v) ((v).type == VAL_NUMBER)
+#define VAL_IS_INT(v) ((v).type == VAL_INT)
 #define VAL_IS_OBJ(v) ((v).type == VAL_OBJECT)
+// Both values are floats/ints, tested with a single comparison
+#define VAL_PAIR_IS_NUMBER(a, b) ((((a).type << 8) | (b).type) == ((VAL_NUMBER << 8) | VAL_NUMBER))
+#define VAL_PAIR_IS_INT(a, b) ((((a).type << 8) | (b).type) == ((VAL_INT << 8) | VAL_INT))
 
 #define VAL_AS_OBJ(v) ((v).as.obj)
 #define VAL_AS_BOOL(v) ((v).as.boolean)
-#define VAL_AS_NUMBER(v) ((v).as.number)
+#define VAL_AS_NUMBER(v) xen_value_as_f64(v)    // any numeric value converted to a float
+#define VAL_AS_INTEGER(v) xen_value_as_i64(v)   // any numeric value truncated to an integer
+#define VAL_AS_INT(v) ((v).as.integer)
 
 #define NULL_VAL ((xen_value) {VAL_NULL, {.number = 0}})
 #define BOOL_VAL(v) ((xen_value) {VAL_BOOL, {.boolean = (v)}})
 #define NUMBER_VAL(v) ((xen_value) {VAL_NUMBER, {.number = (v)}})
+#define INT_VAL(v) ((xen_value) {VAL_INT, {.integer = (v)}})
 #define OBJ_VAL(o) ((xen_value) {VAL_OBJECT, {.obj = (xen_obj*)(o)}})
 
+static inline f64 xen_value_as_f64(xen_value value) {
+    return value.type == VAL_INT ? (f64)value.as.integer : value.as.number;
+}
+
+static inline i64 xen_value_as_i64(xen_value value) {
+    return value.type == VAL_INT ? value.as.integer : (i64)value.as.number;
+}
+
 bool xen_value_equal(xen_value a, xen_value b);
 void xen_value_array_init(xen_value_array* array);
 void xen_value_array_write(xen_value_array* array, xen_value value);
@@ -3,8 +3,12 @@
 #include "xchunk.h"
 #include "xcommon.h"
 #include "xerr.h"
+#include "xjit.h"
 #include "xmem.h"
 #include "xcompiler.h"
+#include "xbytecode.h"
+#include "xcache.h"
+#include "xsnapshot.h"
 #include "xstack.h"
 #include "xtable.h"
 #include "xutils.h"
@@ -21,31 +25,46 @@
 #include "object/xobj_instance.h"
 #include "object/xobj_bound_method.h"
 #include "object/xobj_u8array.h"
+#include "object/xobj_closure.h"
+#include "object/xobj_fiber.h"
+#include <inttypes.h>
 #include <string.h>
 
 //====================================================================================================================//
 
-// Global VM instance
-xen_vm g_vm;
+// VM of the calling thread
+XEN_THREAD_LOCAL xen_vm* g_vm = NULL;
 
 //====================================================================================================================//
 
+#define XEN_FRAME_SLOTS 256  // stack headroom every new frame is guaranteed
+
+// Drops whatever was running (including any fiber) and returns to an empty main script context
 static void stack_reset() {
-    g_vm.stack_top = g_vm.stack;
+    g_vm->fiber          = NULL;
+    g_vm->frames         = g_vm->main_frames;
+    g_vm->frame_count    = 0;
+    g_vm->frame_capacity = FRAMES_MAX;
+    g_vm->stack          = g_vm->main_stack;
+    g_vm->stack_top      = g_vm->stack;
+    g_vm->stack_end      = g_vm->stack + STACK_MAX;
+    g_vm->open_upvalues  = NULL;
+    g_vm->native_depth   = 0;
+    g_vm->switch_pending = XEN_FALSE;
 }
 
 static void stack_push(xen_value value) {
-    *g_vm.stack_top = value;
-    g_vm.stack_top++;
+    *g_vm->stack_top = value;
+    g_vm->stack_top++;
 }
 
 static xen_value stack_pop() {
-    g_vm.stack_top--;
-    return *g_vm.stack_top;
+    g_vm->stack_top--;
+    return *g_vm->stack_top;
 }
 
 static xen_value peek(i32 distance) {
-    return g_vm.stack_top[-1 - distance];
+    return g_vm->stack_top[-1 - distance];
 }
 
 static bool is_falsy(xen_value value) {
@@ -57,7 +76,7 @@ static void concatenate() {
     const xen_obj_str* a = OBJ_AS_STRING(stack_pop());
     const i32 length     = a->length + b->length;
 
-    char* str = XEN_ALLOC_ARRAY(g_vm.mem.permanent, char, length + 1);
+    char* str = XEN_ALLOC_ARRAY(g_vm->mem.permanent, char, length + 1);
     memcpy(str, a->str, a->length);
     memcpy(str + a->length, b->str, b->length);
     str[length] = '\0';
@@ -74,11 +93,11 @@ static void runtime_error(const char* fmt, ...) {
     fputs("\n", stderr);
 
     // print stack trace
-    for (i32 i = g_vm.frame_count - 1; i >= 0; i--) {
-        xen_call_frame* frame = &g_vm.frames[i];
+    for (i32 i = g_vm->frame_count - 1; i >= 0; i--) {
+        xen_call_frame* frame = &g_vm->frames[i];
         xen_obj_func* fn      = frame->fn;
         size_t instruction    = frame->ip - fn->chunk.code - 1;
-        fprintf(stderr, "[line %lu] in ", fn->chunk.lines[instruction]);
+        fprintf(stderr, "[line %lu] in ", xen_chunk_line(&fn->chunk, instruction));
         if (fn->name == NULL) {
             fprintf(stderr, "script\n");
         } else {
@@ -89,35 +108,91 @@ static void runtime_error(const char* fmt, ...) {
     stack_reset();
 }
 
+// Fibers start with small stacks that grow on demand, the main script keeps its fixed arrays
+static bool grow_frames() {
+    if (g_vm->fiber == NULL || g_vm->frame_capacity >= XEN_FIBER_FRAMES_MAX) {
+        return XEN_FALSE;
+    }
+
+    const i32 capacity   = g_vm->frame_capacity * 2;
+    g_vm->frames         = XEN_GROW_ARRAY(xen_call_frame, g_vm->frames, g_vm->frame_capacity, capacity);
+    g_vm->frame_capacity = capacity;
+    return XEN_TRUE;
+}
+
+static void grow_stack() {
+    xen_value* old_stack   = g_vm->stack;
+    const i64 old_capacity = g_vm->stack_end - old_stack;
+    const i64 capacity     = old_capacity * 2;
+    xen_value* stack       = XEN_GROW_ARRAY(xen_value, old_stack, old_capacity, capacity);
+
+    // rebase everything that points into the stack
+    g_vm->stack_top = stack + (g_vm->stack_top - old_stack);
+    for (i32 i = 0; i < g_vm->frame_count; i++) {
+        g_vm->frames[i].slots = stack + (g_vm->frames[i].slots - old_stack);
+    }
+    for (xen_obj_upvalue* upvalue = g_vm->open_upvalues; upvalue != NULL; upvalue = upvalue->next) {
+        upvalue->location = stack + (upvalue->location - old_stack);
+    }
+
+    g_vm->stack     = stack;
+    g_vm->stack_end = stack + capacity;
+}
+
 static bool call(xen_obj_func* fn, i32 arg_count) {
     if (arg_count != fn->arity) {
         runtime_error("expected %d arguments but got %d", fn->arity, arg_count);
         return XEN_FALSE;
     }
+    if (XEN_UNLIKELY(fn->module != NULL) && !xen_bytecode_load_function(fn)) {
+        runtime_error("failed to load function '%s' from bytecode", fn->name != NULL ? fn->name->str : "script");
+        return XEN_FALSE;
+    }
 
-    if (g_vm.frame_count == FRAMES_MAX) {
+    if (XEN_UNLIKELY(g_vm->frame_count == g_vm->frame_capacity) && !grow_frames()) {
         runtime_error("stack overflow");
         return XEN_FALSE;
     }
+    if (XEN_UNLIKELY(g_vm->stack_end - g_vm->stack_top < XEN_FRAME_SLOTS) && g_vm->fiber != NULL) {
+        grow_stack();
+    }
 
-    xen_call_frame* frame = &g_vm.frames[g_vm.frame_count++];
+    xen_call_frame* frame = &g_vm->frames[g_vm->frame_count++];
     frame->fn             = fn;
     frame->ip             = fn->chunk.code;
-    frame->slots          = g_vm.stack_top - arg_count - 1;
+    frame->slots          = g_vm->stack_top - arg_count - 1;
+    frame->closure        = NULL;
+
+    if (XEN_UNLIKELY(++fn->hotness == g_vm->jit_threshold)) {
+        xen_jit_compile(fn);
+    }
 
     return XEN_TRUE;
 }
 
+static bool switch_fiber();
+
 static bool call_value(xen_value callee, i32 arg_count) {
     if (VAL_IS_OBJ(callee)) {
         switch (OBJ_TYPE(callee)) {
             case OBJ_FUNCTION:
                 return call(OBJ_AS_FUNCTION(callee), arg_count);
+            case OBJ_CLOSURE: {
+                xen_obj_closure* closure = OBJ_AS_CLOSURE(callee);
+                if (!call(closure->fn, arg_count))
+                    return XEN_FALSE;
+                g_vm->frames[g_vm->frame_count - 1].closure = closure;
+                return XEN_TRUE;
+            }
             case OBJ_NATIVE_FUNC: {
                 xen_native_fn native = OBJ_AS_NATIVE_FUNC(callee)->function;
-                xen_value result     = native(arg_count, g_vm.stack_top - arg_count);
-                g_vm.stack_top -= arg_count + 1;
+                xen_value result     = native(arg_count, g_vm->stack_top - arg_count);
+                if (XEN_UNLIKELY(g_vm->reentry_failed))
+                    return XEN_FALSE;
+                g_vm->stack_top -= arg_count + 1;
                 stack_push(result);
+                if (XEN_UNLIKELY(g_vm->switch_pending))
+                    return switch_fiber();
                 return XEN_TRUE;
             }
             default:
@@ -128,9 +203,216 @@ static bool call_value(xen_value callee, i32 arg_count) {
     return XEN_FALSE;
 }
 
+// Integer form of a binary arithmetic or comparison instruction. Returns false when the result is not representable as
+// an integer (overflow, division, modulo by zero), in which case the caller falls back to float math.
+static bool int_binary(u8 op, i64 a, i64 b, xen_value* out) {
+    i64 result;
+    switch (op) {
+        case OP_ADD:
+            if (__builtin_add_overflow(a, b, &result))
+                return XEN_FALSE;
+            break;
+        case OP_SUBTRACT:
+            if (__builtin_sub_overflow(a, b, &result))
+                return XEN_FALSE;
+            break;
+        case OP_MULTIPLY:
+            if (__builtin_mul_overflow(a, b, &result))
+                return XEN_FALSE;
+            break;
+        case OP_MOD:
+            if (b == 0)
+                return XEN_FALSE;
+            result = b == -1 ? 0 : a % b;
+            break;
+        case OP_LESS:
+            *out = BOOL_VAL(a < b);
+            return XEN_TRUE;
+        case OP_GREATER:
+            *out = BOOL_VAL(a > b);
+            return XEN_TRUE;
+        default:
+            return XEN_FALSE;
+    }
+
+    *out = INT_VAL(result);
+    return XEN_TRUE;
+}
+
+bool xen_vm_numeric_binary(u8 op, xen_value a, xen_value b, xen_value* out) {
+    if (!VAL_IS_NUMBER(a) || !VAL_IS_NUMBER(b))
+        return XEN_FALSE;
+
+    xen_value result;
+    if (!VAL_PAIR_IS_INT(a, b) || !int_binary(op, VAL_AS_INT(a), VAL_AS_INT(b), &result)) {
+        const f64 x = VAL_AS_NUMBER(a);
+        const f64 y = VAL_AS_NUMBER(b);
+        switch (op) {
+            case OP_ADD:
+                result = NUMBER_VAL(x + y);
+                break;
+            case OP_SUBTRACT:
+                result = NUMBER_VAL(x - y);
+                break;
+            case OP_MULTIPLY:
+                result = NUMBER_VAL(x * y);
+                break;
+            case OP_DIVIDE:
+                result = NUMBER_VAL(x / y);
+                break;
+            case OP_MOD:
+                result = NUMBER_VAL(fmod(x, y));
+                break;
+            case OP_LESS:
+                result = BOOL_VAL(x < y);
+                break;
+            case OP_GREATER:
+                result = BOOL_VAL(x > y);
+                break;
+            default:
+                return XEN_FALSE;
+        }
+    }
+
+    *out = result;
+    return XEN_TRUE;
+}
+
+// Applies `op` to the two numbers on top of the stack, see xen_vm_numeric_binary
+static bool numeric_binary(u8 op) {
+    if (!xen_vm_numeric_binary(op, peek(1), peek(0), &g_vm->stack_top[-2]))
+        return XEN_FALSE;
+    g_vm->stack_top--;
+    return XEN_TRUE;
+}
+
+// Bitwise operands have to be integers. Floats holding an integral value are accepted as well so the result of `/` can
+// still be masked and shifted.
+static bool to_bits(xen_value value, i64* out) {
+    if (VAL_IS_INT(value)) {
+        *out = VAL_AS_INT(value);
+        return XEN_TRUE;
+    }
+    if (VAL_IS_FLOAT(value)) {
+        const f64 number = value.as.number;
+        if (number >= -9223372036854775808.0 && number < 9223372036854775808.0 && number == trunc(number)) {
+            *out = (i64)number;
+            return XEN_TRUE;
+        }
+    }
+    return XEN_FALSE;
+}
+
+// Returns the upvalue for a stack slot, reusing an open one so every closure capturing the slot shares it
+static xen_obj_upvalue* capture_upvalue(xen_value* local) {
+    xen_obj_upvalue* prev    = NULL;
+    xen_obj_upvalue* upvalue = g_vm->open_upvalues;
+    while (upvalue != NULL && upvalue->location > local) {
+        prev    = upvalue;
+        upvalue = upvalue->next;
+    }
+
+    if (upvalue != NULL && upvalue->location == local) {
+        return upvalue;
+    }
+
+    xen_obj_upvalue* created = xen_obj_upvalue_new(local);
+    created->next            = upvalue;
+    if (prev == NULL) {
+        g_vm->open_upvalues = created;
+    } else {
+        prev->next = created;
+    }
+    return created;
+}
+
+// Moves every captured variable at or above `last` off the stack
+static void close_upvalues(xen_value* last) {
+    while (g_vm->open_upvalues != NULL && g_vm->open_upvalues->location >= last) {
+        xen_obj_upvalue* upvalue = g_vm->open_upvalues;
+        upvalue->closed          = *upvalue->location;
+        upvalue->location        = &upvalue->closed;
+        g_vm->open_upvalues      = upvalue->next;
+    }
+}
+
+static void save_context(xen_exec_context* context) {
+    context->frames         = g_vm->frames;
+    context->frame_count    = g_vm->frame_count;
+    context->frame_capacity = g_vm->frame_capacity;
+    context->stack          = g_vm->stack;
+    context->stack_top      = g_vm->stack_top;
+    context->stack_end      = g_vm->stack_end;
+    context->open_upvalues  = g_vm->open_upvalues;
+    context->native_depth   = g_vm->native_depth;
+}
+
+static void load_context(const xen_exec_context* context) {
+    g_vm->frames         = context->frames;
+    g_vm->frame_count    = context->frame_count;
+    g_vm->frame_capacity = context->frame_capacity;
+    g_vm->stack          = context->stack;
+    g_vm->stack_top      = context->stack_top;
+    g_vm->stack_end      = context->stack_end;
+    g_vm->open_upvalues  = context->open_upvalues;
+    g_vm->native_depth   = context->native_depth;
+}
+
+void xen_vm_switch_fiber(xen_obj_fiber* target, xen_value value) {
+    g_vm->switch_pending = XEN_TRUE;
+    g_vm->switch_target  = target;
+    g_vm->switch_value   = value;
+}
+
+bool xen_vm_yield(xen_value value) {
+    xen_obj_fiber* fiber = g_vm->fiber;
+    if (fiber == NULL) {
+        xen_runtime_error("cannot yield from outside a fiber");
+        return XEN_FALSE;
+    }
+    // the native's C frame would be left behind on the machine stack
+    if (g_vm->native_depth > 0) {
+        xen_runtime_error("cannot yield across a native call");
+        return XEN_FALSE;
+    }
+
+    fiber->state = FIBER_SUSPENDED;
+    xen_vm_switch_fiber(fiber->resumer, value);
+    return XEN_TRUE;
+}
+
+// Performs the switch requested through xen_vm_switch_fiber. Runs after the requesting native's placeholder result has
+// been pushed; the target continues with the transferred value as the result of its own resume()/yield() call.
+static bool switch_fiber() {
+    xen_obj_fiber* target = g_vm->switch_target;
+    const xen_value value = g_vm->switch_value;
+    g_vm->switch_pending  = XEN_FALSE;
+
+    save_context(g_vm->fiber != NULL ? &g_vm->fiber->context : &g_vm->main_context);
+    load_context(target != NULL ? &target->context : &g_vm->main_context);
+    g_vm->fiber = target;
+
+    if (target == NULL || target->state != FIBER_NEW) {
+        if (target != NULL)
+            target->state = FIBER_RUNNING;
+        g_vm->stack_top[-1] = value;
+        return XEN_TRUE;
+    }
+
+    // first resume: call the fiber's function on its own stack
+    target->state      = FIBER_RUNNING;
+    const xen_value fn = target->fn;
+    const i32 arity    = OBJ_IS_CLOSURE(fn) ? OBJ_AS_CLOSURE(fn)->fn->arity : OBJ_AS_FUNCTION(fn)->arity;
+    stack_push(fn);
+    if (arity > 0) {
+        stack_push(value);
+    }
+    return call_value(fn, arity);
+}
+
 static bool is_same_class_context(xen_obj_class* target_class) {
     // Get the current call frame
-    xen_call_frame* frame = &g_vm.frames[g_vm.frame_count - 1];
+    xen_call_frame* frame = &g_vm->frames[g_vm->frame_count - 1];
 
     // Check if we're in a method (slot 0 would be 'this')
     if (frame->slots != NULL) {
@@ -148,23 +430,45 @@ static bool is_same_class_context(xen_obj_class* target_class) {
 
 //====================================================================================================================//
 
-void xen_vm_init(xen_vm_config config) {
-    xen_vm_mem_init(&g_vm.mem, config.mem_size_permanent, config.mem_size_generation, config.mem_size_temporary);
+xen_vm* xen_vm_new(xen_vm_config config) {
+    assert(g_vm == NULL);  // one VM per thread: free the current one before creating another
+    g_vm = calloc(1, sizeof(xen_vm));
+    g_vm->config = config;
+    xen_vm_mem_init(&g_vm->mem, config.mem_size_permanent, config.mem_size_generation, config.mem_size_temporary);
     stack_reset();
-    g_vm.objects = NULL;
-    xen_table_init(&g_vm.globals);
-    xen_table_init(&g_vm.strings);
-    xen_table_init(&g_vm.namespace_registry);
-    xen_table_init(&g_vm.const_globals);
+    g_vm->objects = NULL;
+    xen_table_init(&g_vm->globals);
+    xen_table_init(&g_vm->strings);
+    xen_table_init(&g_vm->namespace_registry);
+    xen_table_init(&g_vm->const_globals);
+    g_vm->jit_threshold  = XEN_JIT_SUPPORTED ? config.jit_threshold : 0;
+    g_vm->reentry_failed = XEN_FALSE;
     xen_builtins_register();
+    return g_vm;
+}
+
+void xen_vm_free(xen_vm* vm) {
+    assert(vm == g_vm);
+    xen_table_free(&g_vm->strings);
+    xen_table_free(&g_vm->globals);
+    xen_table_free(&g_vm->namespace_registry);
+    xen_table_free(&g_vm->const_globals);
+    xen_vm_mem_destroy(&g_vm->mem);
+    xen_buffer_pool_free(&g_vm->buffers);
+    xen_thread_release_channels();
+    xen_frozen_release_all();
+    xen_bytecode_modules_free();
+    xen_jit_shutdown();
+    free(g_vm);
+    g_vm = NULL;
+}
+
+void xen_vm_init(xen_vm_config config) {
+    xen_vm_new(config);
 }
 
 void xen_vm_shutdown() {
-    xen_table_free(&g_vm.strings);
-    xen_table_free(&g_vm.globals);
-    xen_table_free(&g_vm.namespace_registry);
-    xen_table_free(&g_vm.const_globals);
-    xen_vm_mem_destroy(&g_vm.mem);
+    xen_vm_free(g_vm);
 }
 
 //====================================================================================================================//
@@ -172,39 +476,142 @@ void xen_vm_shutdown() {
 #define READ_BYTE() (*frame->ip++)
 #define READ_CONSTANT() (frame->fn->chunk.constants.values[READ_BYTE()])
 #define READ_STRING() OBJ_AS_STRING(READ_CONSTANT())
-#define BINARY_OP(value_type, op)                                                                                      \
+#define BINARY_OP(op)                                                                                                  \
     do {                                                                                                               \
-        if (!VAL_IS_NUMBER(peek(0)) || !VAL_IS_NUMBER(peek(1))) {                                                      \
+        if (!numeric_binary(op)) {                                                                                     \
             runtime_error("operands must be numbers");                                                                 \
             return EXEC_RUNTIME_ERROR;                                                                                 \
         }                                                                                                              \
-        f64 b = VAL_AS_NUMBER(stack_pop());                                                                            \
-        f64 a = VAL_AS_NUMBER(stack_pop());                                                                            \
-        stack_push(value_type(a op b));                                                                                \
+    } while (XEN_FALSE)
+#define BITWISE_OP(op)                                                                                                 \
+    do {                                                                                                               \
+        i64 a, b;                                                                                                      \
+        if (!to_bits(peek(1), &a) || !to_bits(peek(0), &b)) {                                                         \
+            runtime_error("operands must be integers");                                                                \
+            return EXEC_RUNTIME_ERROR;                                                                                 \
+        }                                                                                                              \
+        g_vm->stack_top[-2] = INT_VAL(a op b);                                                                         \
+        g_vm->stack_top--;                                                                                             \
     } while (XEN_FALSE)
 #define READ_SHORT() (frame->ip += 2, (u16)((frame->ip[-2] << 8) | frame->ip[-1]))
+// Rewrite the instruction being executed into its float- or int-specialized form
+#define QUICKEN(float_op, int_op)                                                                                      \
+    do {                                                                                                               \
+        if (VAL_PAIR_IS_NUMBER(peek(1), peek(0)))                                                                      \
+            frame->ip[-1] = float_op;                                                                                  \
+        else if (VAL_PAIR_IS_INT(peek(1), peek(0)))                                                                    \
+            frame->ip[-1] = int_op;                                                                                    \
+    } while (XEN_FALSE)
+// Fast paths for quickened instructions. On a type mismatch (or integer overflow) the instruction is rewritten back to
+// its generic form and dispatched again.
+#define NUMBER_OP(value_type, op, generic_op)                                                                          \
+    do {                                                                                                               \
+        xen_value* top = g_vm->stack_top;                                                                              \
+        if (XEN_UNLIKELY(!VAL_PAIR_IS_NUMBER(top[-2], top[-1]))) {                                                     \
+            frame->ip[-1] = generic_op;                                                                                \
+            frame->ip--;                                                                                               \
+            break;                                                                                                     \
+        }                                                                                                              \
+        top[-2] = value_type(top[-2].as.number op top[-1].as.number);                                                  \
+        g_vm->stack_top--;                                                                                             \
+    } while (XEN_FALSE)
+#define INT_OP(checked_op, generic_op)                                                                                 \
+    do {                                                                                                               \
+        xen_value* top = g_vm->stack_top;                                                                              \
+        i64 result;                                                                                                    \
+        if (XEN_UNLIKELY(!VAL_PAIR_IS_INT(top[-2], top[-1]) ||                                                         \
+                         checked_op(top[-2].as.integer, top[-1].as.integer, &result))) {                               \
+            frame->ip[-1] = generic_op;                                                                                \
+            frame->ip--;                                                                                               \
+            break;                                                                                                     \
+        }                                                                                                              \
+        top[-2] = INT_VAL(result);                                                                                     \
+        g_vm->stack_top--;                                                                                             \
+    } while (XEN_FALSE)
+#define INT_COMPARE(op, generic_op)                                                                                    \
+    do {                                                                                                               \
+        xen_value* top = g_vm->stack_top;                                                                              \
+        if (XEN_UNLIKELY(!VAL_PAIR_IS_INT(top[-2], top[-1]))) {                                                        \
+            frame->ip[-1] = generic_op;                                                                                \
+            frame->ip--;                                                                                               \
+            break;                                                                                                     \
+        }                                                                                                              \
+        top[-2] = BOOL_VAL(top[-2].as.integer op top[-1].as.integer);                                                  \
+        g_vm->stack_top--;                                                                                             \
+    } while (XEN_FALSE)
+// A native that called back into the VM (xen_vm_call) hit a runtime error that has already been reported
+#define CHECK_REENTRY()                                                                                                \
+    do {                                                                                                               \
+        if (XEN_UNLIKELY(g_vm->reentry_failed))                                                                        \
+            return EXEC_RUNTIME_ERROR;                                                                                 \
+    } while (XEN_FALSE)
+// Control is back in the context run() was entered for, by a return or by a fiber switch. While run() executes
+// that context's own code its frame count is always above base_frame.
+#define RETURNED_TO_BASE() (g_vm->frame_count == base_frame && g_vm->fiber == base_fiber)
+// Replaces a native's receiver (or callee) and arguments with its result. The native may have grown the stack by
+// calling back into the VM or requested a fiber switch, so the frame is reloaded afterwards.
+#define NATIVE_RESULT(slot_count, result)                                                                              \
+    do {                                                                                                               \
+        CHECK_REENTRY();                                                                                               \
+        g_vm->stack_top -= (slot_count);                                                                               \
+        stack_push(result);                                                                                            \
+        if (XEN_UNLIKELY(g_vm->switch_pending)) {                                                                      \
+            if (!switch_fiber())                                                                                       \
+                return EXEC_RUNTIME_ERROR;                                                                             \
+            if (RETURNED_TO_BASE())                                                                                    \
+                return EXEC_OK;                                                                                        \
+        }                                                                                                              \
+        frame = &g_vm->frames[g_vm->frame_count - 1];                                                                  \
+    } while (XEN_FALSE)
+// Continue in native code if the current frame's function has been compiled, ahead of time or by the JIT
+#define JIT_ENTER()                                                                                                    \
+    do {                                                                                                               \
+        if (frame->fn->aot != NULL)                                                                                    \
+            frame->fn->aot(frame, &g_vm->stack_top);                                                                   \
+        else if (frame->fn->jit != NULL)                                                                               \
+            xen_jit_enter(frame, &g_vm->stack_top);                                                                    \
+    } while (XEN_FALSE)
 
 //====================================================================================================================//
 
-// This is the core of the entire interpreter
-static xen_exec_result run() {
-    xen_call_frame* frame = &g_vm.frames[g_vm.frame_count - 1];
+// This is the core of the entire interpreter. Returns once `base_fiber` (NULL = the main script) is running again
+// with `base_frame` frames, leaving the result of whatever returned or yielded on the stack. For the script itself
+// that is once everything has finished.
+static xen_exec_result run(xen_obj_fiber* base_fiber, i32 base_frame) {
+    xen_call_frame* frame = &g_vm->frames[g_vm->frame_count - 1];
+    JIT_ENTER();
 
     for (;;) {
         u8 instruction;
         switch (instruction = READ_BYTE()) {
             case OP_RETURN: {
                 xen_value result = stack_pop();
-                g_vm.frame_count--;
+                close_upvalues(frame->slots);
+                g_vm->frame_count--;
+
+                if (g_vm->frame_count == 0 && g_vm->fiber != NULL) {
+                    // the fiber's function returned, its result goes to whoever resumed it
+                    xen_obj_fiber* finished = g_vm->fiber;
+                    finished->state         = FIBER_DONE;
+                    xen_vm_switch_fiber(finished->resumer, result);
+                    switch_fiber();
+                    xen_obj_fiber_release_stack(finished);
+                    if (RETURNED_TO_BASE()) {
+                        return EXEC_OK;
+                    }
+                    frame = &g_vm->frames[g_vm->frame_count - 1];
+                    JIT_ENTER();
+                    break;
+                }
 
-                if (g_vm.frame_count == 0) {
-                    stack_pop();
+                g_vm->stack_top = frame->slots;
+                stack_push(result);
+                if (RETURNED_TO_BASE()) {
                     return EXEC_OK;
                 }
 
-                g_vm.stack_top = frame->slots;
-                stack_push(result);
-                frame = &g_vm.frames[g_vm.frame_count - 1];
+                frame = &g_vm->frames[g_vm->frame_count - 1];
+                JIT_ENTER();
                 break;
             }
             case OP_CONSTANT: {
@@ -231,19 +638,25 @@ static xen_exec_result run() {
                 break;
             }
             case OP_GREATER: {
-                BINARY_OP(BOOL_VAL, >);
+                QUICKEN(OP_GREATER_NUM, OP_GREATER_INT);
+                BINARY_OP(OP_GREATER);
                 break;
             }
             case OP_LESS: {
-                BINARY_OP(BOOL_VAL, <);
+                QUICKEN(OP_LESS_NUM, OP_LESS_INT);
+                BINARY_OP(OP_LESS);
                 break;
             }
             case OP_NEGATE: {
-                if (!VAL_IS_NUMBER(peek(0))) {
+                xen_value operand = peek(0);
+                if (VAL_IS_INT(operand) && VAL_AS_INT(operand) != INT64_MIN) {
+                    g_vm->stack_top[-1] = INT_VAL(-VAL_AS_INT(operand));
+                } else if (VAL_IS_NUMBER(operand)) {
+                    g_vm->stack_top[-1] = NUMBER_VAL(-VAL_AS_NUMBER(operand));
+                } else {
                     runtime_error("operand must be a number");
                     return EXEC_RUNTIME_ERROR;
                 }
-                stack_push(NUMBER_VAL(-VAL_AS_NUMBER(stack_pop())));
                 break;
             }
             case OP_NOT: {
@@ -253,11 +666,11 @@ static xen_exec_result run() {
             case OP_ADD: {
                 if (OBJ_IS_STRING(peek(0)) && OBJ_IS_STRING(peek(1))) {
                     concatenate();
-                } else if (VAL_IS_NUMBER(peek(0)) && VAL_IS_NUMBER(peek(1))) {
-                    const f64 b = VAL_AS_NUMBER(stack_pop());
-                    const f64 a = VAL_AS_NUMBER(stack_pop());
-                    stack_push(NUMBER_VAL(a + b));
-                } else {
+                    break;
+                }
+
+                QUICKEN(OP_ADD_NUM, OP_ADD_INT);
+                if (!numeric_binary(OP_ADD)) {
                     runtime_error("operands must be of matching types");
                     return EXEC_RUNTIME_ERROR;
                 }
@@ -265,26 +678,136 @@ static xen_exec_result run() {
                 break;
             }
             case OP_SUBTRACT: {
-                BINARY_OP(NUMBER_VAL, -);
+                QUICKEN(OP_SUBTRACT_NUM, OP_SUBTRACT_INT);
+                BINARY_OP(OP_SUBTRACT);
                 break;
             }
             case OP_MULTIPLY: {
-                BINARY_OP(NUMBER_VAL, *);
+                QUICKEN(OP_MULTIPLY_NUM, OP_MULTIPLY_INT);
+                BINARY_OP(OP_MULTIPLY);
                 break;
             }
             case OP_DIVIDE: {
-                BINARY_OP(NUMBER_VAL, /);
+                // Division always produces a float, so there is no int-specialized form
+                QUICKEN(OP_DIVIDE_NUM, OP_DIVIDE);
+                BINARY_OP(OP_DIVIDE);
+                break;
+            }
+            case OP_ADD_NUM: {
+                NUMBER_OP(NUMBER_VAL, +, OP_ADD);
+                break;
+            }
+            case OP_SUBTRACT_NUM: {
+                NUMBER_OP(NUMBER_VAL, -, OP_SUBTRACT);
+                break;
+            }
+            case OP_MULTIPLY_NUM: {
+                NUMBER_OP(NUMBER_VAL, *, OP_MULTIPLY);
+                break;
+            }
+            case OP_DIVIDE_NUM: {
+                NUMBER_OP(NUMBER_VAL, /, OP_DIVIDE);
+                break;
+            }
+            case OP_LESS_NUM: {
+                NUMBER_OP(BOOL_VAL, <, OP_LESS);
+                break;
+            }
+            case OP_GREATER_NUM: {
+                NUMBER_OP(BOOL_VAL, >, OP_GREATER);
+                break;
+            }
+            case OP_ADD_INT: {
+                INT_OP(__builtin_add_overflow, OP_ADD);
+                break;
+            }
+            case OP_SUBTRACT_INT: {
+                INT_OP(__builtin_sub_overflow, OP_SUBTRACT);
+                break;
+            }
+            case OP_MULTIPLY_INT: {
+                INT_OP(__builtin_mul_overflow, OP_MULTIPLY);
+                break;
+            }
+            case OP_LESS_INT: {
+                INT_COMPARE(<, OP_LESS);
+                break;
+            }
+            case OP_GREATER_INT: {
+                INT_COMPARE(>, OP_GREATER);
                 break;
             }
             case OP_MOD: {
-                if (!VAL_IS_NUMBER(peek(0)) || !VAL_IS_NUMBER(peek(1))) {
-                    runtime_error("operands must be numbers");
+                BINARY_OP(OP_MOD);
+                break;
+            }
+            case OP_CLOSURE: {
+                xen_obj_func* fn         = OBJ_AS_FUNCTION(READ_CONSTANT());
+                xen_obj_closure* closure = xen_obj_closure_new(fn);
+                const u8 upvalue_count   = READ_BYTE();
+                stack_push(OBJ_VAL(closure));
+
+                for (i32 i = 0; i < upvalue_count; i++) {
+                    const u8 is_local = READ_BYTE();
+                    const u8 index    = READ_BYTE();
+                    if (is_local) {
+                        closure->upvalues[i] = capture_upvalue(frame->slots + index);
+                    } else {
+                        closure->upvalues[i] = frame->closure->upvalues[index];
+                    }
+                }
+                break;
+            }
+            case OP_GET_UPVALUE: {
+                const u8 slot = READ_BYTE();
+                stack_push(*frame->closure->upvalues[slot]->location);
+                break;
+            }
+            case OP_SET_UPVALUE: {
+                const u8 slot                             = READ_BYTE();
+                *frame->closure->upvalues[slot]->location = peek(0);
+                break;
+            }
+            case OP_CLOSE_UPVALUE: {
+                close_upvalues(g_vm->stack_top - 1);
+                stack_pop();
+                break;
+            }
+            case OP_BIT_AND: {
+                BITWISE_OP(&);
+                break;
+            }
+            case OP_BIT_OR: {
+                BITWISE_OP(|);
+                break;
+            }
+            case OP_BIT_XOR: {
+                BITWISE_OP(^);
+                break;
+            }
+            case OP_BIT_NOT: {
+                i64 bits;
+                if (!to_bits(peek(0), &bits)) {
+                    runtime_error("operand must be an integer");
                     return EXEC_RUNTIME_ERROR;
                 }
-
-                f64 b = VAL_AS_NUMBER(stack_pop());
-                f64 a = VAL_AS_NUMBER(stack_pop());
-                stack_push(NUMBER_VAL(fmod(a, b)));
+                g_vm->stack_top[-1] = INT_VAL(~bits);
+                break;
+            }
+            case OP_SHIFT_LEFT:
+            case OP_SHIFT_RIGHT: {
+                i64 bits, count;
+                if (!to_bits(peek(1), &bits) || !to_bits(peek(0), &count)) {
+                    runtime_error("operands must be integers");
+                    return EXEC_RUNTIME_ERROR;
+                }
+                if (count < 0 || count > 63) {
+                    runtime_error("shift count %lld out of range (0..63)", (long long)count);
+                    return EXEC_RUNTIME_ERROR;
+                }
+                const i64 result = instruction == OP_SHIFT_LEFT ? (i64)((u64)bits << count) : bits >> count;
+                g_vm->stack_top[-2] = INT_VAL(result);
+                g_vm->stack_top--;
                 break;
             }
             case OP_POP: {
@@ -308,14 +831,14 @@ static xen_exec_result run() {
             }
             case OP_DEFINE_GLOBAL: {
                 xen_obj_str* name = OBJ_AS_STRING(READ_CONSTANT());
-                xen_table_set(&g_vm.globals, name, peek(0));
+                xen_table_set(&g_vm->globals, name, peek(0));
                 stack_pop();
                 break;
             }
             case OP_GET_GLOBAL: {
                 xen_obj_str* name = OBJ_AS_STRING(READ_CONSTANT());
                 xen_value value;
-                if (!xen_table_get(&g_vm.globals, name, &value)) {
+                if (!xen_table_get(&g_vm->globals, name, &value)) {
                     runtime_error("undefined variable '%s'", name->str);
                     return EXEC_RUNTIME_ERROR;
                 }
@@ -324,8 +847,8 @@ static xen_exec_result run() {
             }
             case OP_SET_GLOBAL: {
                 xen_obj_str* name = OBJ_AS_STRING(READ_CONSTANT());
-                if (xen_table_set(&g_vm.globals, name, peek(0))) {
-                    xen_table_delete(&g_vm.globals, name);
+                if (xen_table_set(&g_vm->globals, name, peek(0))) {
+                    xen_table_delete(&g_vm->globals, name);
                     runtime_error("undefined variable '%s'", name->str);
                     return EXEC_RUNTIME_ERROR;
                 }
@@ -336,7 +859,11 @@ static xen_exec_result run() {
                 if (!call_value(peek(arg_count), arg_count)) {
                     return EXEC_RUNTIME_ERROR;
                 }
-                frame = &g_vm.frames[g_vm.frame_count - 1];
+                if (XEN_UNLIKELY(RETURNED_TO_BASE())) {
+                    return EXEC_OK;
+                }
+                frame = &g_vm->frames[g_vm->frame_count - 1];
+                JIT_ENTER();
                 break;
             }
             case OP_JUMP: {
@@ -354,16 +881,20 @@ static xen_exec_result run() {
             case OP_LOOP: {
                 u16 offset = READ_SHORT();
                 frame->ip -= offset;
+                if (XEN_UNLIKELY(++frame->fn->hotness == g_vm->jit_threshold)) {
+                    xen_jit_compile(frame->fn);
+                }
+                JIT_ENTER();
                 break;
             }
             case OP_INCLUDE: {
                 xen_obj_str* name = OBJ_AS_STRING(READ_CONSTANT());
                 xen_value namespace_val;
-                if (!xen_table_get(&g_vm.namespace_registry, name, &namespace_val)) {
+                if (!xen_table_get(&g_vm->namespace_registry, name, &namespace_val)) {
                     runtime_error("unknown namespace '%s'", name->str);
                     return EXEC_RUNTIME_ERROR;
                 }
-                xen_table_set(&g_vm.globals, name, namespace_val);
+                xen_table_set(&g_vm->globals, name, namespace_val);
                 break;
             }
             case OP_GET_PROPERTY: {
@@ -455,9 +986,9 @@ static xen_exec_result run() {
                 if (method != NULL) {
                     if (is_property) {
                         // It's a property - call immediately with receiver
-                        xen_value receiver = stack_pop();
+                        xen_value receiver = peek(0);
                         xen_value result   = method(1, &receiver);
-                        stack_push(result);
+                        NATIVE_RESULT(1, result);
                     } else {
                         // It's a method - create a bound method
                         xen_value receiver          = stack_pop();
@@ -486,10 +1017,9 @@ static xen_exec_result run() {
                         if (OBJ_IS_NATIVE_FUNC(method)) {
                             // Native method - call directly
                             xen_native_fn native = OBJ_AS_NATIVE_FUNC(method)->function;
-                            xen_value* args      = g_vm.stack_top - arg_count - 1;
+                            xen_value* args      = g_vm->stack_top - arg_count - 1;
                             xen_value result     = native(arg_count + 1, args);
-                            g_vm.stack_top -= arg_count + 1;
-                            stack_push(result);
+                            NATIVE_RESULT(arg_count + 1, result);
                             break;
                         }
 
@@ -497,7 +1027,8 @@ static xen_exec_result run() {
                         if (!call(OBJ_AS_FUNCTION(method), arg_count)) {
                             return EXEC_RUNTIME_ERROR;
                         }
-                        frame = &g_vm.frames[g_vm.frame_count - 1];
+                        frame = &g_vm->frames[g_vm->frame_count - 1];
+                        JIT_ENTER();
                         break;
                     }
 
@@ -510,17 +1041,17 @@ static xen_exec_result run() {
 
                         if (OBJ_IS_NATIVE_FUNC(method)) {
                             xen_native_fn native = OBJ_AS_NATIVE_FUNC(method)->function;
-                            xen_value* args      = g_vm.stack_top - arg_count - 1;
+                            xen_value* args      = g_vm->stack_top - arg_count - 1;
                             xen_value result     = native(arg_count + 1, args);
-                            g_vm.stack_top -= arg_count + 1;
-                            stack_push(result);
+                            NATIVE_RESULT(arg_count + 1, result);
                             break;
                         }
 
                         if (!call(OBJ_AS_FUNCTION(method), arg_count)) {
                             return EXEC_RUNTIME_ERROR;
                         }
-                        frame = &g_vm.frames[g_vm.frame_count - 1];
+                        frame = &g_vm->frames[g_vm->frame_count - 1];
+                        JIT_ENTER();
                         break;
                     }
 
@@ -538,11 +1069,15 @@ static xen_exec_result run() {
                     }
 
                     // replace namespace on stack with the function, then call
-                    g_vm.stack_top[-arg_count - 1] = method_val;
+                    g_vm->stack_top[-arg_count - 1] = method_val;
                     if (!call_value(method_val, arg_count)) {
                         return EXEC_RUNTIME_ERROR;
                     }
-                    frame = &g_vm.frames[g_vm.frame_count - 1];
+                    if (XEN_UNLIKELY(RETURNED_TO_BASE())) {
+                        return EXEC_OK;
+                    }
+                    frame = &g_vm->frames[g_vm->frame_count - 1];
+                    JIT_ENTER();
                     break;
                 }
 
@@ -552,11 +1087,9 @@ static xen_exec_result run() {
 
                 if (method != NULL) {
                     // build args array: [ receiver, arg1, arg2, ... ]
-                    xen_value* args  = g_vm.stack_top - arg_count - 1;
+                    xen_value* args  = g_vm->stack_top - arg_count - 1;
                     xen_value result = method(arg_count + 1, args);  // +1 for receiver
-                    // pop args and receiver, push result
-                    g_vm.stack_top -= arg_count + 1;
-                    stack_push(result);
+                    NATIVE_RESULT(arg_count + 1, result);
                     break;
                 }
 
@@ -584,10 +1117,10 @@ static xen_exec_result run() {
 
                 if (OBJ_IS_ARRAY(array_val)) {
                     xen_obj_array* arr = OBJ_AS_ARRAY(array_val);
-                    stack_push(NUMBER_VAL(arr->array.count));
+                    stack_push(INT_VAL(arr->array.count));
                 } else if (OBJ_IS_U8ARRAY(array_val)) {
                     xen_obj_u8array* arr = OBJ_AS_U8ARRAY(array_val);
-                    stack_push(NUMBER_VAL(arr->count));
+                    stack_push(INT_VAL(arr->count));
                 }
 
                 break;
@@ -622,10 +1155,10 @@ static xen_exec_result run() {
                         return EXEC_RUNTIME_ERROR;
                     }
                     xen_obj_array* arr = OBJ_AS_ARRAY(container);
-                    i32 idx            = (i32)VAL_AS_NUMBER(index);
+                    i64 idx            = VAL_AS_INTEGER(index);
 
                     if (idx < 0 || idx >= arr->array.count) {
-                        runtime_error("array index %d out of bounds (length %d)", idx, arr->array.count);
+                        runtime_error("array index %" PRId64 " out of bounds (length %d)", idx, arr->array.count);
                         return EXEC_RUNTIME_ERROR;
                     }
 
@@ -636,14 +1169,14 @@ static xen_exec_result run() {
                         return EXEC_RUNTIME_ERROR;
                     }
                     xen_obj_u8array* arr = OBJ_AS_U8ARRAY(container);
-                    i32 idx              = (i32)VAL_AS_NUMBER(index);
+                    i64 idx              = VAL_AS_INTEGER(index);
 
                     if (idx < 0 || idx >= arr->count) {
-                        runtime_error("array index %d out of bounds (length %d)", idx, arr->count);
+                        runtime_error("array index %" PRId64 " out of bounds (length %d)", idx, arr->count);
                         return EXEC_RUNTIME_ERROR;
                     }
 
-                    stack_push(NUMBER_VAL(arr->values[idx]));
+                    stack_push(INT_VAL(arr->values[idx]));
                 } else if (OBJ_IS_DICT(container)) {
                     xen_obj_dict* dict = OBJ_AS_DICT(container);
                     xen_value result;
@@ -654,11 +1187,15 @@ static xen_exec_result run() {
                         stack_push(result);
                     }
                 } else if (OBJ_IS_STRING(container)) {
+                    if (!VAL_IS_NUMBER(index)) {
+                        runtime_error("string index must be a number");
+                        return EXEC_RUNTIME_ERROR;
+                    }
                     xen_obj_str* str = OBJ_AS_STRING(container);
-                    i32 idx          = (i32)VAL_AS_NUMBER(index);
+                    i64 idx          = VAL_AS_INTEGER(index);
 
-                    if (idx > str->length - 1) {
-                        runtime_error("character index %d out of bounds (length %d)", idx, str->length - 1);
+                    if (idx < 0 || idx > str->length - 1) {
+                        runtime_error("character index %" PRId64 " out of bounds (length %d)", idx, str->length - 1);
                         return EXEC_RUNTIME_ERROR;
                     }
 
@@ -676,6 +1213,11 @@ static xen_exec_result run() {
                 xen_value index     = stack_pop();
                 xen_value container = stack_pop();
 
+                if (OBJ_IS_FROZEN(container)) {
+                    runtime_error("cannot modify a frozen %s", xen_typeid_str(xen_typeid_get(container)));
+                    return EXEC_RUNTIME_ERROR;
+                }
+
                 if (OBJ_IS_ARRAY(container)) {
                     // array assignment - index must be a number
                     if (!VAL_IS_NUMBER(index)) {
@@ -683,10 +1225,10 @@ static xen_exec_result run() {
                         return EXEC_RUNTIME_ERROR;
                     }
                     xen_obj_array* arr = OBJ_AS_ARRAY(container);
-                    i32 idx            = (i32)VAL_AS_NUMBER(index);
+                    i64 idx            = VAL_AS_INTEGER(index);
 
                     if (idx < 0 || idx >= arr->array.count) {
-                        runtime_error("array index %d out of bounds (length %d)", idx, arr->array.count);
+                        runtime_error("array index %" PRId64 " out of bounds (length %d)", idx, arr->array.count);
                         return EXEC_RUNTIME_ERROR;
                     }
                     arr->array.values[idx] = value;
@@ -697,13 +1239,13 @@ static xen_exec_result run() {
                         return EXEC_RUNTIME_ERROR;
                     }
                     xen_obj_u8array* arr = OBJ_AS_U8ARRAY(container);
-                    i32 idx              = (i32)VAL_AS_NUMBER(index);
+                    i64 idx              = VAL_AS_INTEGER(index);
 
                     if (idx < 0 || idx >= arr->count) {
-                        runtime_error("array index %d out of bounds (length %d)", idx, arr->count);
+                        runtime_error("array index %" PRId64 " out of bounds (length %d)", idx, arr->count);
                         return EXEC_RUNTIME_ERROR;
                     }
-                    arr->values[idx] = (u8)VAL_AS_NUMBER(value);
+                    arr->values[idx] = (u8)VAL_AS_INTEGER(value);
                 } else if (OBJ_IS_DICT(container)) {
                     // dictionary assignment - creates or updates key
                     xen_obj_dict* dict = OBJ_AS_DICT(container);
@@ -779,16 +1321,17 @@ static xen_exec_result run() {
                 xen_obj_instance* instance = xen_obj_instance_new(class);
 
                 // Replace class on stack with instance
-                g_vm.stack_top[-arg_count - 1] = OBJ_VAL(instance);
+                g_vm->stack_top[-arg_count - 1] = OBJ_VAL(instance);
 
                 // Check for native initializer first
                 if (class->native_initializer != NULL) {
                     // Build args array: [instance, arg1, arg2, ...]
-                    xen_value* args  = g_vm.stack_top - arg_count - 1;
+                    xen_value* args  = g_vm->stack_top - arg_count - 1;
                     xen_value result = class->native_initializer(arg_count + 1, args);
 
                     // Pop arguments, keep instance on stack
-                    g_vm.stack_top -= arg_count;
+                    g_vm->stack_top -= arg_count;
+                    frame = &g_vm->frames[g_vm->frame_count - 1];
 
                     if (!OBJ_IS_INSTANCE(result) && !VAL_IS_NULL(result)) {
                         xen_runtime_error("native initializer for class '%s' returned invalid type: %d",
@@ -802,7 +1345,8 @@ static xen_exec_result run() {
                     if (!call(class->initializer, arg_count)) {
                         return EXEC_RUNTIME_ERROR;
                     }
-                    frame = &g_vm.frames[g_vm.frame_count - 1];
+                    frame = &g_vm->frames[g_vm->frame_count - 1];
+                    JIT_ENTER();
                 } else if (arg_count != 0) {
                     runtime_error("expected 0 arguments but got %d", arg_count);
                     return EXEC_RUNTIME_ERROR;
@@ -817,7 +1361,10 @@ static xen_exec_result run() {
                 xen_value inst_val = peek(0);
 
                 if (!OBJ_IS_INSTANCE(inst_val)) {
-                    runtime_error("only instances have properties");
+                    if (OBJ_IS_FROZEN(inst_val))
+                        runtime_error("cannot modify a frozen %s", xen_typeid_str(xen_typeid_get(inst_val)));
+                    else
+                        runtime_error("only instances have properties");
                     return EXEC_RUNTIME_ERROR;
                 }
 
@@ -847,7 +1394,9 @@ static xen_exec_result run() {
                 bool result           = false;
 
                 if (XEN_STREQ(type_name, "Number")) {
-                    result = typeid == TYPEID_NUMBER;
+                    result = typeid == TYPEID_NUMBER || typeid == TYPEID_INT;
+                } else if (XEN_STREQ(type_name, "Int")) {
+                    result = typeid == TYPEID_INT;
                 } else if (XEN_STREQ(type_name, "String")) {
                     result = typeid == TYPEID_STRING;
                 } else if (XEN_STREQ(type_name, "Bool")) {
@@ -890,6 +1439,24 @@ static xen_exec_result run() {
                         const f64 val   = strtod(str, NULL);
                         stack_pop();
                         stack_push(NUMBER_VAL(val));
+                    } else if (typeid == TYPEID_INT) {
+                        stack_pop();
+                        stack_push(NUMBER_VAL((f64)VAL_AS_INT(value)));
+                    }
+
+                    break;
+                } else if (XEN_STREQ(type_name, "Int")) {
+                    if (typeid == TYPEID_BOOL) {
+                        stack_pop();
+                        stack_push(INT_VAL(VAL_AS_BOOL(value)));
+                    } else if (typeid == TYPEID_STRING) {
+                        const char* str = OBJ_AS_CSTRING(value);
+                        const i64 val   = strtoll(str, NULL, 0);
+                        stack_pop();
+                        stack_push(INT_VAL(val));
+                    } else if (typeid == TYPEID_NUMBER) {
+                        stack_pop();
+                        stack_push(INT_VAL(VAL_AS_INTEGER(value)));
                     }
 
                     break;
@@ -912,6 +1479,11 @@ static xen_exec_result run() {
                         }
                         stack_pop();
                         stack_push(OBJ_VAL(xen_obj_str_copy(buffer, strlen(buffer))));
+                    } else if (typeid == TYPEID_INT) {
+                        char buffer[32];
+                        snprintf(buffer, sizeof(buffer), "%" PRId64, VAL_AS_INT(value));
+                        stack_pop();
+                        stack_push(OBJ_VAL(xen_obj_str_copy(buffer, strlen(buffer))));
                     }
 
                     break;
@@ -925,7 +1497,7 @@ static xen_exec_result run() {
                             stack_pop();
                             stack_push(BOOL_VAL(false));
                         }
-                    } else if (typeid == TYPEID_NUMBER) {
+                    } else if (typeid == TYPEID_NUMBER || typeid == TYPEID_INT) {
                         f64 num = VAL_AS_NUMBER(value);
                         if (num == 0) {
                             stack_pop();
@@ -952,8 +1524,17 @@ static xen_exec_result run() {
 //====================================================================================================================//
 
 #undef READ_BYTE
+#undef JIT_ENTER
+#undef CHECK_REENTRY
+#undef RETURNED_TO_BASE
+#undef NATIVE_RESULT
 #undef READ_CONSTANT
 #undef BINARY_OP
+#undef QUICKEN
+#undef INT_OP
+#undef INT_COMPARE
+#undef BITWISE_OP
+#undef NUMBER_OP
 #undef READ_CONSTANT
 #undef READ_STRING
 
@@ -964,199 +1545,14 @@ static xen_exec_result exec(xen_obj_func* fn) {
 
     stack_push(OBJ_VAL(fn));
     call(fn, 0);
+    g_vm->reentry_failed = XEN_FALSE;
 
-    return run();
-}
-
-typedef struct {
-    u8 typeid;
-
-    union {
-        bool b;
-        f64 n;
-
-        struct str {
-            i32 len;
-            char* chars;
-        } str;
-    } as;
-} xen_constant_value;
-
-/*
- * Bytecode Binary Format (.xenb):
- *
- * MAGIC             : 'XENB'    - 4 bytes
- * Version           : u8        - 1 byte
- * Lines             : u32       - 4 bytes
- * Entrypoint Length : u32       - 4 bytes
- * Entrypoint        : <string>  - n bytes
- * Args Count        : u32       - 4 bytes
- * Constants Size    : u32       - 4 bytes
- * Constants Table   : entry[]   - n bytes
- *   Constant Entry
- *     Type          : u8        - 1 byte
- *     Value Length  : u32       - 4 bytes
- *     Value         : <any>     - n bytes
- * Bytecode Size     : u32       - 4 bytes
- * Bytecode          : u8[]      - n bytes
- *
- * ---------------------------------------
- *
- * Constant Entry
- *   Type          : u8        - 1 byte
- *   Value Length  : u32       - 4 bytes
- *   Value         : <any>     - n bytes
- *
- */
-xen_obj_func* xen_decode_bytecode(u8* bytecode, const size_t size) {
-    xen_obj_func* fn = xen_obj_func_new();
-
-    i32 offset    = 0;
-    char magic[5] = {'\0'};
-    memcpy(magic, bytecode, 4);
-    if (strcmp(magic, "XENB") != 0) {
-        fprintf(stderr, "Invalid bytecode format\n");
-        return NULL;
-    }
-    offset += 4;
-
-    u8 version = 0;
-    memcpy(&version, bytecode + offset, sizeof(u8));
-    if (version != 1) {
-        fprintf(stderr, "Incorrect version: %d (expected: 1)\n", (i32)version);
-        return NULL;
-    }
-    offset += sizeof(u8);
-
-    u32 lines;
-    memcpy(&lines, bytecode + offset, sizeof(u32));
-    offset += sizeof(u32);
-
-    u32 entrypoint_length;
-    memcpy(&entrypoint_length, bytecode + offset, sizeof(u32));
-    offset += sizeof(u32);
-
-    char* entrypoint_name = (char*)malloc((entrypoint_length + 1) * sizeof(char));
-    if (!entrypoint_name) {
-        fprintf(stderr, "failed to allocate entrypoint string with length: %d\n", entrypoint_length);
-        return NULL;
-    }
-    memcpy(entrypoint_name, bytecode + offset, entrypoint_length);
-    entrypoint_name[entrypoint_length] = '\0';
-    offset += entrypoint_length;
-
-    u32 args_count;
-    memcpy(&args_count, bytecode + offset, sizeof(u32));
-    offset += sizeof(u32);
-
-    u32 constants_size;
-    memcpy(&constants_size, bytecode + offset, sizeof(u32));
-    offset += sizeof(u32);
-
-    // Read contents table
-    /*
-     * Constant Entry
-     *   Type          : u8        - 1 byte
-     *   Value Length  : u32       - 4 bytes
-     *   Value         : <any>     - n bytes
-     */
-    xen_constant_value* constants = (xen_constant_value*)malloc(constants_size);
-    for (u32 i = 0; i < constants_size; i++) {
-        // track how many bytes we've read for this entry
-        i32 read = 0;
-
-        u8 type;
-        memcpy(&type, bytecode + offset, sizeof(u8));
-        offset += sizeof(u8);
-        read += sizeof(u8);
-
-        u32 value_length;
-        memcpy(&type, bytecode + offset, sizeof(u8));
-        offset += sizeof(u8);
-        read += sizeof(u8);
-
-        switch (type) {
-            case TYPEID_BOOL: {
-                bool val;
-                memcpy(&val, bytecode + offset, sizeof(bool));
-                constants[i].typeid = type;
-                constants[i].as.b   = val;
-                offset += value_length;
-                read += value_length;
-            } break;
-            case TYPEID_NUMBER: {
-                f64 val;
-                memcpy(&val, bytecode + offset, sizeof(f64));
-                constants[i].typeid = type;
-                constants[i].as.n   = val;
-                offset += value_length;
-                read += value_length;
-            } break;
-            case TYPEID_STRING: {
-                u32 len;
-                memcpy(&len, bytecode + offset, sizeof(u32));
-                offset += sizeof(u32);
-                read += sizeof(u32);
-
-                char* val = (char*)malloc(len + 1);
-                memcpy(val, bytecode + offset, len);
-                val[len] = '\0';
-
-                constants[i].typeid       = type;
-                constants[i].as.str.len   = 0;
-                constants[i].as.str.chars = xen_strdup(val);
-                offset += value_length;
-                read += value_length;
-
-                free(val);
-            } break;
-            case TYPEID_NULL: {
-                bool val;
-                memcpy(&val, bytecode + offset, sizeof(bool));
-                constants[i].typeid = type;
-                constants[i].as.b   = val;
-                offset += value_length;
-                read += value_length;
-            } break;
-        }
-
-        // move to next entry
-        offset += read;
+    // the script's own return value is left on the stack like any other, nobody needs it
+    const xen_exec_result result = run(NULL, 0);
+    if (result == EXEC_OK) {
+        stack_pop();
     }
-
-    u32 bytecode_size;
-    memcpy(&bytecode_size, bytecode + offset, sizeof(u32));
-    offset += sizeof(u32);
-
-    u8* bytecode_bytes = NULL;
-    memcpy(bytecode_bytes, bytecode + offset, bytecode_size);
-
-    //  * MAGIC             : 'XENB'    - 4 bytes
-    //  * Version           : u8        - 1 byte
-    //  * Lines             : u32       - 4 bytes
-    //  * Entrypoint Length : u32       - 4 bytes
-    //  * Entrypoint        : <string>  - n bytes
-    //  * Args Count        : u32       - 4 bytes
-    //  * Constants Size    : u32       - 4 bytes
-    //  * Constants Table   : entry[]   - n bytes
-    //  *   Constant Entry
-    //  *     Type          : u8        - 1 byte
-    //  *     Value Length  : u32       - 4 bytes
-    //  *     Value         : <any>     - n bytes
-    //  * Bytecode Size     : u32       - 4 bytes
-    //  * Bytecode          : u8[]      - n bytes
-
-    printf("magic: %s\n", magic);
-    printf("version: %d\n", version);
-    printf("lines: %d\n", lines);
-    printf("entrypoint: %s\n", entrypoint_name);
-    printf("args count: %d\n", args_count);
-    printf("constants count: %d\n", constants_size);
-    printf("bytecode size: %d\n", bytecode_size);
-
-    free(entrypoint_name);
-
-    return fn;
+    return result;
 }
 
 static void create_env_namespace(char** args, i32 argc) {
@@ -1169,10 +1565,10 @@ static void create_env_namespace(char** args, i32 argc) {
     }
 
     xen_obj_namespace_set(env, "args", OBJ_VAL(args_array));
-    xen_obj_namespace_set(env, "argc", NUMBER_VAL(argc));
+    xen_obj_namespace_set(env, "argc", INT_VAL(argc));
 
     xen_obj_str* env_name = xen_obj_str_copy("env", 3);
-    xen_table_set(&g_vm.globals, env_name, OBJ_VAL(env));
+    xen_table_set(&g_vm->globals, env_name, OBJ_VAL(env));
 }
 
 xen_exec_result xen_vm_exec(const char* source, char** args, i32 argc) {
@@ -1184,7 +1580,113 @@ xen_exec_result xen_vm_exec(const char* source, char** args, i32 argc) {
     return exec(fn);
 }
 
-xen_exec_result xen_vm_exec_bytecode(u8* bytecode, const size_t size) {
-    xen_obj_func* fn = xen_decode_bytecode(bytecode, size);
+xen_exec_result xen_vm_exec_file(const char* path, const char* source, char** args, i32 argc) {
+    if (!xen_cache_enabled())
+        return xen_vm_exec(source, args, argc);
+
+    xen_bytecode_image image;
+    if (xen_cache_open(path, source, &image)) {
+        const xen_exec_result result = xen_vm_exec_bytecode(
+          image.data + XEN_CACHE_HEADER_SIZE, image.size - XEN_CACHE_HEADER_SIZE, args, argc);
+        xen_bytecode_image_close(&image);
+        return result;
+    }
+
+    if (args != NULL && argc > 0) {
+        create_env_namespace(args, argc);
+    }
+
+    xen_obj_func* fn = xen_compile(source);
+    if (fn != NULL) {
+        xen_cache_store(path, source, fn);
+    }
+    return exec(fn);
+}
+
+xen_exec_result xen_vm_exec_snapshot(u8* image, size_t size, char** args, i32 argc) {
+    if (args != NULL && argc > 0) {
+        create_env_namespace(args, argc);
+    }
+    if (!xen_snapshot_restore(image, size)) {
+        return EXEC_COMPILE_ERROR;
+    }
+
+    xen_value entry;
+    xen_obj_str* entry_name = xen_obj_str_copy(XEN_SNAPSHOT_ENTRY, (i32)strlen(XEN_SNAPSHOT_ENTRY));
+    if (!xen_table_get(&g_vm->globals, entry_name, &entry) || (!OBJ_IS_FUNCTION(entry) && !OBJ_IS_CLOSURE(entry))) {
+        return EXEC_OK;
+    }
+
+    stack_push(entry);
+    if (!call_value(entry, 0)) {
+        return EXEC_RUNTIME_ERROR;
+    }
+    g_vm->reentry_failed = XEN_FALSE;
+
+    const xen_exec_result result = run(NULL, 0);
+    if (result == EXEC_OK) {
+        stack_pop();
+    }
+    return result;
+}
+
+bool xen_vm_call(xen_value callee, i32 argc, xen_value* argv, xen_value* result) {
+    const i64 base       = g_vm->stack_top - g_vm->stack;  // an offset, the call may grow (and move) a fiber's stack
+    const i32 base_frame = g_vm->frame_count;
+    g_vm->reentry_failed = XEN_FALSE;
+
+    stack_push(callee);
+    for (i32 i = 0; i < argc; i++) {
+        stack_push(argv[i]);
+    }
+
+    // Natives complete inside call_value, script functions push a frame that runs until it returns to base_frame.
+    // A runtime error has already reset the VM, the calling script is aborted as soon as the native returns.
+    g_vm->native_depth++;
+    if (!call_value(callee, argc) || (g_vm->frame_count > base_frame && run(g_vm->fiber, base_frame) != EXEC_OK)) {
+        g_vm->reentry_failed = XEN_TRUE;
+        *result              = NULL_VAL;
+        return XEN_FALSE;
+    }
+    g_vm->native_depth--;
+
+    *result         = stack_pop();
+    g_vm->stack_top = g_vm->stack + base;
+    return XEN_TRUE;
+}
+
+bool xen_vm_resume(xen_obj_fiber* fiber, xen_value value, xen_value* result) {
+    xen_obj_fiber* base_fiber = g_vm->fiber;
+    const i32 base_frame      = g_vm->frame_count;
+    g_vm->reentry_failed      = XEN_FALSE;
+
+    // slot for the value the fiber yields or returns, like the result of a script-level resume() call
+    stack_push(NULL_VAL);
+
+    g_vm->native_depth++;
+    fiber->resumer = base_fiber;
+    xen_vm_switch_fiber(fiber, value);
+    if (!switch_fiber() || run(base_fiber, base_frame) != EXEC_OK) {
+        g_vm->reentry_failed = XEN_TRUE;
+        *result              = NULL_VAL;
+        return XEN_FALSE;
+    }
+    g_vm->native_depth--;
+
+    *result = stack_pop();
+    return XEN_TRUE;
+}
+
+xen_exec_result xen_vm_exec_bytecode(u8* bytecode, size_t size, char** args, i32 argc) {
+    return xen_vm_exec_aot(bytecode, size, NULL, 0, args, argc);
+}
+
+xen_exec_result xen_vm_exec_aot(
+  u8* bytecode, size_t size, const xen_aot_fn* natives, u32 native_count, char** args, i32 argc) {
+    if (args != NULL && argc > 0) {
+        create_env_namespace(args, argc);
+    }
+
+    xen_obj_func* fn = xen_decode_bytecode_aot(bytecode, size, natives, native_count);
     return exec(fn);
 }
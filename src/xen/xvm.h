@@ -7,30 +7,70 @@
 #include "xtable.h"
 #include "xmem.h"
 #include "xchunk.h"
+#include "xfrozen.h"
+#include "object/xobj_function.h"
 
 #define FRAMES_MAX 64  // Maximum stack frames for a function
 #define STACK_MAX (FRAMES_MAX * 256)
 
-typedef struct {
+struct xen_call_frame {
     xen_obj_func* fn;
     u8* ip;
-    array(xen_value) slots;  // Points into VM's value stack
-} xen_call_frame;
+    array(xen_value) slots;    // Points into VM's value stack
+    xen_obj_closure* closure;  // Captured variables, NULL if the function doesn't capture any
+};
+
+// Execution state that belongs to one line of execution: the main script or a fiber. Switching fibers saves the
+// running context into its owner and loads the next one, nothing is copied.
+typedef struct {
+    xen_call_frame* frames;
+    i32 frame_count;
+    i32 frame_capacity;
+    xen_value* stack;
+    xen_value* stack_top;
+    xen_value* stack_end;
+    xen_obj_upvalue* open_upvalues;  // upvalues still pointing into the stack, sorted by slot (highest first)
+    i32 native_depth;                // active xen_vm_call re-entries, a fiber can only yield while this is 0
+} xen_exec_context;
 
 typedef struct {
     xen_vm_mem mem;
 
-    xen_call_frame frames[FRAMES_MAX];
+    // Registers of the running context (see xen_exec_context). They point at main_frames/main_stack while the script
+    // itself runs and at the fiber's own heap-allocated arrays while a fiber runs.
+    xen_call_frame* frames;
     i32 frame_count;
-
-    xen_value stack[STACK_MAX];
+    i32 frame_capacity;
+    xen_value* stack;
     xen_value* stack_top;
+    xen_value* stack_end;
+    xen_obj_upvalue* open_upvalues;
+    i32 native_depth;
+    xen_obj_fiber* fiber;  // running fiber, NULL while the main script runs
+
+    xen_call_frame main_frames[FRAMES_MAX];
+    xen_value main_stack[STACK_MAX];
+    xen_exec_context main_context;  // the script's registers while a fiber runs
+
+    // Fiber switch requested by a native (resume/yield), performed once the native has returned
+    bool switch_pending;
+    xen_obj_fiber* switch_target;  // NULL switches back to the main script
+    xen_value switch_value;
 
     xen_table strings;
     xen_table globals;
     xen_table const_globals;
     xen_table namespace_registry;
     array(xen_obj) objects;
+    xen_buffer_pool buffers;  // scratch buffers for socket reads
+    xen_frozen** frozen;      // regions of frozen values this VM holds a reference to
+    i32 frozen_count;
+    i32 frozen_capacity;
+    xen_bytecode_module* modules;  // .xenb images this VM has loaded, functions are decoded from them on demand
+
+    xen_vm_config config;  // what the VM was created with, also used for the worker VMs it spawns
+    u32 jit_threshold;
+    bool reentry_failed;  // set when a script function called from native code (xen_vm_call) raised an error
 } xen_vm;
 
 typedef enum {
@@ -39,12 +79,60 @@ typedef enum {
     EXEC_RUNTIME_ERROR,
 } xen_exec_result;
 
-extern xen_vm g_vm;
+// The VM of the calling thread. A VM belongs to the thread that created it and a thread runs one VM at a time, so
+// everything that works on "the" VM (natives, object constructors, the compiler) reaches it through this pointer.
+// One VM per thread: xen_vm_new() asserts the thread has none yet, and a host that wants another one on the same
+// thread has to xen_vm_free() the current one first. Threads that need VMs of their own create them on themselves.
+extern XEN_THREAD_LOCAL xen_vm* g_vm;
+
+/// @brief Creates a VM with its own heap, string table and globals and makes it the calling thread's VM. The thread
+/// must not have a VM already.
+xen_vm* xen_vm_new(xen_vm_config config);
+
+/// @brief Releases everything owned by `vm`, which must be the calling thread's VM. The thread has no VM afterwards.
+void xen_vm_free(xen_vm* vm);
 
 void xen_vm_init(xen_vm_config config);
 void xen_vm_shutdown();
 xen_exec_result xen_vm_exec(const char* source, char** args, i32 argc);
-xen_exec_result xen_vm_exec_bytecode(u8* bytecode, const size_t size);
-xen_obj_func* xen_decode_bytecode(u8* bytecode, const size_t size);
+
+/// @brief Runs the script at `path`, whose contents are `source`, through the bytecode cache (see xcache.h): a cached
+/// image compiled from the same source is run instead of compiling it, otherwise the compiled script is cached first.
+xen_exec_result xen_vm_exec_file(const char* path, const char* source, char** args, i32 argc);
+
+/// @brief Runs a script compiled to a .xenb image (see xbytecode.h) without scanning or compiling any source. The
+/// image's code is executed in place, see xen_decode_bytecode.
+xen_exec_result xen_vm_exec_bytecode(u8* bytecode, size_t size, char** args, i32 argc);
+
+/// @brief Runs a .xenb image whose functions were translated to C by `xenc --aot`. `natives` holds the translation of
+/// every function of the image in FUNC order, NULL for those left to the interpreter (see xaot.h).
+xen_exec_result xen_vm_exec_aot(
+  u8* bytecode, size_t size, const xen_aot_fn* natives, u32 native_count, char** args, i32 argc);
+
+/// @brief Restores the globals saved in a snapshot image (see xsnapshot.h) and calls the script's `main` function, if it
+/// defined one. Like a .xenb image, `image` is executed in place and must outlive the run.
+xen_exec_result xen_vm_exec_snapshot(u8* image, size_t size, char** args, i32 argc);
+
+/// @brief The arithmetic and comparison instructions on two numbers (OP_ADD, OP_SUBTRACT, OP_MULTIPLY, OP_DIVIDE, OP_MOD,
+/// OP_LESS, OP_GREATER): two ints stay ints where possible, any other combination is computed in floating point.
+/// @return false, leaving `out` untouched, if either operand isn't a number.
+bool xen_vm_numeric_binary(u8 op, xen_value a, xen_value b, xen_value* out);
+
+/// @brief Calls a script or native function from native code and stores its return value in `result`.
+/// @return false if the call raised a runtime error. The error has already been reported and the native should return
+/// right away; the interpreter aborts the calling script as well.
+bool xen_vm_call(xen_value callee, i32 argc, xen_value* argv, xen_value* result);
+
+/// @brief Suspends the running fiber once the calling native returns, handing `value` to whoever resumed it.
+/// @return false (after reporting the error) outside a fiber or while a native further up has called into the VM.
+bool xen_vm_yield(xen_value value);
+
+/// @brief Runs a new or suspended fiber from native code until it yields or returns, storing that value in `result`.
+/// @return false if the fiber raised a runtime error, with the same contract as xen_vm_call.
+bool xen_vm_resume(xen_obj_fiber* fiber, xen_value value, xen_value* result);
+
+/// @brief Switches to `target` (NULL = the main script) once the calling native returns. `value` becomes the result of
+/// the target's pending resume()/yield() call, or the argument of its function if the fiber hasn't started yet.
+void xen_vm_switch_fiber(xen_obj_fiber* target, xen_value value);
 
 #endif
@@ -3,11 +3,15 @@
 
 #include "xcommon.h"
 
+// Set to the worker index in each process started by `xen --workers N`
+#define XEN_WORKER_ID_ENV "XEN_WORKER_ID"
+
 typedef struct {
     size_t mem_size_permanent;
     size_t mem_size_generation;
     size_t mem_size_temporary;
     size_t stack_size;
+    u32 jit_threshold;  // calls/back-edges before a function is compiled to native code, 0 disables the JIT
 } xen_vm_config;
 
 #endif
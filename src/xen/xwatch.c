@@ -0,0 +1,329 @@
+#include "xwatch.h"
+#include "xcompiler.h"
+#include "xerr.h"
+#include "xscanner.h"
+#include "xutils.h"
+#include "builtin/xbuiltin_net.h"
+
+#ifdef __linux__
+    #include <errno.h>
+    #include <limits.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+//==============================================================//
+//                      Top-level units                         //
+//==============================================================//
+
+static bool opens_block(xen_token_type type) {
+    return type == TOKEN_LEFT_PAREN || type == TOKEN_LEFT_BRACE || type == TOKEN_LEFT_BRACKET;
+}
+
+static bool closes_block(xen_token_type type) {
+    return type == TOKEN_RIGHT_PAREN || type == TOKEN_RIGHT_BRACE || type == TOKEN_RIGHT_BRACKET;
+}
+
+static bool starts_declaration(xen_token_type type) {
+    return type == TOKEN_FN || type == TOKEN_CLASS || type == TOKEN_VAR || type == TOKEN_CONST || type == TOKEN_INCLUDE;
+}
+
+// Splits `source` into its top-level declarations and statements with the scanner alone, no code is generated. A unit
+// ends at a `;` outside any brackets or at the `}` closing a function, class or statement body (taking a `;` right
+// after it, as in `class A {};`), unless an `else` follows. Returns the number of units, -1 if the source doesn't scan,
+// in which case the compiler gets to report it.
+static i32 split_units(const char* source, xen_source_unit** out) {
+    xen_source_unit* units = NULL;
+    i32 count = 0, capacity = 0;
+
+    xen_scanner_init(source);
+    xen_token token = xen_scanner_emit();
+    while (token.type != TOKEN_EOF) {
+        const xen_token first = token;
+        xen_token last        = token;
+        i32 depth             = 0;
+        for (;;) {
+            if (last.type == TOKEN_ERROR) {
+                free(units);
+                return -1;
+            }
+            if (opens_block(last.type))
+                depth++;
+            else if (closes_block(last.type))
+                depth--;
+
+            xen_token next = xen_scanner_emit();
+            const bool ends =
+              depth <= 0 && (last.type == TOKEN_SEMICOLON ||
+                             (last.type == TOKEN_RIGHT_BRACE && first.type != TOKEN_VAR && first.type != TOKEN_CONST));
+            if (ends && next.type == TOKEN_SEMICOLON && last.type == TOKEN_RIGHT_BRACE) {
+                last = next;
+                next = xen_scanner_emit();
+            }
+            if ((ends && next.type != TOKEN_ELSE) || next.type == TOKEN_EOF) {
+                token = next;
+                break;
+            }
+            last = next;
+        }
+
+        if (count == capacity) {
+            capacity = capacity < 16 ? 16 : capacity * 2;
+            units    = realloc(units, capacity * sizeof(xen_source_unit));
+        }
+        xen_source_unit* unit = &units[count++];
+        unit->offset          = (i32)(first.start - source);
+        unit->length          = (i32)(last.start + last.length - first.start);
+        unit->hash            = xen_hash_string(first.start, unit->length);
+        unit->declaration     = starts_declaration(first.type);
+    }
+
+    *out = units;
+    return count;
+}
+
+static bool ran_before(const xen_watch_state* state, const char* source, const xen_source_unit* unit) {
+    for (i32 i = 0; i < state->unit_count; i++) {
+        const xen_source_unit* old = &state->units[i];
+        if (old->declaration && old->hash == unit->hash && old->length == unit->length &&
+            memcmp(state->source + old->offset, source + unit->offset, unit->length) == 0) {
+            return XEN_TRUE;
+        }
+    }
+    return XEN_FALSE;
+}
+
+void xen_watch_state_init(xen_watch_state* state) {
+    state->source     = NULL;
+    state->units      = NULL;
+    state->unit_count = 0;
+}
+
+void xen_watch_state_free(xen_watch_state* state) {
+    free(state->source);
+    free(state->units);
+    xen_watch_state_init(state);
+}
+
+// Copies `source` with the units that don't need to run blanked out: declarations that ran before and, unless
+// `statements` is set, every statement. Blanked rather than cut out, so the lines after them keep their numbers.
+static char* select_units(const xen_watch_state* state, const char* source, const xen_source_unit* units, i32 count,
+                          bool statements, i32* reloaded) {
+    const size_t length = strlen(source);
+    char* selected      = malloc(length + 1);
+    memcpy(selected, source, length + 1);
+    *reloaded = 0;
+
+    for (i32 i = 0; i < count; i++) {
+        const xen_source_unit* unit = &units[i];
+        if (unit->declaration && !ran_before(state, source, unit)) {
+            (*reloaded)++;
+            continue;
+        }
+        if (!unit->declaration && statements)
+            continue;
+        for (i32 c = unit->offset; c < unit->offset + unit->length; c++) {
+            if (selected[c] != '\n')
+                selected[c] = ' ';
+        }
+    }
+    return selected;
+}
+
+static void remember_source(xen_watch_state* state, const char* source, xen_source_unit* units, i32 count) {
+    const size_t length = strlen(source);
+    xen_watch_state_free(state);
+    state->source = malloc(length + 1);
+    memcpy(state->source, source, length + 1);
+    state->units      = units;
+    state->unit_count = count;
+}
+
+xen_exec_result xen_watch_exec(xen_watch_state* state, const char* source, char** args, i32 argc, i32* reloaded) {
+    xen_source_unit* units = NULL;
+    const i32 count        = split_units(source, &units);
+    char* compiled         = select_units(state, source, units, count, XEN_TRUE, reloaded);
+
+    // remembered up front: a script running an event loop only returns once it is stopped, and reloads while it runs
+    // are compared against it
+    xen_watch_state previous = *state;
+    xen_watch_state_init(state);
+    if (count >= 0)
+        remember_source(state, source, units, count);
+
+    const xen_exec_result result = xen_vm_exec(compiled, args, argc);
+    free(compiled);
+
+    if (result != EXEC_OK || count < 0) {
+        // what didn't compile or failed halfway is compared against the last version that ran next time
+        xen_watch_state_free(state);
+        *state = previous;
+        return result;
+    }
+    xen_watch_state_free(&previous);
+    return result;
+}
+
+bool xen_watch_swap(xen_watch_state* state, const char* source, i32* reloaded) {
+    xen_source_unit* units = NULL;
+    const i32 count        = split_units(source, &units);
+    if (count < 0) {
+        // doesn't scan: compiled only for the compiler to report where
+        *reloaded = 0;
+        xen_compile(source);
+        return XEN_TRUE;
+    }
+
+    char* compiled   = select_units(state, source, units, count, XEN_FALSE, reloaded);
+    xen_obj_func* fn = xen_compile(compiled);
+    free(compiled);
+    if (fn == NULL) {
+        // the version that's running stays in place
+        *reloaded = 0;
+        free(units);
+        return XEN_TRUE;
+    }
+
+    xen_value result;
+    if (!xen_vm_call(OBJ_VAL(fn), 0, NULL, &result)) {
+        free(units);
+        return XEN_FALSE;
+    }
+    remember_source(state, source, units, count);
+    return XEN_TRUE;
+}
+
+//==============================================================//
+//                          Watcher                             //
+//==============================================================//
+
+#ifdef __linux__
+// Like xen_read_file, but a script that's missing for a moment while an editor replaces it isn't fatal
+static char* read_source(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return NULL;
+    fseek(fp, 0, SEEK_END);
+    const long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    char* source       = malloc(size + 1);
+    const size_t count = fread(source, 1, size, fp);
+    source[count]      = '\0';
+    fclose(fp);
+    return source;
+}
+
+// Reads one batch of events. Returns 1 if `name` in the watched directory has been written to or replaced, 0 if not,
+// -1 if the watch is gone.
+static i32 read_changes(int fd, const char* name) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const ssize_t length = read(fd, buffer, sizeof(buffer));
+    if (length < 0)
+        return errno == EINTR ? 0 : -1;
+    for (char* p = buffer; p < buffer + length;) {
+        const struct inotify_event* event = (const struct inotify_event*)p;
+        if (event->len > 0 && strcmp(event->name, name) == 0)
+            return 1;
+        p += sizeof(struct inotify_event) + event->len;
+    }
+    return 0;
+}
+
+// Blocks until `name` has changed, false if the watch is gone
+static bool wait_for_change(int fd, const char* name) {
+    for (;;) {
+        const i32 changed = read_changes(fd, name);
+        if (changed != 0)
+            return changed > 0;
+    }
+}
+
+typedef struct {
+    const char* path;
+    const char* name;
+    int fd;
+    xen_watch_state state;
+    char* last;  // last version read, changes that leave the text as it was are ignored
+} xen_watcher;
+
+// Returns the file's text if it differs from the last version read, which it then replaces
+static char* read_if_changed(xen_watcher* watcher) {
+    char* source = read_source(watcher->path);
+    if (source == NULL || (watcher->last != NULL && strcmp(source, watcher->last) == 0)) {
+        free(source);  // gone for the moment, or saved without changes
+        return NULL;
+    }
+    free(watcher->last);
+    watcher->last = source;
+    return source;
+}
+
+static void report_reload(const xen_watcher* watcher, i32 reloaded, const char* how) {
+    fprintf(stderr, "[xen] %s changed, reloaded %d declaration%s%s\n", watcher->name, reloaded,
+            reloaded == 1 ? "" : "s", how);
+}
+
+// Loop hook: the script is running an EventLoop, changed declarations are swapped in between two of its dispatches
+static bool on_loop_change(void* data) {
+    xen_watcher* watcher = data;
+    if (read_changes(watcher->fd, watcher->name) <= 0)
+        return XEN_TRUE;
+    const char* source = read_if_changed(watcher);
+    if (source == NULL)
+        return XEN_TRUE;
+
+    i32 reloaded;
+    const bool ok = xen_watch_swap(&watcher->state, source, &reloaded);
+    if (ok && reloaded > 0)
+        report_reload(watcher, reloaded, " while running");
+    fflush(stdout);
+    return ok;
+}
+#endif
+
+bool xen_watch(const char* path, char** args, i32 argc) {
+#ifdef __linux__
+    // the directory is watched rather than the file: editors often save by renaming a new file over the old one
+    char dir[PATH_MAX];
+    const char* slash = strrchr(path, '/');
+    if (slash != NULL)
+        snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+    else
+        snprintf(dir, sizeof(dir), ".");
+
+    xen_watcher watcher;
+    watcher.path = path;
+    watcher.name = slash != NULL ? slash + 1 : path;
+    watcher.fd   = inotify_init1(IN_CLOEXEC);
+    watcher.last = NULL;
+    if (watcher.fd < 0 || inotify_add_watch(watcher.fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        xen_panic(XEN_ERR_OPEN_FILE, "failed to watch %s: %s", path, strerror(errno));
+    }
+    xen_watch_state_init(&watcher.state);
+    xen_net_set_loop_hook(watcher.fd, on_loop_change, &watcher);
+
+    // a run ends when the script returns (or fails), the next change runs it again, statements included
+    bool first = XEN_TRUE;
+    do {
+        const char* source = read_if_changed(&watcher);
+        if (source == NULL)
+            continue;
+
+        i32 reloaded;
+        const xen_exec_result result = xen_watch_exec(&watcher.state, source, args, argc, &reloaded);
+        if (!first && result != EXEC_COMPILE_ERROR)
+            report_reload(&watcher, reloaded, "");
+        fflush(stdout);
+        first = XEN_FALSE;
+    } while (wait_for_change(watcher.fd, watcher.name));
+
+    xen_net_set_loop_hook(-1, NULL, NULL);
+    free(watcher.last);
+    xen_watch_state_free(&watcher.state);
+    close(watcher.fd);
+    return XEN_TRUE;
+#else
+    return XEN_FALSE;
+#endif
+}
@@ -0,0 +1,56 @@
+#ifndef X_WATCH_H
+#define X_WATCH_H
+
+#include "xcommon.h"
+#include "xvm.h"
+
+/*
+ * Incremental reloading
+ *
+ * `xen --watch script.xen` runs a script and keeps its VM alive, reloading the script each time the file is saved.
+ * Rather than recompiling the whole file, a reload compiles and runs only its top-level declarations (fn, class, var,
+ * const and include) whose text changed since the last run. Changed functions and classes are swapped into the globals
+ * under the same names, so code that looks them up by name picks them up on its next call, while unchanged
+ * declarations keep their values: state built by a previous run (counters, caches, open connections) survives a reload.
+ *
+ * While the script is running a net.EventLoop (a server), the loop polls the watch as well and a save swaps the changed
+ * declarations in between two dispatches, leaving the top-level statements alone since the one running the loop hasn't
+ * returned. Once the script has returned, a save runs it again: the changed declarations together with every top-level
+ * statement, which is what drives the script.
+ *
+ * Declarations are told apart by their source text, comments and the whitespace around them excluded. Skipped ones
+ * are blanked out of the source handed to the compiler, so line numbers in errors stay those of the file.
+ */
+
+typedef struct {
+    i32 offset;  // into xen_watch_state.source
+    i32 length;
+    u32 hash;
+    bool declaration;
+} xen_source_unit;
+
+typedef struct {
+    char* source;  // last version that ran successfully, `units` point into it
+    xen_source_unit* units;
+    i32 unit_count;
+} xen_watch_state;
+
+void xen_watch_state_init(xen_watch_state* state);
+void xen_watch_state_free(xen_watch_state* state);
+
+/// @brief Runs the parts of `source` that changed since the last successful call with the same `state` (all of it on
+/// the first call) in the calling thread's VM. `reloaded` receives the number of declarations that were compiled.
+xen_exec_result xen_watch_exec(xen_watch_state* state, const char* source, char** args, i32 argc, i32* reloaded);
+
+/// @brief Like xen_watch_exec without the top-level statements, for a script that is still running: the changed
+/// declarations of `source` are run through xen_vm_call, from native code the VM is in the middle of. A source that
+/// doesn't compile is reported and leaves the running version in place.
+/// @return false if the declarations raised a runtime error, with the same contract as xen_vm_call.
+bool xen_watch_swap(xen_watch_state* state, const char* source, i32* reloaded);
+
+/// @brief Runs `path` and reloads it whenever the file changes, until the process is interrupted: with xen_watch_swap
+/// while an EventLoop of the script is running, with xen_watch_exec after the script has returned.
+/// Returns XEN_FALSE right away on platforms without a file watcher (only Linux has one, through inotify).
+bool xen_watch(const char* path, char** args, i32 argc);
+
+#endif
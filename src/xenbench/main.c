@@ -0,0 +1,172 @@
+#include "xbench.h"
+
+#ifndef __linux
+    #error "Unsupported platform"
+#endif
+
+#include <inttypes.h>
+#include <time.h>
+
+typedef struct {
+    const char* name;
+    const char* description;
+    i32 (*run)(const xen_bench_options* options);
+} xen_bench_command;
+
+static const xen_bench_command k_commands[] = {
+  {"echo", "round-trips fixed-size payloads through an echo server", xen_bench_echo},
+  {"http", "sends keep-alive GET requests to an HTTP server", xen_bench_http},
+  {"par", "measures how Array.par_map/par_reduce/par_sort scale with threads", xen_bench_par},
+  {"scanner", "measures tokenizer throughput over a generated corpus", xen_bench_scanner},
+};
+
+static void print_usage() {
+    printf("usage: xenbench <command> [options]\n\n");
+    printf("COMMANDS\n");
+    for (size_t i = 0; i < XEN_ARRAY_SIZE(k_commands); i++) {
+        printf("  %-10s %s\n", k_commands[i].name, k_commands[i].description);
+    }
+    printf("\nOPTIONS\n");
+    printf("  --host <addr>          Server address (default 127.0.0.1)\n");
+    printf("  --port <n>             Server port (default 9000)\n");
+    printf("  -c, --connections <n>  Concurrent connections (default 100)\n");
+    printf("  -d, --duration <s>     Test duration in seconds (default 10)\n");
+    printf("  --size <bytes>         Echo payload size (default 64)\n");
+    printf("  --path <path>          HTTP request path (default /)\n");
+    printf("  --xen <path>           Interpreter for par (default: xen next to xenbench)\n");
+    printf("  -t, --threads <n>      Highest thread count for par (default: one per CPU)\n");
+    printf("  --items <n>            Array size for par (default 100000)\n");
+    printf("  --corpus <mb>          Corpus size for scanner (default 32)\n");
+}
+
+u64 xen_bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+void xen_bench_stats_init(xen_bench_stats* stats, u64 capacity) {
+    memset(stats, 0, sizeof(xen_bench_stats));
+    stats->samples         = malloc(sizeof(u64) * capacity);
+    stats->sample_capacity = stats->samples != NULL ? capacity : 0;
+}
+
+void xen_bench_stats_record(xen_bench_stats* stats, u64 latency_ns) {
+    stats->completed++;
+    if (stats->sample_count < stats->sample_capacity) {
+        stats->samples[stats->sample_count++] = latency_ns;
+    }
+}
+
+static int compare_u64(const void* a, const void* b) {
+    const u64 x = *(const u64*)a;
+    const u64 y = *(const u64*)b;
+    return (x > y) - (x < y);
+}
+
+static f64 percentile_us(const xen_bench_stats* stats, f64 p) {
+    if (stats->sample_count == 0)
+        return 0.0;
+    u64 index = (u64)(p * (f64)(stats->sample_count - 1));
+    return (f64)stats->samples[index] / 1000.0;
+}
+
+void xen_bench_stats_report(xen_bench_stats* stats, f64 seconds) {
+    qsort(stats->samples, stats->sample_count, sizeof(u64), compare_u64);
+
+    f64 total_us = 0.0;
+    for (u64 i = 0; i < stats->sample_count; i++) {
+        total_us += (f64)stats->samples[i] / 1000.0;
+    }
+
+    printf("  requests   %" PRIu64 " in %.2fs, %" PRIu64 " errors\n", stats->completed, seconds, stats->errors);
+    printf("  throughput %.0f req/s, %.2f MB/s\n",
+           (f64)stats->completed / seconds,
+           (f64)stats->bytes / seconds / (1024.0 * 1024.0));
+    printf("  latency    avg %.1fus  p50 %.1fus  p90 %.1fus  p99 %.1fus  max %.1fus\n",
+           stats->sample_count > 0 ? total_us / (f64)stats->sample_count : 0.0,
+           percentile_us(stats, 0.50),
+           percentile_us(stats, 0.90),
+           percentile_us(stats, 0.99),
+           percentile_us(stats, 1.0));
+}
+
+void xen_bench_stats_free(xen_bench_stats* stats) {
+    free(stats->samples);
+    stats->samples = NULL;
+}
+
+static bool parse_int_option(const char* name, const char* value, i32* out) {
+    if (value == NULL) {
+        fprintf(stderr, "error: %s requires a value\n", name);
+        return XEN_FALSE;
+    }
+    *out = (i32)strtol(value, NULL, 10);
+    return XEN_TRUE;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || XEN_STREQ(argv[1], "help") || XEN_STREQ(argv[1], "--help")) {
+        print_usage();
+        return argc < 2;
+    }
+
+    xen_bench_options options = {
+      .host        = "127.0.0.1",
+      .port        = 9000,
+      .connections = 100,
+      .duration    = 10,
+      .size        = 64,
+      .path        = "/",
+      .xen         = NULL,
+      .threads     = 0,
+      .items       = 100000,
+      .corpus      = 32,
+    };
+
+    for (i32 i = 2; i < argc; i++) {
+        const char* arg   = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool ok           = XEN_TRUE;
+        if (XEN_STREQ(arg, "--host")) {
+            options.host = value;
+            ok           = value != NULL;
+        } else if (XEN_STREQ(arg, "--port")) {
+            ok = parse_int_option(arg, value, &options.port);
+        } else if (XEN_STREQ(arg, "-c") || XEN_STREQ(arg, "--connections")) {
+            ok = parse_int_option(arg, value, &options.connections);
+        } else if (XEN_STREQ(arg, "-d") || XEN_STREQ(arg, "--duration")) {
+            ok = parse_int_option(arg, value, &options.duration);
+        } else if (XEN_STREQ(arg, "--size")) {
+            ok = parse_int_option(arg, value, &options.size);
+        } else if (XEN_STREQ(arg, "--path")) {
+            options.path = value;
+            ok           = value != NULL;
+        } else if (XEN_STREQ(arg, "--xen")) {
+            options.xen = value;
+            ok          = value != NULL;
+        } else if (XEN_STREQ(arg, "-t") || XEN_STREQ(arg, "--threads")) {
+            ok = parse_int_option(arg, value, &options.threads);
+        } else if (XEN_STREQ(arg, "--items")) {
+            ok = parse_int_option(arg, value, &options.items);
+        } else if (XEN_STREQ(arg, "--corpus")) {
+            ok = parse_int_option(arg, value, &options.corpus);
+        } else {
+            fprintf(stderr, "error: unknown option '%s'\n", arg);
+            return 1;
+        }
+        if (!ok)
+            return 1;
+        i++;
+    }
+
+    for (size_t i = 0; i < XEN_ARRAY_SIZE(k_commands); i++) {
+        if (XEN_STREQ(argv[1], k_commands[i].name)) {
+            return k_commands[i].run(&options);
+        }
+    }
+
+    fprintf(stderr, "error: unknown command '%s'\n", argv[1]);
+    print_usage();
+    return 1;
+}
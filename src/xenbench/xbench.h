@@ -0,0 +1,46 @@
+#ifndef X_BENCH_H
+#define X_BENCH_H
+
+#include "../xen/xcommon.h"
+
+/*
+ * xenbench - load and micro benchmarks for the Xen runtime
+ *
+ * Every benchmark is a subcommand that receives the parsed options and prints its own report. Latencies are
+ * collected as samples so percentiles are exact.
+ */
+
+typedef struct {
+    const char* host;
+    i32 port;
+    i32 connections;
+    i32 duration;  // seconds
+    i32 size;      // payload bytes
+    const char* path;
+    const char* xen;  // interpreter for the par benchmark, NULL for the one next to xenbench
+    i32 threads;      // par: highest thread count, 0 for one per CPU
+    i32 items;        // par: array size
+    i32 corpus;       // scanner: corpus size in MB
+} xen_bench_options;
+
+typedef struct {
+    u64 completed;
+    u64 errors;
+    u64 bytes;
+    array(u64) samples;  // latencies in nanoseconds
+    u64 sample_count;
+    u64 sample_capacity;
+} xen_bench_stats;
+
+u64 xen_bench_now_ns();
+void xen_bench_stats_init(xen_bench_stats* stats, u64 capacity);
+void xen_bench_stats_record(xen_bench_stats* stats, u64 latency_ns);
+void xen_bench_stats_report(xen_bench_stats* stats, f64 seconds);
+void xen_bench_stats_free(xen_bench_stats* stats);
+
+i32 xen_bench_echo(const xen_bench_options* options);
+i32 xen_bench_http(const xen_bench_options* options);
+i32 xen_bench_par(const xen_bench_options* options);
+i32 xen_bench_scanner(const xen_bench_options* options);
+
+#endif
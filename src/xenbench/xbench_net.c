@@ -0,0 +1,274 @@
+#include "xbench.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * Closed-loop network load generator: every connection keeps exactly one request in flight and sends the next one as
+ * soon as the response is complete. All connections are driven by a single epoll loop so the client stays cheap
+ * compared to the server under test.
+ */
+
+#define BENCH_MAX_EVENTS 512
+#define BENCH_READ_SIZE 65536
+#define BENCH_HEAD_MAX 8192
+#define BENCH_SAMPLES_MAX (1 << 24)
+
+typedef enum {
+    BENCH_ECHO,
+    BENCH_HTTP,
+} xen_bench_protocol;
+
+typedef struct {
+    int fd;
+    bool connecting;
+    u64 sent_at;
+    size_t written;   // bytes of the current request sent
+    size_t received;  // bytes of the current response body received
+    size_t expected;  // response body size, SIZE_MAX while the HTTP header is incomplete
+    char head[BENCH_HEAD_MAX];
+    size_t head_len;
+} bench_conn;
+
+typedef struct {
+    xen_bench_protocol protocol;
+    const xen_bench_options* options;
+    struct sockaddr_in address;
+    int epoll_fd;
+    char* request;
+    size_t request_len;
+    bench_conn* conns;
+    xen_bench_stats stats;
+} bench_state;
+
+static bool bench_connect(bench_state* state, bench_conn* conn) {
+    conn->fd         = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    conn->connecting = XEN_TRUE;
+    conn->written    = 0;
+    conn->received   = 0;
+    conn->head_len   = 0;
+    if (conn->fd < 0)
+        return XEN_FALSE;
+
+    int one = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(conn->fd, (struct sockaddr*)&state->address, sizeof(state->address)) < 0 && errno != EINPROGRESS) {
+        close(conn->fd);
+        conn->fd = -1;
+        return XEN_FALSE;
+    }
+
+    struct epoll_event ev = {.events = EPOLLOUT, .data.ptr = conn};
+    return epoll_ctl(state->epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) == 0;
+}
+
+static void bench_reconnect(bench_state* state, bench_conn* conn) {
+    state->stats.errors++;
+    if (conn->fd >= 0)
+        close(conn->fd);
+    if (!bench_connect(state, conn))
+        conn->fd = -1;
+}
+
+static void bench_set_events(bench_state* state, bench_conn* conn, u32 events) {
+    struct epoll_event ev = {.events = events, .data.ptr = conn};
+    epoll_ctl(state->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+// Sends (the rest of) the current request. Returns false on a socket error.
+static bool bench_send(bench_state* state, bench_conn* conn) {
+    if (conn->written == 0) {
+        conn->sent_at  = xen_bench_now_ns();
+        conn->received = 0;
+        conn->head_len = 0;
+        conn->expected = state->protocol == BENCH_ECHO ? state->request_len : SIZE_MAX;
+    }
+
+    while (conn->written < state->request_len) {
+        ssize_t n = write(conn->fd, state->request + conn->written, state->request_len - conn->written);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                bench_set_events(state, conn, EPOLLOUT);
+                return XEN_TRUE;
+            }
+            return XEN_FALSE;
+        }
+        conn->written += (size_t)n;
+    }
+
+    bench_set_events(state, conn, EPOLLIN);
+    return XEN_TRUE;
+}
+
+// Parses the Content-Length of a complete HTTP header, 0 if there is none
+static size_t http_content_length(const char* head, size_t len) {
+    const char* line = head;
+    const char* end  = head + len;
+    while (line < end) {
+        const char* eol = memchr(line, '\n', end - line);
+        if (eol == NULL)
+            break;
+        if ((size_t)(eol - line) > 15 && strncasecmp(line, "Content-Length:", 15) == 0) {
+            return (size_t)strtoull(line + 15, NULL, 10);
+        }
+        line = eol + 1;
+    }
+    return 0;
+}
+
+// Consumes response bytes. Returns true once the whole response has arrived.
+static bool bench_consume(bench_conn* conn, const char* data, size_t len) {
+    if (conn->expected == SIZE_MAX) {
+        // accumulate the header until the blank line, anything after it is body
+        const size_t take = XEN_MIN(len, BENCH_HEAD_MAX - conn->head_len);
+        memcpy(conn->head + conn->head_len, data, take);
+        conn->head_len += take;
+
+        const char* blank = NULL;
+        for (size_t i = 3; i < conn->head_len; i++) {
+            if (memcmp(conn->head + i - 3, "\r\n\r\n", 4) == 0) {
+                blank = conn->head + i + 1;
+                break;
+            }
+        }
+        if (blank == NULL)
+            return XEN_FALSE;
+
+        const size_t head_size = (size_t)(blank - conn->head);
+        conn->expected         = http_content_length(conn->head, head_size);
+        conn->received         = conn->head_len - head_size + (len - take);
+        return conn->received >= conn->expected;
+    }
+
+    conn->received += len;
+    return conn->received >= conn->expected;
+}
+
+static void bench_on_event(bench_state* state, bench_conn* conn, u32 events) {
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        bench_reconnect(state, conn);
+        return;
+    }
+
+    if (conn->connecting) {
+        conn->connecting = XEN_FALSE;
+        conn->written    = 0;
+        if (!bench_send(state, conn))
+            bench_reconnect(state, conn);
+        return;
+    }
+
+    if (events & EPOLLOUT) {
+        if (!bench_send(state, conn))
+            bench_reconnect(state, conn);
+        return;
+    }
+
+    static char buffer[BENCH_READ_SIZE];
+    for (;;) {
+        ssize_t n = read(conn->fd, buffer, sizeof(buffer));
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0) {
+            bench_reconnect(state, conn);
+            return;
+        }
+
+        state->stats.bytes += (u64)n;
+        if (bench_consume(conn, buffer, (size_t)n)) {
+            xen_bench_stats_record(&state->stats, xen_bench_now_ns() - conn->sent_at);
+            conn->written = 0;
+            if (!bench_send(state, conn))
+                bench_reconnect(state, conn);
+            return;
+        }
+    }
+}
+
+static i32 bench_run(xen_bench_protocol protocol, const xen_bench_options* options) {
+    bench_state state;
+    memset(&state, 0, sizeof(state));
+    state.protocol = protocol;
+    state.options  = options;
+
+    state.address.sin_family = AF_INET;
+    state.address.sin_port   = htons((u16)options->port);
+    if (inet_pton(AF_INET, options->host, &state.address.sin_addr) != 1) {
+        fprintf(stderr, "error: invalid host address '%s'\n", options->host);
+        return 1;
+    }
+
+    if (protocol == BENCH_ECHO) {
+        state.request_len = (size_t)XEN_MAX(options->size, 1);
+        state.request     = malloc(state.request_len);
+        for (size_t i = 0; i < state.request_len; i++) {
+            state.request[i] = (char)('a' + i % 26);
+        }
+    } else {
+        char request[1024];
+        const int len = snprintf(request,
+                                 sizeof(request),
+                                 "GET %s HTTP/1.1\r\nHost: %s:%d\r\nConnection: keep-alive\r\n\r\n",
+                                 options->path,
+                                 options->host,
+                                 options->port);
+        state.request_len = (size_t)len;
+        state.request     = strdup(request);
+    }
+
+    state.epoll_fd = epoll_create1(0);
+    state.conns    = calloc((size_t)options->connections, sizeof(bench_conn));
+    xen_bench_stats_init(&state.stats, BENCH_SAMPLES_MAX);
+
+    printf("xenbench %s: %d connections to %s:%d for %ds\n",
+           protocol == BENCH_ECHO ? "echo" : "http",
+           options->connections,
+           options->host,
+           options->port,
+           options->duration);
+
+    for (i32 i = 0; i < options->connections; i++) {
+        if (!bench_connect(&state, &state.conns[i])) {
+            fprintf(stderr, "error: failed to open connection %d: %s\n", i, strerror(errno));
+            state.stats.errors++;
+        }
+    }
+
+    const u64 start    = xen_bench_now_ns();
+    const u64 deadline = start + (u64)options->duration * 1000000000ull;
+    struct epoll_event events[BENCH_MAX_EVENTS];
+    while (xen_bench_now_ns() < deadline) {
+        const int count = epoll_wait(state.epoll_fd, events, BENCH_MAX_EVENTS, 100);
+        for (int i = 0; i < count; i++) {
+            bench_on_event(&state, (bench_conn*)events[i].data.ptr, events[i].events);
+        }
+    }
+    const f64 seconds = (f64)(xen_bench_now_ns() - start) / 1e9;
+
+    xen_bench_stats_report(&state.stats, seconds);
+
+    for (i32 i = 0; i < options->connections; i++) {
+        if (state.conns[i].fd >= 0)
+            close(state.conns[i].fd);
+    }
+    close(state.epoll_fd);
+    xen_bench_stats_free(&state.stats);
+    free(state.conns);
+    free(state.request);
+    return 0;
+}
+
+i32 xen_bench_echo(const xen_bench_options* options) {
+    return bench_run(BENCH_ECHO, options);
+}
+
+i32 xen_bench_http(const xen_bench_options* options) {
+    return bench_run(BENCH_HTTP, options);
+}
@@ -0,0 +1,160 @@
+#include "xbench.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Scaling benchmark for the parallel array methods: runs the same workload through `xen` with 1, 2, 4 ... threads
+ * and reports the speedup over a single thread. Every run is a fresh process, so the time it takes to start up and
+ * build the input array is measured on its own ("setup" runs) and subtracted. Each figure is the best of a few runs.
+ */
+
+#define PAR_RUNS 3
+
+static const char* k_par_script =
+  "// usage: xen <script> setup|map|reduce|sort <workers> <items>\n"
+  "fn work(x) {\n"
+  "    var h = x;\n"
+  "    for (var i = 0; i < 200; i++) {\n"
+  "        h = (h * 31 + i) % 1000003;\n"
+  "    }\n"
+  "    return h;\n"
+  "}\n"
+  "\n"
+  "fn add(a, b) => a + b\n"
+  "\n"
+  "const var op      = env.args[0];\n"
+  "const var workers = Int(env.args[1]);\n"
+  "const var count   = Int(env.args[2]);\n"
+  "var items         = [];\n"
+  "for (var i = 0; i < count; i++) {\n"
+  "    items.push((i * 7919) % 1000003);\n"
+  "}\n"
+  "if (op == \"map\") {\n"
+  "    items.par_map(work, workers);\n"
+  "} else if (op == \"reduce\") {\n"
+  "    items.par_reduce(add, 0, workers);\n"
+  "} else if (op == \"sort\") {\n"
+  "    items.par_sort(workers);\n"
+  "}\n";
+
+typedef struct {
+    const char* op;
+    const char* label;
+    i32 items_scale;  // multiple of --items, cheap operations need more items to be measurable
+} par_workload;
+
+static const par_workload k_workloads[] = {
+  {"map", "par_map", 1},
+  {"reduce", "par_reduce", 10},
+  {"sort", "par_sort", 10},
+};
+
+// The xen binary next to xenbench, unless --xen says otherwise
+static bool find_xen(const xen_bench_options* options, char* out, size_t size) {
+    if (options->xen != NULL) {
+        snprintf(out, size, "%s", options->xen);
+        return XEN_TRUE;
+    }
+    char self[PATH_MAX];
+    const ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (length < 0)
+        return XEN_FALSE;
+    self[length] = '\0';
+    snprintf(out, size, "%s/xen", dirname(self));
+    return access(out, X_OK) == 0;
+}
+
+// Wall time of one `xen script op workers items` run in seconds, or a negative value if it failed
+static f64 run_once(const char* xen, const char* script, const char* op, i32 workers, i32 items) {
+    char workers_arg[16], items_arg[16];
+    snprintf(workers_arg, sizeof(workers_arg), "%d", workers);
+    snprintf(items_arg, sizeof(items_arg), "%d", items);
+
+    const u64 start = xen_bench_now_ns();
+    const pid_t pid = fork();
+    if (pid < 0)
+        return -1.0;
+    if (pid == 0) {
+        const int null = open("/dev/null", O_WRONLY);
+        if (null >= 0)
+            dup2(null, STDOUT_FILENO);
+        execl(xen, xen, script, op, workers_arg, items_arg, (char*)NULL);
+        _exit(127);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return -1.0;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1.0;
+    return (f64)(xen_bench_now_ns() - start) / 1e9;
+}
+
+// 1, 2, 4 ... and finally `max` itself if it isn't a power of two
+static i32 next_thread_count(i32 count, i32 max) {
+    return count < max && count * 2 > max ? max : count * 2;
+}
+
+static f64 run_best(const char* xen, const char* script, const char* op, i32 workers, i32 items) {
+    f64 best = -1.0;
+    for (i32 i = 0; i < PAR_RUNS; i++) {
+        const f64 seconds = run_once(xen, script, op, workers, items);
+        if (seconds < 0.0)
+            return -1.0;
+        if (best < 0.0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+i32 xen_bench_par(const xen_bench_options* options) {
+    char xen[PATH_MAX];
+    if (!find_xen(options, xen, sizeof(xen))) {
+        fprintf(stderr, "error: xen binary not found, pass its path with --xen\n");
+        return 1;
+    }
+
+    char script[] = "/tmp/xenbench-par-XXXXXX.xen";
+    const int fd  = mkstemps(script, 4);
+    if (fd < 0 || write(fd, k_par_script, strlen(k_par_script)) != (ssize_t)strlen(k_par_script)) {
+        fprintf(stderr, "error: failed to write benchmark script: %s\n", strerror(errno));
+        return 1;
+    }
+    close(fd);
+
+    const long cpus   = sysconf(_SC_NPROCESSORS_ONLN);
+    const i32 threads = options->threads > 0 ? options->threads : (cpus > 0 ? (i32)cpus : 1);
+    printf("xenbench par: %s, up to %d threads (%ld CPUs online), best of %d runs\n", xen, threads, cpus, PAR_RUNS);
+
+    i32 result = 0;
+    for (size_t w = 0; w < XEN_ARRAY_SIZE(k_workloads) && result == 0; w++) {
+        const par_workload* workload = &k_workloads[w];
+        const i32 items              = options->items * workload->items_scale;
+        const f64 setup              = run_best(xen, script, "setup", 1, items);
+        printf("\n  %s, %d items\n", workload->label, items);
+
+        f64 baseline = 0.0;
+        for (i32 t = 1; t <= threads; t = next_thread_count(t, threads)) {
+            const f64 total = run_best(xen, script, workload->op, t, items);
+            if (setup < 0.0 || total < 0.0) {
+                fprintf(stderr, "error: %s failed with %d threads\n", workload->label, t);
+                result = 1;
+                break;
+            }
+            const f64 seconds = XEN_MAX(total - setup, 1e-6);
+            if (t == 1)
+                baseline = seconds;
+            printf("    %3d threads  %9.1fms  %5.2fx\n", t, seconds * 1000.0, baseline / seconds);
+        }
+    }
+
+    unlink(script);
+    return result;
+}
@@ -0,0 +1,98 @@
+#include "xbench.h"
+#include "../xen/xscanner.h"
+
+#include <inttypes.h>
+
+/*
+ * Scanner throughput: tokenizes a generated corpus of Xen source and reports MB/s and tokens/s. The corpus mixes the
+ * things the scanner spends its time on in real scripts (indentation, comments, keywords, identifiers, numbers and
+ * string literals), with identifiers varied so keyword matching can't settle into a single path. Each figure is the
+ * best of a few passes over the whole corpus.
+ */
+
+#define SCANNER_RUNS 5
+
+// One chunk of the corpus, %d is replaced by a running number
+static const char* k_scanner_templates[] = {
+  "// Computes the running total for batch %d\n"
+  "fn total_%d(items, scale) {\n"
+  "    var sum = 0;\n"
+  "    for (var i = 0; i < items.len; i++) {\n"
+  "        sum += items[i] * scale; // scaled\n"
+  "    }\n"
+  "    return sum;\n"
+  "}\n\n",
+
+  "class Record%d {\n"
+  "    name  = \"record number %d with a longer description string\";\n"
+  "    count = 0x%X;\n\n"
+  "    init(name) {\n"
+  "        this.name = name;\n"
+  "    }\n\n"
+  "    private fn is_empty() {\n"
+  "        return this.count == 0 or this.name == null;\n"
+  "    }\n"
+  "};\n\n",
+
+  "const var LIMIT_%d = %d.5;\n"
+  "var table_%d      = {\"key\": \"value\", \"other\": [1, 2, 3]};\n"
+  "if (LIMIT_%d >= 10 and !false) {\n"
+  "    io.println(\"over the limit: \", LIMIT_%d);\n"
+  "} else {\n"
+  "    while (true) {\n"
+  "        table_%d[\"key\"] = new Record0(\"x\") is Record0;\n"
+  "    }\n"
+  "}\n\n",
+};
+
+static char* generate_corpus(size_t size, size_t* length_out) {
+    char* corpus  = malloc(size + 1024);
+    size_t length = 0;
+    for (i32 n = 0; length < size; n++) {
+        const char* template = k_scanner_templates[n % XEN_ARRAY_SIZE(k_scanner_templates)];
+        length += (size_t)snprintf(corpus + length, 1024, template, n, n, n, n, n, n);
+    }
+    *length_out = length;
+    return corpus;
+}
+
+i32 xen_bench_scanner(const xen_bench_options* options) {
+    const i32 megabytes = options->corpus > 0 ? options->corpus : 32;
+    size_t length;
+    char* corpus = generate_corpus((size_t)megabytes * 1024 * 1024, &length);
+    printf("xenbench scanner: %.1f MB generated corpus, best of %d runs\n\n", (f64)length / (1024.0 * 1024.0),
+           SCANNER_RUNS);
+
+    f64 best       = -1.0;
+    u64 tokens     = 0;
+    i32 lines      = 0;
+    bool had_error = XEN_FALSE;
+    for (i32 run = 0; run < SCANNER_RUNS; run++) {
+        const u64 start = xen_bench_now_ns();
+        u64 count       = 0;
+        xen_scanner_init(corpus);
+        for (;;) {
+            const xen_token token = xen_scanner_emit();
+            count++;
+            if (token.type == TOKEN_EOF || token.type == TOKEN_ERROR) {
+                had_error = token.type == TOKEN_ERROR;
+                lines     = token.line;
+                break;
+            }
+        }
+        const f64 seconds = (f64)(xen_bench_now_ns() - start) / 1e9;
+        if (best < 0.0 || seconds < best)
+            best = seconds;
+        tokens = count;
+    }
+    free(corpus);
+
+    if (had_error) {
+        fprintf(stderr, "error: the generated corpus didn't scan (line %d)\n", lines);
+        return 1;
+    }
+    printf("  tokens     %" PRIu64 " over %d lines in %.1fms\n", tokens, lines, best * 1000.0);
+    printf("  throughput %.1f MB/s, %.1f M tokens/s\n", (f64)length / best / (1024.0 * 1024.0),
+           (f64)tokens / best / 1e6);
+    return 0;
+}
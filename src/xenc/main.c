@@ -4,6 +4,9 @@
  * The initial goal is to simply wrap pre-exisiting Xen code with the Xen VM
  * and have it run that code by default. This would effectively produce
  * a "native" binary, although its not exactly Xen -> Native machine code.
+ * With --aot the script's functions are translated to C as well, so the
+ * binary runs them as compiled code and only calls into the VM for objects,
+ * calls and everything else the translation leaves to the interpreter.
  *
  * [!] Only intended to work on Linux for now
  *
@@ -14,25 +17,29 @@
 #include "../xen/xutils.h"
 #include "../xen/xvm.h"
 #include "xenb.h"
+#include "transpile.h"
 
 #ifdef __linux
     #include <sys/stat.h>
     #include <sys/types.h>
     #include <errno.h>
+    #include <limits.h>
+    #include <pthread.h>
+    #include <stdatomic.h>
     #include <unistd.h>
 #else
     #error "Unsupported platform"
 #endif
 
-#define MAX_CODE_SIZE XEN_MB(1)
 #define BYTES_PER_LINE 12
 
 /*
  * The general approach is as follows:
  * 1. Accept the source to compile as an argument
  * 2. Compile source to bytecode
- * 2. Generate a simple C runner project and embed bytecode
- * 3. Compile this runner project to produce the final application binary
+ * 3. Translate every function of the bytecode to C (transpile.c)
+ * 4. Generate a simple C runner project that embeds the bytecode and links the translation with the VM
+ * 5. Compile this runner project to produce the final application binary
  */
 
 static bool dir_exists(const char* path) {
@@ -40,87 +47,315 @@ static bool dir_exists(const char* path) {
     return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
 }
 
-static void generate_runner_project(const char* name, const char* source_path) {
+static bool write_bytecode_header(const char* path, const u8* bytecode, size_t bytecode_size) {
+    FILE* output = fopen(path, "w");
+    if (!output) {
+        perror("Failed to open output file");
+        return XEN_FALSE;
+    }
+
+    // Write header
+    fprintf(output, "#ifndef BYTECODE_H\n");
+    fprintf(output, "#define BYTECODE_H\n\n");
+    fprintf(output, "#include <stdint.h>\n\n");
+    fprintf(output, "#define BYTECODE_SIZE %ld\n", bytecode_size);
+    // not const: the interpreter runs the code in place and quickens it. Aligned like a mapped .xenb file, whose CODE
+    // section starts on a page boundary.
+    fprintf(output, "__attribute__((aligned(4096))) uint8_t k_bytecode[BYTECODE_SIZE] = {\n");
+
+    // Write bytecode array, a line at a time: "0xAB, " for every byte from a lookup table instead of a fprintf per byte
+    static const char k_hex[] = "0123456789ABCDEF";
+    char line[4 + BYTES_PER_LINE * 6];
+    for (size_t i = 0; i < bytecode_size; i += BYTES_PER_LINE) {
+        const size_t count = bytecode_size - i < BYTES_PER_LINE ? bytecode_size - i : BYTES_PER_LINE;
+        char* c            = line;
+        memcpy(c, "    ", 4);
+        c += 4;
+        for (size_t j = 0; j < count; j++) {
+            const u8 byte = bytecode[i + j];
+            c[0]          = '0';
+            c[1]          = 'x';
+            c[2]          = k_hex[byte >> 4];
+            c[3]          = k_hex[byte & 0xF];
+            c[4]          = ',';
+            c[5]          = ' ';
+            c += 6;
+        }
+        // the last byte of the array has no comma, every other line ends in one
+        c -= i + count == bytecode_size ? 2 : 1;
+        *c++ = '\n';
+        fwrite(line, 1, (size_t)(c - line), output);
+    }
+
+    fprintf(output, "};\n\n");
+    fprintf(output, "#endif // BYTECODE_H\n");
+
+    return fclose(output) == 0;
+}
+
+static bool write_runner(const char* path) {
+    FILE* output = fopen(path, "w");
+    if (!output) {
+        perror("Failed to open output file");
+        return XEN_FALSE;
+    }
+
+    fprintf(output, "// Generated by xenc --aot\n\n");
+    fprintf(output, "#include \"xvm.h\"\n");
+    fprintf(output, "#include \"bytecode.h\"\n\n");
+    fprintf(output, "extern const u32 k_aot_function_count;\n");
+    fprintf(output, "extern const xen_aot_fn k_aot_functions[];\n\n");
+    fprintf(output, "int main(int argc, char* argv[]) {\n");
+    fprintf(output, "    xen_vm_config config;\n");
+    fprintf(output, "    config.mem_size_permanent  = XEN_MB(64);\n");
+    fprintf(output, "    config.mem_size_generation = XEN_MB(64);\n");
+    fprintf(output, "    config.mem_size_temporary  = XEN_MB(4);\n");
+    fprintf(output, "    config.stack_size          = XEN_KB(1);\n");
+    fprintf(output, "    config.jit_threshold       = 0;\n");
+    fprintf(output, "    xen_vm_init(config);\n\n");
+    fprintf(output, "    const xen_exec_result result = xen_vm_exec_aot(\n");
+    fprintf(output, "      k_bytecode, BYTECODE_SIZE, k_aot_functions, k_aot_function_count, argv + 1, argc - 1);\n");
+    fprintf(output, "    xen_vm_shutdown();\n");
+    fprintf(output, "    return result == EXEC_OK ? 0 : 1;\n");
+    fprintf(output, "}\n");
+
+    return fclose(output) == 0;
+}
+
+static bool write_makefile(const char* path, const char* name) {
+    FILE* output = fopen(path, "w");
+    if (!output) {
+        perror("Failed to open output file");
+        return XEN_FALSE;
+    }
+
+    fprintf(output, "# Generated by xenc --aot\n\n");
+    fprintf(output, "XEN_SRC ?= %s\n", XEN_SOURCE_DIR);
+    fprintf(output, "CFLAGS ?= -O2\n\n");
+    fprintf(output, "SOURCES = runner.c aot.c \\\n");
+    fprintf(output, "          $(filter-out $(XEN_SRC)/xen/main.c, $(wildcard $(XEN_SRC)/xen/*.c)) \\\n");
+    fprintf(output, "          $(wildcard $(XEN_SRC)/xen/builtin/*.c) \\\n");
+    fprintf(output, "          $(wildcard $(XEN_SRC)/xen/object/*.c)\n\n");
+    fprintf(output, "%s: $(SOURCES) bytecode.h\n", name);
+    fprintf(output,
+            "\t$(CC) -w -std=gnu11 -D_DEFAULT_SOURCE -DNDEBUG $(CFLAGS) -I$(XEN_SRC)/xen -I$(XEN_SRC)/xen/builtin \\\n");
+    fprintf(output, "\t  -o $@ $(SOURCES) -lpthread -lm -ldl\n");
+
+    return fclose(output) == 0;
+}
+
+// Builds `name` from the script at `source_path` in the runner project `name`-build and moves it to `output_path`
+static bool generate_runner_project(const char* name, const char* source_path, const char* output_path) {
     // Needed files:
     // - runner_dir
     //   - Makefile
     //   - runner.c
     //   - bytecode.h (compiled bytecode)
+    //   - aot.c (bytecode translated to C)
     //
     // Compile this generated project for the final executable
 
     char project_name[256] = {'\0'};
     snprintf(project_name, 256, "%s-build", name);
 
-    // Create runner project directory
-    if (!dir_exists(project_name)) {
-        if (mkdir(project_name, 0755) == -1) {
-            fprintf(stderr, "error: failed to create project directory\n");
-            return;
-        }
-    } else {
-        if (rmdir(project_name) == -1) {
-            fprintf(stderr, "error: failed to remove existing project directory\n");
-            return;
-        }
-        if (mkdir(project_name, 0755) == -1) {
-            fprintf(stderr, "error: failed to create project directory\n");
-            return;
-        }
+    // Create runner project directory, an existing one is regenerated in place
+    if (!dir_exists(project_name) && mkdir(project_name, 0755) == -1) {
+        fprintf(stderr, "error: failed to create project directory\n");
+        return XEN_FALSE;
     }
 
     char makefile_path[256] = {'\0'};
     char runner_path[256]   = {'\0'};
     char bytecode_path[256] = {'\0'};
+    char aot_path[256]      = {'\0'};
+    char binary_path[512]   = {'\0'};
     snprintf(makefile_path, 256, "%s/Makefile", project_name);
     snprintf(runner_path, 256, "%s/runner.c", project_name);
     snprintf(bytecode_path, 256, "%s/bytecode.h", project_name);
+    snprintf(aot_path, 256, "%s/aot.c", project_name);
+    snprintf(binary_path, 512, "%s/%s", project_name, name);
 
     size_t bytecode_size;
-    u8 bytecode[MAX_CODE_SIZE];
-    xenb_compile(source_path, bytecode, &bytecode_size);
+    u8* bytecode = xenb_compile(source_path, &bytecode_size);
+    if (!bytecode) {
+        fprintf(stderr, "error: failed to compile %s\n", source_path);
+        return XEN_FALSE;
+    }
 
     // Convert bytecode into C header file
-    FILE* output = fopen(bytecode_path, "w");
-    if (!output) {
+    if (!write_bytecode_header(bytecode_path, bytecode, bytecode_size)) {
+        free(bytecode);
+        return XEN_FALSE;
+    }
+
+    FILE* aot = fopen(aot_path, "w");
+    if (!aot) {
         perror("Failed to open output file");
-        return;
+        free(bytecode);
+        return XEN_FALSE;
+    }
+    const i32 translated = xenc_transpile(bytecode, bytecode_size, aot);
+    const bool aot_ok    = fclose(aot) == 0 && translated >= 0;
+    free(bytecode);
+    if (!aot_ok) {
+        fprintf(stderr, "error: failed to translate %s\n", source_path);
+        return XEN_FALSE;
     }
 
-    // Write header
-    fprintf(output, "#ifndef BYTECODE_H\n");
-    fprintf(output, "#define BYTECODE_H\n\n");
-    fprintf(output, "#include <stdint.h>\n\n");
-    fprintf(output, "#define BYTECODE_SIZE %ld\n", bytecode_size);
-    fprintf(output, "const uint8_t k_bytecode[BYTECODE_SIZE] = {\n");
+    if (!write_runner(runner_path) || !write_makefile(makefile_path, name)) {
+        return XEN_FALSE;
+    }
 
-    // Write bytecode array
-    for (size_t i = 0; i < bytecode_size; i++) {
-        if (i % BYTES_PER_LINE == 0) {
-            fprintf(output, "    ");
-        }
+    char command[512] = {'\0'};
+    snprintf(command, 512, "make -C '%s'", project_name);
+    if (system(command) != 0) {
+        fprintf(stderr, "error: failed to build %s\n", project_name);
+        return XEN_FALSE;
+    }
+    if (rename(binary_path, output_path) != 0) {
+        fprintf(stderr, "error: failed to write %s\n", output_path);
+        return XEN_FALSE;
+    }
+    return XEN_TRUE;
+}
+
+// script.xen -> script.xenb (or script, with an empty extension)
+static void default_output_path(const char* source_path, const char* extension, char* out, size_t size) {
+    const char* ext   = strrchr(source_path, '.');
+    const char* slash = strrchr(source_path, '/');
+    const size_t stem = ext != NULL && (slash == NULL || ext > slash) ? (size_t)(ext - source_path) : strlen(source_path);
+    snprintf(out, size, "%.*s%s", (int)stem, source_path, extension);
+}
+
+// Compiles `source_path` to a .xenb image in `output_path`, in the calling thread's VM
+static bool compile_script(const char* source_path, const char* output_path) {
+    // the image is streamed to the output file as it's encoded
+    FILE* output = fopen(output_path, "wb");
+    if (!output) {
+        fprintf(stderr, "error: failed to write %s\n", output_path);
+        return XEN_FALSE;
+    }
+    xen_bin_writer w;
+    xen_bin_writer_init_stream(&w, output, XEN_KB(64));
+    const bool compiled = xenb_compile_to(source_path, &w);
+    const bool written  = compiled && xen_bin_writer_flush(&w);
+    xen_bin_writer_free(&w);
+    const bool closed = fclose(output) == 0;
+
+    if (!compiled) {
+        fprintf(stderr, "error: failed to compile %s\n", source_path);
+        remove(output_path);
+        return XEN_FALSE;
+    }
+    if (!written || !closed) {
+        fprintf(stderr, "error: failed to write %s\n", output_path);
+        return XEN_FALSE;
+    }
+    return XEN_TRUE;
+}
+
+//==============================================================//
+//                    Parallel compilation                      //
+//==============================================================//
+
+// Several scripts are independent of each other, so they are compiled on a pool of threads. The scanner and
+// compiler keep their state per thread and every worker runs its own VM (strings, heap), so workers share nothing
+// but the index of the next script to take.
+typedef struct {
+    char** sources;
+    i32 count;
+    const char* output_path;  // only for a single script, the others go next to their source
+    xen_vm_config config;
+    atomic_int next;
+    atomic_bool failed;
+} compile_job;
 
-        fprintf(output, "0x%02X", bytecode[i]);
+static void* compile_worker(void* arg) {
+    compile_job* job = arg;
+    xen_vm* vm       = xen_vm_new(job->config);
 
-        if (i < (size_t)bytecode_size - 1) {
-            fprintf(output, ",");
-            if ((i + 1) % BYTES_PER_LINE == 0) {
-                fprintf(output, "\n");
-            } else {
-                fprintf(output, " ");
-            }
+    for (i32 i = atomic_fetch_add(&job->next, 1); i < job->count; i = atomic_fetch_add(&job->next, 1)) {
+        const char* source_path = job->sources[i];
+        char default_output[PATH_MAX];
+        const char* output_path = job->output_path;
+        if (output_path == NULL) {
+            default_output_path(source_path, ".xenb", default_output, sizeof(default_output));
+            output_path = default_output;
         }
+
+        // holding stderr keeps a script's compile errors together when several fail at once
+        flockfile(stderr);
+        const bool compiled = compile_script(source_path, output_path);
+        funlockfile(stderr);
+        if (!compiled)
+            atomic_store(&job->failed, XEN_TRUE);
     }
 
-    fprintf(output, "\n};\n\n");
-    fprintf(output, "#endif // BYTECODE_H\n");
+    xen_vm_free(vm);
+    return NULL;
+}
+
+// Compiles every script with up to `jobs` threads, the calling one included
+static bool compile_scripts(compile_job* job, i32 jobs) {
+    if (jobs > job->count)
+        jobs = job->count;
 
-    fclose(output);
+    pthread_t threads[jobs];
+    i32 started = 0;
+    for (i32 i = 1; i < jobs; i++) {
+        if (pthread_create(&threads[started], NULL, compile_worker, job) == 0)
+            started++;
+    }
+    compile_worker(job);
+    for (i32 i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return !atomic_load(&job->failed);
+}
+
+static void print_usage() {
+    printf("usage: xenc <script.xen>... [-o <output.xenb>] [-j <jobs>]\n");
+    printf("       xenc --aot <script.xen> [-o <binary>]\n\n");
+    printf("Compiles scripts to bytecode that `xen` runs without recompiling them, each to a .xenb file next to it\n");
+    printf("(or to -o, given a single script). Several scripts are compiled in parallel on -j threads, one per CPU\n");
+    printf("by default.\n\n");
+    printf("With --aot, every function is translated to C instead and built into a standalone binary together with\n");
+    printf("the VM, in a runner project created in <script>-build. Needs make and a C compiler.\n");
 }
 
 int main(i32 argc, char* argv[]) {
-    if (argc != 2) {
+    char** sources          = malloc(argc * sizeof(char*));
+    i32 source_count        = 0;
+    const char* output_path = NULL;
+    bool aot                = XEN_FALSE;
+    i32 jobs                = (i32)sysconf(_SC_NPROCESSORS_ONLN);
+    for (i32 i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--aot") == 0) {
+            aot = XEN_TRUE;
+        } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            print_usage();
+            free(sources);
+            return 0;
+        } else if (argv[i][0] != '-') {
+            sources[source_count++] = argv[i];
+        } else {
+            print_usage();
+            free(sources);
+            return 1;
+        }
+    }
+    if (source_count == 0) {
         fprintf(stderr, "error: no input file provided\n");
+        free(sources);
+        return 1;
+    }
+    if (source_count > 1 && (aot || output_path != NULL)) {
+        fprintf(stderr, "error: %s takes a single input file\n", aot ? "--aot" : "-o");
+        free(sources);
         return 1;
     }
 
@@ -129,24 +364,39 @@ int main(i32 argc, char* argv[]) {
     config.mem_size_generation = XEN_MB(64);
     config.mem_size_temporary  = XEN_MB(4);
     config.stack_size          = XEN_KB(1);
+    config.jit_threshold       = 0;
 
-    xen_vm_init(config);
+    if (!aot) {
+        compile_job job;
+        job.sources     = sources;
+        job.count       = source_count;
+        job.output_path = output_path;
+        job.config      = config;
+        atomic_init(&job.next, 0);
+        atomic_init(&job.failed, XEN_FALSE);
 
-    const char* source_path = argv[1];
+        const bool compiled = compile_scripts(&job, jobs > 0 ? jobs : 1);
+        free(sources);
+        return compiled ? 0 : 1;
+    }
 
-    size_t bytecode_size;
-    u8 bytecode[MAX_CODE_SIZE];
-    xenb_compile(source_path, bytecode, &bytecode_size);
+    const char* source_path = sources[0];
+    free(sources);
 
-    xen_obj_func* decoded = xen_decode_bytecode(bytecode, bytecode_size);
+    char default_output[PATH_MAX];
+    if (output_path == NULL) {
+        default_output_path(source_path, "", default_output, sizeof(default_output));
+        output_path = default_output;
+    }
 
-    // printf("Compiling: %s\n", source_path);
+    xen_vm_init(config);
 
-    // // Generate C runner project
-    // const char* project_name = "test";
-    // generate_runner_project(project_name, source_path);
+    // the project and the binary are named after the script
+    const char* slash = strrchr(source_path, '/');
+    char name[256];
+    default_output_path(slash != NULL ? slash + 1 : source_path, "", name, sizeof(name));
 
+    const bool built = generate_runner_project(name, source_path, output_path);
     xen_vm_shutdown();
-
-    return 0;
-}
\ No newline at end of file
+    return built ? 0 : 1;
+}
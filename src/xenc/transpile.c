@@ -0,0 +1,526 @@
+#include "transpile.h"
+
+#include "../xen/xbytecode.h"
+#include "../xen/xchunk.h"
+#include "../xen/xvm.h"
+#include "../xen/object/xobj_function.h"
+#include "../xen/object/xobj_string.h"
+
+#define MAX_DEPTH 256  // stack slots a translated function may use, each one becomes a C local
+#define NO_DEPTH (-1)
+#define LOCALS_PER_LINE 12
+
+// What has to be known about a function before it can be translated: the stack depth at every instruction, which the
+// compiler keeps the same along every path that reaches it
+typedef struct {
+    const xen_chunk* chunk;
+    array(i32) depth;  // values on the frame's stack before each instruction, NO_DEPTH if unreached or mid-instruction
+    array(bool) label;  // jumped to or entered from the interpreter
+    array(bool) entry;  // the interpreter continues in native code here (function start, after calls, loop heads)
+    array(u32) pending;
+    u32 pending_count;
+    i32 max_depth;
+    i32 max_exit_depth;
+} fn_layout;
+
+static u16 jump_operand(const u8* ip) {
+    return (u16)((ip[1] << 8) | ip[2]);
+}
+
+#define EFFECT(taken, pushed)                                                                                          \
+    do {                                                                                                               \
+        *pops   = (taken);                                                                                             \
+        *pushes = (pushed);                                                                                            \
+        return XEN_TRUE;                                                                                               \
+    } while (XEN_FALSE)
+
+// Values an instruction takes off the stack and leaves on it. Instructions that only look at or replace the top value
+// count as taking it and pushing it back, so the depth they need is checked too.
+static bool stack_effect(const u8* ip, i32* pops, i32* pushes) {
+    switch (ip[0]) {
+        case OP_CONSTANT:
+        case OP_NULL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_GET_LOCAL:
+        case OP_GET_GLOBAL:
+        case OP_GET_UPVALUE:
+        case OP_DICT_NEW:
+        case OP_CLASS:
+        case OP_CLOSURE:
+            EFFECT(0, 1);
+        case OP_JUMP:
+        case OP_LOOP:
+        case OP_INCLUDE:
+            EFFECT(0, 0);
+        case OP_NOT:
+        case OP_NEGATE:
+        case OP_BIT_NOT:
+        case OP_SET_LOCAL:
+        case OP_SET_GLOBAL:
+        case OP_SET_UPVALUE:
+        case OP_JUMP_IF_FALSE:
+        case OP_GET_PROPERTY:
+        case OP_ARRAY_LEN:
+        case OP_IS_TYPE:
+        case OP_CAST:
+            EFFECT(1, 1);
+        case OP_POP:
+        case OP_PRINT:
+        case OP_DEFINE_GLOBAL:
+        case OP_CLOSE_UPVALUE:
+        case OP_RETURN:
+            EFFECT(1, 0);
+        case OP_EQUAL:
+        case OP_GREATER:
+        case OP_LESS:
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_MOD:
+        case OP_BIT_AND:
+        case OP_BIT_OR:
+        case OP_BIT_XOR:
+        case OP_SHIFT_LEFT:
+        case OP_SHIFT_RIGHT:
+        case OP_INDEX_GET:
+        case OP_SET_PROPERTY:
+        case OP_METHOD:
+        case OP_PROPERTY:
+        case OP_INITIALIZER:
+        case OP_ADD_NUM:
+        case OP_SUBTRACT_NUM:
+        case OP_MULTIPLY_NUM:
+        case OP_DIVIDE_NUM:
+        case OP_LESS_NUM:
+        case OP_GREATER_NUM:
+        case OP_ADD_INT:
+        case OP_SUBTRACT_INT:
+        case OP_MULTIPLY_INT:
+        case OP_LESS_INT:
+        case OP_GREATER_INT:
+            EFFECT(2, 1);
+        case OP_INDEX_SET:
+        case OP_DICT_ADD:
+            EFFECT(3, 1);
+        case OP_CALL:
+        case OP_CALL_INIT:
+            EFFECT(ip[1] + 1, 1);
+        case OP_INVOKE:
+            EFFECT(ip[2] + 1, 1);
+        case OP_ARRAY_NEW:
+            EFFECT(ip[1], 1);
+        default:
+            return XEN_FALSE;
+    }
+}
+
+#undef EFFECT
+
+//=====================================================================================================================//
+//  Analysis                                                                                                           //
+//=====================================================================================================================//
+
+static bool reach(fn_layout* layout, const bool* starts, u64 offset, i32 depth) {
+    if (offset >= layout->chunk->count || !starts[offset])
+        return XEN_FALSE;
+    if (layout->depth[offset] == NO_DEPTH) {
+        layout->depth[offset]                    = depth;
+        layout->pending[layout->pending_count++] = (u32)offset;
+        return XEN_TRUE;
+    }
+    return layout->depth[offset] == depth;
+}
+
+static bool analyze(const xen_obj_func* fn, fn_layout* layout) {
+    const xen_chunk* chunk = &fn->chunk;
+    const u64 count        = chunk->count;
+    bool ok                = count > 0 && fn->arity + 1 <= MAX_DEPTH;
+
+    array(bool) starts = calloc(count, sizeof(bool));
+    for (u64 offset = 0; ok && offset < count; offset += xen_chunk_instruction_size(chunk, offset)) {
+        starts[offset] = XEN_TRUE;
+        ok             = offset + xen_chunk_instruction_size(chunk, offset) <= count;
+    }
+
+    ok = ok && reach(layout, starts, 0, fn->arity + 1);  // the callee (or receiver) and its arguments
+    layout->entry[0] = layout->label[0] = XEN_TRUE;
+    layout->max_depth                   = fn->arity + 1;
+
+    while (ok && layout->pending_count > 0) {
+        const u32 offset = layout->pending[--layout->pending_count];
+        const u8* ip     = chunk->code + offset;
+        const i32 depth  = layout->depth[offset];
+        i32 pops, pushes;
+        if (!stack_effect(ip, &pops, &pushes) || depth < pops) {
+            ok = XEN_FALSE;
+            break;
+        }
+        if ((ip[0] == OP_GET_LOCAL || ip[0] == OP_SET_LOCAL) && ip[1] >= depth) {
+            ok = XEN_FALSE;
+            break;
+        }
+
+        const i32 after = depth - pops + pushes;
+        const u64 next  = offset + xen_chunk_instruction_size(chunk, offset);
+        if (after >= MAX_DEPTH) {
+            ok = XEN_FALSE;
+            break;
+        }
+        if (after > layout->max_depth)
+            layout->max_depth = after;
+
+        switch (ip[0]) {
+            case OP_RETURN:
+                break;
+            case OP_JUMP: {
+                const u64 target = next + jump_operand(ip);
+                ok               = reach(layout, starts, target, after);
+                if (ok)
+                    layout->label[target] = XEN_TRUE;
+                break;
+            }
+            case OP_LOOP: {
+                const u64 target = next - jump_operand(ip);
+                ok               = jump_operand(ip) <= next && reach(layout, starts, target, after);
+                if (ok)
+                    layout->label[target] = layout->entry[target] = XEN_TRUE;
+                break;
+            }
+            case OP_JUMP_IF_FALSE: {
+                const u64 target = next + jump_operand(ip);
+                ok               = reach(layout, starts, target, after) && reach(layout, starts, next, after);
+                if (ok)
+                    layout->label[target] = XEN_TRUE;
+                break;
+            }
+            case OP_CALL:
+            case OP_INVOKE:
+            case OP_CALL_INIT:
+                ok = reach(layout, starts, next, after);
+                if (ok)
+                    layout->label[next] = layout->entry[next] = XEN_TRUE;
+                break;
+            default:
+                ok = reach(layout, starts, next, after);
+                break;
+        }
+    }
+
+    free(starts);
+    return ok;
+}
+
+//=====================================================================================================================//
+//  Code generation                                                                                                    //
+//=====================================================================================================================//
+
+static void emit_exit(FILE* out, fn_layout* layout, u32 offset, i32 depth) {
+    fprintf(out, "    AOT_EXIT(%u, %d);\n", offset, depth);
+    if (depth > layout->max_exit_depth)
+        layout->max_exit_depth = depth;
+}
+
+// `if (!call) exit` for a helper from xaot.h
+static void emit_guarded(FILE* out, fn_layout* layout, u32 offset, i32 depth, const char* call) {
+    fprintf(out, "    if (!%s)\n    ", call);
+    emit_exit(out, layout, offset, depth);
+}
+
+static const char* generic_opcode(u8 op) {
+    switch (op) {
+        case OP_ADD:
+        case OP_ADD_NUM:
+        case OP_ADD_INT:
+            return "OP_ADD";
+        case OP_SUBTRACT:
+        case OP_SUBTRACT_NUM:
+        case OP_SUBTRACT_INT:
+            return "OP_SUBTRACT";
+        case OP_MULTIPLY:
+        case OP_MULTIPLY_NUM:
+        case OP_MULTIPLY_INT:
+            return "OP_MULTIPLY";
+        case OP_DIVIDE:
+        case OP_DIVIDE_NUM:
+            return "OP_DIVIDE";
+        case OP_MOD:
+            return "OP_MOD";
+        case OP_LESS:
+        case OP_LESS_NUM:
+        case OP_LESS_INT:
+            return "OP_LESS";
+        case OP_GREATER:
+        case OP_GREATER_NUM:
+        case OP_GREATER_INT:
+            return "OP_GREATER";
+        case OP_BIT_AND:
+            return "OP_BIT_AND";
+        case OP_BIT_OR:
+            return "OP_BIT_OR";
+        case OP_BIT_XOR:
+            return "OP_BIT_XOR";
+        case OP_SHIFT_LEFT:
+            return "OP_SHIFT_LEFT";
+        default:
+            return "OP_SHIFT_RIGHT";
+    }
+}
+
+static void emit_instruction(FILE* out, fn_layout* layout, u32 offset) {
+    const u8* ip    = layout->chunk->code + offset;
+    const i32 d     = layout->depth[offset];  // v<d - 1> is the top of the stack
+    const u64 next  = offset + xen_chunk_instruction_size(layout->chunk, offset);
+    char call[160];
+
+    switch (ip[0]) {
+        case OP_CONSTANT:
+            fprintf(out, "    v%d = k[%d];\n", d, ip[1]);
+            break;
+        case OP_NULL:
+            fprintf(out, "    v%d = NULL_VAL;\n", d);
+            break;
+        case OP_TRUE:
+            fprintf(out, "    v%d = BOOL_VAL(XEN_TRUE);\n", d);
+            break;
+        case OP_FALSE:
+            fprintf(out, "    v%d = BOOL_VAL(XEN_FALSE);\n", d);
+            break;
+        case OP_POP:
+            break;
+        case OP_PRINT:
+            fprintf(out, "    xen_value_print(v%d);\n    printf(\"\\n\");\n", d - 1);
+            break;
+        case OP_GET_LOCAL:
+            fprintf(out, "    v%d = v%d;\n", d, ip[1]);
+            break;
+        case OP_SET_LOCAL:
+            fprintf(out, "    v%d = v%d;\n", ip[1], d - 1);
+            break;
+        case OP_GET_UPVALUE:
+            fprintf(out, "    v%d = *xen_aot_upvalue(frame, %d);\n", d, ip[1]);
+            break;
+        case OP_SET_UPVALUE:
+            fprintf(out, "    *xen_aot_upvalue(frame, %d) = v%d;\n", ip[1], d - 1);
+            break;
+        case OP_DEFINE_GLOBAL:
+            fprintf(out, "    xen_table_set(&g_vm->globals, OBJ_AS_STRING(k[%d]), v%d);\n", ip[1], d - 1);
+            break;
+        case OP_GET_GLOBAL:
+            snprintf(call, sizeof(call), "xen_aot_get_global(OBJ_AS_STRING(k[%d]), &v%d)", ip[1], d);
+            emit_guarded(out, layout, offset, d, call);
+            break;
+        case OP_SET_GLOBAL:
+            snprintf(call, sizeof(call), "xen_aot_set_global(OBJ_AS_STRING(k[%d]), v%d)", ip[1], d - 1);
+            emit_guarded(out, layout, offset, d, call);
+            break;
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_MOD:
+        case OP_LESS:
+        case OP_GREATER:
+        case OP_ADD_NUM:
+        case OP_SUBTRACT_NUM:
+        case OP_MULTIPLY_NUM:
+        case OP_DIVIDE_NUM:
+        case OP_LESS_NUM:
+        case OP_GREATER_NUM:
+        case OP_ADD_INT:
+        case OP_SUBTRACT_INT:
+        case OP_MULTIPLY_INT:
+        case OP_LESS_INT:
+        case OP_GREATER_INT:
+            snprintf(call, sizeof(call), "xen_aot_arith(%s, &v%d, v%d)", generic_opcode(ip[0]), d - 2, d - 1);
+            emit_guarded(out, layout, offset, d, call);
+            break;
+        case OP_BIT_AND:
+        case OP_BIT_OR:
+        case OP_BIT_XOR:
+        case OP_SHIFT_LEFT:
+        case OP_SHIFT_RIGHT:
+            snprintf(call, sizeof(call), "xen_aot_bitwise(%s, &v%d, v%d)", generic_opcode(ip[0]), d - 2, d - 1);
+            emit_guarded(out, layout, offset, d, call);
+            break;
+        case OP_BIT_NOT:
+            snprintf(call, sizeof(call), "VAL_IS_INT(v%d)", d - 1);
+            emit_guarded(out, layout, offset, d, call);
+            fprintf(out, "    v%d.as.integer = ~v%d.as.integer;\n", d - 1, d - 1);
+            break;
+        case OP_EQUAL:
+            fprintf(out, "    v%d = BOOL_VAL(xen_value_equal(v%d, v%d));\n", d - 2, d - 2, d - 1);
+            break;
+        case OP_NOT:
+            fprintf(out, "    v%d = BOOL_VAL(xen_aot_is_falsy(v%d));\n", d - 1, d - 1);
+            break;
+        case OP_NEGATE:
+            snprintf(call, sizeof(call), "xen_aot_negate(&v%d)", d - 1);
+            emit_guarded(out, layout, offset, d, call);
+            break;
+        case OP_JUMP:
+            fprintf(out, "    goto L%u;\n", (u32)(next + jump_operand(ip)));
+            break;
+        case OP_LOOP:
+            fprintf(out, "    goto L%u;\n", (u32)(next - jump_operand(ip)));
+            break;
+        case OP_JUMP_IF_FALSE:
+            fprintf(out, "    if (xen_aot_is_falsy(v%d))\n        goto L%u;\n", d - 1, (u32)(next + jump_operand(ip)));
+            break;
+        case OP_ARRAY_LEN:
+            snprintf(call, sizeof(call), "xen_aot_array_len(&v%d)", d - 1);
+            emit_guarded(out, layout, offset, d, call);
+            break;
+        case OP_INDEX_GET:
+            snprintf(call, sizeof(call), "xen_aot_index_get(v%d, v%d, &v%d)", d - 2, d - 1, d - 2);
+            emit_guarded(out, layout, offset, d, call);
+            break;
+        case OP_INDEX_SET:
+            snprintf(call, sizeof(call), "xen_aot_index_set(v%d, v%d, v%d)", d - 3, d - 2, d - 1);
+            emit_guarded(out, layout, offset, d, call);
+            fprintf(out, "    v%d = v%d;\n", d - 3, d - 1);
+            break;
+        case OP_ARRAY_NEW: {
+            const i32 count = ip[1];
+            if (count == 0) {
+                fprintf(out, "    v%d = xen_aot_array_new(NULL, 0);\n", d);
+                break;
+            }
+            fprintf(out, "    v%d = xen_aot_array_new((xen_value[]) {", d - count);
+            for (i32 i = d - count; i < d; i++)
+                fprintf(out, "v%d%s", i, i + 1 < d ? ", " : "");
+            fprintf(out, "}, %d);\n", count);
+            break;
+        }
+        case OP_DICT_NEW:
+            fprintf(out, "    v%d = OBJ_VAL(xen_obj_dict_new());\n", d);
+            break;
+        case OP_DICT_ADD:
+            snprintf(call, sizeof(call), "OBJ_IS_DICT(v%d)", d - 3);
+            emit_guarded(out, layout, offset, d, call);
+            fprintf(out, "    xen_obj_dict_set(OBJ_AS_DICT(v%d), v%d, v%d);\n", d - 3, d - 2, d - 1);
+            break;
+        case OP_GET_PROPERTY:
+            snprintf(call, sizeof(call), "xen_aot_get_field(v%d, OBJ_AS_STRING(k[%d]), &v%d)", d - 1, ip[1], d - 1);
+            emit_guarded(out, layout, offset, d, call);
+            break;
+        case OP_SET_PROPERTY:
+            snprintf(call, sizeof(call), "xen_aot_set_field(v%d, OBJ_AS_STRING(k[%d]), v%d)", d - 2, ip[1], d - 1);
+            emit_guarded(out, layout, offset, d, call);
+            fprintf(out, "    v%d = v%d;\n", d - 2, d - 1);
+            break;
+        default:
+            // calls, returns, closures, classes, type checks: the interpreter's job
+            emit_exit(out, layout, offset, d);
+            break;
+    }
+}
+
+static void emit_function(FILE* out, const xen_obj_func* fn, u32 index, fn_layout* layout) {
+    const xen_chunk* chunk = layout->chunk;
+
+    fprintf(out, "// %s\n", fn->name != NULL ? fn->name->str : "script");
+    fprintf(out, "static void aot_%u(xen_call_frame* frame, xen_value** stack_top) {\n", index);
+    fprintf(out, "    xen_value* const slots   = frame->slots;\n");
+    fprintf(out, "    const xen_value* const k = frame->fn->chunk.constants.values;\n");
+    fprintf(out, "    u32 resume, depth;\n");
+    for (i32 i = 0; i < layout->max_depth; i++) {
+        if (i % LOCALS_PER_LINE == 0)
+            fprintf(out, "%sxen_value v%d", i == 0 ? "    " : ";\n    ", i);
+        else
+            fprintf(out, ", v%d", i);
+    }
+    fprintf(out, ";\n\n");
+
+    fprintf(out, "    switch ((u32)(frame->ip - frame->fn->chunk.code)) {\n");
+    for (u32 offset = 0; offset < chunk->count; offset++) {
+        if (!layout->entry[offset] || layout->depth[offset] == NO_DEPTH)
+            continue;
+        fprintf(out, "        case %u:\n", offset);
+        for (i32 i = 0; i < layout->depth[offset]; i++)
+            fprintf(out, "            v%d = slots[%d];\n", i, i);
+        fprintf(out, "            goto L%u;\n", offset);
+    }
+    fprintf(out, "        default:\n            return;\n    }\n\n");
+
+    u64 line = 0;
+    for (u32 offset = 0; offset < chunk->count; offset += xen_chunk_instruction_size(chunk, offset)) {
+        if (layout->depth[offset] == NO_DEPTH)
+            continue;  // unreachable, e.g. the implicit return after an explicit one
+        if (layout->label[offset])
+            fprintf(out, "L%u:\n", offset);
+        const u64 offset_line = xen_chunk_line(chunk, offset);
+        if (offset_line != line) {
+            fprintf(out, "    // line %llu\n", (unsigned long long)offset_line);
+            line = offset_line;
+        }
+        emit_instruction(out, layout, offset);
+    }
+
+    // Every exit stores the locals back to the VM stack, the deepest ones first
+    fprintf(out, "\n");
+    for (i32 i = layout->max_exit_depth; i > 0; i--)
+        fprintf(out, "exit_%d:\n    slots[%d] = v%d;\n", i, i - 1, i - 1);
+    fprintf(out, "exit_0:\n");
+    fprintf(out, "    frame->ip  = frame->fn->chunk.code + resume;\n");
+    fprintf(out, "    *stack_top = slots + depth;\n");
+    fprintf(out, "}\n\n");
+}
+
+static bool translate(FILE* out, const xen_obj_func* fn, u32 index) {
+    const u64 count   = fn->chunk.count;
+    fn_layout layout  = {0};
+    layout.chunk      = &fn->chunk;
+    layout.depth      = malloc(count * sizeof(i32));
+    layout.label      = calloc(count, sizeof(bool));
+    layout.entry      = calloc(count, sizeof(bool));
+    layout.pending    = malloc(count * sizeof(u32));
+    for (u64 i = 0; i < count; i++)
+        layout.depth[i] = NO_DEPTH;
+
+    const bool ok = analyze(fn, &layout);
+    if (ok)
+        emit_function(out, fn, index, &layout);
+    else
+        fprintf(stderr, "note: %s is left to the interpreter\n", fn->name != NULL ? fn->name->str : "the script");
+
+    free(layout.depth);
+    free(layout.label);
+    free(layout.entry);
+    free(layout.pending);
+    return ok;
+}
+
+i32 xenc_transpile(u8* bytecode, size_t size, FILE* out) {
+    if (xen_decode_bytecode(bytecode, size) == NULL)
+        return -1;
+
+    fprintf(out, "// Generated by xenc --aot, see xaot.h\n\n");
+    fprintf(out, "#include \"xaot.h\"\n\n");
+    fprintf(out, "// Hands the instruction at `offset` to the interpreter with `stack_depth` values on the frame's stack\n");
+    fprintf(out, "#define AOT_EXIT(offset, stack_depth) \\\n");
+    fprintf(out, "    do { resume = (offset); depth = (stack_depth); goto exit_##stack_depth; } while (XEN_FALSE)\n\n");
+
+    array(bool) translated = NULL;
+    u32 count              = 0;
+    i32 translated_count   = 0;
+    for (xen_obj_func* fn; (fn = xen_bytecode_function(bytecode, count)) != NULL; count++) {
+        translated        = realloc(translated, (count + 1) * sizeof(bool));
+        translated[count] = translate(out, fn, count);
+        translated_count += translated[count];
+    }
+
+    fprintf(out, "const u32 k_aot_function_count = %u;\n\n", count);
+    fprintf(out, "const xen_aot_fn k_aot_functions[] = {\n");
+    for (u32 i = 0; i < count; i++) {
+        if (translated[i])
+            fprintf(out, "    aot_%u,\n", i);
+        else
+            fprintf(out, "    NULL,\n");
+    }
+    fprintf(out, "};\n");
+
+    free(translated);
+    return translated_count;
+}
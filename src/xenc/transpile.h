@@ -0,0 +1,13 @@
+#ifndef TRANSPILE_H
+#define TRANSPILE_H
+
+#include "../xen/xcommon.h"
+
+/// @brief Writes the C translation of every function of a .xenb image (see xen/xaot.h) to `out`, followed by the table
+/// `k_aot_functions` that xen_vm_exec_aot takes: one entry per function of the image, NULL for functions whose stack
+/// layout couldn't be worked out statically and are left to the interpreter. Its length is `k_aot_function_count`.
+/// The image is decoded in the calling thread's VM and has to stay alive until this returns.
+/// @return the number of functions translated, or -1 if the image couldn't be decoded.
+i32 xenc_transpile(u8* bytecode, size_t size, FILE* out);
+
+#endif
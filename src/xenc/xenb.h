@@ -2,7 +2,14 @@
 #define XENB_H
 
 #include "../xen/xcommon.h"
+#include "../xen/xbin_writer.h"
 
-void xenb_compile(const char* filename, u8* bytecode_out, size_t* size_out);
+/// @brief Compiles a script to a .xenb image (see xen/xbytecode.h). Returns a malloc'd buffer, or NULL if the script
+/// failed to compile or couldn't be encoded.
+u8* xenb_compile(const char* filename, size_t* size_out);
 
-#endif
\ No newline at end of file
+/// @brief Compiles a script to a .xenb image written to `w`, which can stream it straight to a file
+/// (xen_bin_writer_init_stream) instead of holding the whole image in memory.
+bool xenb_compile_to(const char* filename, xen_bin_writer* w);
+
+#endif